@@ -5,17 +5,20 @@ CONFIG -= qt
 
 QMAKE_CXXFLAGS += -std=c++11
 
-INCLUDEPATH += AntTweakBar/include/
+INCLUDEPATH += AntTweakBar/include/ \
+    ../shared/
 
 LIBS += -lAntTweakBar -lglut -lGL -lX11 -lGLEW
 
 SOURCES += main.cpp \
-    shader.cpp
+    shader.cpp \
+    ../shared/glcounters.cpp
 
 HEADERS += \
     common.h \
     shader.h \
-    AntTweakBar/include/AntTweakBar.h
+    AntTweakBar/include/AntTweakBar.h \
+    ../shared/glcounters.h
 
 OTHER_FILES += \
     shaders/3.glslfs \
@@ -47,6 +47,7 @@ public:
    void draw_frame(float time_from_start);
    void change_mode();
    void init(string const& vs_file, string const& fs_file);
+   void init_locations();
 
 private:
    bool   wireframe_;
@@ -56,6 +57,10 @@ private:
 
    GLuint vs_, fs_, program_;
    GLuint vx_buf_;
+
+   // Uniform and attribute locations, queried once after linking
+   GLint mvp_location_, cell_size_location_;
+   GLint pos_location_;
    quat   rotation_by_control_;
 };
 
@@ -125,10 +130,19 @@ void sample_t::init(string const& vs_file, string const& fs_file)
     fs_ = create_shader(GL_FRAGMENT_SHADER, fs_file.c_str());
 
     program_ = create_program(vs_, fs_);
+    init_locations();
 
     init_buffer();
 }
 
+void sample_t::init_locations()
+{
+    mvp_location_       = glGetUniformLocation(program_, "mvp");
+    cell_size_location_ = glGetUniformLocation(program_, "cell_size");
+
+    pos_location_ = glGetAttribLocation(program_, "in_pos");
+}
+
 void sample_t::init_buffer()
 {
    // Создание пустого буфера
@@ -183,21 +197,17 @@ void sample_t::draw_frame( float time_from_start )
 
     glUseProgram(program_);
 
-    GLuint const mvp_location = glGetUniformLocation(program_, "mvp");
-    glUniformMatrix4fv(mvp_location, 1, GL_FALSE, &mvp[0][0]);
-
-    GLuint const cell_size_location = glGetUniformLocation(program_, "cell_size");
-    glUniform1i(cell_size_location, cell_size_);
+    glUniformMatrix4fv(mvp_location_, 1, GL_FALSE, &mvp[0][0]);
+    glUniform1i(cell_size_location_, cell_size_);
 
     glBindBuffer(GL_ARRAY_BUFFER, vx_buf_);
 
-    GLuint const pos_location = glGetAttribLocation(program_, "in_pos");
-    glVertexAttribPointer(pos_location, 2, GL_FLOAT, GL_FALSE, sizeof(vec2), 0);
-    glEnableVertexAttribArray(pos_location);
+    glVertexAttribPointer(pos_location_, 2, GL_FLOAT, GL_FALSE, sizeof(vec2), 0);
+    glEnableVertexAttribArray(pos_location_);
 
     glDrawArrays(GL_TRIANGLES, 0, 3);
 
-    glDisableVertexAttribArray(pos_location);
+    glDisableVertexAttribArray(pos_location_);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
@@ -216,10 +226,17 @@ void display_func()
    g_sample->draw_frame(chrono::duration<float>(chrono::system_clock::now() - start).count());
 
    // отрисовка GUI
-   TwDraw();
+   {
+      static const int subsystem = gGLCounters.subsystem("anttweakbar");
+      GLCounterScope counter_scope(subsystem);
+      TwDraw();
+   }
 
    // смена front и back buffer'а (напоминаю, что у нас используется режим двойной буферизации)
    glutSwapBuffers();
+
+   // конец кадра для счётчиков вызовов GL
+   gGLCounters.endFrame();
 }
 
 // Переисовка кадра в отсутствии других сообщений
@@ -302,6 +319,11 @@ int main( int argc, char ** argv )
       return 1;
    }
 
+#ifdef GL_COUNTERS
+   gGLCounters.install();
+   gGLCounters.openLog("glcounters.csv");
+#endif
+
    // Проверка созданности контекста той версии, какой мы запрашивали
    if (!GLEW_VERSION_3_0)
    {
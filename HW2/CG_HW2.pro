@@ -5,19 +5,47 @@ CONFIG -= qt
 
 QMAKE_CXXFLAGS += -std=c++11
 
-INCLUDEPATH += AntTweakBar/include/
+INCLUDEPATH += AntTweakBar/include/ \
+    ../shared/
 
-LIBS += -lAntTweakBar -lglut -lGL -lX11 -lGLEW
+LIBS += -lAntTweakBar -lglut -lGL -lX11 -lGLEW -lpthread
 
 SOURCES += main.cpp \
     shader.cpp \
-    model.cpp
+    ../shared/model.cpp \
+    ../shared/indexedmesh.cpp \
+    meshlets.cpp \
+    ../shared/objparser.cpp \
+    ../shared/mappedfile.cpp \
+    ../shared/meshcache.cpp \
+    ../shared/simplifier.cpp \
+    vertexquantization.cpp \
+    ../shared/meshbounds.cpp \
+    bvh.cpp \
+    modelstream.cpp \
+    instances.cpp \
+    workerpool.cpp \
+    ../shared/glcounters.cpp
 
 HEADERS += \
     common.h \
     shader.h \
     AntTweakBar/include/AntTweakBar.h \
-    model.h
+    ../shared/model.h \
+    ../shared/indexedmesh.h \
+    meshlets.h \
+    ../shared/objparser.h \
+    ../shared/profilezones.h \
+    ../shared/mappedfile.h \
+    ../shared/meshcache.h \
+    ../shared/simplifier.h \
+    vertexquantization.h \
+    ../shared/meshbounds.h \
+    bvh.h \
+    modelstream.h \
+    instances.h \
+    workerpool.h \
+    ../shared/glcounters.h
 
 OTHER_FILES += \
     model.obj \
@@ -0,0 +1,379 @@
+#include "bvh.h"
+#include <algorithm>
+#include <limits>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BVH_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    const int BINS_COUNT = 16;
+
+    // Leaves take at most this many triangles, fewer when splitting is cheaper
+    const size_t MAX_LEAF_TRIANGLES = 8;
+
+    // A box test against a triangle test in the surface area heuristic
+    const float TRAVERSAL_COST = 1.0f;
+
+    // Smaller ranges aren't worth a thread
+    const size_t MIN_PARALLEL_TRIANGLES = 1 << 14;
+
+    // Deeper ranges become leaves whatever their size, so traversal fits a fixed stack
+    const int MAX_DEPTH = 48;
+    const int STACK_SIZE = MAX_DEPTH + 2;
+
+    struct Box
+    {
+        vec3 minimum;
+        vec3 maximum;
+
+        Box()
+            : minimum(std::numeric_limits<float>::max()), maximum(-std::numeric_limits<float>::max())
+        {}
+
+        void grow(const vec3& point)
+        {
+            minimum = glm::min(minimum, point);
+            maximum = glm::max(maximum, point);
+        }
+
+        void grow(const Box& box)
+        {
+            minimum = glm::min(minimum, box.minimum);
+            maximum = glm::max(maximum, box.maximum);
+        }
+
+        // Half the surface area, the heuristic only compares them
+        float area() const
+        {
+            vec3 size = glm::max(maximum - minimum, vec3(0));
+            return size.x * size.y + size.y * size.z + size.z * size.x;
+        }
+    };
+
+    struct BuildInput
+    {
+        vector<Box> boxes;
+        vector<vec3> centroids;
+        // Triangle numbers, each subtree sorts its own range
+        vector<uint32_t> order;
+    };
+
+    int binIndex(float centroid, float minimum, float scale)
+    {
+        return std::min(BINS_COUNT - 1, int((centroid - minimum) * scale));
+    }
+
+    // Best split of [begin, end) over the bins of each axis; false if a leaf is cheaper
+    bool findSplit(const BuildInput& input, size_t begin, size_t end, const Box& bounds, const Box& centroidBounds,
+                   int& splitAxis, int& splitBin)
+    {
+        size_t count = end - begin;
+        float bestCost = float(count);
+        bool isFound = false;
+
+        for (int axis = 0; axis < 3; ++axis) {
+            float minimum = centroidBounds.minimum[axis];
+            float extent = centroidBounds.maximum[axis] - minimum;
+            if (extent <= 0) {
+                continue;
+            }
+            float scale = BINS_COUNT / extent;
+
+            Box bins[BINS_COUNT];
+            size_t counts[BINS_COUNT] = { 0 };
+            for (size_t i = begin; i < end; ++i) {
+                uint32_t t = input.order[i];
+                int bin = binIndex(input.centroids[t][axis], minimum, scale);
+                bins[bin].grow(input.boxes[t]);
+                counts[bin]++;
+            }
+
+            // Right side areas swept from the end, then the left ones from the start
+            float rightAreas[BINS_COUNT];
+            size_t rightCounts[BINS_COUNT];
+            Box right;
+            size_t rightCount = 0;
+            for (int bin = BINS_COUNT - 1; bin > 0; --bin) {
+                right.grow(bins[bin]);
+                rightCount += counts[bin];
+                rightAreas[bin] = right.area();
+                rightCounts[bin] = rightCount;
+            }
+            Box left;
+            size_t leftCount = 0;
+            for (int bin = 0; bin + 1 < BINS_COUNT; ++bin) {
+                left.grow(bins[bin]);
+                leftCount += counts[bin];
+                if (leftCount == 0 || rightCounts[bin + 1] == 0) {
+                    continue;
+                }
+                float cost = TRAVERSAL_COST + (left.area() * leftCount + rightAreas[bin + 1] * rightCounts[bin + 1]) / bounds.area();
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    splitAxis = axis;
+                    splitBin = bin;
+                    isFound = true;
+                }
+            }
+        }
+        return isFound;
+    }
+
+    // Appends the subtree of [begin, end) to nodes; links are indices into nodes
+    void buildSubtree(BuildInput& input, size_t begin, size_t end, vector<BvhNode>& nodes, int depth, int threadsCount)
+    {
+        Box bounds, centroidBounds;
+        for (size_t i = begin; i < end; ++i) {
+            bounds.grow(input.boxes[input.order[i]]);
+            centroidBounds.grow(input.centroids[input.order[i]]);
+        }
+
+        size_t index = nodes.size();
+        BvhNode node;
+        node.minimum = bounds.minimum;
+        node.maximum = bounds.maximum;
+        node.offset = uint32_t(begin);
+        node.count = uint32_t(end - begin);
+        nodes.push_back(node);
+
+        size_t count = end - begin;
+        if (count <= 2 || depth == MAX_DEPTH) {
+            return;
+        }
+
+        int axis, bin;
+        if (!findSplit(input, begin, end, bounds, centroidBounds, axis, bin)) {
+            if (count <= MAX_LEAF_TRIANGLES) {
+                return;
+            }
+            // Too many for a leaf: the middle of the longest axis, the end bins are never empty
+            vec3 extents = centroidBounds.maximum - centroidBounds.minimum;
+            axis = extents.x >= extents.y && extents.x >= extents.z ? 0 : extents.y >= extents.z ? 1 : 2;
+            bin = BINS_COUNT / 2 - 1;
+        }
+
+        size_t middle;
+        float extent = centroidBounds.maximum[axis] - centroidBounds.minimum[axis];
+        if (extent > 0) {
+            float minimum = centroidBounds.minimum[axis];
+            float scale = BINS_COUNT / extent;
+            middle = std::partition(input.order.begin() + begin, input.order.begin() + end, [&](uint32_t t) {
+                return binIndex(input.centroids[t][axis], minimum, scale) <= bin;
+            }) - input.order.begin();
+        }
+        else {
+            // Every centroid in one point: any halves will do
+            middle = begin + count / 2;
+        }
+
+        nodes[index].count = 0;
+        if (threadsCount > 1 && count >= MIN_PARALLEL_TRIANGLES) {
+            // Both halves into their own arrays, then appended with their links moved
+            vector<BvhNode> leftNodes, rightNodes;
+            int leftThreads = threadsCount / 2;
+            std::thread leftBuilder([&]() {
+                buildSubtree(input, begin, middle, leftNodes, depth + 1, leftThreads);
+            });
+            buildSubtree(input, middle, end, rightNodes, depth + 1, threadsCount - leftThreads);
+            leftBuilder.join();
+
+            const vector<BvhNode>* halves[2] = { &leftNodes, &rightNodes };
+            for (int half = 0; half < 2; ++half) {
+                uint32_t base = uint32_t(nodes.size());
+                if (half == 1) {
+                    nodes[index].offset = base;
+                }
+                for (size_t i = 0; i < halves[half]->size(); ++i) {
+                    BvhNode child = (*halves[half])[i];
+                    if (child.count == 0) {
+                        child.offset += base;
+                    }
+                    nodes.push_back(child);
+                }
+            }
+        }
+        else {
+            buildSubtree(input, begin, middle, nodes, depth + 1, 1);
+            nodes[index].offset = uint32_t(nodes.size());
+            buildSubtree(input, middle, end, nodes, depth + 1, 1);
+        }
+    }
+
+    bool intersectTriangle(const vec3& origin, const vec3& direction, const vec3* corners, float& distance)
+    {
+        // Moller-Trumbore, both sides
+        vec3 edge1 = corners[1] - corners[0];
+        vec3 edge2 = corners[2] - corners[0];
+        vec3 p = glm::cross(direction, edge2);
+        float determinant = glm::dot(edge1, p);
+        if (determinant == 0) {
+            return false;
+        }
+        float inverse = 1 / determinant;
+        vec3 s = origin - corners[0];
+        float u = glm::dot(s, p) * inverse;
+        if (u < 0 || u > 1) {
+            return false;
+        }
+        vec3 q = glm::cross(s, edge1);
+        float v = glm::dot(direction, q) * inverse;
+        if (v < 0 || u + v > 1) {
+            return false;
+        }
+        distance = glm::dot(edge2, q) * inverse;
+        return distance >= 0;
+    }
+
+    struct Ray
+    {
+#ifdef BVH_SSE2
+        __m128 origin;
+        __m128 inverseDirection;
+#else
+        vec3 origin;
+        vec3 inverseDirection;
+#endif
+    };
+
+    // Distance the ray enters the node's box at, if before maxDistance
+    inline bool intersectBox(const BvhNode& node, const Ray& ray, float maxDistance, float& entry)
+    {
+#ifdef BVH_SSE2
+        // The fourth lanes hold offset and count, only x, y and z are reduced
+        __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&node.minimum.x), ray.origin), ray.inverseDirection);
+        __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&node.maximum.x), ray.origin), ray.inverseDirection);
+        __m128 near = _mm_min_ps(t0, t1);
+        __m128 far = _mm_max_ps(t0, t1);
+        near = _mm_max_ss(_mm_max_ss(near, _mm_shuffle_ps(near, near, _MM_SHUFFLE(1, 1, 1, 1))),
+                          _mm_max_ss(_mm_shuffle_ps(near, near, _MM_SHUFFLE(2, 2, 2, 2)), _mm_setzero_ps()));
+        far = _mm_min_ss(_mm_min_ss(far, _mm_shuffle_ps(far, far, _MM_SHUFFLE(1, 1, 1, 1))),
+                         _mm_min_ss(_mm_shuffle_ps(far, far, _MM_SHUFFLE(2, 2, 2, 2)), _mm_set_ss(maxDistance)));
+        entry = _mm_cvtss_f32(near);
+        return _mm_comile_ss(near, far) != 0;
+#else
+        vec3 t0 = (node.minimum - ray.origin) * ray.inverseDirection;
+        vec3 t1 = (node.maximum - ray.origin) * ray.inverseDirection;
+        vec3 near = glm::min(t0, t1);
+        vec3 far = glm::max(t0, t1);
+        entry = std::max(std::max(near.x, near.y), std::max(near.z, 0.0f));
+        return entry <= std::min(std::min(far.x, far.y), std::min(far.z, maxDistance));
+#endif
+    }
+}
+
+void Bvh::build(const vec3* positions, const uint32_t* indices, size_t indicesCount, int threadsCount)
+{
+    _nodes.clear();
+    _triangles.clear();
+    _corners.clear();
+    size_t trianglesCount = indicesCount / 3;
+    if (trianglesCount == 0) {
+        return;
+    }
+
+    BuildInput input;
+    input.boxes.resize(trianglesCount);
+    input.centroids.resize(trianglesCount);
+    input.order.resize(trianglesCount);
+    for (size_t t = 0; t < trianglesCount; ++t) {
+        Box& box = input.boxes[t];
+        for (size_t k = 0; k < 3; ++k) {
+            box.grow(positions[indices[3 * t + k]]);
+        }
+        input.centroids[t] = (box.minimum + box.maximum) * 0.5f;
+        input.order[t] = uint32_t(t);
+    }
+
+    if (threadsCount <= 0) {
+        threadsCount = int(std::max(1u, std::thread::hardware_concurrency()));
+    }
+    buildSubtree(input, 0, trianglesCount, _nodes, 0, threadsCount);
+
+    // Leaves read their corners in order instead of chasing the indices
+    _triangles.swap(input.order);
+    _corners.resize(3 * trianglesCount);
+    for (size_t i = 0; i < trianglesCount; ++i) {
+        for (size_t k = 0; k < 3; ++k) {
+            _corners[3 * i + k] = positions[indices[3 * _triangles[i] + k]];
+        }
+    }
+}
+
+bool Bvh::intersect(const vec3& origin, const vec3& direction, float maxDistance, RayHit& hit) const
+{
+    if (_nodes.empty()) {
+        return false;
+    }
+
+    // Zero direction components give infinities, which the slabs handle
+    vec3 inverseDirection = vec3(1) / direction;
+    Ray ray;
+#ifdef BVH_SSE2
+    ray.origin = _mm_setr_ps(origin.x, origin.y, origin.z, 0);
+    ray.inverseDirection = _mm_setr_ps(inverseDirection.x, inverseDirection.y, inverseDirection.z, 0);
+#else
+    ray.origin = origin;
+    ray.inverseDirection = inverseDirection;
+#endif
+
+    bool isHit = false;
+    float closest = maxDistance;
+
+    // Nodes with the distance their box is entered at, the nearer child on top
+    uint32_t stack[STACK_SIZE];
+    float entries[STACK_SIZE];
+    int stackSize = 0;
+    float entry;
+    if (intersectBox(_nodes[0], ray, closest, entry)) {
+        stack[0] = 0;
+        entries[0] = entry;
+        stackSize = 1;
+    }
+
+    while (stackSize > 0) {
+        --stackSize;
+        if (entries[stackSize] > closest) {
+            continue;
+        }
+        const BvhNode& node = _nodes[stack[stackSize]];
+
+        if (node.count > 0) {
+            for (uint32_t i = node.offset; i < node.offset + node.count; ++i) {
+                float distance;
+                if (intersectTriangle(origin, direction, &_corners[3 * i], distance) && distance < closest) {
+                    closest = distance;
+                    hit.triangle = _triangles[i];
+                    hit.distance = distance;
+                    isHit = true;
+                }
+            }
+            continue;
+        }
+
+        uint32_t children[2] = { stack[stackSize] + 1, node.offset };
+        float childEntries[2];
+        bool isEntered[2];
+        for (int i = 0; i < 2; ++i) {
+            isEntered[i] = intersectBox(_nodes[children[i]], ray, closest, childEntries[i]);
+        }
+        int nearer = childEntries[1] < childEntries[0] ? 1 : 0;
+        for (int pass = 0; pass < 2; ++pass) {
+            int i = pass == 0 ? 1 - nearer : nearer;
+            if (isEntered[i]) {
+                stack[stackSize] = children[i];
+                entries[stackSize] = childEntries[i];
+                ++stackSize;
+            }
+        }
+    }
+    return isHit;
+}
+
+size_t Bvh::nodesCount() const
+{
+    return _nodes.size();
+}
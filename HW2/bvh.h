@@ -0,0 +1,46 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include "common.h"
+
+// 32 bytes, two to a cache line. Nodes are stored depth first, so the first
+// child of an inner node is the next node and only the second one is linked.
+struct BvhNode
+{
+    vec3 minimum;
+    // Leaf: first of its triangles in leaf order. Inner node: the second child.
+    uint32_t offset;
+    vec3 maximum;
+    // Triangles in a leaf, 0 for an inner node
+    uint32_t count;
+};
+
+struct RayHit
+{
+    // Triangle number, its corners are indices[3 * triangle] and the next two
+    uint32_t triangle;
+    // Along the ray's direction, in its units
+    float distance;
+};
+
+// Bounding volume hierarchy over indexed triangles for ray queries
+class Bvh
+{
+public:
+    // Binned surface area heuristic. Subtrees of large ranges are built on
+    // threadsCount threads, 0 for one per core.
+    void build(const vec3* positions, const uint32_t* indices, size_t indicesCount, int threadsCount = 0);
+
+    // Closest triangle hit before maxDistance, from either side
+    bool intersect(const vec3& origin, const vec3& direction, float maxDistance, RayHit& hit) const;
+
+    size_t nodesCount() const;
+
+private:
+    vector<BvhNode> _nodes;
+    // Triangle numbers in leaf order, and their corners copied next to each other
+    vector<uint32_t> _triangles;
+    vector<vec3> _corners;
+};
+
+#endif //BVH_H
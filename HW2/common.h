@@ -27,6 +27,9 @@ using std::string;
 // AntTweakBar - GUI
 #include "AntTweakBar.h"
 
+//   GL (GL_COUNTERS)
+#include "glcounters.h"
+
 // GLM -   ,    
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
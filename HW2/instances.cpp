@@ -0,0 +1,164 @@
+#include "instances.h"
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+
+namespace
+{
+    // Waking a worker costs more than updating fewer copies than this
+    const size_t MIN_INSTANCES_PER_THREAD = 4096;
+
+    // Copies stand this many model radii apart, so spinning ones never touch
+    const float SPACING = 2.5f;
+
+    const uint8_t NOT_VISIBLE = 0xff;
+
+    void extractFrustumPlanes(const mat4& mvp, vec4 planes[6])
+    {
+        vec4 rows[4];
+        for (int i = 0; i < 4; ++i) {
+            rows[i] = vec4(mvp[0][i], mvp[1][i], mvp[2][i], mvp[3][i]);
+        }
+        for (int i = 0; i < 3; ++i) {
+            planes[2 * i] = rows[3] + rows[i];
+            planes[2 * i + 1] = rows[3] - rows[i];
+        }
+        for (int i = 0; i < 6; ++i) {
+            planes[i] /= glm::length(vec3(planes[i]));
+        }
+    }
+
+    // The same as the vertex shader does
+    vec3 rotate(const vec4& rotation, const vec3& v)
+    {
+        vec3 axis(rotation);
+        return v + 2.0f * glm::cross(axis, glm::cross(axis, v) + rotation.w * v);
+    }
+}
+
+InstanceField::InstanceField(WorkerPool& workers)
+    : _modelCenter(0), _modelRadius(0), _radius(0), _workers(workers)
+{}
+
+void InstanceField::layout(size_t count, const vec3& modelCenter, float modelRadius)
+{
+    _modelCenter = modelCenter;
+    _modelRadius = modelRadius;
+    _positions.resize(count);
+    _spins.resize(count);
+    _transforms.resize(count);
+    _groups.resize(count);
+
+    size_t side = 1;
+    while (side * side * side < count) {
+        ++side;
+    }
+    float spacing = SPACING * modelRadius;
+    float half = (side - 1) * 0.5f;
+    // The same field every time for the same count
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> unit(-1, 1);
+    for (size_t i = 0; i < count; ++i) {
+        vec3 cell(float(i % side), float(i / side % side), float(i / (side * side)));
+        _positions[i] = vec4((cell - half) * spacing, 1);
+
+        vec3 axis(unit(random), unit(random), unit(random));
+        float length = glm::length(axis);
+        axis = length > 0 ? axis / length : vec3(0, 1, 0);
+        // From half a radian to two radians a second
+        float speed = count == 1 ? 0 : 1.25f + 0.75f * unit(random);
+        _spins[i] = vec4(axis, speed);
+    }
+    _radius = half * spacing * std::sqrt(3.0f) + glm::length(modelCenter) + modelRadius;
+}
+
+void InstanceField::update(float time, const mat4& viewProjection, const vec3& camera, const vector<float>& lodDistances)
+{
+    if (lodDistances.size() + 1 >= NOT_VISIBLE) {
+        throw std::invalid_argument("Too many levels of detail for an instance field");
+    }
+
+    vec4 planes[6];
+    extractFrustumPlanes(viewProjection, planes);
+
+    size_t count = _positions.size();
+    size_t groupsCount = lodDistances.size() + 1;
+    size_t slicesCount = std::min(_workers.threadsCount(), std::max<size_t>(1, count / MIN_INSTANCES_PER_THREAD));
+
+    // Copies of every group in every slice, then where the slice writes the first of them
+    vector<size_t> places(slicesCount * groupsCount, 0);
+
+    _workers.run(count, slicesCount, [&](size_t slice, size_t begin, size_t end) {
+        size_t* counts = &places[slice * groupsCount];
+        for (size_t i = begin; i < end; ++i) {
+            const vec4& spin = _spins[i];
+            float halfAngle = 0.5f * spin.w * time;
+            InstanceTransform& transform = _transforms[i];
+            transform.positionScale = _positions[i];
+            transform.rotation = vec4(vec3(spin) * std::sin(halfAngle), std::cos(halfAngle));
+
+            float scale = transform.positionScale.w;
+            vec3 center = vec3(transform.positionScale) + rotate(transform.rotation, _modelCenter) * scale;
+            float radius = _modelRadius * scale;
+            uint8_t group = 0;
+            for (int p = 0; p < 6; ++p) {
+                if (glm::dot(vec3(planes[p]), center) + planes[p].w < -radius) {
+                    group = NOT_VISIBLE;
+                    break;
+                }
+            }
+            if (group != NOT_VISIBLE) {
+                float distance = glm::length(center - camera) - radius;
+                while (group < lodDistances.size() && distance >= lodDistances[group]) {
+                    ++group;
+                }
+                ++counts[group];
+            }
+            _groups[i] = group;
+        }
+    });
+
+    // Group by group, and slice by slice inside a group, so the order doesn't depend on the threads
+    _groupOffsets.assign(groupsCount + 1, 0);
+    size_t offset = 0;
+    for (size_t group = 0; group < groupsCount; ++group) {
+        _groupOffsets[group] = offset;
+        for (size_t slice = 0; slice < slicesCount; ++slice) {
+            size_t& place = places[slice * groupsCount + group];
+            size_t sliceCount = place;
+            place = offset;
+            offset += sliceCount;
+        }
+    }
+    _groupOffsets[groupsCount] = offset;
+    _visible.resize(offset);
+
+    _workers.run(count, slicesCount, [&](size_t slice, size_t begin, size_t end) {
+        size_t* slicePlaces = &places[slice * groupsCount];
+        for (size_t i = begin; i < end; ++i) {
+            if (_groups[i] != NOT_VISIBLE) {
+                _visible[slicePlaces[_groups[i]]++] = _transforms[i];
+            }
+        }
+    });
+}
+
+size_t InstanceField::count() const
+{
+    return _positions.size();
+}
+
+float InstanceField::radius() const
+{
+    return _radius;
+}
+
+const vector<InstanceTransform>& InstanceField::visible() const
+{
+    return _visible;
+}
+
+const vector<size_t>& InstanceField::groupOffsets() const
+{
+    return _groupOffsets;
+}
@@ -0,0 +1,60 @@
+#ifndef INSTANCES_H
+#define INSTANCES_H
+
+#include "common.h"
+#include "workerpool.h"
+
+// Where one copy of a model goes: position and uniform scale, then rotation as a
+// quaternion (x, y, z, w). 32 bytes, half of a model matrix.
+struct InstanceTransform
+{
+    vec4 positionScale;
+    vec4 rotation;
+};
+
+// Copies of a model in a cube-shaped grid, each spinning about its own axis. Every
+// frame they are animated, culled against the frustum and grouped by level of
+// detail on several threads, ready to be uploaded as is and drawn a group at a time.
+class InstanceField
+{
+public:
+    // Copies are split over the threads of workers, which must outlive the field
+    explicit InstanceField(WorkerPool& workers);
+
+    // count copies of a model with the bounding sphere modelCenter, modelRadius.
+    // A single copy stays at the origin as it is.
+    void layout(size_t count, const vec3& modelCenter, float modelRadius);
+
+    // lodDistances[i] is how far from the camera level i + 1 is good enough, in
+    // increasing order. viewProjection and camera are in the field's space.
+    void update(float time, const mat4& viewProjection, const vec3& camera, const vector<float>& lodDistances);
+
+    size_t count() const;
+    // Of the sphere around the origin holding every copy
+    float radius() const;
+
+    // Copies that survived the cull, group by group with the full model first.
+    // Group i is [groupOffsets()[i], groupOffsets()[i + 1]).
+    const vector<InstanceTransform>& visible() const;
+    const vector<size_t>& groupOffsets() const;
+
+private:
+    vec3 _modelCenter;
+    float _modelRadius;
+    float _radius;
+    // Position and scale, rotation axis and angular speed
+    vector<vec4> _positions;
+    vector<vec4> _spins;
+    // This frame's transform and group of every copy
+    vector<InstanceTransform> _transforms;
+    vector<uint8_t> _groups;
+    vector<InstanceTransform> _visible;
+    vector<size_t> _groupOffsets;
+
+    WorkerPool& _workers;
+
+    InstanceField(const InstanceField&);
+    InstanceField& operator=(const InstanceField&);
+};
+
+#endif //INSTANCES_H
@@ -1,6 +1,12 @@
 ﻿#include "common.h"
 #include "shader.h"
 #include "model.h"
+#include "meshlets.h"
+#include "vertexquantization.h"
+#include "bvh.h"
+#include "modelstream.h"
+#include "instances.h"
+#include <iomanip>
 
 #ifndef APIENTRY
 #define APIENTRY
@@ -21,6 +27,14 @@ static const string MODEL_FILE         = "model.obj";
 static const string VERTEX_SHADER      = "shaders/0.glslvs";
 static const string FRAGMENT_SHADER    = "shaders/0.glslfs";
 
+// Число копий на каждом шаге прогона; кадры каждого шага, первые не считаются
+static const int    SWEEP_INSTANCES[]   = { 1, 3, 10, 30, 100, 300, 1000, 3000, 10000, 30000, 100000 };
+static const int    SWEEP_STEPS         = sizeof(SWEEP_INSTANCES) / sizeof(SWEEP_INSTANCES[0]);
+static const int    SWEEP_WARMUP_FRAMES = 10;
+static const int    SWEEP_FRAMES        = 30;
+// Потолок — больше всего копий, которые ещё рисуются за кадр при 60 fps
+static const double SWEEP_FRAME_BUDGET  = 1000.0 / 60;
+
 
 struct triangle
 {
@@ -48,25 +62,89 @@ public:
     void draw_frame(float time_from_start);
     void change_mode();
     void init(string const& vs_file, string const& fs_file);
+    void init_locations();
 
     void refresh(mat4 m);
+    void pick(int x, int y);
+    void start_sweep();
 
 private:
+    void prepare_model();
+    void update_stream();
+    void update_instances(float time_from_start, mat4 const& mvp, vec3 const& camera, float h);
+    void advance_sweep(float frame_time);
+    void draw_model();
+
     bool   skeleton_;
+    bool   cluster_culling_;
+    bool   quantized_vertices_;
     triangle triangle_;
     float  cell_size_;
     ColorMode mode_;
 
     GLuint vs_, fs_, program_;
-    GLuint vx_buf_;
+    GLuint vx_buf_, quantized_vx_buf_, ix_buf_;
+
+    // Расположения uniform-переменных и атрибутов, запрашиваются один раз после линковки
+    GLint mvp_location_, is_skeleton_location_, T_location_, k_location_, v_location_;
+    GLint center_location_, max_location_, func_mode_location_;
+    GLint pos_location_, color_location_, oct_normal_location_, is_quantized_location_;
+    GLint dequantization_scale_location_, dequantization_offset_location_, instance_position_location_, instance_rotation_location_;
+
     quat   rotation_by_control_;
 
-    vvec3 data_;
+    // Индексы полной сетки переставляют только кластеры, поэтому до загрузки на GPU у них своя копия
+    vector<uint32_t> indices_;
+    // 16-битные позиции внутри границ, октаэдрические нормали, текстурные координаты в half float
+    vector<QuantizedVertex> quantized_data_;
+    mat4 dequantization_;
     Model model_;
 
+    // Диапазоны индексов примерно на 64 вершины, каждый кадр отсекаются целиком
+    vector<Meshlet> meshlets_;
+    MeshletDraws meshlet_draws_;
+    unsigned int drawn_meshlets_, drawn_triangles_;
+
+    // Уровни детализации лежат в индексном буфере сразу за полной сеткой
+    vector<size_t> lod_offsets_;
+    float camera_distance_;
+    float lod_pixel_error_;
+    int lod_;
+
+    // Треугольник под курсором по последнему клику
+    Bvh bvh_;
+    mat4 last_mvp_;
+    int picked_triangle_;
+    float picked_distance_;
+    float pick_time_;
+
+    // Потоки, между которыми каждый кадр делятся отсечение мешлетов и обновление копий
+    WorkerPool workers_;
+
+    // Копии модели рисуются одним вызовом на уровень детализации
+    InstanceField instances_;
+    bool is_instancing_supported_;
+    int instances_count_;
+    unsigned int visible_instances_;
+    GLuint instance_buf_;
+    float instance_update_time_, instance_upload_time_;
+
+    // Прогон по SWEEP_INSTANCES, sweep_step_ равен -1, пока он не идёт
+    int sweep_step_, sweep_frame_;
+    double sweep_update_time_, sweep_upload_time_, sweep_frame_time_;
+    int sweep_ceiling_, instances_before_sweep_;
+
     float v_, k_;
     vec3 center_;
     float max_;
+
+    // Пока модель грузится, рисуем уже прочитанные треугольники из растущего буфера.
+    // Поток загрузки пишет в поля выше, поэтому он объявлен последним и завершается первым
+    bool is_model_ready_;
+    GLuint stream_buf_;
+    size_t stream_capacity_;
+    vvec3 stream_data_;
+    ModelStream stream_;
 };
 
 void switch_colors_callback(void * sample)
@@ -74,22 +152,56 @@ void switch_colors_callback(void * sample)
     static_cast<sample_t*>(sample)->change_mode();
 }
 
+void instance_sweep_callback(void * sample)
+{
+    static_cast<sample_t*>(sample)->start_sweep();
+}
+
 
 sample_t::sample_t()
-    : skeleton_(false), triangle_(vec2(0, 25), vec2(20, -15), vec2(-20, -15)), cell_size_(3.0f), mode_(NORMALS),
-      v_(1), k_(1), center_(vec3(0, 0, 0)), max_(0)
+    : skeleton_(false), cluster_culling_(true), quantized_vertices_(true), triangle_(vec2(0, 25), vec2(20, -15), vec2(-20, -15)), cell_size_(3.0f), mode_(NORMALS),
+      vx_buf_(0), quantized_vx_buf_(0), ix_buf_(0), drawn_meshlets_(0), drawn_triangles_(0), camera_distance_(30), lod_pixel_error_(1), lod_(0), picked_triangle_(-1), picked_distance_(0), pick_time_(0),
+      instances_(workers_), is_instancing_supported_(false), instances_count_(1), visible_instances_(1), instance_buf_(0), instance_update_time_(0), instance_upload_time_(0),
+      sweep_step_(-1), sweep_frame_(0), sweep_update_time_(0), sweep_upload_time_(0), sweep_frame_time_(0), sweep_ceiling_(0), instances_before_sweep_(1), v_(1), k_(1), center_(vec3(0, 0, 0)), max_(0),
+      is_model_ready_(false), stream_buf_(0), stream_capacity_(0)
 {
     TwInit(TW_OPENGL, NULL);
 
     // Определение "контролов" GUI
     TwBar *bar = TwNewBar("Parameters");
-    TwDefine(" Parameters size='500 150' color='70 100 120' valueswidth=220 iconpos=topleft");
+    TwDefine(" Parameters size='500 340' color='70 100 120' valueswidth=220 iconpos=topleft");
 
     TwAddVarRW(bar, "v", TW_TYPE_FLOAT, &v_, " min=-100 max=100 step=1 label='V' keyincr=p keydecr=o");
     TwAddVarRW(bar, "k", TW_TYPE_FLOAT, &k_, " min=-100 max=100 step=1 label='K' keyincr=l keydecr=k");
 
     TwAddVarRW(bar, "Skeleton", TW_TYPE_BOOLCPP, &skeleton_, " true='ON' false='OFF' key=w");
 
+    TwAddVarRW(bar, "ClusterCulling", TW_TYPE_BOOLCPP, &cluster_culling_,
+               " label='Cluster culling' true='ON' false='OFF' key=c help='Skip meshlets outside the view or facing away.' ");
+    TwAddVarRO(bar, "DrawnMeshlets", TW_TYPE_UINT32, &drawn_meshlets_, " label='Drawn meshlets' ");
+    TwAddVarRO(bar, "DrawnTriangles", TW_TYPE_UINT32, &drawn_triangles_, " label='Drawn triangles' ");
+
+    TwAddVarRW(bar, "QuantizedVertices", TW_TYPE_BOOLCPP, &quantized_vertices_,
+               " label='Quantized vertices' true='ON' false='OFF' key=q help='16 bytes per vertex instead of 24.' ");
+
+    TwAddVarRW(bar, "CameraDistance", TW_TYPE_FLOAT, &camera_distance_, " label='Camera distance' min=5 max=90 step=1");
+    TwAddVarRW(bar, "LodPixelError", TW_TYPE_FLOAT, &lod_pixel_error_,
+               " label='LOD error, px' min=0 max=20 step=0.25 help='Coarsest level whose error stays under this many pixels.' ");
+    TwAddVarRO(bar, "Lod", TW_TYPE_INT32, &lod_, " label='Level of detail' ");
+
+    TwAddVarRO(bar, "PickedTriangle", TW_TYPE_INT32, &picked_triangle_,
+               " label='Picked triangle' help='Triangle under the last click, -1 for none.' ");
+    TwAddVarRO(bar, "PickedDistance", TW_TYPE_FLOAT, &picked_distance_, " label='Picked distance' ");
+    TwAddVarRO(bar, "PickTime", TW_TYPE_FLOAT, &pick_time_, " label='Pick time, us' ");
+
+    TwAddVarRW(bar, "Instances", TW_TYPE_INT32, &instances_count_,
+               " label='Instances' min=1 max=500000 step=100 help='Copies of the model, drawn with instancing.' ");
+    TwAddVarRO(bar, "VisibleInstances", TW_TYPE_UINT32, &visible_instances_, " label='Visible instances' ");
+    TwAddVarRO(bar, "InstanceUpdateTime", TW_TYPE_FLOAT, &instance_update_time_, " label='Instance update, ms' ");
+    TwAddVarRO(bar, "InstanceUploadTime", TW_TYPE_FLOAT, &instance_upload_time_, " label='Instance upload, ms' ");
+    TwAddButton(bar, "InstanceSweep", instance_sweep_callback, this,
+                " label='Instance sweep' key=b help='Draws 1 to 100000 copies and prints the frame times.' ");
+
     TwAddButton(bar, "SwitchColorMode", switch_colors_callback, this,
                 " label = 'Switch color mode' key=g");
 
@@ -99,31 +211,173 @@ sample_t::sample_t()
     TwAddVarRW(bar, "ObjRotation", TW_TYPE_QUAT4F, &rotation_by_control_,
                " label='Object orientation' opened=true help='Change the object orientation.' ");
 
-    model_.load(MODEL_FILE);
+    // Загрузка и подготовка модели идут в фоне, первый кадр их не ждёт
+    stream_.start(MODEL_FILE, model_, [this]() { prepare_model(); });
+
+    init(VERTEX_SHADER, FRAGMENT_SHADER);
+}
+
+// Выполняется в потоке загрузки, когда model_ уже загружена
+void sample_t::prepare_model()
+{
+    // Вершины читаем там, где их хранит модель: после первого запуска это отображённый в память кэш
+    indices_.assign(model_.indices(), model_.indices() + model_.indices_count());
+    dequantization_ = quantizeVertices(model_.positions(), model_.tex_coords(), model_.normals(), model_.vertices_count(),
+                                       quantized_data_);
+
+    buildMeshlets(model_.positions(), model_.vertices_count(), indices_, meshlets_);
+    bvh_.build(model_.positions(), indices_.data(), indices_.size());
+}
+
+void sample_t::update_stream()
+{
+    // Новые треугольники дописываем в конец буфера; когда места нет, он растёт вдвое
+    size_t const old_size = stream_data_.size();
+    ModelStream::Batch batch;
+    while (stream_.popBatch(batch)) {
+        stream_data_.insert(stream_data_.end(), batch.begin(), batch.end());
+    }
+    if (stream_data_.size() > old_size) {
+        glBindBuffer(GL_ARRAY_BUFFER, stream_buf_);
+        if (stream_data_.size() > stream_capacity_) {
+            stream_capacity_ = std::max(2 * stream_capacity_, stream_data_.size());
+            glBufferData(GL_ARRAY_BUFFER, sizeof(vec3) * stream_capacity_, NULL, GL_DYNAMIC_DRAW);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vec3) * stream_data_.size(), &stream_data_[0]);
+        }
+        else {
+            glBufferSubData(GL_ARRAY_BUFFER, sizeof(vec3) * old_size, sizeof(vec3) * (stream_data_.size() - old_size),
+                            &stream_data_[old_size]);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
 
-    for (size_t i = 0; i < model_.vertices_count(); ++i) {
-        data_.push_back(model_.vertices_[i]);
-        data_.push_back(model_.normals_[i]);
+    if (!stream_.isDone()) {
+        return;
+    }
+    if (!stream_.error().empty()) {
+        cerr << stream_.error() << endl;
+        exit(1);
     }
 
-    init(VERTEX_SHADER, FRAGMENT_SHADER);
+    // Модель готова, временный буфер больше не нужен
+    init_buffer();
+    is_model_ready_ = true;
+    while (stream_.popBatch(batch)) {
+    }
+    glDeleteBuffers(1, &stream_buf_);
+    stream_buf_ = 0;
+    vvec3().swap(stream_data_);
 }
 
 void sample_t::refresh(mat4 m)
 {
-    for (size_t i = 0; i < model_.vertices_count(); ++i) {
-        center_ += model_.vertices_[i];
+    // Центр и радиус посчитаны при загрузке модели, каждый кадр их только переносим
+    transformSphere(m, model_.bounds_.centroid, model_.bounds_.centroidRadius, center_, max_);
+}
+
+void sample_t::pick(int x, int y)
+{
+    // Дерево строится вместе с моделью и есть только у неё одной, не у копий
+    if (!is_model_ready_ || instances_count_ > 1) {
+        return;
     }
 
-    center_ = center_ / float(model_.vertices_count());
+    float const w = (float)glutGet(GLUT_WINDOW_WIDTH);
+    float const h = (float)glutGet(GLUT_WINDOW_HEIGHT);
+
+    // Луч через пиксель от ближней до дальней плоскости, в координатах модели
+    mat4 const inverse_mvp = inverse(last_mvp_);
+    vec2 const ndc(2 * (x + 0.5f) / w - 1, 1 - 2 * (y + 0.5f) / h);
+    vec4 near_point = inverse_mvp * vec4(ndc, -1, 1);
+    vec4 far_point  = inverse_mvp * vec4(ndc,  1, 1);
+    vec3 const origin = vec3(near_point) / near_point.w;
+    vec3 const ray    = vec3(far_point) / far_point.w - origin;
+
+    chrono::high_resolution_clock::time_point const start = chrono::high_resolution_clock::now();
+    RayHit hit;
+    bool const is_hit = bvh_.intersect(origin, normalize(ray), length(ray), hit);
+    pick_time_ = chrono::duration<float, std::micro>(chrono::high_resolution_clock::now() - start).count();
+
+    picked_triangle_ = is_hit ? int(hit.triangle) : -1;
+    picked_distance_ = is_hit ? hit.distance : 0;
+}
 
-    for (size_t i = 0; i < model_.vertices_count(); ++i) {
-        if (glm::length(center_ - model_.vertices_[i]) > max_) {
-            max_ = glm::length(center_ - model_.vertices_[i]);
+void sample_t::update_instances(float time_from_start, mat4 const& mvp, vec3 const& camera, float h)
+{
+    // Дальше этих расстояний ошибка уровня на экране меньше lod_pixel_error_ пикселей
+    vector<float> lod_distances;
+    if (lod_pixel_error_ > 0) {
+        for (size_t i = 0; i < model_.lods_count(); ++i) {
+            lod_distances.push_back(model_.lod_error(i) * h / (2 * tan(radians(45.0f / 2)) * lod_pixel_error_));
         }
     }
 
-    center_ = vec3(m * vec4(center_, 1));
+    chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+    instances_.update(time_from_start, mvp, camera, lod_distances);
+    instance_update_time_ = chrono::duration<float, std::milli>(chrono::high_resolution_clock::now() - start).count();
+
+    // Прошлый кадр может ещё читать старый буфер, поэтому берём новый вместо перезаписи
+    start = chrono::high_resolution_clock::now();
+    vector<InstanceTransform> const& visible = instances_.visible();
+    glBindBuffer(GL_ARRAY_BUFFER, instance_buf_);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(InstanceTransform) * visible.size(), NULL, GL_STREAM_DRAW);
+    if (!visible.empty()) {
+        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(InstanceTransform) * visible.size(), &visible[0]);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    instance_upload_time_ = chrono::duration<float, std::milli>(chrono::high_resolution_clock::now() - start).count();
+
+    vector<size_t> const& offsets = instances_.groupOffsets();
+    visible_instances_ = unsigned(visible.size());
+    drawn_meshlets_ = 0;
+    drawn_triangles_ = 0;
+    for (size_t group = 0; group + 1 < offsets.size(); ++group) {
+        size_t const indices_count = group == 0 ? model_.indices_count() : model_.lod_indices_count(group - 1);
+        drawn_triangles_ += unsigned((offsets[group + 1] - offsets[group]) * (indices_count / 3));
+    }
+}
+
+void sample_t::start_sweep()
+{
+    if (!is_model_ready_ || !is_instancing_supported_ || sweep_step_ >= 0) {
+        return;
+    }
+    instances_before_sweep_ = instances_count_;
+    sweep_step_ = 0;
+    sweep_frame_ = 0;
+    sweep_update_time_ = sweep_upload_time_ = sweep_frame_time_ = 0;
+    sweep_ceiling_ = 0;
+
+    std::cout << " instances   visible     triangles   update, ms  upload, ms   frame, ms" << endl;
+}
+
+void sample_t::advance_sweep(float frame_time)
+{
+    if (sweep_frame_ >= SWEEP_WARMUP_FRAMES) {
+        sweep_update_time_ += instance_update_time_;
+        sweep_upload_time_ += instance_upload_time_;
+        sweep_frame_time_ += frame_time;
+    }
+    if (++sweep_frame_ < SWEEP_WARMUP_FRAMES + SWEEP_FRAMES) {
+        return;
+    }
+
+    double const frame_time_mean = sweep_frame_time_ / SWEEP_FRAMES;
+    std::cout << std::setw(10) << instances_count_ << std::setw(10) << visible_instances_ << std::setw(14) << drawn_triangles_
+              << std::fixed << std::setprecision(3)
+              << std::setw(13) << sweep_update_time_ / SWEEP_FRAMES << std::setw(12) << sweep_upload_time_ / SWEEP_FRAMES
+              << std::setw(12) << frame_time_mean << endl;
+    if (frame_time_mean <= SWEEP_FRAME_BUDGET) {
+        sweep_ceiling_ = instances_count_;
+    }
+
+    sweep_frame_ = 0;
+    sweep_update_time_ = sweep_upload_time_ = sweep_frame_time_ = 0;
+    if (++sweep_step_ == SWEEP_STEPS) {
+        std::cout << "instances within " << SWEEP_FRAME_BUDGET << " ms a frame: " << sweep_ceiling_ << endl;
+        sweep_step_ = -1;
+        instances_count_ = instances_before_sweep_;
+    }
 }
 
 void sample_t::change_mode()
@@ -143,6 +397,10 @@ sample_t::~sample_t()
     glDeleteShader(vs_);
     glDeleteShader(fs_);
     glDeleteBuffers(1, &vx_buf_);
+    glDeleteBuffers(1, &quantized_vx_buf_);
+    glDeleteBuffers(1, &ix_buf_);
+    glDeleteBuffers(1, &stream_buf_);
+    glDeleteBuffers(1, &instance_buf_);
 
     TwDeleteAllBars();
     TwTerminate();
@@ -154,8 +412,38 @@ void sample_t::init(string const& vs_file, string const& fs_file)
     fs_ = create_shader(GL_FRAGMENT_SHADER, fs_file.c_str());
 
     program_ = create_program(vs_, fs_);
+    init_locations();
 
-    init_buffer();
+    glGenBuffers(1, &stream_buf_);
+
+    // glVertexAttribDivisor появился в 3.3, без него рисуем одну модель
+    is_instancing_supported_ = GLEW_VERSION_3_3 != 0;
+    if (!is_instancing_supported_) {
+        cerr << "OpenGL 3.3 not supported, instancing is off" << endl;
+    }
+    glGenBuffers(1, &instance_buf_);
+}
+
+void sample_t::init_locations()
+{
+    mvp_location_         = glGetUniformLocation(program_, "mvp");
+    is_skeleton_location_ = glGetUniformLocation(program_, "is_skeleton");
+    T_location_           = glGetUniformLocation(program_, "T");
+    k_location_           = glGetUniformLocation(program_, "k");
+    v_location_           = glGetUniformLocation(program_, "v");
+    center_location_      = glGetUniformLocation(program_, "center");
+    max_location_         = glGetUniformLocation(program_, "max");
+    func_mode_location_   = glGetUniformLocation(program_, "func_mode");
+    is_quantized_location_ = glGetUniformLocation(program_, "is_quantized");
+
+    pos_location_   = glGetAttribLocation(program_, "in_pos");
+    color_location_ = glGetAttribLocation(program_, "in_color");
+    oct_normal_location_ = glGetAttribLocation(program_, "in_oct_normal");
+
+    dequantization_scale_location_  = glGetUniformLocation(program_, "dequantization_scale");
+    dequantization_offset_location_ = glGetUniformLocation(program_, "dequantization_offset");
+    instance_position_location_  = glGetAttribLocation(program_, "in_instance_position");
+    instance_rotation_location_  = glGetAttribLocation(program_, "in_instance_rotation");
 }
 
 void sample_t::init_buffer()
@@ -165,26 +453,111 @@ void sample_t::init_buffer()
     // Делаем буфер активным
     glBindBuffer(GL_ARRAY_BUFFER, vx_buf_);
 
-    // Копируем данные для текущего буфера на GPU
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vec3) * data_.size(), &data_[0], GL_STATIC_DRAW);
+    // Копируем данные для текущего буфера на GPU прямо из модели: все позиции, за ними все нормали
+    size_t const vertices_size = sizeof(vec3) * model_.vertices_count();
+    glBufferData(GL_ARRAY_BUFFER, 2 * vertices_size, NULL, GL_STATIC_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, vertices_size, model_.positions());
+    if (model_.normals() != NULL) {
+        glBufferSubData(GL_ARRAY_BUFFER, vertices_size, vertices_size, model_.normals());
+    }
+
+    // Те же вершины в сжатом виде
+    glGenBuffers(1, &quantized_vx_buf_);
+    glBindBuffer(GL_ARRAY_BUFFER, quantized_vx_buf_);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(QuantizedVertex) * quantized_data_.size(), &quantized_data_[0], GL_STATIC_DRAW);
 
     // Сбрасываем текущий активный буфер
     glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glGenBuffers(1, &ix_buf_);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ix_buf_);
+    // Полная сетка в порядке кластеров, за ней уровни детализации из модели
+    size_t indices_count = indices_.size();
+    for (size_t i = 0; i < model_.lods_count(); ++i) {
+        lod_offsets_.push_back(indices_count);
+        indices_count += model_.lod_indices_count(i);
+    }
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint32_t) * indices_count, NULL, GL_STATIC_DRAW);
+    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, sizeof(uint32_t) * indices_.size(), indices_.data());
+    for (size_t i = 0; i < model_.lods_count(); ++i) {
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint32_t) * lod_offsets_[i], sizeof(uint32_t) * model_.lod_indices_count(i),
+                        model_.lod_indices(i));
+    }
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    vector<uint32_t>().swap(indices_);
 }
 
 void sample_t::draw_frame( float time_from_start )
 {
+    if (!is_model_ready_) {
+        update_stream();
+    }
+
+    chrono::high_resolution_clock::time_point const frame_start = chrono::high_resolution_clock::now();
+
+    if (sweep_step_ >= 0) {
+        instances_count_ = SWEEP_INSTANCES[sweep_step_];
+    }
+    if (!is_model_ready_ || !is_instancing_supported_) {
+        instances_count_ = 1;
+    }
+    bool const is_instanced = instances_count_ > 1;
+    if (is_instanced && instances_.count() != size_t(instances_count_)) {
+        instances_.layout(size_t(instances_count_), model_.bounds_.sphereCenter, model_.bounds_.sphereRadius);
+    }
+
     float const w = (float)glutGet(GLUT_WINDOW_WIDTH);
     float const h = (float)glutGet(GLUT_WINDOW_HEIGHT);
 
-    mat4 const proj             = perspective(45.0f, w / h, 0.1f, 100.0f);
-    mat4 const view             = lookAt(vec3(0, 0, 30), vec3(0, 0, 0), vec3(0, 1, 0));
+    // Поле копий целиком в кадре, camera_distance_ отсчитывается от описанной вокруг него сферы
+    float const field_radius    = is_instanced ? instances_.radius() : 0;
+    float const eye_distance    = camera_distance_ + field_radius / sin(radians(45.0f / 2));
+
+    mat4 const proj             = perspective(45.0f, w / h, 0.1f, std::max(100.0f, eye_distance + field_radius));
+    mat4 const view             = lookAt(vec3(0, 0, eye_distance), vec3(0, 0, 0), vec3(0, 1, 0));
     mat4 const full_rotate      = mat4_cast(rotation_by_control_);
 
     mat4 const modelview        = view * full_rotate;
     mat4 const mvp              = proj * modelview;
+    last_mvp_ = mvp;
+
+    // Камера в координатах модели, для отсечения кластеров и выбора детализации
+    vec3 const camera = vec3(inverse(modelview) * vec4(0, 0, 0, 1));
+
+    lod_ = 0;
+    if (is_model_ready_) {
+        refresh(modelview); //or refresh(mat4(1.0f));
+
+        // Самый грубый уровень, ошибка которого на экране не больше lod_pixel_error_ пикселей
+        float const distance         = std::max(glm::length(camera - model_.bounds_.sphereCenter) - model_.bounds_.sphereRadius, 0.1f);
+        float const pixels_per_unit  = h / (2 * tan(radians(45.0f / 2)) * distance);
+        while (lod_ < int(model_.lods_count()) && model_.lod_error(lod_) * pixels_per_unit <= lod_pixel_error_) {
+            ++lod_;
+        }
+    }
 
-    refresh(modelview); //or refresh(mat4(1.0f));
+    visible_instances_ = 1;
+    instance_update_time_ = instance_upload_time_ = 0;
+    if (!is_model_ready_) {
+        drawn_meshlets_ = 0;
+        drawn_triangles_ = unsigned(stream_data_.size() / 6);
+    }
+    else if (is_instanced) {
+        update_instances(time_from_start, mvp, camera, h);
+    }
+    else if (lod_ > 0) {
+        drawn_meshlets_ = 0;
+        drawn_triangles_ = unsigned(model_.lod_indices_count(lod_ - 1) / 3);
+    }
+    else if (cluster_culling_) {
+        cullMeshlets(meshlets_, mvp, camera, true, meshlet_draws_, &workers_);
+        drawn_meshlets_ = unsigned(meshlet_draws_.visibleMeshlets);
+        drawn_triangles_ = unsigned(meshlet_draws_.visibleTriangles);
+    }
+    else {
+        drawn_meshlets_ = unsigned(meshlets_.size());
+        drawn_triangles_ = unsigned(model_.indices_count() / 3);
+    }
 
     glEnable(GL_DEPTH_TEST);
     glDepthFunc(GL_LEQUAL);
@@ -196,46 +569,73 @@ void sample_t::draw_frame( float time_from_start )
 
     glUseProgram(program_);
 
-    GLuint const mvp_location = glGetUniformLocation(program_, "mvp");
-    glUniformMatrix4fv(mvp_location, 1, GL_FALSE, &mvp[0][0]);
+    // Сжатые позиции лежат в [0, 1] внутри границ модели. Одну модель растягивает mvp, а копии
+    // поворачиваются вокруг начала координат модели, поэтому их растягивает шейдер до поворота
+    bool const is_quantized = quantized_vertices_ && is_model_ready_;
+    bool const is_dequantized_per_vertex = is_quantized && is_instanced;
+    mat4 const draw_mvp = is_quantized && !is_instanced ? mvp * dequantization_ : mvp;
+    glUniformMatrix4fv(mvp_location_, 1, GL_FALSE, &draw_mvp[0][0]);
+
+    vec3 const dequantization_scale  = is_dequantized_per_vertex ? vec3(dequantization_[0][0], dequantization_[1][1], dequantization_[2][2]) : vec3(1);
+    vec3 const dequantization_offset = is_dequantized_per_vertex ? vec3(dequantization_[3]) : vec3(0);
+    glUniform3f(dequantization_scale_location_, dequantization_scale.x, dequantization_scale.y, dequantization_scale.z);
+    glUniform3f(dequantization_offset_location_, dequantization_offset.x, dequantization_offset.y, dequantization_offset.z);
+    glUniform1i(is_quantized_location_, is_quantized);
+    glUniform1i(is_skeleton_location_, false);
+    glUniform1f(T_location_, time_from_start);
+    glUniform1f(k_location_, k_);
+    glUniform1f(v_location_, v_);
+    glUniform3f(center_location_, center_[0], center_[1], center_[2]);
+    glUniform1f(max_location_, max_);
 
-    GLuint const is_skeleton_location = glGetUniformLocation(program_, "is_skeleton");
-    glUniform1i(is_skeleton_location, false);
-
-    GLuint const T_location = glGetUniformLocation(program_, "T");
-    glUniform1f(T_location, time_from_start);
-
-    GLuint const k_location = glGetUniformLocation(program_, "k");
-    glUniform1f(k_location, k_);
+    if (mode_ == NORMALS) {
+        glUniform1i(func_mode_location_, false);
+    }
+    else {
+        glUniform1i(func_mode_location_, true);
+    }
 
-    GLuint const v_location = glGetUniformLocation(program_, "v");
-    glUniform1f(v_location, v_);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ix_buf_);
 
-    GLuint const center_location = glGetUniformLocation(program_, "center");
-    glUniform3f(center_location, center_[0], center_[1], center_[2]);
+    if (is_quantized) {
+        glBindBuffer(GL_ARRAY_BUFFER, quantized_vx_buf_);
 
-    GLuint const max_location = glGetUniformLocation(program_, "max");
-    glUniform1f(max_location, max_);
+        glEnableVertexAttribArray(pos_location_);
+        glVertexAttribPointer(pos_location_, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(QuantizedVertex),
+                              (GLvoid*)offsetof(QuantizedVertex, position));
 
-    GLuint const func_mode_location = glGetUniformLocation(program_, "func_mode");
-    if (mode_ == NORMALS) {
-        glUniform1i(func_mode_location, false);
+        glEnableVertexAttribArray(oct_normal_location_);
+        glVertexAttribPointer(oct_normal_location_, 2, GL_SHORT, GL_TRUE, sizeof(QuantizedVertex),
+                              (GLvoid*)offsetof(QuantizedVertex, normal));
     }
     else {
-        glUniform1i(func_mode_location, true);
-    }
+        // У готовой модели все нормали идут после всех позиций,
+        // прочитанные треугольники лежат парами позиция и нормаль и без индексов
+        GLsizei const stride        = is_model_ready_ ? 0 : 2 * sizeof(vec3);
+        size_t const normals_offset = is_model_ready_ ? sizeof(vec3) * model_.vertices_count() : sizeof(vec3);
+        glBindBuffer(GL_ARRAY_BUFFER, is_model_ready_ ? vx_buf_ : stream_buf_);
 
-    glBindBuffer(GL_ARRAY_BUFFER, vx_buf_);
+        glEnableVertexAttribArray(pos_location_);
+        glVertexAttribPointer(pos_location_, 3, GL_FLOAT, GL_FALSE, stride, 0);
 
-    GLuint const pos_location = glGetAttribLocation(program_, "in_pos");
-    glEnableVertexAttribArray(pos_location);
-    glVertexAttribPointer(pos_location, 3, GL_FLOAT, GL_FALSE, 2 * sizeof(vec3), 0);
+        glEnableVertexAttribArray(color_location_);
+        glVertexAttribPointer(color_location_, 3, GL_FLOAT, GL_FALSE, stride, (GLvoid*)normals_offset);
+    }
 
-    GLuint const color_location = glGetAttribLocation(program_, "in_color");
-    glEnableVertexAttribArray(color_location);
-    glVertexAttribPointer(color_location, 3, GL_FLOAT, GL_FALSE, 2 * sizeof(vec3), (GLvoid*)(sizeof(vec3)));
+    if (is_instanced) {
+        // Атрибуты копии меняются раз на копию, а не на вершину; указатели на них ставит draw_model
+        glEnableVertexAttribArray(instance_position_location_);
+        glEnableVertexAttribArray(instance_rotation_location_);
+        glVertexAttribDivisor(instance_position_location_, 1);
+        glVertexAttribDivisor(instance_rotation_location_, 1);
+    }
+    else {
+        // Одна модель как есть: без сдвига и поворота, масштаб 1
+        glVertexAttrib4f(instance_position_location_, 0, 0, 0, 1);
+        glVertexAttrib4f(instance_rotation_location_, 0, 0, 0, 1);
+    }
 
-    glDrawArrays(GL_TRIANGLES, 0, data_.size() / 2);
+    draw_model();
 
     if (skeleton_) {
         glPolygonOffset(-1, -1);
@@ -243,16 +643,73 @@ void sample_t::draw_frame( float time_from_start )
 
         glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
-        GLboolean const is_skeleton_location = glGetUniformLocation(program_, "is_skeleton");
-        glUniform1i(is_skeleton_location, true);
+        glUniform1i(is_skeleton_location_, true);
 
-        glDrawArrays(GL_TRIANGLES, 0, data_.size() / 2);
+        draw_model();
         glDisable(GL_POLYGON_OFFSET_FILL);
     }
 
-    glDisableVertexAttribArray(pos_location);
-    glDisableVertexAttribArray(color_location);
+    glDisableVertexAttribArray(pos_location_);
+    glDisableVertexAttribArray(is_quantized ? oct_normal_location_ : color_location_);
+    if (is_instanced) {
+        glVertexAttribDivisor(instance_position_location_, 0);
+        glVertexAttribDivisor(instance_rotation_location_, 0);
+        glDisableVertexAttribArray(instance_position_location_);
+        glDisableVertexAttribArray(instance_rotation_location_);
+    }
     glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    if (sweep_step_ >= 0) {
+        // Ждём GPU, чтобы во время кадра вошла и сама отрисовка
+        glFinish();
+        advance_sweep(chrono::duration<float, std::milli>(chrono::high_resolution_clock::now() - frame_start).count());
+    }
+}
+
+void sample_t::draw_model()
+{
+    if (!is_model_ready_) {
+        glDrawArrays(GL_TRIANGLES, 0, GLsizei(stream_data_.size() / 2));
+    }
+    else if (instances_count_ > 1) {
+        // Один вызов на группу копий со своим уровнем детализации, атрибуты копий
+        // начинаются с первой копии группы
+        vector<size_t> const& offsets = instances_.groupOffsets();
+        glBindBuffer(GL_ARRAY_BUFFER, instance_buf_);
+        for (size_t group = 0; group + 1 < offsets.size(); ++group) {
+            GLsizei const count = GLsizei(offsets[group + 1] - offsets[group]);
+            if (count == 0) {
+                continue;
+            }
+            size_t const first = sizeof(InstanceTransform) * offsets[group];
+            glVertexAttribPointer(instance_position_location_, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceTransform),
+                                  (GLvoid*)(first + offsetof(InstanceTransform, positionScale)));
+            glVertexAttribPointer(instance_rotation_location_, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceTransform),
+                                  (GLvoid*)(first + offsetof(InstanceTransform, rotation)));
+
+            if (group == 0) {
+                glDrawElementsInstanced(GL_TRIANGLES, GLsizei(model_.indices_count()), GL_UNSIGNED_INT, 0, count);
+            }
+            else {
+                glDrawElementsInstanced(GL_TRIANGLES, GLsizei(model_.lod_indices_count(group - 1)), GL_UNSIGNED_INT,
+                                        (GLvoid*)(sizeof(uint32_t) * lod_offsets_[group - 1]), count);
+            }
+        }
+    }
+    else if (lod_ > 0) {
+        // Грубые уровни мелкие на экране, их рисуем целиком
+        glDrawElements(GL_TRIANGLES, GLsizei(model_.lod_indices_count(lod_ - 1)), GL_UNSIGNED_INT,
+                       (GLvoid*)(sizeof(uint32_t) * lod_offsets_[lod_ - 1]));
+    }
+    else if (!cluster_culling_) {
+        glDrawElements(GL_TRIANGLES, GLsizei(model_.indices_count()), GL_UNSIGNED_INT, 0);
+    }
+    else if (!meshlet_draws_.counts.empty()) {
+        // Один вызов на все уцелевшие диапазоны индексов
+        glMultiDrawElements(GL_TRIANGLES, &meshlet_draws_.counts[0], GL_UNSIGNED_INT,
+                            &meshlet_draws_.offsets[0], GLsizei(meshlet_draws_.counts.size()));
+    }
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////
@@ -270,10 +727,17 @@ void display_func()
     g_sample->draw_frame(chrono::duration<float>(chrono::system_clock::now() - start).count());
 
     // отрисовка GUI
-    TwDraw();
+    {
+        static const int subsystem = gGLCounters.subsystem("anttweakbar");
+        GLCounterScope counter_scope(subsystem);
+        TwDraw();
+    }
 
     // смена front и back buffer'а (напоминаю, что у нас используется режим двойной буферизации)
     glutSwapBuffers();
+
+    // конец кадра для счётчиков вызовов GL
+    gGLCounters.endFrame();
 }
 
 // Переисовка кадра в отсутствии других сообщений
@@ -282,6 +746,15 @@ void idle_func()
     glutPostRedisplay();
 }
 
+void mouse_func( int button, int state, int x, int y )
+{
+    if (TwEventMouseButtonGLUT(button, state, x, y))
+        return;
+
+    if (button == GLUT_LEFT_BUTTON && state == GLUT_DOWN)
+        g_sample->pick(x, y);
+}
+
 void keyboard_func( unsigned char button, int x, int y )
 {
     if (TwEventKeyboardGLUT(button, x, y))
@@ -358,6 +831,11 @@ int main( int argc, char ** argv )
         return 1;
     }
 
+#ifdef GL_COUNTERS
+    gGLCounters.install();
+    gGLCounters.openLog("glcounters.csv");
+#endif
+
     // Проверка созданности контекста той версии, какой мы запрашивали
     if (!GLEW_VERSION_3_0)
     {
@@ -373,7 +851,7 @@ int main( int argc, char ** argv )
     glutKeyboardFunc(keyboard_func);
 
     // подписываемся на события для AntTweakBar'а
-    glutMouseFunc        ((GLUTmousebuttonfun)TwEventMouseButtonGLUT);
+    glutMouseFunc        (mouse_func);
     glutMotionFunc       ((GLUTmousemotionfun)TwEventMouseMotionGLUT);
     glutPassiveMotionFunc((GLUTmousemotionfun)TwEventMouseMotionGLUT);
     glutSpecialFunc      ((GLUTspecialfun    )TwEventSpecialGLUT    );
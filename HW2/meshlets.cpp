@@ -0,0 +1,288 @@
+#include "meshlets.h"
+#include <algorithm>
+
+namespace
+{
+    // Waking a worker costs more than culling fewer meshlets than this
+    const size_t MIN_MESHLETS_PER_THREAD = 4096;
+
+    // Below this the normals spread over more than a hemisphere, less the margin
+    const float MIN_CONE_DOT = 0.1f;
+
+    void computeBounds(const vec3* positions, const uint32_t* indices, size_t indicesCount, Meshlet& meshlet)
+    {
+        vec3 minimum = positions[indices[0]];
+        vec3 maximum = minimum;
+        for (size_t i = 1; i < indicesCount; ++i) {
+            minimum = glm::min(minimum, positions[indices[i]]);
+            maximum = glm::max(maximum, positions[indices[i]]);
+        }
+        meshlet.center = (minimum + maximum) * 0.5f;
+        meshlet.radius = 0;
+        for (size_t i = 0; i < indicesCount; ++i) {
+            meshlet.radius = std::max(meshlet.radius, glm::length(positions[indices[i]] - meshlet.center));
+        }
+
+        // Cone around the average normal, degenerate triangles don't face anywhere
+        vector<vec3> normals(indicesCount / 3, vec3(0));
+        vec3 axis(0);
+        for (size_t t = 0; t < normals.size(); ++t) {
+            const vec3& p0 = positions[indices[3 * t]];
+            vec3 normal = glm::cross(positions[indices[3 * t + 1]] - p0, positions[indices[3 * t + 2]] - p0);
+            float area = glm::length(normal);
+            if (area > 0) {
+                normals[t] = normal / area;
+                axis += normals[t];
+            }
+        }
+
+        meshlet.coneApex = meshlet.center;
+        meshlet.coneAxis = vec3(0, 0, 1);
+        meshlet.coneCutoff = 1;
+        float axisLength = glm::length(axis);
+        if (axisLength == 0) {
+            return;
+        }
+        axis /= axisLength;
+
+        float minDot = 1;
+        for (size_t t = 0; t < normals.size(); ++t) {
+            if (normals[t] != vec3(0)) {
+                minDot = std::min(minDot, glm::dot(axis, normals[t]));
+            }
+        }
+        if (minDot <= MIN_CONE_DOT) {
+            return;
+        }
+
+        // The apex goes back along the axis until it is behind every triangle's plane
+        float maxDistance = 0;
+        for (size_t t = 0; t < normals.size(); ++t) {
+            if (normals[t] != vec3(0)) {
+                float distance = glm::dot(meshlet.center - positions[indices[3 * t]], normals[t]) / glm::dot(axis, normals[t]);
+                maxDistance = std::max(maxDistance, distance);
+            }
+        }
+
+        meshlet.coneApex = meshlet.center - axis * maxDistance;
+        meshlet.coneAxis = axis;
+        meshlet.coneCutoff = std::sqrt(1 - minDot * minDot);
+    }
+
+    void extractFrustumPlanes(const mat4& mvp, vec4 planes[6])
+    {
+        vec4 rows[4];
+        for (int i = 0; i < 4; ++i) {
+            rows[i] = vec4(mvp[0][i], mvp[1][i], mvp[2][i], mvp[3][i]);
+        }
+        for (int i = 0; i < 3; ++i) {
+            planes[2 * i] = rows[3] + rows[i];
+            planes[2 * i + 1] = rows[3] - rows[i];
+        }
+        for (int i = 0; i < 6; ++i) {
+            planes[i] /= glm::length(vec3(planes[i]));
+        }
+    }
+
+    bool isMeshletVisible(const Meshlet& meshlet, const vec4 planes[6], const vec3& cameraPosition, bool cullBackfaces)
+    {
+        for (int i = 0; i < 6; ++i) {
+            if (glm::dot(vec3(planes[i]), meshlet.center) + planes[i].w < -meshlet.radius) {
+                return false;
+            }
+        }
+        return !cullBackfaces || meshlet.coneCutoff >= 1
+            || glm::dot(glm::normalize(meshlet.coneApex - cameraPosition), meshlet.coneAxis) < meshlet.coneCutoff;
+    }
+}
+
+void buildMeshlets(const vec3* positions, size_t verticesCount, vector<uint32_t>& indices, vector<Meshlet>& meshlets,
+                   size_t maxVertices, size_t maxTriangles)
+{
+    meshlets.clear();
+    size_t trianglesCount = indices.size() / 3;
+    if (trianglesCount == 0) {
+        return;
+    }
+
+    // Vertices split by their normals still touch, so neighbours are found by position
+    vector<uint32_t> positionIds(verticesCount);
+    {
+        vector<uint32_t> order(verticesCount);
+        for (size_t v = 0; v < order.size(); ++v) {
+            order[v] = uint32_t(v);
+        }
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+            const vec3& pa = positions[a];
+            const vec3& pb = positions[b];
+            return pa.x != pb.x ? pa.x < pb.x : pa.y != pb.y ? pa.y < pb.y : pa.z < pb.z;
+        });
+        uint32_t id = 0;
+        for (size_t i = 0; i < order.size(); ++i) {
+            if (i > 0 && positions[order[i]] != positions[order[i - 1]]) {
+                ++id;
+            }
+            positionIds[order[i]] = id;
+        }
+    }
+
+    // Triangles around every position, packed one position after another
+    size_t positionsCount = verticesCount == 0 ? 0 : *std::max_element(positionIds.begin(), positionIds.end()) + 1;
+    vector<uint32_t> offsets(positionsCount + 1, 0);
+    for (size_t i = 0; i < trianglesCount * 3; ++i) {
+        offsets[positionIds[indices[i]] + 1]++;
+    }
+    for (size_t p = 0; p < positionsCount; ++p) {
+        offsets[p + 1] += offsets[p];
+    }
+    vector<uint32_t> adjacency(trianglesCount * 3);
+    {
+        vector<uint32_t> filled(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < trianglesCount * 3; ++i) {
+            adjacency[filled[positionIds[indices[i]]]++] = uint32_t(i / 3);
+        }
+    }
+
+    vector<vec3> normals(trianglesCount, vec3(0));
+    for (size_t t = 0; t < trianglesCount; ++t) {
+        const vec3& p0 = positions[indices[3 * t]];
+        vec3 normal = glm::cross(positions[indices[3 * t + 1]] - p0, positions[indices[3 * t + 2]] - p0);
+        float area = glm::length(normal);
+        if (area > 0) {
+            normals[t] = normal / area;
+        }
+    }
+
+    vector<uint32_t> result;
+    result.reserve(trianglesCount * 3);
+    vector<bool> isUsed(trianglesCount, false);
+    // Meshlet that last took a vertex or listed a triangle, +1 so zero is none
+    vector<uint32_t> vertexOwners(verticesCount, 0);
+    vector<uint32_t> candidateOwners(trianglesCount, 0);
+    vector<uint32_t> candidates;
+
+    for (size_t seed = 0; seed < trianglesCount; ++seed) {
+        if (isUsed[seed]) {
+            continue;
+        }
+
+        // Grows from the first free triangle in index order through its neighbours,
+        // preferring triangles that bring few new vertices and face the same way
+        uint32_t owner = uint32_t(meshlets.size() + 1);
+        size_t begin = result.size();
+        size_t verticesCount = 0;
+        vec3 axis(0);
+        candidates.assign(1, uint32_t(seed));
+        candidateOwners[seed] = owner;
+
+        while ((result.size() - begin) / 3 < maxTriangles) {
+            size_t best = 0;
+            int bestNewVertices = 4;
+            float bestDot = -2;
+            vec3 direction = glm::length(axis) > 0 ? glm::normalize(axis) : axis;
+            for (size_t i = 0; i < candidates.size(); ) {
+                uint32_t t = candidates[i];
+                if (isUsed[t]) {
+                    candidates[i] = candidates.back();
+                    candidates.pop_back();
+                    continue;
+                }
+                uint32_t a = indices[3 * t], b = indices[3 * t + 1], c = indices[3 * t + 2];
+                // A degenerate triangle may repeat a vertex, it's counted once
+                int newVertices = (vertexOwners[a] != owner) + (vertexOwners[b] != owner && b != a)
+                                + (vertexOwners[c] != owner && c != a && c != b);
+                float facing = glm::dot(direction, normals[t]);
+                if (verticesCount + newVertices <= maxVertices
+                    && (newVertices < bestNewVertices || (newVertices == bestNewVertices && facing > bestDot))) {
+                    best = i;
+                    bestNewVertices = newVertices;
+                    bestDot = facing;
+                }
+                ++i;
+            }
+            if (bestNewVertices > 3) {
+                // Every neighbour left would overflow the vertices
+                break;
+            }
+
+            uint32_t t = candidates[best];
+            isUsed[t] = true;
+            axis += normals[t];
+            for (size_t k = 3 * t; k < 3 * t + 3; ++k) {
+                uint32_t v = indices[k];
+                result.push_back(v);
+                if (vertexOwners[v] != owner) {
+                    vertexOwners[v] = owner;
+                    verticesCount++;
+                }
+                uint32_t p = positionIds[v];
+                for (uint32_t j = offsets[p]; j < offsets[p + 1]; ++j) {
+                    uint32_t neighbour = adjacency[j];
+                    if (!isUsed[neighbour] && candidateOwners[neighbour] != owner) {
+                        candidateOwners[neighbour] = owner;
+                        candidates.push_back(neighbour);
+                    }
+                }
+            }
+        }
+
+        Meshlet meshlet;
+        meshlet.indexOffset = uint32_t(begin);
+        meshlet.indicesCount = uint32_t(result.size() - begin);
+        computeBounds(positions, &result[begin], result.size() - begin, meshlet);
+        meshlets.push_back(meshlet);
+    }
+
+    indices.swap(result);
+}
+
+MeshletDraws::MeshletDraws()
+    : visibleMeshlets(0), visibleTriangles(0)
+{}
+
+void cullMeshlets(const vector<Meshlet>& meshlets, const mat4& mvp, const vec3& cameraPosition,
+                  bool cullBackfaces, MeshletDraws& draws, WorkerPool* workers)
+{
+    vec4 planes[6];
+    extractFrustumPlanes(mvp, planes);
+
+    size_t count = meshlets.size();
+    draws.isVisible.resize(count);
+    auto cullRange = [&](size_t, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            draws.isVisible[i] = isMeshletVisible(meshlets[i], planes, cameraPosition, cullBackfaces);
+        }
+    };
+
+    // Each slice writes its own range of the flags
+    if (workers != NULL) {
+        size_t slicesCount = std::min(workers->threadsCount(), std::max<size_t>(1, count / MIN_MESHLETS_PER_THREAD));
+        workers->run(count, slicesCount, cullRange);
+    }
+    else {
+        cullRange(0, 0, count);
+    }
+
+    // Survivors next to each other in the index buffer become one draw
+    draws.counts.clear();
+    draws.offsets.clear();
+    draws.visibleMeshlets = 0;
+    draws.visibleTriangles = 0;
+    uint32_t rangeEnd = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (!draws.isVisible[i]) {
+            continue;
+        }
+        const Meshlet& meshlet = meshlets[i];
+        if (!draws.counts.empty() && rangeEnd == meshlet.indexOffset) {
+            draws.counts.back() += GLsizei(meshlet.indicesCount);
+        }
+        else {
+            draws.counts.push_back(GLsizei(meshlet.indicesCount));
+            draws.offsets.push_back((const GLvoid*)(sizeof(uint32_t) * meshlet.indexOffset));
+        }
+        rangeEnd = meshlet.indexOffset + meshlet.indicesCount;
+        draws.visibleMeshlets++;
+        draws.visibleTriangles += meshlet.indicesCount / 3;
+    }
+}
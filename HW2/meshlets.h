@@ -0,0 +1,52 @@
+#ifndef MESHLETS_H
+#define MESHLETS_H
+
+#include "common.h"
+#include "workerpool.h"
+
+// A cluster of neighbouring triangles small enough to be culled as a whole.
+// The triangles stay in the shared index buffer, a meshlet is a range of it.
+struct Meshlet
+{
+    // Bounding sphere
+    vec3 center;
+    float radius;
+
+    // Every triangle faces away from a camera inside the cone behind the apex:
+    // dot(normalize(apex - camera), axis) >= cutoff. A cutoff of 1 never culls.
+    vec3 coneApex;
+    vec3 coneAxis;
+    float coneCutoff;
+
+    uint32_t indexOffset;
+    uint32_t indicesCount;
+};
+
+// Groups the triangles into meshlets of at most maxVertices distinct vertices and
+// maxTriangles triangles, grown over neighbours that face the same way so the normal
+// cones stay narrow. Indices are reordered so every meshlet is a contiguous range,
+// in the order of the old ones. Counter-clockwise triangles face out.
+void buildMeshlets(const vec3* positions, size_t verticesCount, vector<uint32_t>& indices, vector<Meshlet>& meshlets,
+                   size_t maxVertices = 64, size_t maxTriangles = 124);
+
+// Draw ranges for glMultiDrawElements over the meshlets that survive the cull
+struct MeshletDraws
+{
+    vector<GLsizei> counts;
+    vector<const GLvoid*> offsets;
+    size_t visibleMeshlets;
+    size_t visibleTriangles;
+    // Per meshlet result of the last cull
+    vector<uint8_t> isVisible;
+
+    MeshletDraws();
+};
+
+// Drops meshlets outside the frustum of mvp (model space to clip space) and, if
+// cullBackfaces, those facing away from the camera at cameraPosition (model space).
+// Ranges of neighbouring survivors are merged. Large meshlet counts are split over
+// the threads of workers, all are culled on the calling thread without it.
+void cullMeshlets(const vector<Meshlet>& meshlets, const mat4& mvp, const vec3& cameraPosition,
+                  bool cullBackfaces, MeshletDraws& draws, WorkerPool* workers = NULL);
+
+#endif //MESHLETS_H
@@ -0,0 +1,114 @@
+#include "modelstream.h"
+#include "mappedfile.h"
+#include "objparser.h"
+#include <stdexcept>
+
+namespace
+{
+    // About 20k triangles of a typical OBJ, a few milliseconds to parse
+    const size_t CHUNK_SIZE = 1 << 20;
+
+    vec3 faceNormal(const vec3& p0, const vec3& p1, const vec3& p2)
+    {
+        vec3 normal = glm::cross(p1 - p0, p2 - p0);
+        float length = glm::length(normal);
+        return length > 0 ? normal / length : normal;
+    }
+}
+
+ModelStream::ModelStream()
+    : _isDone(false), _isCancelled(false)
+{}
+
+ModelStream::~ModelStream()
+{
+    _isCancelled = true;
+    if (_thread.joinable()) {
+        _thread.join();
+    }
+}
+
+void ModelStream::start(const string& path, Model& model, const std::function<void()>& prepare)
+{
+    _thread = std::thread([this, path, &model, prepare]() {
+        run(path, model, prepare);
+    });
+}
+
+bool ModelStream::popBatch(Batch& batch)
+{
+    return _batches.pop(batch);
+}
+
+bool ModelStream::isDone() const
+{
+    return _isDone.load(std::memory_order_acquire);
+}
+
+const string& ModelStream::error() const
+{
+    return _error;
+}
+
+void ModelStream::run(const string& path, Model& model, const std::function<void()>& prepare)
+{
+    try {
+        if (!model.loadCached(path)) {
+            ObjData obj;
+            parse(path, obj);
+            if (!_isCancelled) {
+                model.build(path, obj);
+            }
+        }
+        if (!_isCancelled) {
+            prepare();
+        }
+    }
+    catch (std::exception const& except) {
+        _error = except.what();
+    }
+    _isDone.store(true, std::memory_order_release);
+}
+
+void ModelStream::parse(const string& path, ObjData& obj)
+{
+    MappedFile file;
+    if (!file.open(path)) {
+        throw std::runtime_error("Can't open model: " + path);
+    }
+
+    const char* text = (const char*)file.data();
+    const char* end = text + file.size();
+    for (const char* p = text; p < end && !_isCancelled; ) {
+        const char* chunkEnd = findObjChunkEnd(p, end, CHUNK_SIZE);
+        size_t cornersCount = obj.positionIndices.size();
+        appendObj(text, p, chunkEnd, obj);
+        pushTriangles(obj, cornersCount);
+        p = chunkEnd;
+    }
+    checkObjIndices(obj);
+}
+
+void ModelStream::pushTriangles(const ObjData& obj, size_t begin)
+{
+    Batch batch;
+    batch.reserve(2 * (obj.positionIndices.size() - begin));
+    for (size_t corner = begin; corner + 3 <= obj.positionIndices.size(); corner += 3) {
+        const int* positions = &obj.positionIndices[corner];
+        const int* normals = &obj.normalIndices[corner];
+        // Faces referring further into the file only show up with the whole model
+        if (positions[0] >= int(obj.positions.size()) || positions[1] >= int(obj.positions.size())
+            || positions[2] >= int(obj.positions.size())) {
+            continue;
+        }
+        vec3 flat = faceNormal(obj.positions[positions[0]], obj.positions[positions[1]], obj.positions[positions[2]]);
+        for (int k = 0; k < 3; ++k) {
+            batch.push_back(obj.positions[positions[k]]);
+            bool hasNormal = normals[k] >= 0 && normals[k] < int(obj.normals.size());
+            batch.push_back(hasNormal ? obj.normals[normals[k]] : flat);
+        }
+    }
+    if (!batch.empty()) {
+        _batches.push(batch);
+    }
+}
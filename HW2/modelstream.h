@@ -0,0 +1,105 @@
+#ifndef MODELSTREAM_H
+#define MODELSTREAM_H
+
+#include "common.h"
+#include "model.h"
+#include <atomic>
+#include <functional>
+#include <thread>
+
+// Queue from one producer thread to one consumer thread, without locks: push only
+// links a node after the tail and pop only unlinks the one after the head
+template<typename T>
+class SpscQueue
+{
+public:
+    SpscQueue()
+        : _head(new Node()), _tail(_head)
+    {}
+
+    ~SpscQueue()
+    {
+        while (_head != NULL) {
+            Node* next = _head->next.load(std::memory_order_relaxed);
+            delete _head;
+            _head = next;
+        }
+    }
+
+    void push(T& value)
+    {
+        Node* node = new Node();
+        std::swap(node->value, value);
+        _tail->next.store(node, std::memory_order_release);
+        _tail = node;
+    }
+
+    bool pop(T& value)
+    {
+        Node* next = _head->next.load(std::memory_order_acquire);
+        if (next == NULL) {
+            return false;
+        }
+        // The old head was already read, next becomes the empty one in front
+        std::swap(value, next->value);
+        delete _head;
+        _head = next;
+        return true;
+    }
+
+private:
+    struct Node
+    {
+        T value;
+        std::atomic<Node*> next;
+
+        Node()
+            : next(NULL)
+        {}
+    };
+
+    SpscQueue(const SpscQueue&);
+    SpscQueue& operator=(const SpscQueue&);
+
+    Node* _head;
+    Node* _tail;
+};
+
+// Loads a model on a background thread, so the first frames don't wait for it.
+// Without a valid mesh cache the OBJ is parsed a chunk at a time and every chunk's
+// triangles are queued as a batch right away, to be drawn until the model is done.
+class ModelStream
+{
+public:
+    // Three corners per triangle, each a position followed by a normal
+    typedef vector<vec3> Batch;
+
+    ModelStream();
+    // Parsing stops at the next chunk, building the model can't be interrupted
+    ~ModelStream();
+
+    // Loads path into model, then runs prepare on the same thread for whatever else
+    // has to be done before drawing it. Neither may be touched until isDone().
+    void start(const string& path, Model& model, const std::function<void()>& prepare);
+
+    bool popBatch(Batch& batch);
+    bool isDone() const;
+    // Empty unless loading failed
+    const string& error() const;
+
+private:
+    ModelStream(const ModelStream&);
+    ModelStream& operator=(const ModelStream&);
+
+    void run(const string& path, Model& model, const std::function<void()>& prepare);
+    void parse(const string& path, ObjData& obj);
+    void pushTriangles(const ObjData& obj, size_t begin);
+
+    SpscQueue<Batch> _batches;
+    std::thread _thread;
+    std::atomic<bool> _isDone;
+    std::atomic<bool> _isCancelled;
+    string _error;
+};
+
+#endif //MODELSTREAM_H
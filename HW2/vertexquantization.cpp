@@ -0,0 +1,88 @@
+#include "vertexquantization.h"
+#include <algorithm>
+
+namespace
+{
+    vec2 signNotZero(const vec2& v)
+    {
+        return vec2(v.x >= 0 ? 1.0f : -1.0f, v.y >= 0 ? 1.0f : -1.0f);
+    }
+
+    uint16_t quantizeUnorm(float value)
+    {
+        return uint16_t(glm::clamp(value, 0.0f, 1.0f) * 65535.0f + 0.5f);
+    }
+
+    int16_t quantizeSnorm(float value)
+    {
+        return int16_t(glm::round(glm::clamp(value, -1.0f, 1.0f) * 32767.0f));
+    }
+}
+
+vec2 encodeOctahedral(const vec3& normal)
+{
+    float length1 = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+    if (length1 == 0) {
+        return vec2(0);
+    }
+    vec3 n = normal / length1;
+    vec2 encoded(n.x, n.y);
+    if (n.z < 0) {
+        // The lower half folds over the diagonals onto the corners
+        encoded = (vec2(1) - glm::abs(vec2(n.y, n.x))) * signNotZero(encoded);
+    }
+    return encoded;
+}
+
+vec3 decodeOctahedral(const vec2& encoded)
+{
+    vec3 n(encoded.x, encoded.y, 1 - std::abs(encoded.x) - std::abs(encoded.y));
+    if (n.z < 0) {
+        vec2 folded = (vec2(1) - glm::abs(vec2(n.y, n.x))) * signNotZero(vec2(n.x, n.y));
+        n.x = folded.x;
+        n.y = folded.y;
+    }
+    return glm::normalize(n);
+}
+
+mat4 quantizeVertices(const vec3* positions, const vec2* texCoords, const vec3* normals, size_t verticesCount,
+                      vector<QuantizedVertex>& vertices)
+{
+    vertices.resize(verticesCount);
+    if (verticesCount == 0) {
+        return mat4(1.0f);
+    }
+
+    vec3 minimum = positions[0];
+    vec3 maximum = minimum;
+    for (size_t i = 1; i < verticesCount; ++i) {
+        minimum = glm::min(minimum, positions[i]);
+        maximum = glm::max(maximum, positions[i]);
+    }
+    // Each axis gets all 16 bits of its own extent; a flat axis keeps a unit scale
+    vec3 extent = maximum - minimum;
+    for (int axis = 0; axis < 3; ++axis) {
+        if (extent[axis] <= 0) {
+            extent[axis] = 1;
+        }
+    }
+
+    for (size_t i = 0; i < verticesCount; ++i) {
+        QuantizedVertex& vertex = vertices[i];
+        vec3 position = (positions[i] - minimum) / extent;
+        for (int axis = 0; axis < 3; ++axis) {
+            vertex.position[axis] = quantizeUnorm(position[axis]);
+        }
+        vertex.padding = 0;
+
+        vec2 normal = normals != NULL ? encodeOctahedral(normals[i]) : vec2(0);
+        vertex.normal[0] = quantizeSnorm(normal.x);
+        vertex.normal[1] = quantizeSnorm(normal.y);
+
+        uint32_t texCoord = texCoords != NULL ? glm::packHalf2x16(texCoords[i]) : 0;
+        vertex.texCoord[0] = uint16_t(texCoord & 0xffff);
+        vertex.texCoord[1] = uint16_t(texCoord >> 16);
+    }
+
+    return glm::translate(mat4(1.0f), minimum) * glm::scale(mat4(1.0f), extent);
+}
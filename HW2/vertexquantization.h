@@ -0,0 +1,29 @@
+#ifndef VERTEXQUANTIZATION_H
+#define VERTEXQUANTIZATION_H
+
+#include "common.h"
+
+// 16 bytes instead of 32 for float positions, normals and texture coordinates.
+// Read with glVertexAttribPointer as:
+//   position: 3 x GL_UNSIGNED_SHORT, normalized, 0..1 across the mesh bounds
+//   normal:   2 x GL_SHORT, normalized, octahedral (decodeOctahedral in the shader)
+//   texCoord: 2 x GL_HALF_FLOAT
+struct QuantizedVertex
+{
+    uint16_t position[3];
+    uint16_t padding;
+    int16_t normal[2];
+    uint16_t texCoord[2];
+};
+
+// Maps a unit vector onto the octahedron unfolded to [-1, 1]^2.
+// Decoding: n = (e.x, e.y, 1 - |e.x| - |e.y|); if n.z < 0, n.xy = (1 - |n.yx|) * sign(n.xy).
+vec2 encodeOctahedral(const vec3& normal);
+vec3 decodeOctahedral(const vec2& encoded);
+
+// Packs the vertices and returns the matrix that turns the 0..1 positions back
+// into model space, to be folded into the model matrix. texCoords and normals may be NULL.
+mat4 quantizeVertices(const vec3* positions, const vec2* texCoords, const vec3* normals, size_t verticesCount,
+                      vector<QuantizedVertex>& vertices);
+
+#endif //VERTEXQUANTIZATION_H
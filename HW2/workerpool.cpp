@@ -0,0 +1,80 @@
+#include "workerpool.h"
+#include <algorithm>
+
+WorkerPool::WorkerPool(int threadsCount)
+    : _jobCount(0), _jobWorkers(0), _jobNumber(0), _busyWorkers(0), _isStopping(false)
+{
+    if (threadsCount <= 0) {
+        threadsCount = int(std::max(1u, std::thread::hardware_concurrency()));
+    }
+    for (int i = 0; i + 1 < threadsCount; ++i) {
+        _workers.push_back(std::thread(&WorkerPool::workerLoop, this, size_t(i)));
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _isStopping = true;
+    lock.unlock();
+    _jobStarted.notify_all();
+
+    for (size_t i = 0; i < _workers.size(); ++i) {
+        _workers[i].join();
+    }
+}
+
+size_t WorkerPool::threadsCount() const
+{
+    return _workers.size() + 1;
+}
+
+void WorkerPool::workerLoop(size_t slice)
+{
+    size_t lastJob = 0;
+    std::unique_lock<std::mutex> lock(_mutex);
+    for (;;) {
+        _jobStarted.wait(lock, [&]() { return _isStopping || _jobNumber != lastJob; });
+        if (_isStopping) {
+            return;
+        }
+        lastJob = _jobNumber;
+        if (slice >= _jobWorkers) {
+            continue;
+        }
+
+        // The job stays put until every busy worker is done with it
+        size_t slicesCount = _jobWorkers + 1;
+        size_t count = _jobCount;
+        lock.unlock();
+        _job(slice, count * slice / slicesCount, count * (slice + 1) / slicesCount);
+        lock.lock();
+        if (--_busyWorkers == 0) {
+            _jobFinished.notify_one();
+        }
+    }
+}
+
+void WorkerPool::run(size_t count, size_t slicesCount, const std::function<void(size_t, size_t, size_t)>& work)
+{
+    slicesCount = std::max<size_t>(1, std::min(slicesCount, threadsCount()));
+    if (slicesCount == 1) {
+        work(0, 0, count);
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    _job = work;
+    _jobCount = count;
+    _jobWorkers = slicesCount - 1;
+    _busyWorkers = _jobWorkers;
+    ++_jobNumber;
+    lock.unlock();
+    _jobStarted.notify_all();
+
+    work(slicesCount - 1, count * (slicesCount - 1) / slicesCount, count);
+
+    lock.lock();
+    _jobFinished.wait(lock, [&]() { return _busyWorkers == 0; });
+    _job = nullptr;
+}
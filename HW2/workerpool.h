@@ -0,0 +1,47 @@
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include "common.h"
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Threads started once and kept waiting for work, so splitting a per-frame job
+// costs a wake-up rather than a thread start. The calling thread is one of them.
+class WorkerPool
+{
+public:
+    // threadsCount threads in all, 0 for one per core
+    explicit WorkerPool(int threadsCount = 0);
+    ~WorkerPool();
+
+    // Including the calling thread
+    size_t threadsCount() const;
+
+    // Runs work(slice, begin, end) over slicesCount slices of count items and waits for
+    // all of them; the calling thread runs the last slice. At most threadsCount() slices.
+    void run(size_t count, size_t slicesCount, const std::function<void(size_t, size_t, size_t)>& work);
+
+private:
+    // Worker i runs slice i of every job
+    vector<std::thread> _workers;
+    std::mutex _mutex;
+    std::condition_variable _jobStarted;
+    std::condition_variable _jobFinished;
+    // Work of the current job over slice, begin, end, and how many workers it needs
+    std::function<void(size_t, size_t, size_t)> _job;
+    size_t _jobCount;
+    size_t _jobWorkers;
+    // Bumped for every job, so a worker never runs the same one twice
+    size_t _jobNumber;
+    size_t _busyWorkers;
+    bool _isStopping;
+
+    WorkerPool(const WorkerPool&);
+    WorkerPool& operator=(const WorkerPool&);
+
+    void workerLoop(size_t slice);
+};
+
+#endif //WORKERPOOL_H
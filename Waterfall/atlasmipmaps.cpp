@@ -0,0 +1,115 @@
+#include "atlasmipmaps.h"
+#include "pixelkernels.h"
+#include "profiler.h"
+#include "textureloader.h"
+#include <algorithm>
+#include <thread>
+
+namespace
+{
+    // Rows below this are not worth a thread
+    const uint ROWS_PER_THREAD = 64;
+
+    // For every destination pixel along one axis, the two source pixels it averages,
+    // both clamped to the cell the pixel belongs to
+    struct AxisSamples
+    {
+        vector<uint> first, second;
+        // Pairs are always (2i, 2i + 1) inside one cell, so whole rows can use the SIMD kernel
+        bool isAligned;
+
+        AxisSamples(uint sourceSize, uint size, int cellsCount)
+            : first(size), second(size)
+        {
+            for (uint i = 0; i < size; ++i) {
+                uint cell = uint(uint64_t(i) * cellsCount / size);
+                // Source pixel x is in cell x * cellsCount / sourceSize, rounded down
+                uint cellBegin = uint((uint64_t(cell) * sourceSize + cellsCount - 1) / cellsCount);
+                uint cellEnd = uint((uint64_t(cell + 1) * sourceSize + cellsCount - 1) / cellsCount) - 1;
+                first[i] = std::min(std::max(2 * i, cellBegin), cellEnd);
+                second[i] = std::min(std::max(2 * i + 1, cellBegin), cellEnd);
+            }
+            isAligned = sourceSize == 2 * size && size % cellsCount == 0;
+        }
+    };
+
+    void downsampleRows(const GLubyte* source, uint sourceWidth, GLubyte* destination, uint width,
+                        const AxisSamples& columns, const AxisSamples& rows, uint rowBegin, uint rowEnd)
+    {
+        for (uint y = rowBegin; y < rowEnd; ++y) {
+            const GLubyte* row0 = source + size_t(rows.first[y]) * sourceWidth * 4;
+            const GLubyte* row1 = source + size_t(rows.second[y]) * sourceWidth * 4;
+            GLubyte* row = destination + size_t(y) * width * 4;
+
+            if (columns.isAligned) {
+                downsample2x2(row0, row1, row, width);
+                continue;
+            }
+
+            for (uint x = 0; x < width; ++x) {
+                const GLubyte* p00 = row0 + columns.first[x] * 4;
+                const GLubyte* p01 = row0 + columns.second[x] * 4;
+                const GLubyte* p10 = row1 + columns.first[x] * 4;
+                const GLubyte* p11 = row1 + columns.second[x] * 4;
+                for (int c = 0; c < 4; ++c) {
+                    row[x * 4 + c] = GLubyte((p00[c] + p01[c] + p10[c] + p11[c] + 2) >> 2);
+                }
+            }
+        }
+    }
+}
+
+void buildAtlasMipmaps(const DecodedImage& image, int rowCount, int columnCount, vector<MipLevel>& levels)
+{
+    PROFILE_SCOPE("buildAtlasMipmaps");
+
+    levels.clear();
+    // Levels must not move, each one is the source of the next
+    levels.reserve(32);
+    rowCount = std::max(rowCount, 1);
+    columnCount = std::max(columnCount, 1);
+
+    uint threadsLimit = std::max(1u, std::thread::hardware_concurrency());
+
+    const GLubyte* source = &image.pixels[0];
+    uint sourceWidth = image.width;
+    uint sourceHeight = image.height;
+    while (sourceWidth > 1 || sourceHeight > 1) {
+        uint width = std::max(1u, sourceWidth / 2);
+        uint height = std::max(1u, sourceHeight / 2);
+        if (width < uint(columnCount) || height < uint(rowCount)) {
+            break;
+        }
+
+        levels.push_back(MipLevel());
+        MipLevel& level = levels.back();
+        level.width = width;
+        level.height = height;
+        level.pixels.resize(size_t(width) * height * 4);
+
+        AxisSamples columns(sourceWidth, width, columnCount);
+        AxisSamples rows(sourceHeight, height, rowCount);
+        GLubyte* destination = &level.pixels[0];
+
+        uint threadsCount = std::min(threadsLimit, std::max(1u, height / ROWS_PER_THREAD));
+        if (threadsCount == 1) {
+            downsampleRows(source, sourceWidth, destination, width, columns, rows, 0, height);
+        }
+        else {
+            vector<std::thread> threads;
+            for (uint i = 0; i < threadsCount; ++i) {
+                uint rowBegin = height * i / threadsCount;
+                uint rowEnd = height * (i + 1) / threadsCount;
+                threads.push_back(std::thread(downsampleRows, source, sourceWidth, destination, width,
+                                              std::cref(columns), std::cref(rows), rowBegin, rowEnd));
+            }
+            for (size_t i = 0; i < threads.size(); ++i) {
+                threads[i].join();
+            }
+        }
+
+        source = destination;
+        sourceWidth = width;
+        sourceHeight = height;
+    }
+}
@@ -0,0 +1,21 @@
+#ifndef ATLAS_MIPMAPS_H
+#define ATLAS_MIPMAPS_H
+
+#include "common.h"
+
+struct DecodedImage;
+
+struct MipLevel
+{
+    uint width, height;
+    vector<GLubyte> pixels;
+};
+
+// Builds mip levels 1..n of a sprite atlas with rowCount x columnCount cells.
+// Every cell is box filtered on its own with its edges clamped, so lower levels
+// never blend neighbouring frames the way glGenerateMipmap does. The chain stops
+// at the last level where each cell still covers a pixel; a 1x1 grid goes down to 1x1.
+// Rows of large levels are split between threads.
+void buildAtlasMipmaps(const DecodedImage& image, int rowCount, int columnCount, vector<MipLevel>& levels);
+
+#endif //ATLAS_MIPMAPS_H
@@ -0,0 +1,437 @@
+#include "benchmarks.h"
+#include "indexedmesh.h"
+#include "meshbounds.h"
+#include "meshcache.h"
+#include "model.h"
+#include "objparser.h"
+#include "pixelkernels.h"
+#include "textureloader.h"
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+namespace
+{
+    // Best of several runs, in milliseconds
+    double measure(int runsCount, const std::function<void()>& setup, const std::function<void()>& run)
+    {
+        double best = 1e30;
+        for (int i = 0; i < runsCount; ++i) {
+            setup();
+            chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+            run();
+            chrono::steady_clock::time_point end = chrono::steady_clock::now();
+            best = std::min(best, chrono::duration<double, std::milli>(end - begin).count());
+        }
+        return best;
+    }
+
+    void printResult(const char* kernel, const char* level, double milliseconds, double baseline, size_t pixelsCount, bool isValid)
+    {
+        cout << std::left << std::setw(16) << kernel << std::setw(10) << level << std::right << std::fixed
+             << std::setprecision(3) << std::setw(10) << milliseconds << " ms"
+             << std::setprecision(1) << std::setw(10) << pixelsCount / milliseconds / 1000.0 << " MPix/s"
+             << std::setprecision(2) << std::setw(8) << baseline / milliseconds << "x"
+             << (isValid ? "" : "  MISMATCH") << endl;
+    }
+
+    // The per-byte loop TextureLoader::decode used before the kernels
+    void swizzleBaseline(const uint8_t* src, uint8_t* dst, size_t pixelsCount)
+    {
+        for (size_t x = 0; x < pixelsCount; ++x) {
+            dst[x * 4 + 0] = src[x * 4 + 2];
+            dst[x * 4 + 1] = src[x * 4 + 1];
+            dst[x * 4 + 2] = src[x * 4 + 0];
+            dst[x * 4 + 3] = src[x * 4 + 3];
+        }
+    }
+
+    void premultiplyBaseline(uint8_t* rgba, size_t pixelsCount)
+    {
+        for (size_t i = 0; i < pixelsCount; ++i) {
+            uint8_t* p = rgba + i * 4;
+            p[0] = uint8_t((p[0] * p[3] + 127) / 255);
+            p[1] = uint8_t((p[1] * p[3] + 127) / 255);
+            p[2] = uint8_t((p[2] * p[3] + 127) / 255);
+        }
+    }
+
+    vec2 readVertex2(stringstream& in)
+    {
+        float u, v;
+        in >> u; in.get(); in >> v;
+
+        return vec2(u, v);
+    }
+
+    vec3 readVertex3(stringstream& in)
+    {
+        float x, y, z;
+        in >> x; in.get(); in >> y; in.get(); in >> z;
+
+        return vec3(x, y, z);
+    }
+
+    // Model::load before the mapped parser: a string and a stringstream per line
+    void loadObjBaseline(const string& path, Model& model)
+    {
+        ifstream file(path.c_str());
+
+        vvec3 tempVertices, tempNormals;
+        vvec2 tempTextures;
+        vector<int> vertexIndices, textureIndices, normalIndices;
+
+        while (!file.eof()) {
+            string line;
+            std::getline(file, line);
+            if (line.length() == 0) {
+                continue;
+            }
+            if (strncmp(line.c_str(), "vt", 2) == 0) {
+                stringstream in(line.substr(2));
+                tempTextures.push_back(readVertex2(in));
+            }
+            else if (strncmp(line.c_str(), "vn", 2) == 0) {
+                stringstream in(line.substr(2));
+                tempNormals.push_back(readVertex3(in));
+            }
+            else if (strncmp(line.c_str(), "v", 1) == 0) {
+                stringstream in(line.substr(1));
+                tempVertices.push_back(readVertex3(in));
+            }
+            else if (strncmp(line.c_str(), "f", 1) == 0) {
+                stringstream in(line.substr(1));
+                for (int i = 0; i < 3; ++i) {
+                    vec3 f = readVertex3(in);
+                    vertexIndices.push_back(int(f[0])); textureIndices.push_back(int(f[1])); normalIndices.push_back(int(f[2]));
+                }
+            }
+        }
+
+        for (size_t i = 0; i < vertexIndices.size(); ++i) {
+            model.vertices_.push_back(tempVertices[--vertexIndices[i]]);
+            model.textures_.push_back(tempTextures[--textureIndices[i]]);
+            model.normals_.push_back(tempNormals[--normalIndices[i]]);
+        }
+    }
+
+    // Triangulated size x size grid with texture coordinates and normals, as exporters write it
+    void writeGridObj(const string& fileName, int size)
+    {
+        std::ofstream file(fileName.c_str());
+        file << std::fixed << std::setprecision(6);
+        for (int y = 0; y <= size; ++y) {
+            for (int x = 0; x <= size; ++x) {
+                float u = float(x) / size, v = float(y) / size;
+                file << "v " << u * 100 - 50 << " " << std::sin(u * 20) * std::cos(v * 20) << " " << v * 100 - 50 << "\n";
+            }
+        }
+        for (int y = 0; y <= size; ++y) {
+            for (int x = 0; x <= size; ++x) {
+                file << "vt " << float(x) / size << " " << float(y) / size << "\n";
+            }
+        }
+        for (int y = 0; y <= size; ++y) {
+            for (int x = 0; x <= size; ++x) {
+                vec3 n = normalize(vec3(std::sin(x * 0.1f), 1.0f, std::cos(y * 0.1f)));
+                file << "vn " << n.x << " " << n.y << " " << n.z << "\n";
+            }
+        }
+        for (int y = 0; y < size; ++y) {
+            for (int x = 0; x < size; ++x) {
+                int a = y * (size + 1) + x + 1, b = a + 1, c = a + size + 1, d = c + 1;
+                file << "f " << a << "/" << a << "/" << a << " " << b << "/" << b << "/" << b << " " << d << "/" << d << "/" << d << "\n";
+                file << "f " << a << "/" << a << "/" << a << " " << d << "/" << d << "/" << d << " " << c << "/" << c << "/" << c << "\n";
+            }
+        }
+    }
+
+    // Position, texture coordinates and normal of the three corners
+    typedef std::array<float, 24> TriangleKey;
+
+    void appendCorner(float* key, const vec3& position, const vec2& texCoord, const vec3& normal)
+    {
+        memcpy(key, &position[0], sizeof(vec3));
+        memcpy(key + 3, &texCoord[0], sizeof(vec2));
+        memcpy(key + 5, &normal[0], sizeof(vec3));
+    }
+
+    template<typename T>
+    bool isArraySame(const T* a, const T* b, size_t count)
+    {
+        return count == 0 || (a != NULL && b != NULL && std::equal(a, a + count, b));
+    }
+
+    // Largest difference between the triangles of the unindexed baseline and the
+    // indexed model, or -1 if their counts differ. Model::load reorders the
+    // triangles, so both lists are sorted first.
+    float compareModels(const Model& baseline, const Model& indexed)
+    {
+        if (baseline.vertices_.size() != indexed.indices_.size()) {
+            return -1;
+        }
+
+        vector<TriangleKey> expected(baseline.vertices_.size() / 3), actual(expected.size());
+        for (size_t i = 0; i < baseline.vertices_.size(); ++i) {
+            uint32_t v = indexed.indices_[i];
+            appendCorner(&expected[i / 3][8 * (i % 3)], baseline.vertices_[i], baseline.textures_[i], baseline.normals_[i]);
+            appendCorner(&actual[i / 3][8 * (i % 3)], indexed.vertices_[v], indexed.textures_[v], indexed.normals_[v]);
+        }
+        std::sort(expected.begin(), expected.end());
+        std::sort(actual.begin(), actual.end());
+
+        float difference = 0;
+        for (size_t t = 0; t < expected.size(); ++t) {
+            for (size_t k = 0; k < expected[t].size(); ++k) {
+                difference = std::max(difference, std::abs(expected[t][k] - actual[t][k]));
+            }
+        }
+        return difference;
+    }
+}
+
+int runPixelKernelsBenchmark(const string& imageFileName)
+{
+    const int runsCount = 10;
+
+    DecodedImage image;
+    if (imageFileName.empty()) {
+        image.width = image.height = 4096;
+        image.pixels.resize(4 * image.width * image.height);
+        for (size_t i = 0; i < image.pixels.size(); ++i) {
+            image.pixels[i] = GLubyte(rand());
+        }
+    }
+    else {
+        try {
+            TextureLoader::decode(imageFileName, image);
+        }
+        catch (std::exception const& except) {
+            std::cerr << except.what() << endl;
+            return 1;
+        }
+    }
+
+    size_t pixelsCount = size_t(image.width) * image.height;
+    const vector<uint8_t>& source = image.pixels;
+    vector<uint8_t> expected(source.size());
+    vector<uint8_t> target(source.size());
+
+    PixelKernelLevel supported = supportedPixelKernelLevel();
+    cout << image.width << "x" << image.height << " pixels, best of " << runsCount
+         << " runs, CPU supports " << pixelKernelLevelName(supported) << endl;
+
+    double baseline = measure(runsCount, [](){}, [&]() {
+        swizzleBaseline(&source[0], &expected[0], pixelsCount);
+    });
+    printResult("swizzle", "baseline", baseline, baseline, pixelsCount, true);
+    for (int level = PIXEL_KERNELS_SCALAR; level <= supported; ++level) {
+        setPixelKernelLevel(PixelKernelLevel(level));
+        double time = measure(runsCount, [](){}, [&]() {
+            swizzleBGRAToRGBA(&source[0], &target[0], pixelsCount);
+        });
+        printResult("swizzle", pixelKernelLevelName(PixelKernelLevel(level)), time, baseline, pixelsCount, target == expected);
+    }
+
+    baseline = measure(runsCount, [&]() { expected = source; }, [&]() {
+        premultiplyBaseline(&expected[0], pixelsCount);
+    });
+    printResult("premultiply", "baseline", baseline, baseline, pixelsCount, true);
+    for (int level = PIXEL_KERNELS_SCALAR; level <= supported; ++level) {
+        setPixelKernelLevel(PixelKernelLevel(level));
+        double time = measure(runsCount, [&]() { target = source; }, [&]() {
+            premultiplyAlpha(&target[0], pixelsCount);
+        });
+        printResult("premultiply", pixelKernelLevelName(PixelKernelLevel(level)), time, baseline, pixelsCount, target == expected);
+    }
+
+    // Half-size mip level of the whole image, one row pair at a time
+    uint halfWidth = image.width / 2;
+    uint halfHeight = image.height / 2;
+    size_t halfPixelsCount = size_t(halfWidth) * halfHeight;
+    vector<uint8_t> expectedMip(halfPixelsCount * 4);
+    vector<uint8_t> mip(halfPixelsCount * 4);
+    double mipBaseline = 0;
+    for (int level = PIXEL_KERNELS_SCALAR; level <= supported; ++level) {
+        setPixelKernelLevel(PixelKernelLevel(level));
+        vector<uint8_t>& output = level == PIXEL_KERNELS_SCALAR ? expectedMip : mip;
+        double time = measure(runsCount, [](){}, [&]() {
+            for (uint y = 0; y < halfHeight; ++y) {
+                const uint8_t* row0 = &source[size_t(2 * y) * image.width * 4];
+                downsample2x2(row0, row0 + image.width * 4, &output[size_t(y) * halfWidth * 4], halfWidth);
+            }
+        });
+        if (level == PIXEL_KERNELS_SCALAR) {
+            mipBaseline = time;
+        }
+        printResult("downsample2x2", pixelKernelLevelName(PixelKernelLevel(level)), time, mipBaseline, halfPixelsCount,
+                    level == PIXEL_KERNELS_SCALAR || mip == expectedMip);
+    }
+    setPixelKernelLevel(supported);
+
+    double time = measure(runsCount, [&]() { target = source; }, [&]() {
+        srgbToLinear(&target[0], pixelsCount);
+    });
+    printResult("srgbToLinear", "table", time, time, pixelsCount, true);
+
+    time = measure(runsCount, [&]() { target = source; }, [&]() {
+        linearToSrgb(&target[0], pixelsCount);
+    });
+    printResult("linearToSrgb", "table", time, time, pixelsCount, true);
+
+    time = measure(runsCount, [](){}, [&]() {
+        flipVertical(&target[0], image.width, image.height, 4);
+    });
+    printResult("flipVertical", "memcpy", time, time, pixelsCount, true);
+
+    return 0;
+}
+
+int runObjLoadBenchmark(const string& modelFileName)
+{
+    const int runsCount = 5;
+
+    string fileName = modelFileName;
+    if (fileName.empty()) {
+        fileName = "obj_benchmark.obj";
+        writeGridObj(fileName, 700);
+    }
+
+    ifstream file(fileName.c_str(), std::ios::binary | std::ios::ate);
+    if (!file) {
+        std::cerr << "Can't open " << fileName << endl;
+        return 1;
+    }
+    double megabytes = double(file.tellg()) / (1 << 20);
+    file.close();
+
+    // The first load parses and writes the mesh cache, later ones map it
+    string cacheFileName = MeshCache::cacheFileName(fileName);
+    Model expected, model, cached;
+    double baseline = measure(runsCount, [&]() { expected = Model(); }, [&]() {
+        loadObjBaseline(fileName, expected);
+    });
+    double time = 0, cachedTime = 0;
+    try {
+        time = measure(runsCount, [&]() { std::remove(cacheFileName.c_str()); }, [&]() {
+            model.load(fileName);
+        });
+        cachedTime = measure(runsCount, [](){}, [&]() {
+            cached.load(fileName);
+        });
+    }
+    catch (std::exception const& except) {
+        std::cerr << except.what() << endl;
+        return 1;
+    }
+
+    float difference = compareModels(expected, model);
+    cout << fileName << ": " << std::fixed << std::setprecision(1) << megabytes << " MB, "
+         << model.indices_count() / 3 << " triangles, best of " << runsCount << " runs" << endl;
+    cout << std::left << std::setw(16) << "streams" << std::right << std::setprecision(3) << std::setw(10) << baseline << " ms"
+         << std::setprecision(1) << std::setw(10) << megabytes / baseline * 1000 << " MB/s" << endl;
+    cout << std::left << std::setw(16) << "first load" << std::right << std::setprecision(3) << std::setw(10) << time << " ms"
+         << std::setprecision(1) << std::setw(10) << megabytes / time * 1000 << " MB/s"
+         << std::setprecision(2) << std::setw(8) << baseline / time << "x" << endl;
+    // The cached model points into the mapped file, the built one into its own arrays
+    size_t verticesCount = model.vertices_count();
+    bool isCacheSame = cached.vertices_count() == verticesCount && cached.indices_count() == model.indices_count()
+                    && isArraySame(cached.positions(), model.positions(), verticesCount)
+                    && isArraySame(cached.tex_coords(), model.tex_coords(), verticesCount)
+                    && isArraySame(cached.normals(), model.normals(), verticesCount)
+                    && isArraySame(cached.indices(), model.indices(), model.indices_count())
+                    && cached.lods_count() == model.lods_count()
+                    && cached.bounds_.minimum == model.bounds_.minimum && cached.bounds_.maximum == model.bounds_.maximum
+                    && cached.bounds_.sphereCenter == model.bounds_.sphereCenter && cached.bounds_.sphereRadius == model.bounds_.sphereRadius;
+    for (size_t i = 0; isCacheSame && i < model.lods_count(); ++i) {
+        isCacheSame = cached.lod_indices_count(i) == model.lod_indices_count(i) && cached.lod_error(i) == model.lod_error(i)
+                   && isArraySame(cached.lod_indices(i), model.lod_indices(i), model.lod_indices_count(i));
+    }
+    cout << std::left << std::setw(16) << "cached load" << std::right << std::setprecision(3) << std::setw(10) << cachedTime << " ms"
+         << std::setprecision(1) << std::setw(10) << megabytes / cachedTime * 1000 << " MB/s"
+         << std::setprecision(2) << std::setw(8) << baseline / cachedTime << "x"
+         << (isCacheSame ? "" : "  MISMATCH") << endl;
+
+    // Parsing alone, small files stay on one thread whatever the count
+    int coresCount = int(std::max(1u, std::thread::hardware_concurrency()));
+    for (int threadsCount = 1; ; threadsCount = std::min(2 * threadsCount, coresCount)) {
+        ObjData obj;
+        double parseTime = measure(runsCount, [](){}, [&]() {
+            loadObj(fileName, obj, threadsCount);
+        });
+        std::ostringstream label;
+        label << threadsCount << (threadsCount == 1 ? " thread" : " threads");
+        cout << std::left << std::setw(16) << label.str() << std::right << std::setprecision(3) << std::setw(10) << parseTime << " ms"
+             << std::setprecision(1) << std::setw(10) << megabytes / parseTime * 1000 << " MB/s"
+             << std::setprecision(2) << std::setw(8) << baseline / parseTime << "x"
+             << (obj.positionIndices.size() == model.indices_count() ? "" : "  MISMATCH") << endl;
+        if (threadsCount == coresCount) {
+            break;
+        }
+    }
+
+    // What Model::load does after parsing: weld, then reorder for the post-transform cache
+    ObjData obj;
+    loadObj(fileName, obj);
+    vector<vec3> positions, normals;
+    vector<vec2> texCoords;
+    vector<uint32_t> indices;
+    buildIndexedMesh(obj, positions, texCoords, normals, indices);
+    cout << "indexed: " << indices.size() << " corners -> " << positions.size() << " vertices, ACMR "
+         << std::setprecision(3) << averageCacheMissRatio(indices, positions.size()) << " welded, "
+         << averageCacheMissRatio(model.indices_, model.vertices_count()) << " reordered (3 without indexing)" << endl;
+    cout << "levels of detail:";
+    for (size_t i = 0; i < model.lods_.size(); ++i) {
+        cout << (i == 0 ? " " : ", ") << model.lods_[i].indices.size() / 3 << " triangles (error "
+             << std::setprecision(4) << model.lods_[i].error << ")";
+    }
+    cout << (model.lods_.empty() ? " none" : "") << endl;
+
+    // The two loops HW2 ran every frame, the centroid and then the farthest vertex from it,
+    // against the full bounds computed once on load
+    const vector<vec3>& vertices = model.vertices_;
+    vec3 centroid(0);
+    float centroidRadius = 0;
+    double scalarBoundsTime = measure(runsCount, [&]() { centroid = vec3(0); centroidRadius = 0; }, [&]() {
+        for (size_t i = 0; i < vertices.size(); ++i) {
+            centroid += vertices[i];
+        }
+        centroid /= float(vertices.size());
+        for (size_t i = 0; i < vertices.size(); ++i) {
+            centroidRadius = std::max(centroidRadius, glm::length(centroid - vertices[i]));
+        }
+    });
+    MeshBounds bounds;
+    double boundsTime = measure(runsCount, [](){}, [&]() {
+        bounds = computeMeshBounds(vertices);
+    });
+    bool isBoundsValid = glm::length(bounds.centroid - centroid) <= 1e-3f * bounds.centroidRadius;
+    for (size_t i = 0; isBoundsValid && i < vertices.size(); ++i) {
+        isBoundsValid = glm::length(vertices[i] - bounds.sphereCenter) <= bounds.sphereRadius * (1 + 1e-5f)
+                     && vertices[i] == glm::clamp(vertices[i], bounds.minimum, bounds.maximum);
+    }
+    cout << std::left << std::setw(16) << "bounds, frame" << std::right << std::setprecision(3) << std::setw(10) << scalarBoundsTime << " ms"
+         << "  centroid and radius, 2 scalar passes" << endl;
+    cout << std::left << std::setw(16) << "bounds, load" << std::right << std::setprecision(3) << std::setw(10) << boundsTime << " ms"
+         << "  box, centroid and sphere, once; sphere radius " << std::setprecision(4) << bounds.sphereRadius << " (" << centroidRadius << " around the centroid)"
+         << (isBoundsValid ? "" : "  MISMATCH") << endl;
+    if (difference < 0) {
+        // Expected for polygon meshes, the old loader kept the first three corners of every face
+        cout << "corner counts differ: " << expected.vertices_count() << " streams, " << model.indices_count() << " mapped" << endl;
+    }
+    else {
+        cout << "largest difference " << std::scientific << difference << endl;
+    }
+
+    if (modelFileName.empty()) {
+        std::remove(fileName.c_str());
+        std::remove(cacheFileName.c_str());
+    }
+    return difference > 1e-5f || !isCacheSame || !isBoundsValid ? 1 : 0;
+}
@@ -0,0 +1,18 @@
+#ifndef BENCHMARKS_H
+#define BENCHMARKS_H
+
+#include "common.h"
+
+// Command line benchmarks, run instead of the demo: main --bench-pixels [image],
+// main --bench-obj [model]
+// Each one prints its timings to stdout and returns the process exit code.
+
+// Times the pixel kernels at every supported level against the plain per-byte
+// loop they replaced; uses a random 4096x4096 image unless a file is given
+int runPixelKernelsBenchmark(const string& imageFileName);
+
+// Times Model::load against the getline and stringstream loader it replaced and
+// checks both read the same mesh; writes a large generated grid unless a file is given
+int runObjLoadBenchmark(const string& modelFileName);
+
+#endif //BENCHMARKS_H
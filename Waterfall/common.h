@@ -2,6 +2,7 @@
 #define COMMON_H
 
 #include <cstddef>
+#include <cstdint>
 
 #include <vector>
 using std::vector;
@@ -20,6 +21,7 @@ namespace chrono = std::chrono;
 #include <GL/glew.h>
 #include <GL/freeglut.h>
 #include <AntTweakBar.h>
+#include "glcounters.h"
 
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
@@ -0,0 +1,76 @@
+#include "frameconstants.h"
+#include <cstring>
+
+FrameConstantsBuffer::FrameConstantsBuffer()
+    : _buffer(0), _isCreated(false)
+{
+    constants.mView = mat4(1.0f);
+    constants.mProj = mat4(1.0f);
+    constants.quad1 = vec4(1.0f, 0.0f, 0.0f, 0.0f);
+    constants.quad2 = vec4(0.0f, 1.0f, 0.0f, 0.0f);
+    constants.time = 0.0f;
+    constants.timePassed = 0.0f;
+    constants.padding[0] = constants.padding[1] = 0.0f;
+}
+
+void FrameConstantsBuffer::createBuffer()
+{
+    if (_isCreated) {
+        return;
+    }
+
+    glGenBuffers(1, &_buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, _buffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameConstants), NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    // The binding never changes, programs only have to point their block at it
+    glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_CONSTANTS_BINDING, _buffer);
+    _isCreated = true;
+}
+
+void FrameConstantsBuffer::deleteBuffer()
+{
+    if (!_isCreated) {
+        return;
+    }
+
+    glDeleteBuffers(1, &_buffer);
+    _isCreated = false;
+}
+
+void FrameConstantsBuffer::setCamera(mat4 mProj, vec3 eye, vec3 viewCenter, vec3 upVector)
+{
+    constants.mProj = mProj;
+    constants.mView = lookAt(eye, viewCenter, upVector);
+
+    vec3 viewDirection = viewCenter - eye;
+    vec3 quad1 = cross(viewDirection, upVector);
+    vec3 quad2 = cross(quad1, viewDirection);
+    constants.quad1 = vec4(normalize(quad1), 0.0f);
+    constants.quad2 = vec4(normalize(quad2), 0.0f);
+}
+
+void FrameConstantsBuffer::advanceTime(float timePassed)
+{
+    constants.timePassed = timePassed;
+    constants.time += timePassed;
+}
+
+void FrameConstantsBuffer::update()
+{
+    if (!_isCreated) {
+        return;
+    }
+
+    glBindBuffer(GL_UNIFORM_BUFFER, _buffer);
+    // Invalidating the whole range orphans the previous storage,
+    // so the write never waits for draws still reading last frame's constants
+    void* data = glMapBufferRange(GL_UNIFORM_BUFFER, 0, sizeof(FrameConstants),
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (data != NULL) {
+        memcpy(data, &constants, sizeof(FrameConstants));
+        glUnmapBuffer(GL_UNIFORM_BUFFER);
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
@@ -0,0 +1,51 @@
+#ifndef FRAME_CONSTANTS_H
+#define FRAME_CONSTANTS_H
+
+#include "common.h"
+
+// Binding point of the FrameConstants uniform block, set on every WProgram at link time
+static const GLuint FRAME_CONSTANTS_BINDING = 0;
+static const char* const FRAME_CONSTANTS_BLOCK = "FrameConstants";
+
+// Mirrors the std140 layout of the FrameConstants block in the shaders:
+// vec3 values are stored as vec4 and the struct is padded to a multiple of 16 bytes.
+struct FrameConstants
+{
+    mat4  mView;
+    mat4  mProj;
+    vec4  quad1;
+    vec4  quad2;
+    float time;
+    float timePassed;
+    float padding[2];
+};
+
+static_assert(offsetof(FrameConstants, mView) == 0, "std140: mView offset");
+static_assert(offsetof(FrameConstants, mProj) == 64, "std140: mProj offset");
+static_assert(offsetof(FrameConstants, quad1) == 128, "std140: quad1 offset");
+static_assert(offsetof(FrameConstants, quad2) == 144, "std140: quad2 offset");
+static_assert(offsetof(FrameConstants, time) == 160, "std140: time offset");
+static_assert(offsetof(FrameConstants, timePassed) == 164, "std140: timePassed offset");
+static_assert(sizeof(FrameConstants) % 16 == 0, "std140: block size must be a multiple of vec4");
+
+class FrameConstantsBuffer
+{
+    GLuint _buffer;
+    bool _isCreated;
+
+public:
+    FrameConstants constants;
+
+    FrameConstantsBuffer();
+
+    void createBuffer();
+    void deleteBuffer();
+
+    void setCamera(mat4 mProj, vec3 eye, vec3 viewCenter, vec3 upVector);
+    void advanceTime(float timePassed);
+
+    // Uploads the constants once for all programs
+    void update();
+};
+
+#endif //FRAME_CONSTANTS_H
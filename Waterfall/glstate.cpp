@@ -0,0 +1,288 @@
+#include "glstate.h"
+
+GLStateCache gGLState;
+
+GLStateCache::GLStateCache()
+    : _isInitialized(false)
+{}
+
+GLStateCache::Capability GLStateCache::capabilityIndex(GLenum cap)
+{
+    switch (cap) {
+    case GL_BLEND:              return CAP_BLEND;
+    case GL_DEPTH_TEST:         return CAP_DEPTH_TEST;
+    case GL_CULL_FACE:          return CAP_CULL_FACE;
+    case GL_SCISSOR_TEST:       return CAP_SCISSOR_TEST;
+    case GL_LINE_SMOOTH:        return CAP_LINE_SMOOTH;
+    case GL_RASTERIZER_DISCARD: return CAP_RASTERIZER_DISCARD;
+    }
+    return CAP_COUNT;
+}
+
+GLenum GLStateCache::capabilityEnum(Capability cap)
+{
+    static const GLenum capabilities[CAP_COUNT] = {
+        GL_BLEND, GL_DEPTH_TEST, GL_CULL_FACE, GL_SCISSOR_TEST, GL_LINE_SMOOTH, GL_RASTERIZER_DISCARD
+    };
+    return capabilities[cap];
+}
+
+void GLStateCache::initialize()
+{
+    for (int i = 0; i < CAP_COUNT; ++i) {
+        _capabilities[i].update(glIsEnabled(capabilityEnum(Capability(i))) == GL_TRUE);
+    }
+
+    GLboolean depthMask;
+    glGetBooleanv(GL_DEPTH_WRITEMASK, &depthMask);
+    _depthMask.update(depthMask == GL_TRUE);
+
+    ivec2 blendFunc;
+    glGetIntegerv(GL_BLEND_SRC, &blendFunc.x);
+    glGetIntegerv(GL_BLEND_DST, &blendFunc.y);
+    _blendFunc.update(blendFunc);
+
+    vec4 clearColor;
+    glGetFloatv(GL_COLOR_CLEAR_VALUE, value_ptr(clearColor));
+    _clearColor.update(clearColor);
+
+    float value;
+    glGetFloatv(GL_DEPTH_CLEAR_VALUE, &value);
+    _clearDepth.update(value);
+    glGetFloatv(GL_LINE_WIDTH, &value);
+    _lineWidth.update(value);
+
+    ivec4 box;
+    glGetIntegerv(GL_VIEWPORT, value_ptr(box));
+    _viewport.update(box);
+    glGetIntegerv(GL_SCISSOR_BOX, value_ptr(box));
+    _scissorBox.update(box);
+
+    GLint name;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &name);
+    _program.update(name);
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &name);
+    _vertexArray.update(name);
+    _vertexAttribArrays.clear();
+
+    GLint activeTexture;
+    glGetIntegerv(GL_ACTIVE_TEXTURE, &activeTexture);
+    for (int i = 0; i < MAX_TEXTURE_UNITS; ++i) {
+        glActiveTexture(GL_TEXTURE0 + i);
+        glGetIntegerv(GL_TEXTURE_BINDING_2D, &name);
+        _textures2D[i].update(name);
+    }
+    glActiveTexture(activeTexture);
+    _activeTexture.update(activeTexture);
+
+    _isInitialized = true;
+}
+
+void GLStateCache::resync()
+{
+    initialize();
+}
+
+void GLStateCache::enable(GLenum cap)
+{
+    setEnabled(cap, true);
+}
+
+void GLStateCache::disable(GLenum cap)
+{
+    setEnabled(cap, false);
+}
+
+void GLStateCache::setEnabled(GLenum cap, bool enabled)
+{
+    Capability index = capabilityIndex(cap);
+    if (index != CAP_COUNT && !_capabilities[index].update(enabled)) {
+        return;
+    }
+
+    if (enabled) {
+        glEnable(cap);
+    }
+    else {
+        glDisable(cap);
+    }
+}
+
+bool GLStateCache::isEnabled(GLenum cap)
+{
+    Capability index = capabilityIndex(cap);
+    if (index == CAP_COUNT || !_capabilities[index].isKnown) {
+        return glIsEnabled(cap) == GL_TRUE;
+    }
+    return _capabilities[index].value;
+}
+
+void GLStateCache::depthMask(bool enabled)
+{
+    if (_depthMask.update(enabled)) {
+        glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+    }
+}
+
+void GLStateCache::blendFunc(GLenum sfactor, GLenum dfactor)
+{
+    if (_blendFunc.update(ivec2(sfactor, dfactor))) {
+        glBlendFunc(sfactor, dfactor);
+    }
+}
+
+void GLStateCache::clearColor(float r, float g, float b, float a)
+{
+    if (_clearColor.update(vec4(r, g, b, a))) {
+        glClearColor(r, g, b, a);
+    }
+}
+
+void GLStateCache::clearDepth(float depth)
+{
+    if (_clearDepth.update(depth)) {
+        glClearDepth(depth);
+    }
+}
+
+void GLStateCache::lineWidth(float width)
+{
+    if (_lineWidth.update(width)) {
+        glLineWidth(width);
+    }
+}
+
+void GLStateCache::viewport(int x, int y, int width, int height)
+{
+    if (_viewport.update(ivec4(x, y, width, height))) {
+        glViewport(x, y, width, height);
+    }
+}
+
+void GLStateCache::scissor(int x, int y, int width, int height)
+{
+    if (_scissorBox.update(ivec4(x, y, width, height))) {
+        glScissor(x, y, width, height);
+    }
+}
+
+void GLStateCache::useProgram(GLuint program)
+{
+    if (_program.update(program)) {
+        glUseProgram(program);
+    }
+}
+
+void GLStateCache::bindVertexArray(GLuint vertexArray)
+{
+    if (_vertexArray.update(vertexArray)) {
+        glBindVertexArray(vertexArray);
+    }
+}
+
+void GLStateCache::setVertexAttribArrays(uint32_t mask)
+{
+    if (!_vertexArray.isKnown) {
+        _vertexArray.update(0);
+        glBindVertexArray(0);
+    }
+
+    Shadowed<uint32_t>& enabled = _vertexAttribArrays[_vertexArray.value];
+    uint32_t changed = enabled.isKnown ? (enabled.value ^ mask) : ~0u;
+    if (!enabled.update(mask)) {
+        return;
+    }
+
+    for (int i = 0; i < MAX_VERTEX_ATTRIBS; ++i) {
+        if (!(changed & (1u << i))) {
+            continue;
+        }
+        if (mask & (1u << i)) {
+            glEnableVertexAttribArray(i);
+        }
+        else {
+            glDisableVertexAttribArray(i);
+        }
+    }
+}
+
+void GLStateCache::activeTexture(GLenum texture)
+{
+    if (_activeTexture.update(texture)) {
+        glActiveTexture(texture);
+    }
+}
+
+void GLStateCache::bindTexture2D(GLuint texture)
+{
+    if (!_activeTexture.isKnown) {
+        activeTexture(GL_TEXTURE0);
+    }
+
+    int unit = _activeTexture.value - GL_TEXTURE0;
+    if (unit >= MAX_TEXTURE_UNITS) {
+        glBindTexture(GL_TEXTURE_2D, texture);
+        return;
+    }
+
+    if (_textures2D[unit].update(texture)) {
+        glBindTexture(GL_TEXTURE_2D, texture);
+    }
+}
+
+void GLStateCache::forgetTexture(GLuint texture)
+{
+    // Deleting a texture unbinds it from every unit
+    for (int i = 0; i < MAX_TEXTURE_UNITS; ++i) {
+        if (_textures2D[i].value == texture) {
+            _textures2D[i].update(0);
+        }
+    }
+}
+
+void GLStateCache::forgetVertexArray(GLuint vertexArray)
+{
+    _vertexAttribArrays.erase(vertexArray);
+    if (_vertexArray.value == vertexArray) {
+        _vertexArray.update(0);
+    }
+}
+
+GLuint GLStateCache::currentProgram()
+{
+    return _program.value;
+}
+
+GLuint GLStateCache::boundTexture2D()
+{
+    int unit = _activeTexture.value - GL_TEXTURE0;
+    return unit >= 0 && unit < MAX_TEXTURE_UNITS ? _textures2D[unit].value : 0;
+}
+
+#ifdef TW_GL_STATE_SHADOW
+void GLStateCache::exportState(TwGLState& state)
+{
+    if (!_isInitialized) {
+        initialize();
+    }
+
+    for (int i = 0; i < 4; ++i) {
+        state.Viewport[i] = _viewport.value[i];
+        state.ScissorBox[i] = _scissorBox.value[i];
+    }
+    state.VertexArray = _vertexArray.value;
+    state.LineWidth = _lineWidth.value;
+    state.LineSmooth = _capabilities[CAP_LINE_SMOOTH].value;
+    state.CullFace = _capabilities[CAP_CULL_FACE].value;
+    state.DepthTest = _capabilities[CAP_DEPTH_TEST].value;
+    state.Blend = _capabilities[CAP_BLEND].value;
+    state.ScissorTest = _capabilities[CAP_SCISSOR_TEST].value;
+    state.BlendSrc = _blendFunc.value.x;
+    state.BlendDst = _blendFunc.value.y;
+    state.ActiveTexture = _activeTexture.value;
+    int unit = _activeTexture.value - GL_TEXTURE0;
+    state.Texture2D = unit < MAX_TEXTURE_UNITS ? _textures2D[unit].value : 0;
+    state.Texture2DUnit0 = _textures2D[0].value;
+    state.Program = _program.value;
+}
+#endif
@@ -0,0 +1,113 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include "common.h"
+#include <map>
+
+// Shadow copy of the GL render state. State changes go through it and only
+// reach the driver when the value actually changes; reads never call glGet*.
+// Anything that changes state behind its back (e.g. a library without
+// TwSetGLStateShadow support) must be followed by resync().
+class GLStateCache
+{
+public:
+    static const int MAX_TEXTURE_UNITS = 16;
+    static const int MAX_VERTEX_ATTRIBS = 16;
+
+private:
+    enum Capability
+    {
+        CAP_BLEND,
+        CAP_DEPTH_TEST,
+        CAP_CULL_FACE,
+        CAP_SCISSOR_TEST,
+        CAP_LINE_SMOOTH,
+        CAP_RASTERIZER_DISCARD,
+        CAP_COUNT
+    };
+
+    // A value is known once it has been set through the cache or read by initialize()
+    template <typename T>
+    struct Shadowed
+    {
+        T value;
+        bool isKnown;
+
+        Shadowed() : value(), isKnown(false) {}
+
+        // Returns true when the driver has to be called
+        bool update(const T& newValue)
+        {
+            if (isKnown && value == newValue) {
+                return false;
+            }
+            value = newValue;
+            isKnown = true;
+            return true;
+        }
+    };
+
+    bool _isInitialized;
+
+    Shadowed<bool> _capabilities[CAP_COUNT];
+    Shadowed<bool> _depthMask;
+    Shadowed<ivec2> _blendFunc;
+    Shadowed<vec4> _clearColor;
+    Shadowed<float> _clearDepth;
+    Shadowed<float> _lineWidth;
+    Shadowed<ivec4> _viewport;
+    Shadowed<ivec4> _scissorBox;
+    Shadowed<GLuint> _program;
+    Shadowed<GLuint> _vertexArray;
+    Shadowed<GLenum> _activeTexture;
+    Shadowed<GLuint> _textures2D[MAX_TEXTURE_UNITS];
+
+    // Enabled vertex attribute arrays of every vertex array object, one bit per attribute
+    std::map<GLuint, Shadowed<uint32_t> > _vertexAttribArrays;
+
+    static Capability capabilityIndex(GLenum cap);
+    static GLenum capabilityEnum(Capability cap);
+
+public:
+    GLStateCache();
+
+    // Reads the current GL state once; needs a current context
+    void initialize();
+    // Reads the state again after it was changed behind the cache's back
+    void resync();
+
+    void enable(GLenum cap);
+    void disable(GLenum cap);
+    void setEnabled(GLenum cap, bool enabled);
+    bool isEnabled(GLenum cap);
+
+    void depthMask(bool enabled);
+    void blendFunc(GLenum sfactor, GLenum dfactor);
+    void clearColor(float r, float g, float b, float a);
+    void clearDepth(float depth);
+    void lineWidth(float width);
+    void viewport(int x, int y, int width, int height);
+    void scissor(int x, int y, int width, int height);
+
+    void useProgram(GLuint program);
+    void bindVertexArray(GLuint vertexArray);
+    // Enables exactly the attributes in the mask on the bound vertex array
+    void setVertexAttribArrays(uint32_t mask);
+    void activeTexture(GLenum texture);
+    void bindTexture2D(GLuint texture);
+    // Forgets a deleted object so a recycled name is bound again
+    void forgetTexture(GLuint texture);
+    void forgetVertexArray(GLuint vertexArray);
+
+    GLuint currentProgram();
+    GLuint boundTexture2D();
+
+#ifdef TW_GL_STATE_SHADOW
+    // Hands the shadowed state to AntTweakBar so TwDraw doesn't have to query it
+    void exportState(TwGLState& state);
+#endif
+};
+
+extern GLStateCache gGLState;
+
+#endif //GL_STATE_H
@@ -210,6 +210,45 @@ TW_API int      TW_CALL TwSetCurrentWindow(int windowID); // multi-windows suppo
 TW_API int      TW_CALL TwGetCurrentWindow();
 TW_API int      TW_CALL TwWindowExists(int windowID);
 
+// OpenGL state shadowed by the application (TW_OPENGL_CORE only).
+// When set, TwDraw takes the state to restore from it instead of glGet* queries;
+// the application must keep it up to date. Pass NULL to query again.
+typedef struct CTwGLState
+{
+    int         Viewport[4];
+    int         VertexArray;
+    float       LineWidth;
+    int         LineSmooth;
+    int         CullFace;
+    int         DepthTest;
+    int         Blend;
+    int         ScissorTest;
+    int         ScissorBox[4];
+    int         BlendSrc;
+    int         BlendDst;
+    int         Texture2D;      // bound to ActiveTexture
+    int         Program;
+    int         ActiveTexture;  // GL_TEXTURE0 + unit
+    int         Texture2DUnit0; // bound to GL_TEXTURE0, which the bars are drawn with
+} TwGLState;
+
+#define TW_GL_STATE_SHADOW
+TW_API int      TW_CALL TwSetGLStateShadow(const TwGLState *state);
+
+// Lets the application wrap the OpenGL functions used by the TW_OPENGL_CORE
+// backend (e.g. to count calls). The hook gets each function name with the
+// loaded entry point and returns the one to use. Must be set before TwInit.
+typedef void * (TW_CALL * TwGLProcHook)(const char *name, void *proc);
+#define TW_GL_PROC_HOOK
+TW_API int      TW_CALL TwSetGLProcHook(TwGLProcHook hook);
+
+// Reports the time spent in TwDraw and in bar updates to the application's
+// profiler. Zones nest and are always ended on the thread that began them.
+typedef void (TW_CALL * TwProfileZoneBeginCallback)(const char *zoneName);
+typedef void (TW_CALL * TwProfileZoneEndCallback)();
+#define TW_PROFILE_ZONES
+TW_API int      TW_CALL TwSetProfileZoneCallbacks(TwProfileZoneBeginCallback beginZone, TwProfileZoneEndCallback endZone);
+
 typedef enum ETwKeyModifier
 {
     TW_KMOD_NONE        = 0x0000,   // same codes as SDL keysym.mod
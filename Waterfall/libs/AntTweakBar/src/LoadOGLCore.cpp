@@ -9,6 +9,7 @@
 
 
 #include "TwPrecomp.h"
+#include <AntTweakBar.h>
 #include "LoadOGLCore.h"
 
 //  ---------------------------------------------------------------------------
@@ -26,6 +27,33 @@ int g_NbOGLCoreFunc = 0;
 #if defined(ANT_WINDOWS)
 HMODULE g_OGLCoreModule = NULL;
 #endif
+TwGLProcHook g_OGLCoreProcHook = NULL;
+
+int TW_CALL TwSetGLProcHook(TwGLProcHook _Hook)
+{
+    g_OGLCoreProcHook = _Hook;
+    return 1;
+}
+
+//  ---------------------------------------------------------------------------
+
+static void HookOpenGLCoreFunc(const char *_FuncName, GLCore::PFNOpenGL *_FuncPtr)
+{
+    if( g_OGLCoreProcHook!=NULL && *_FuncPtr!=NULL )
+        *_FuncPtr = reinterpret_cast<GLCore::PFNOpenGL>(g_OGLCoreProcHook(_FuncName, reinterpret_cast<void *>(*_FuncPtr)));
+}
+
+static void HookOpenGLCore()
+{
+    for(int i=0; i<g_NbOGLCoreFunc; ++i)
+        HookOpenGLCoreFunc(g_OGLCoreFuncRec[i].m_Name, g_OGLCoreFuncRec[i].m_FuncPtr);
+#if !defined(ANT_WINDOWS)
+    HookOpenGLCoreFunc("glBindVertexArray", reinterpret_cast<GLCore::PFNOpenGL *>(&_glBindVertexArray));
+    HookOpenGLCoreFunc("glDeleteVertexArrays", reinterpret_cast<GLCore::PFNOpenGL *>(&_glDeleteVertexArrays));
+    HookOpenGLCoreFunc("glGenVertexArrays", reinterpret_cast<GLCore::PFNOpenGL *>(&_glGenVertexArrays));
+    HookOpenGLCoreFunc("glIsVertexArray", reinterpret_cast<GLCore::PFNOpenGL *>(&_glIsVertexArray));
+#endif
+}
 
 //  ---------------------------------------------------------------------------
 
@@ -380,6 +408,8 @@ namespace GLCore { PFNGLGetProcAddress _glGetProcAddress = NULL; }
         
                 }
 
+            if( Res )
+                HookOpenGLCore();
             return Res;
         }
         else
@@ -422,29 +452,29 @@ namespace GLCore { PFNGLGetProcAddress _glGetProcAddress = NULL; }
     
     //  ---------------------------------------------------------------------------
     
-    namespace GLCore
+#endif // defined(ANT_WINDOWS)
+
+//  ---------------------------------------------------------------------------
+
+namespace GLCore
+{
+
+    PFNOpenGL Record(const char *_FuncName, PFNOpenGL *_FuncPtr)
     {
-    
-        PFNOpenGL Record(const char *_FuncName, PFNOpenGL *_FuncPtr)
+        if( g_NbOGLCoreFunc>=ANT_NB_OGL_CORE_FUNC_MAX )
         {
-            if( g_NbOGLCoreFunc>=ANT_NB_OGL_CORE_FUNC_MAX )
-            {
-                fprintf(stderr, "Too many OpenGL Core functions declared. Change ANT_NB_OGL_CORE_FUNC_MAX.");
-                exit(-1);
-            }
-    
-            g_OGLCoreFuncRec[g_NbOGLCoreFunc].m_Name = _FuncName;
-            g_OGLCoreFuncRec[g_NbOGLCoreFunc].m_FuncPtr = _FuncPtr;
-            ++g_NbOGLCoreFunc;
-    
-            return NULL;
+            fprintf(stderr, "Too many OpenGL Core functions declared. Change ANT_NB_OGL_CORE_FUNC_MAX.");
+            exit(-1);
         }
-    
-    } // namespace GL
-    
-    //  ---------------------------------------------------------------------------
 
-#endif // defined(ANT_WINDOWS)
+        g_OGLCoreFuncRec[g_NbOGLCoreFunc].m_Name = _FuncName;
+        g_OGLCoreFuncRec[g_NbOGLCoreFunc].m_FuncPtr = _FuncPtr;
+        ++g_NbOGLCoreFunc;
+
+        return NULL;
+    }
+
+} // namespace GL
 
 //  ---------------------------------------------------------------------------
 
@@ -465,7 +495,10 @@ namespace GLCore { PFNGLGetProcAddress _glGetProcAddress = NULL; }
             return 0;
         }
         else
+        {
+            HookOpenGLCore();
             return 1;
+        }
     }
     
     int UnloadOpenGLCore()
@@ -521,6 +554,7 @@ namespace GLCore { PFNGLGetProcAddress _glGetProcAddress = NULL; }
 			}
         }
         
+        HookOpenGLCore();
         return 1;
     }
 
@@ -33,7 +33,7 @@
         ANT_GL_CORE_DECL_NO_FORWARD(_Ret, _Fct, _Params) \
         extern "C" { _Ret APIENTRY _Fct _Params; }
 #   define ANT_GL_CORE_IMPL(_Fct) \
-        namespace GLCore { PFN##_Fct _##_Fct = _Fct; }
+        namespace GLCore { PFN##_Fct _##_Fct = (Record(#_Fct, (PFNOpenGL*)(&_##_Fct)), _Fct); }
 #endif
 
 
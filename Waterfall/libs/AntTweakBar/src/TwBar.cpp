@@ -4312,6 +4312,7 @@ static int ClampText(string& _Text, const CTexFont *_Font, int _WidthMax)
 
 void CTwBar::Update()
 {
+    CTwProfileZone ProfileZone("CTwBar::Update");
     assert(m_UpToDate==false);
     assert(m_Font);
     ITwGraph *Gr = g_TwMgr->m_Graph;
@@ -35,6 +35,8 @@ using namespace std;
 CTwMgr *g_TwMgr = NULL; // current TwMgr
 bool g_BreakOnError = false;
 TwErrorHandler g_ErrorHandler = NULL;
+TwProfileZoneBeginCallback g_ProfileZoneBegin = NULL;
+TwProfileZoneEndCallback g_ProfileZoneEnd = NULL;
 int g_TabLength = 4;
 CTwBar * const TW_GLOBAL_BAR = (CTwBar *)(-1);
 int g_InitWndWidth = -1;
@@ -2059,8 +2061,18 @@ int ANT_CALL TwWindowExists(int wndID)
 
 //  ---------------------------------------------------------------------------
 
+int ANT_CALL TwSetProfileZoneCallbacks(TwProfileZoneBeginCallback _BeginZone, TwProfileZoneEndCallback _EndZone)
+{
+    g_ProfileZoneBegin = _BeginZone;
+    g_ProfileZoneEnd = _EndZone;
+    return 1;
+}
+
+//  ---------------------------------------------------------------------------
+
 int ANT_CALL TwDraw()
 {
+    CTwProfileZone ProfileZone("TwDraw");
     PERF( PerfTimer Timer; double DT; )
     //CTwFPU fpu;   // fpu precision only forced in update (do not modif dx draw calls)
 
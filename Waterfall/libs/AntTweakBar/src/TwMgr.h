@@ -331,6 +331,17 @@ protected:
 
 extern CTwMgr *g_TwMgr;
 
+extern TwProfileZoneBeginCallback g_ProfileZoneBegin;
+extern TwProfileZoneEndCallback g_ProfileZoneEnd;
+
+// Scoped zone reported through TwSetProfileZoneCallbacks
+struct CTwProfileZone
+{
+    TwProfileZoneEndCallback m_End;
+    CTwProfileZone(const char *_Name) : m_End(g_ProfileZoneEnd) { if( g_ProfileZoneBegin!=NULL && m_End!=NULL ) g_ProfileZoneBegin(_Name); else m_End = NULL; }
+    ~CTwProfileZone() { if( m_End!=NULL ) m_End(); }
+};
+
 
 //  ---------------------------------------------------------------------------
 //  Extra functions and TwTypes
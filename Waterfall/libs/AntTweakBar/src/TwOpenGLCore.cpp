@@ -28,6 +28,14 @@ using namespace std;
 extern const char *g_ErrCantLoadOGL;
 extern const char *g_ErrCantUnloadOGL;
 
+static const TwGLState *g_GLStateShadow = NULL;
+
+int ANT_CALL TwSetGLStateShadow(const TwGLState *_State)
+{
+    g_GLStateShadow = _State;
+    return 1;
+}
+
 //  ---------------------------------------------------------------------------
 
 #ifdef _DEBUG
@@ -403,7 +411,11 @@ void CTwGraphOpenGLCore::BeginDraw(int _WndWidth, int _WndHeight)
     m_OffsetX = 0;
     m_OffsetY = 0;
 
-    _glGetIntegerv(GL_VIEWPORT, m_PrevViewport); CHECK_GL_ERROR;
+    if( g_GLStateShadow!=NULL )
+        LoadPrevStateFromShadow(*g_GLStateShadow);
+    else
+        QueryPrevState();
+
     if( _WndWidth>0 && _WndHeight>0 )
     {
         GLint Vp[4];
@@ -414,49 +426,83 @@ void CTwGraphOpenGLCore::BeginDraw(int _WndWidth, int _WndHeight)
         _glViewport(Vp[0], Vp[1], Vp[2], Vp[3]);
     }
 
+    _glBindVertexArray(0); CHECK_GL_ERROR;
+    _glLineWidth(1); CHECK_GL_ERROR;
+    _glDisable(GL_LINE_SMOOTH); CHECK_GL_ERROR;
+    _glDisable(GL_CULL_FACE); CHECK_GL_ERROR;
+    _glDisable(GL_DEPTH_TEST); CHECK_GL_ERROR;
+    _glEnable(GL_BLEND); CHECK_GL_ERROR;
+    _glDisable(GL_SCISSOR_TEST); CHECK_GL_ERROR;
+    _glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA); CHECK_GL_ERROR;
+    _glBindTexture(GL_TEXTURE_2D, 0); CHECK_GL_ERROR;
+    _glUseProgram(0); CHECK_GL_ERROR;  
+    _glActiveTexture(GL_TEXTURE0);
+
+    CHECK_GL_ERROR;
+}
+
+//  ---------------------------------------------------------------------------
+
+void CTwGraphOpenGLCore::QueryPrevState()
+{
+    _glGetIntegerv(GL_VIEWPORT, m_PrevViewport); CHECK_GL_ERROR;
+
     m_PrevVArray = 0;
     _glGetIntegerv(GL_VERTEX_ARRAY_BINDING, (GLint*)&m_PrevVArray); CHECK_GL_ERROR;
-    _glBindVertexArray(0); CHECK_GL_ERROR;
 
     m_PrevLineWidth = 1;
     _glGetFloatv(GL_LINE_WIDTH, &m_PrevLineWidth); CHECK_GL_ERROR;
-    _glLineWidth(1); CHECK_GL_ERROR;
 
     m_PrevLineSmooth = _glIsEnabled(GL_LINE_SMOOTH);
-    _glDisable(GL_LINE_SMOOTH); CHECK_GL_ERROR;
-
     m_PrevCullFace = _glIsEnabled(GL_CULL_FACE);
-    _glDisable(GL_CULL_FACE); CHECK_GL_ERROR;
-    
     m_PrevDepthTest = _glIsEnabled(GL_DEPTH_TEST);
-    _glDisable(GL_DEPTH_TEST); CHECK_GL_ERROR;
-
     m_PrevBlend = _glIsEnabled(GL_BLEND);
-    _glEnable(GL_BLEND); CHECK_GL_ERROR;
-
     m_PrevScissorTest = _glIsEnabled(GL_SCISSOR_TEST);
-    _glDisable(GL_SCISSOR_TEST); CHECK_GL_ERROR;
-
     _glGetIntegerv(GL_SCISSOR_BOX, m_PrevScissorBox); CHECK_GL_ERROR;
 
     _glGetIntegerv(GL_BLEND_SRC, &m_PrevSrcBlend); CHECK_GL_ERROR;
     _glGetIntegerv(GL_BLEND_DST, &m_PrevDstBlend); CHECK_GL_ERROR;
-    _glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA); CHECK_GL_ERROR;
 
     m_PrevTexture = 0;
     _glGetIntegerv(GL_TEXTURE_BINDING_2D, &m_PrevTexture); CHECK_GL_ERROR;
-    _glBindTexture(GL_TEXTURE_2D, 0); CHECK_GL_ERROR;
 
     m_PrevProgramObject = 0;
     _glGetIntegerv(GL_CURRENT_PROGRAM, (GLint*)&m_PrevProgramObject); CHECK_GL_ERROR;
-    _glBindVertexArray(0); CHECK_GL_ERROR;
-    _glUseProgram(0); CHECK_GL_ERROR;  
 
     m_PrevActiveTexture = 0;
     _glGetIntegerv(GL_ACTIVE_TEXTURE, (GLint*)&m_PrevActiveTexture); CHECK_GL_ERROR;
-    _glActiveTexture(GL_TEXTURE0);
 
-    CHECK_GL_ERROR;
+    m_PrevTexture0 = m_PrevTexture;
+    if( m_PrevActiveTexture!=GL_TEXTURE0 )
+    {
+        _glActiveTexture(GL_TEXTURE0); CHECK_GL_ERROR;
+        _glGetIntegerv(GL_TEXTURE_BINDING_2D, &m_PrevTexture0); CHECK_GL_ERROR;
+        _glActiveTexture(m_PrevActiveTexture); CHECK_GL_ERROR;
+    }
+}
+
+//  ---------------------------------------------------------------------------
+
+void CTwGraphOpenGLCore::LoadPrevStateFromShadow(const TwGLState& _State)
+{
+    for( int i=0; i<4; ++i )
+    {
+        m_PrevViewport[i] = _State.Viewport[i];
+        m_PrevScissorBox[i] = _State.ScissorBox[i];
+    }
+    m_PrevVArray = _State.VertexArray;
+    m_PrevLineWidth = _State.LineWidth;
+    m_PrevLineSmooth = _State.LineSmooth ? GL_TRUE : GL_FALSE;
+    m_PrevCullFace = _State.CullFace ? GL_TRUE : GL_FALSE;
+    m_PrevDepthTest = _State.DepthTest ? GL_TRUE : GL_FALSE;
+    m_PrevBlend = _State.Blend ? GL_TRUE : GL_FALSE;
+    m_PrevScissorTest = _State.ScissorTest ? GL_TRUE : GL_FALSE;
+    m_PrevSrcBlend = _State.BlendSrc;
+    m_PrevDstBlend = _State.BlendDst;
+    m_PrevTexture = _State.Texture2D;
+    m_PrevProgramObject = _State.Program;
+    m_PrevActiveTexture = _State.ActiveTexture;
+    m_PrevTexture0 = _State.Texture2DUnit0;
 }
 
 //  ---------------------------------------------------------------------------
@@ -517,6 +563,10 @@ void CTwGraphOpenGLCore::EndDraw()
 
     _glBlendFunc(m_PrevSrcBlend, m_PrevDstBlend); CHECK_GL_ERROR;
 
+    // Fonts were bound to unit 0, the previous texture to the previously active unit
+    _glActiveTexture(GL_TEXTURE0); CHECK_GL_ERROR;
+    _glBindTexture(GL_TEXTURE_2D, m_PrevTexture0); CHECK_GL_ERROR;
+    _glActiveTexture(m_PrevActiveTexture); CHECK_GL_ERROR;
     _glBindTexture(GL_TEXTURE_2D, m_PrevTexture); CHECK_GL_ERROR;
 
     _glUseProgram(m_PrevProgramObject); CHECK_GL_ERROR;
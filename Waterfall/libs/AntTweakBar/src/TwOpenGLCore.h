@@ -50,6 +50,7 @@ protected:
     GLfloat             m_PrevLineWidth;
     GLint               m_PrevActiveTexture;
     GLint               m_PrevTexture;
+    GLint               m_PrevTexture0;
     GLint               m_PrevVArray;
     GLboolean           m_PrevLineSmooth;
     GLboolean           m_PrevCullFace;
@@ -113,6 +114,8 @@ protected:
         std::vector<color32>m_BgColors;
     };
     void                ResizeTriBuffers(size_t _NewSize);
+    void                QueryPrevState();
+    void                LoadPrevStateFromShadow(const struct CTwGLState& _State);
 };
 
 //  ---------------------------------------------------------------------------
@@ -1,5 +1,10 @@
 #include "common.h"
 #include "waterfallprogram.h"
+#include "benchmarks.h"
+#include "glstate.h"
+#include "profiler.h"
+#include "texturecontainer.h"
+#include "textureloader.h"
 #include <iostream>
 #include <cstring>
 #include <iostream>
@@ -12,13 +17,74 @@ using std::ifstream;
 
 std::unique_ptr<WaterfallProgram> gWaterfallProgram;
 
-void displayFunc()
+#ifdef TW_GL_STATE_SHADOW
+TwGLState gTwGLState;
+#endif
+
+// Chrome trace written on exit when started with --trace <file>
+string gTraceFileName;
+// Chosen with --sprites layers|sheet|packed
+SpriteSource gSpriteSource = SPRITES_LAYERS;
+
+void saveTrace()
 {
-    gWaterfallProgram->drawFrame();
+    if (gTraceFileName.empty()) {
+        return;
+    }
+
+    gProfiler.stop();
+    if (!gProfiler.writeChromeTrace(gTraceFileName)) {
+        std::cerr << "Can't write trace: " << gTraceFileName << std::endl;
+    }
+    gTraceFileName.clear();
+}
 
-    TwDraw();
+// Offline conversion: main --convert-texture <image> [rgba8|bc1|bc3]
+// writes the container TextureAtlas picks up instead of the image
+int convertTexture(const string& imageFileName, const string& formatName)
+{
+    TextureContainerFormat format;
+    if (!TextureContainer::parseFormat(formatName, format)) {
+        std::cerr << "Unknown texture container format: " << formatName << std::endl;
+        return 1;
+    }
 
-    glutSwapBuffers();
+    try {
+        DecodedImage image;
+        TextureLoader::decode(imageFileName, image);
+        TextureContainer::write(TextureContainer::containerFileName(imageFileName), image, format);
+    }
+    catch (std::exception const& except) {
+        std::cerr << except.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+void displayFunc()
+{
+    {
+        PROFILE_SCOPE("frame");
+
+        gWaterfallProgram->drawFrame();
+
+        {
+            static const int subsystem = gGLCounters.subsystem("anttweakbar");
+            GLCounterScope counterScope(subsystem);
+            // Covers the state export too; AntTweakBar's own zones nest inside
+            PROFILE_SCOPE("anttweakbar");
+#ifdef TW_GL_STATE_SHADOW
+            gGLState.exportState(gTwGLState);
+#endif
+            TwDraw();
+        }
+
+        PROFILE_SCOPE("glutSwapBuffers");
+        glutSwapBuffers();
+    }
+
+    gGLCounters.endFrame();
+    gProfiler.collect();
 }
 
 void idleFunc()
@@ -34,6 +100,7 @@ void keyboardFunc(unsigned char button, int x, int y)
 
     switch (button) {
     case 27:
+        saveTrace();
         exit(0);
     }
 }
@@ -43,13 +110,14 @@ void reshapeFunc(int width, int height)
     if (width <= 0 || height <= 0) {
         return;
     }
-    glViewport(0, 0, width, height);
+    gGLState.viewport(0, 0, width, height);
     TwWindowSize(width, height);
 }
 
 void closeFunc()
 {
     gWaterfallProgram.reset();
+    saveTrace();
 }
 
 int main(int argc, char** argv)
@@ -58,10 +126,30 @@ int main(int argc, char** argv)
 
     srand(time(NULL));
 
+    if (argc > 1 && strcmp(argv[1], "--bench-pixels") == 0) {
+        return runPixelKernelsBenchmark(argc > 2 ? argv[2] : "");
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-obj") == 0) {
+        return runObjLoadBenchmark(argc > 2 ? argv[2] : "");
+    }
+    if (argc > 2 && strcmp(argv[1], "--convert-texture") == 0) {
+        return convertTexture(argv[2], argc > 3 ? argv[3] : "rgba8");
+    }
+
     size_t const default_width = 1024;
     size_t const default_height = 1024;
 
     glutInit(&argc, argv);
+
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (strcmp(argv[i], "--trace") == 0) {
+            gTraceFileName = argv[i + 1];
+        }
+        if (strcmp(argv[i], "--sprites") == 0 && !WaterfallProgram::parseSpriteSource(argv[i + 1], gSpriteSource)) {
+            std::cerr << "Unknown sprite source: " << argv[i + 1] << std::endl;
+            return 1;
+        }
+    }
     glutInitWindowSize(default_width, default_height);
     glutInitDisplayMode(GLUT_RGB | GLUT_DOUBLE | GLUT_DEPTH);
     glutInitContextVersion(3, 0);
@@ -89,8 +177,28 @@ int main(int argc, char** argv)
     glutSpecialFunc((GLUTspecialfun)TwEventSpecialGLUT);
     TwGLUTModifiersFunc(glutGetModifiers);
 
+#ifdef GL_COUNTERS
+    gGLCounters.install();
+    gGLCounters.openLog("glcounters.csv");
+#ifdef TW_GL_PROC_HOOK
+    TwSetGLProcHook(glCountersProcHook);
+#endif
+#endif
+
+    gGLState.initialize();
+
+    if (!gTraceFileName.empty()) {
+        gProfiler.start();
+#ifdef TW_PROFILE_ZONES
+        TwSetProfileZoneCallbacks(profilerBeginTwZone, profilerEndTwZone);
+#endif
+    }
+#ifdef TW_GL_STATE_SHADOW
+    TwSetGLStateShadow(&gTwGLState);
+#endif
+
     try {
-        gWaterfallProgram.reset(new WaterfallProgram());
+        gWaterfallProgram.reset(new WaterfallProgram(gSpriteSource));
         glutMainLoop();
     }
     catch (std::exception const& except) {
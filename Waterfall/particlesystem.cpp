@@ -1,6 +1,10 @@
 #include "particlesystem.h"
 #include "common.h"
 #include "utils.h"
+#include "glstate.h"
+#include "profiler.h"
+#include <algorithm>
+#include <sstream>
 
 size_t Particle::serializedSize()
 {
@@ -17,6 +21,7 @@ size_t Particle::serializedSize()
         + sizeof(GLfloat)  // minSize
         + sizeof(GLfloat)  // maxSize
         + sizeof(GLfloat)  // opacity
+        + sizeof(GLfloat)  // layer
         ;
 
     return serializedSize;
@@ -38,31 +43,89 @@ size_t Particle::serialize(GLfloat* buf)
     index += serializeGLfloat(buf + index, minSize);
     index += serializeGLfloat(buf + index, maxSize);
     index += serializeGLfloat(buf + index, opacity);
+    index += serializeGLfloat(buf + index, layer);
 
     assert(index == PARTICLE_SERIALIZED_GLFLOAT_COUNT);
     return index;
 }
 
+ParticleEmitter::ParticleEmitter()
+    : minLifeTime(0), maxLifeTime(0)
+    , minSize(0), maxSize(0)
+    , opacity(1)
+    , particlesCount(0)
+    , layer(0)
+{
+}
+
 ParticleSystem::ParticleSystem()
     : _isInitialized(false)
     , _maxParticlesCount(0)
     , _particlesDataSize(0)
     , _particlesData(NULL)
+    , _texture(&_packedTexture)
+    , _textureManager(NULL)
+    , fadeEnabled(true)
+    , additiveBlend(true)
 {
 }
 
 ParticleSystem::~ParticleSystem()
 {
+    releaseTextures();
     if (_particlesData != NULL) {
         delete _particlesData;
     }
 }
 
-void ParticleSystem::loadTextureAtlas(string const& fileName, size_t rowCount, size_t columnCount)
+void ParticleSystem::loadTextureAtlas(string const& fileName, size_t rowCount, size_t columnCount, TextureManager& textures)
+{
+    // Mips are filtered per cell, so distant particles can use trilinear filtering without bleeding
+    TextureAtlas* texture = textures.acquire(fileName, true, int(rowCount), int(columnCount));
+    releaseSheet();
+    _texture = texture;
+    _textureManager = &textures;
+
+    _texture->bindTexture(0);
+    _texture->setFiltering(TEXTURE_FILTER_MAG_LINEAR, TEXTURE_FILTER_MIN_LINEAR_MIPMAP_LINEAR);
+}
+
+void ParticleSystem::loadPackedAtlas(const vector<string>& frameFileNames, int padding, bool trim)
 {
-    _texture.loadTexture(fileName, false, rowCount, columnCount);
-    _texture.bindTexture(0);
-    _texture.setFiltering(TEXTURE_FILTER_MAG_LINEAR, TEXTURE_FILTER_MIN_LINEAR);
+    _spriteAtlas.build(frameFileNames, padding, trim);
+    _spriteAtlas.uploadFrames();
+    releaseSheet();
+    _packedTexture.loadImage(_spriteAtlas.image(), false, 1, _spriteAtlas.framesCount());
+    _packedTexture.bindTexture(0);
+    _packedTexture.setFiltering(TEXTURE_FILTER_MAG_LINEAR, TEXTURE_FILTER_MIN_LINEAR);
+}
+
+void ParticleSystem::loadTextureArray(const vector<TextureArrayLayer>& layers)
+{
+    _textureArray.loadTextures(layers, false);
+    _textureArray.bindTexture(0);
+    _textureArray.setFiltering(TEXTURE_FILTER_MAG_LINEAR, TEXTURE_FILTER_MIN_LINEAR);
+}
+
+void ParticleSystem::releaseTextures()
+{
+    releaseSheet();
+    if (_textureArray.layersCount() > 0) {
+        _textureArray.releaseTexture();
+    }
+}
+
+void ParticleSystem::releaseSheet()
+{
+    if (_textureManager != NULL) {
+        _textureManager->release(_texture);
+        _textureManager = NULL;
+    }
+    else if (_packedTexture.memorySize() > 0) {
+        _packedTexture.releaseTexture();
+    }
+    _texture = &_packedTexture;
+    _packedTexture = TextureAtlas();
 }
 
 void ParticleSystem::generateParticles()
@@ -76,34 +139,93 @@ void ParticleSystem::generateParticles()
 
     size_t offset = 0;
     int RAND_PRECISION = RAND_MAX;
-    for (size_t p = 0; p < _maxParticlesCount; ++p) {
-        Particle particle;
-        particle.randInit = getRandomRange(-1, 1, RAND_PRECISION);
-        particle.positionInit = getRandomValueVicinityVec3(emitterPosition, emitterVicinity, RAND_PRECISION);
-        particle.position = vec3(0.0f, 0.0f, 0.0f);
-        particle.velocityInit = getRandomValueVicinityVec3(averageVelocity, velocityVicinity, RAND_PRECISION);
-        particle.velocity = vec3(0.0f, 0.0f, 0.0f);
-        particle.color = colorInit;// * getRandom01Vec3(RAND_PRECISION);
-        particle.fullLifeTime = getRandomRange(minLifeTime, maxLifeTime, RAND_PRECISION);
-        particle.actualLifeTime = particle.fullLifeTime * getRandom01(RAND_PRECISION);
-        particle.size = 0;
-        particle.minSize = minSize + (maxSize - minSize) * getRandomRange(0, 0.5, RAND_PRECISION);
-        particle.maxSize = maxSize + (maxSize - minSize) * getRandomRange(0, 0.5, RAND_PRECISION);
-        particle.opacity = 0;
-
-        offset += particle.serialize(_particlesData + offset);
+    int layersCount = std::max(_textureArray.layersCount(), 1);
+    for (size_t e = 0; e < emitters.size(); ++e) {
+        const ParticleEmitter& emitter = emitters[e];
+        GLfloat layer = GLfloat(std::min(std::max(emitter.layer, 0), layersCount - 1));
+
+        for (size_t p = 0; p < emitter.particlesCount; ++p) {
+            Particle particle;
+            particle.randInit = getRandomRange(-1, 1, RAND_PRECISION);
+            particle.positionInit = getRandomValueVicinityVec3(emitter.position, emitter.vicinity, RAND_PRECISION);
+            particle.position = vec3(0.0f, 0.0f, 0.0f);
+            particle.velocityInit = getRandomValueVicinityVec3(emitter.averageVelocity, emitter.velocityVicinity, RAND_PRECISION);
+            particle.velocity = vec3(0.0f, 0.0f, 0.0f);
+            particle.color = emitter.color;// * getRandom01Vec3(RAND_PRECISION);
+            particle.fullLifeTime = getRandomRange(emitter.minLifeTime, emitter.maxLifeTime, RAND_PRECISION);
+            particle.actualLifeTime = particle.fullLifeTime * getRandom01(RAND_PRECISION);
+            particle.size = 0;
+            particle.minSize = emitter.minSize + (emitter.maxSize - emitter.minSize) * getRandomRange(0, 0.5, RAND_PRECISION);
+            particle.maxSize = emitter.maxSize + (emitter.maxSize - emitter.minSize) * getRandomRange(0, 0.5, RAND_PRECISION);
+            particle.opacity = 0;
+            particle.layer = layer;
+
+            offset += particle.serialize(_particlesData + offset);
+        }
     }
 
     assert(offset == _particlesDataSize);
 }
 
-void ParticleSystem::initialize(size_t particlesCount)
+ShaderDefines ParticleSystem::updateDefines()
+{
+    ShaderDefines defines;
+    if (!fadeEnabled) {
+        defines["NO_FADE"] = "1";
+    }
+
+    return defines;
+}
+
+ShaderDefines ParticleSystem::renderDefines()
+{
+    // Specialize for the loaded atlas instead of paying for generic atlas math per vertex and fragment
+    ShaderDefines defines;
+    if (additiveBlend) {
+        defines["ADDITIVE_BLEND"] = "1";
+    }
+    if (_spriteAtlas.framesCount() > 0) {
+        std::ostringstream framesCount;
+        framesCount << _spriteAtlas.framesCount();
+        defines["PACKED_ATLAS_FRAMES_COUNT"] = framesCount.str();
+        return defines;
+    }
+    if (_textureArray.layersCount() > 0) {
+        // Frame grids of the layers become a constant array, indexed by the particle's layer
+        std::ostringstream layersCount, layerGrids;
+        layersCount << _textureArray.layersCount();
+        for (int i = 0; i < _textureArray.layersCount(); ++i) {
+            const TextureArrayLayer& layer = _textureArray.layer(i);
+            layerGrids << (i > 0 ? ", " : "") << "ivec2(" << std::max(layer.rowCount, 1) << ", " << std::max(layer.columnCount, 1) << ")";
+        }
+        defines["TEXTURE_LAYERS_COUNT"] = layersCount.str();
+        defines["TEXTURE_LAYER_GRIDS"] = layerGrids.str();
+        return defines;
+    }
+
+    if (_texture->rowCount() * _texture->columnCount() <= 1) {
+        defines["SINGLE_FRAME_ATLAS"] = "1";
+    }
+
+    std::ostringstream rowCount, columnCount;
+    rowCount << std::max(_texture->rowCount(), 1);
+    columnCount << std::max(_texture->columnCount(), 1);
+    defines["TEX_ROW_COUNT"] = rowCount.str();
+    defines["TEX_COLUMN_COUNT"] = columnCount.str();
+
+    return defines;
+}
+
+void ParticleSystem::initialize(WShaderCache* shaderCache)
 {
     if (_isInitialized) {
         return;
     }
 
-    _maxParticlesCount = particlesCount;
+    _maxParticlesCount = 0;
+    for (size_t i = 0; i < emitters.size(); ++i) {
+        _maxParticlesCount += emitters[i].particlesCount;
+    }
     generateParticles();
 
     const char* varyings[PARTICLE_ATTRIBUTES_COUNT] = {
@@ -114,42 +236,35 @@ void ParticleSystem::initialize(size_t particlesCount)
         "fullLifeTimeOut",
         "actualLifeTimeOut",
         "sizeOut", "minSizeOut", "maxSizeOut",
-        "opacityOut"
+        "opacityOut",
+        "layerOut"
     };
 
-    _vertShaderUpdate.createShader(GL_VERTEX_SHADER, "shaders//update.vert");
-    _geomShaderUpdate.createShader(GL_GEOMETRY_SHADER, "shaders//update.geom");
-
+    // Programs are compiled and linked without waiting, see pollPrograms()
+    ShaderDefines defines = updateDefines();
     _programUpdate.createProgram();
-    _programUpdate.addShader(&_vertShaderUpdate);
-    _programUpdate.addShader(&_geomShaderUpdate);
-    for (size_t i = 0; i < PARTICLE_ATTRIBUTES_COUNT; ++i) {
-        glTransformFeedbackVaryings(_programUpdate.getProgramId(), PARTICLE_ATTRIBUTES_COUNT, varyings, GL_INTERLEAVED_ATTRIBS);
-    }
-    _programUpdate.linkProgram();
-
-    _vertShaderRender.createShader(GL_VERTEX_SHADER, "shaders//render.vert");
-    _geomShaderRender.createShader(GL_GEOMETRY_SHADER, "shaders//render.geom");
-    _fragShaderRender.createShader(GL_FRAGMENT_SHADER, "shaders//render.frag");
+    _programUpdate.addShader(shaderCache->getShader(GL_VERTEX_SHADER, "shaders//update.vert", defines));
+    _programUpdate.addShader(shaderCache->getShader(GL_GEOMETRY_SHADER, "shaders//update.geom", defines));
+    _programUpdate.setTransformFeedbackVaryings(varyings, PARTICLE_ATTRIBUTES_COUNT, GL_INTERLEAVED_ATTRIBS);
+    _programUpdate.beginLink();
 
+    defines = renderDefines();
     _programRender.createProgram();
-    _programRender.addShader(&_vertShaderRender);
-    _programRender.addShader(&_geomShaderRender);
-    _programRender.addShader(&_fragShaderRender);
-    _programRender.linkProgram();
+    _programRender.addShader(shaderCache->getShader(GL_VERTEX_SHADER, "shaders//render.vert", defines));
+    _programRender.addShader(shaderCache->getShader(GL_GEOMETRY_SHADER, "shaders//render.geom", defines));
+    _programRender.addShader(shaderCache->getShader(GL_FRAGMENT_SHADER, "shaders//render.frag", defines));
+    _programRender.beginLink();
 
     glGenTransformFeedbacks(1, &_transformFeedbackBuffer);
     glGenBuffers(2, _particlesBuffers);
     glGenVertexArrays(2, _VAOs);
 
     for (size_t i = 0; i < 2; ++i) {
-        glBindVertexArray(_VAOs[i]);
+        gGLState.bindVertexArray(_VAOs[i]);
         glBindBuffer(GL_ARRAY_BUFFER, _particlesBuffers[i]);
         glBufferData(GL_ARRAY_BUFFER, _particlesDataSize * sizeof(GLfloat), _particlesData, GL_DYNAMIC_DRAW);
         
-        for (size_t i = 0; i < PARTICLE_ATTRIBUTES_COUNT; ++i) {
-            glEnableVertexAttribArray(i);
-        }
+        gGLState.setVertexAttribArrays(ALL_ATTRIBUTES);
 
         glVertexAttribPointer(0,  1, GL_FLOAT, GL_FALSE, Particle::serializedSize(), (const GLvoid*)(0  * sizeof(GLfloat)));  //randInit
         glVertexAttribPointer(1,  3, GL_FLOAT, GL_FALSE, Particle::serializedSize(), (const GLvoid*)(1  * sizeof(GLfloat)));  //positionInit
@@ -163,36 +278,72 @@ void ParticleSystem::initialize(size_t particlesCount)
         glVertexAttribPointer(9,  1, GL_FLOAT, GL_FALSE, Particle::serializedSize(), (const GLvoid*)(19 * sizeof(GLfloat)));  //minSize
         glVertexAttribPointer(10, 1, GL_FLOAT, GL_FALSE, Particle::serializedSize(), (const GLvoid*)(20 * sizeof(GLfloat)));  //maxSize
         glVertexAttribPointer(11, 1, GL_FLOAT, GL_FALSE, Particle::serializedSize(), (const GLvoid*)(21 * sizeof(GLfloat)));  //opacity
+        glVertexAttribPointer(12, 1, GL_FLOAT, GL_FALSE, Particle::serializedSize(), (const GLvoid*)(22 * sizeof(GLfloat)));  //layer
 
-        glBindVertexArray(0);
+        gGLState.bindVertexArray(0);
     }
 
     _curReadBuffer = 0;
     _isInitialized = true;
 }
 
-void ParticleSystem::updateParticles(float timePassed)
+void ParticleSystem::resolveUniforms()
+{
+    _gravityUniform = _programUpdate.getUniform<vec3>(WUNIFORM("gravity"));
+
+    _texRowCountUniform    = _programRender.getUniform<int>(WUNIFORM("texRowCount"));
+    _texColumnCountUniform = _programRender.getUniform<int>(WUNIFORM("texColumnCount"));
+    _samplerUniform        = _programRender.getUniform<int>(WUNIFORM("tSampler"));
+
+    _programRender.bindUniformBlock(ATLAS_FRAMES_BLOCK, ATLAS_FRAMES_BINDING);
+}
+
+void ParticleSystem::pollPrograms()
 {
+    bool updateRelinked = _programUpdate.pollLink();
+    bool renderRelinked = _programRender.pollLink();
+
+    if (updateRelinked || renderRelinked) {
+        resolveUniforms();
+    }
+}
+
+void ParticleSystem::reloadShader(string const& fileName, string const& source)
+{
+    if (_programUpdate.usesShaderFile(fileName)) {
+        _programUpdate.beginRebuild(fileName, source);
+    }
+    if (_programRender.usesShaderFile(fileName)) {
+        _programRender.beginRebuild(fileName, source);
+    }
+}
+
+void ParticleSystem::updateParticles()
+{
+    PROFILE_SCOPE("ParticleSystem::updateParticles");
+
     if (!_isInitialized) {
         return;
     }
 
+    static const int subsystem = gGLCounters.subsystem("particles");
+    GLCounterScope counterScope(subsystem);
+
+    pollPrograms();
+    if (!_programUpdate.isLinked()) {
+        return;
+    }
+
     _programUpdate.useProgram();
-    _programUpdate.setUniform("timePassed", timePassed);
-    _programUpdate.setUniform("gravity",    gravity);
+    _programUpdate.setUniform(_gravityUniform, gravity);
 
-    glEnable(GL_RASTERIZER_DISCARD);
+    gGLState.enable(GL_RASTERIZER_DISCARD);
 
     GLuint query;
     glGenQueries(1, &query);
 
-    glBindVertexArray(_VAOs[_curReadBuffer]);
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
-    glEnableVertexAttribArray(3);
-    glEnableVertexAttribArray(4);
-    glEnableVertexAttribArray(9);
-    glEnableVertexAttribArray(10);
+    gGLState.bindVertexArray(_VAOs[_curReadBuffer]);
+    gGLState.setVertexAttribArrays(ALL_ATTRIBUTES);
     
     glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, _transformFeedbackBuffer);
     glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, _particlesBuffers[1 - _curReadBuffer]);
@@ -212,7 +363,6 @@ void ParticleSystem::updateParticles(float timePassed)
     assert(primitivesCount == _maxParticlesCount);
 
     glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
-    glBindVertexArray(0);
 
     //glBindBuffer(GL_ARRAY_BUFFER, _particlesBuffers[1 - _curReadBuffer]);
     //GLfloat data[22];
@@ -223,44 +373,47 @@ void ParticleSystem::updateParticles(float timePassed)
 
 void ParticleSystem::renderParticles()
 {
+    PROFILE_SCOPE("ParticleSystem::renderParticles");
+
     if (!_isInitialized) {
         return;
     }
 
-    _programRender.useProgram();
+    static const int subsystem = gGLCounters.subsystem("particles");
+    GLCounterScope counterScope(subsystem);
 
-    glDisable(GL_RASTERIZER_DISCARD);
+    gGLState.disable(GL_RASTERIZER_DISCARD);
     
-    glDisable(GL_DEPTH_TEST);
-    glClearColor(0.f, 0.f, 0.f, 1.0f);
-    glClearDepth(1);
+    gGLState.disable(GL_DEPTH_TEST);
+    gGLState.clearColor(0.f, 0.f, 0.f, 1.0f);
+    gGLState.clearDepth(1);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    glDepthMask(0);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-
-    _programRender.setUniform("texRowCount", _texture.rowCount());
-    _programRender.setUniform("texColumnCount", _texture.columnCount());
-    _programRender.setUniform("mView", mView);
-    _programRender.setUniform("mProj", mProj);
-    _programRender.setUniform("quad1", _quad1);
-    _programRender.setUniform("quad2", _quad2);
-    _programRender.setUniform("tSampler", _texture.textureUnit());
-
-    glBindVertexArray(_VAOs[_curReadBuffer]);
-    glDisableVertexAttribArray(0);
-    glDisableVertexAttribArray(1);
-    glDisableVertexAttribArray(3);
-    glDisableVertexAttribArray(4);
-    glDisableVertexAttribArray(9);
-    glDisableVertexAttribArray(10);
+    if (!_programRender.isLinked()) {
+        return;
+    }
+
+    _programRender.useProgram();
+
+    gGLState.depthMask(false);
+    gGLState.enable(GL_BLEND);
+    if (additiveBlend) {
+        gGLState.blendFunc(GL_ONE, GL_ONE);
+    } else {
+        gGLState.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    }
+
+    _programRender.setUniform(_texRowCountUniform,    _texture->rowCount());
+    _programRender.setUniform(_texColumnCountUniform, _texture->columnCount());
+    _programRender.setUniform(_samplerUniform,        _textureArray.layersCount() > 0 ? _textureArray.textureUnit() : _texture->textureUnit());
+
+    gGLState.bindVertexArray(_VAOs[_curReadBuffer]);
+    gGLState.setVertexAttribArrays(RENDER_ATTRIBUTES);
 
     glDrawArrays(GL_POINTS, 0, _maxParticlesCount);
 
-    glDisable(GL_BLEND);
-    glDepthMask(1);
+    gGLState.disable(GL_BLEND);
+    gGLState.depthMask(true);
 }
 
 void ParticleSystem::setMaxParticlesCount(int maxParticlesCount)
@@ -268,18 +421,4 @@ void ParticleSystem::setMaxParticlesCount(int maxParticlesCount)
     _maxParticlesCount = maxParticlesCount;
 }
 
-void ParticleSystem::setMatrices(mat4 mProj, vec3 eye, vec3 viewCenter, vec3 upVector, quat rotation)
-{
-    this->mProj = mProj;
-    mView = lookAt(eye, viewCenter, upVector); // * mat4_cast(rotation);
-
-    vec3 viewDirection = viewCenter - eye;
-    _quad1 = cross(viewDirection, upVector);
-    _quad2 = cross(_quad1, viewDirection);
-    _quad1 = normalize(_quad1);
-    _quad2 = normalize(_quad2);
-
-    assert(_quad1 == vec3(1.0f, 0.0f, 0.0f));
-    assert(_quad2 == vec3(0.0f, 1.0f, 0.0f));
-}
 
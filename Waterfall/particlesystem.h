@@ -4,9 +4,18 @@
 #include "common.h"
 #include "shaders.h"
 #include "texture.h"
+#include "texturemanager.h"
+#include "texturearray.h"
+#include "spriteatlas.h"
 
-static const size_t PARTICLE_ATTRIBUTES_COUNT = 12;
-static const size_t PARTICLE_SERIALIZED_GLFLOAT_COUNT = 22;
+static const size_t PARTICLE_ATTRIBUTES_COUNT = 13;
+static const size_t PARTICLE_SERIALIZED_GLFLOAT_COUNT = 23;
+
+// Vertex attribute masks: the update pass reads every attribute, rendering
+// skips the initial values (randInit, positionInit, velocityInit, velocity, minSize, maxSize)
+static const uint32_t ALL_ATTRIBUTES = (1u << PARTICLE_ATTRIBUTES_COUNT) - 1;
+static const uint32_t RENDER_ATTRIBUTES = ALL_ATTRIBUTES
+    & ~((1u << 0) | (1u << 1) | (1u << 3) | (1u << 4) | (1u << 9) | (1u << 10));
 
 struct Particle
 {
@@ -18,11 +27,28 @@ struct Particle
     GLfloat actualLifeTime;
     GLfloat size, maxSize, minSize;
     GLfloat opacity;
+    GLfloat layer;  // sprite sheet in the texture array
 
     static size_t serializedSize();
     size_t serialize(GLfloat* buf);
 };
 
+// One source of particles. Emitters of a system share its buffers and its draw;
+// with a texture array each one takes its sprites from its own layer.
+struct ParticleEmitter
+{
+    vec3   position, vicinity;
+    vec3   averageVelocity, velocityVicinity;
+    float  minLifeTime, maxLifeTime;
+    float  minSize, maxSize;
+    vec3   color;
+    float  opacity;
+    size_t particlesCount;
+    int    layer;  // ignored without a texture array
+
+    ParticleEmitter();
+};
+
 class ParticleSystem
 {
     bool _isInitialized;
@@ -31,42 +57,64 @@ class ParticleSystem
     size_t _particlesDataSize;
     GLfloat* _particlesData;
 
-    WShader _vertShaderUpdate, _geomShaderUpdate;
     WProgram _programUpdate;
+    WUniform<vec3>  _gravityUniform;
 
-    WShader _vertShaderRender, _geomShaderRender, _fragShaderRender;
     WProgram _programRender;
+    WUniform<int>  _texRowCountUniform, _texColumnCountUniform;
+    WUniform<int>  _samplerUniform;
 
     size_t _curReadBuffer;
     GLuint _transformFeedbackBuffer;
     GLuint _particlesBuffers[2];
     GLuint _VAOs[2];
 
-    vec3 _quad1, _quad2;
-    TextureAtlas _texture;
+    // The sprite sheet in use: shared through the manager, or _packedTexture
+    TextureAtlas* _texture;
+    TextureAtlas _packedTexture;
+    TextureManager* _textureManager;
+    TextureArrayAtlas _textureArray;
+    SpriteAtlas _spriteAtlas;
 
     void generateParticles();
+    ShaderDefines updateDefines();
+    ShaderDefines renderDefines();
+    void resolveUniforms();
+    void pollPrograms();
+    void releaseSheet();
 
 public:
-    vec3  emitterPosition, emitterVicinity;
-    vec3  averageVelocity, velocityVicinity;
+    // Read by initialize(), every emitter owns a contiguous range of the particles
+    vector<ParticleEmitter> emitters;
     vec3  gravity;
-    float minLifeTime, maxLifeTime;
-    float minSize, maxSize;
-    vec3  colorInit;
-    float opacityInit;
-    mat4 mView, mProj;
+    // Compiles a variant without the lifetime fade when false, read by initialize()
+    bool  fadeEnabled;
+    // Additive blending when true, ordinary alpha blending otherwise; read by initialize()
+    bool  additiveBlend;
 
     ParticleSystem();
     ~ParticleSystem();
 
-    void initialize(size_t particlesCount);
-    void loadTextureAtlas(string const& fileName, size_t rowCount, size_t columnCount);
+    void initialize(WShaderCache* shaderCache);
+    // The atlas is shared with other systems loading the same file, see TextureManager
+    void loadTextureAtlas(string const& fileName, size_t rowCount, size_t columnCount, TextureManager& textures);
+    // Uses several sheets at once instead, each emitter draws from the layer it names;
+    // call before initialize()
+    void loadTextureArray(const vector<TextureArrayLayer>& layers);
+    // Packs separate frame images into one atlas, frames play in the given order;
+    // call before initialize()
+    void loadPackedAtlas(const vector<string>& frameFileNames, int padding = 2, bool trim = true);
+    // Gives the shared atlas back to its manager and deletes the owned textures;
+    // needs the GL context, called by the destructor too
+    void releaseTextures();
     
     void setMaxParticlesCount(int maxParticlesCount);
-    void setMatrices(mat4 mProj, vec3 camera, vec3 view, vec3 upVector, quat rotation);
 
-    void updateParticles(float timePassed);
+    // Rebuilds the programs that use fileName in the background
+    void reloadShader(string const& fileName, string const& source);
+
+    // View, projection, camera axes and time come from the FrameConstants block
+    void updateParticles();
     void renderParticles();
 };
 
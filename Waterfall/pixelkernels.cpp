@@ -0,0 +1,375 @@
+#include "pixelkernels.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define PIXEL_KERNELS_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang compile each SIMD function for its own instruction set, so the
+// rest of the program keeps the default target and runs on any x86 CPU
+#if defined(PIXEL_KERNELS_X86) && (defined(__GNUC__) || defined(__clang__))
+#define PIXEL_TARGET(isa) __attribute__((target(isa)))
+#else
+#define PIXEL_TARGET(isa)
+#endif
+
+namespace
+{
+    typedef void (*SwizzleKernel)(const uint8_t* src, uint8_t* dst, size_t pixelsCount);
+    typedef void (*PremultiplyKernel)(uint8_t* rgba, size_t pixelsCount);
+    typedef void (*DownsampleKernel)(const uint8_t* row0, const uint8_t* row1, uint8_t* dst, size_t dstPixelsCount);
+
+    void swizzleScalar(const uint8_t* src, uint8_t* dst, size_t pixelsCount)
+    {
+        for (size_t i = 0; i < pixelsCount; ++i) {
+            uint8_t b = src[i * 4 + 0];
+            uint8_t r = src[i * 4 + 2];
+            dst[i * 4 + 0] = r;
+            dst[i * 4 + 1] = src[i * 4 + 1];
+            dst[i * 4 + 2] = b;
+            dst[i * 4 + 3] = src[i * 4 + 3];
+        }
+    }
+
+    // Rounded c * a / 255 without a division
+    inline uint8_t multiplyAlpha(uint32_t c, uint32_t a)
+    {
+        uint32_t t = c * a + 128;
+        return uint8_t((t + (t >> 8)) >> 8);
+    }
+
+    void premultiplyScalar(uint8_t* rgba, size_t pixelsCount)
+    {
+        for (size_t i = 0; i < pixelsCount; ++i) {
+            uint8_t* p = rgba + i * 4;
+            uint32_t a = p[3];
+            p[0] = multiplyAlpha(p[0], a);
+            p[1] = multiplyAlpha(p[1], a);
+            p[2] = multiplyAlpha(p[2], a);
+        }
+    }
+
+    void downsampleScalar(const uint8_t* row0, const uint8_t* row1, uint8_t* dst, size_t dstPixelsCount)
+    {
+        for (size_t i = 0; i < dstPixelsCount; ++i) {
+            for (size_t c = 0; c < 4; ++c) {
+                uint32_t sum = row0[i * 8 + c] + row0[i * 8 + 4 + c] + row1[i * 8 + c] + row1[i * 8 + 4 + c];
+                dst[i * 4 + c] = uint8_t((sum + 2) >> 2);
+            }
+        }
+    }
+
+#ifdef PIXEL_KERNELS_X86
+    PIXEL_TARGET("ssse3")
+    void swizzleSSSE3(const uint8_t* src, uint8_t* dst, size_t pixelsCount)
+    {
+        const __m128i mask = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+
+        size_t i = 0;
+        for (; i + 4 <= pixelsCount; i += 4) {
+            __m128i pixels = _mm_loadu_si128((const __m128i*)(src + i * 4));
+            _mm_storeu_si128((__m128i*)(dst + i * 4), _mm_shuffle_epi8(pixels, mask));
+        }
+        swizzleScalar(src + i * 4, dst + i * 4, pixelsCount - i);
+    }
+
+    PIXEL_TARGET("avx2")
+    void swizzleAVX2(const uint8_t* src, uint8_t* dst, size_t pixelsCount)
+    {
+        const __m256i mask = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+                                              2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+
+        size_t i = 0;
+        for (; i + 16 <= pixelsCount; i += 16) {
+            __m256i pixels0 = _mm256_loadu_si256((const __m256i*)(src + i * 4));
+            __m256i pixels1 = _mm256_loadu_si256((const __m256i*)(src + i * 4 + 32));
+            _mm256_storeu_si256((__m256i*)(dst + i * 4), _mm256_shuffle_epi8(pixels0, mask));
+            _mm256_storeu_si256((__m256i*)(dst + i * 4 + 32), _mm256_shuffle_epi8(pixels1, mask));
+        }
+        swizzleSSSE3(src + i * 4, dst + i * 4, pixelsCount - i);
+    }
+
+    // Two RGBA pixels widened to 16 bits per channel
+    PIXEL_TARGET("ssse3")
+    inline __m128i premultiplyPair(__m128i pixels, __m128i colorMask, __m128i alphaOne)
+    {
+        __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(pixels, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+        // Alpha is multiplied by 255, which leaves it unchanged after the rounding
+        alpha = _mm_or_si128(_mm_and_si128(alpha, colorMask), alphaOne);
+
+        __m128i t = _mm_add_epi16(_mm_mullo_epi16(pixels, alpha), _mm_set1_epi16(128));
+        return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+    }
+
+    PIXEL_TARGET("ssse3")
+    void premultiplySSSE3(uint8_t* rgba, size_t pixelsCount)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i colorMask = _mm_setr_epi16(-1, -1, -1, 0, -1, -1, -1, 0);
+        const __m128i alphaOne = _mm_setr_epi16(0, 0, 0, 255, 0, 0, 0, 255);
+
+        size_t i = 0;
+        for (; i + 4 <= pixelsCount; i += 4) {
+            __m128i pixels = _mm_loadu_si128((const __m128i*)(rgba + i * 4));
+            __m128i low = premultiplyPair(_mm_unpacklo_epi8(pixels, zero), colorMask, alphaOne);
+            __m128i high = premultiplyPair(_mm_unpackhi_epi8(pixels, zero), colorMask, alphaOne);
+            _mm_storeu_si128((__m128i*)(rgba + i * 4), _mm_packus_epi16(low, high));
+        }
+        premultiplyScalar(rgba + i * 4, pixelsCount - i);
+    }
+
+    PIXEL_TARGET("avx2")
+    inline __m256i premultiplyPairs(__m256i pixels, __m256i colorMask, __m256i alphaOne)
+    {
+        __m256i alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(pixels, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+        alpha = _mm256_or_si256(_mm256_and_si256(alpha, colorMask), alphaOne);
+
+        __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(pixels, alpha), _mm256_set1_epi16(128));
+        return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+    }
+
+    PIXEL_TARGET("avx2")
+    void premultiplyAVX2(uint8_t* rgba, size_t pixelsCount)
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i colorMask = _mm256_setr_epi16(-1, -1, -1, 0, -1, -1, -1, 0, -1, -1, -1, 0, -1, -1, -1, 0);
+        const __m256i alphaOne = _mm256_setr_epi16(0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255);
+
+        // Unpack and pack both work within 128-bit lanes, so the pixel order is preserved
+        size_t i = 0;
+        for (; i + 8 <= pixelsCount; i += 8) {
+            __m256i pixels = _mm256_loadu_si256((const __m256i*)(rgba + i * 4));
+            __m256i low = premultiplyPairs(_mm256_unpacklo_epi8(pixels, zero), colorMask, alphaOne);
+            __m256i high = premultiplyPairs(_mm256_unpackhi_epi8(pixels, zero), colorMask, alphaOne);
+            _mm256_storeu_si256((__m256i*)(rgba + i * 4), _mm256_packus_epi16(low, high));
+        }
+        premultiplySSSE3(rgba + i * 4, pixelsCount - i);
+    }
+
+    // Four source pixels of each row give two destination pixels
+    PIXEL_TARGET("ssse3")
+    void downsampleSSSE3(const uint8_t* row0, const uint8_t* row1, uint8_t* dst, size_t dstPixelsCount)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i rounding = _mm_set1_epi16(2);
+
+        size_t i = 0;
+        for (; i + 2 <= dstPixelsCount; i += 2) {
+            __m128i top = _mm_loadu_si128((const __m128i*)(row0 + i * 8));
+            __m128i bottom = _mm_loadu_si128((const __m128i*)(row1 + i * 8));
+
+            // Vertical sums of pixels 0, 1 and 2, 3 in 16 bits
+            __m128i low = _mm_add_epi16(_mm_unpacklo_epi8(top, zero), _mm_unpacklo_epi8(bottom, zero));
+            __m128i high = _mm_add_epi16(_mm_unpackhi_epi8(top, zero), _mm_unpackhi_epi8(bottom, zero));
+            // Horizontal neighbours are 8 bytes apart
+            low = _mm_add_epi16(low, _mm_srli_si128(low, 8));
+            high = _mm_add_epi16(high, _mm_srli_si128(high, 8));
+
+            __m128i sums = _mm_unpacklo_epi64(low, high);
+            __m128i averages = _mm_srli_epi16(_mm_add_epi16(sums, rounding), 2);
+            _mm_storel_epi64((__m128i*)(dst + i * 4), _mm_packus_epi16(averages, averages));
+        }
+        downsampleScalar(row0 + i * 8, row1 + i * 8, dst + i * 4, dstPixelsCount - i);
+    }
+
+    PIXEL_TARGET("avx2")
+    void downsampleAVX2(const uint8_t* row0, const uint8_t* row1, uint8_t* dst, size_t dstPixelsCount)
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i rounding = _mm256_set1_epi16(2);
+
+        size_t i = 0;
+        for (; i + 4 <= dstPixelsCount; i += 4) {
+            __m256i top = _mm256_loadu_si256((const __m256i*)(row0 + i * 8));
+            __m256i bottom = _mm256_loadu_si256((const __m256i*)(row1 + i * 8));
+
+            // Same as the SSSE3 version within each 128-bit lane
+            __m256i low = _mm256_add_epi16(_mm256_unpacklo_epi8(top, zero), _mm256_unpacklo_epi8(bottom, zero));
+            __m256i high = _mm256_add_epi16(_mm256_unpackhi_epi8(top, zero), _mm256_unpackhi_epi8(bottom, zero));
+            low = _mm256_add_epi16(low, _mm256_srli_si256(low, 8));
+            high = _mm256_add_epi16(high, _mm256_srli_si256(high, 8));
+
+            __m256i sums = _mm256_unpacklo_epi64(low, high);
+            __m256i averages = _mm256_srli_epi16(_mm256_add_epi16(sums, rounding), 2);
+            // Each lane packs its two pixels into the low 8 bytes, gather those
+            __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(averages, averages), _MM_SHUFFLE(3, 1, 2, 0));
+            _mm_storeu_si128((__m128i*)(dst + i * 4), _mm256_castsi256_si128(packed));
+        }
+        downsampleSSSE3(row0 + i * 8, row1 + i * 8, dst + i * 4, dstPixelsCount - i);
+    }
+#endif // PIXEL_KERNELS_X86
+
+    PixelKernelLevel detectLevel()
+    {
+#ifdef PIXEL_KERNELS_X86
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        int maxLeaf = info[0];
+
+        __cpuid(info, 1);
+        bool hasSSSE3 = (info[2] & (1 << 9)) != 0;
+        bool osSavesAVX = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0
+                          && (_xgetbv(0) & 6) == 6;
+
+        bool hasAVX2 = false;
+        if (maxLeaf >= 7 && osSavesAVX) {
+            __cpuidex(info, 7, 0);
+            hasAVX2 = (info[1] & (1 << 5)) != 0;
+        }
+#else
+        __builtin_cpu_init();
+        bool hasSSSE3 = __builtin_cpu_supports("ssse3") != 0;
+        bool hasAVX2 = __builtin_cpu_supports("avx2") != 0;
+#endif
+        if (hasAVX2) {
+            return PIXEL_KERNELS_AVX2;
+        }
+        if (hasSSSE3) {
+            return PIXEL_KERNELS_SSSE3;
+        }
+#endif
+        return PIXEL_KERNELS_SCALAR;
+    }
+
+    struct Kernels
+    {
+        PixelKernelLevel level;
+        SwizzleKernel swizzle;
+        PremultiplyKernel premultiply;
+        DownsampleKernel downsample;
+
+        void select(PixelKernelLevel newLevel)
+        {
+            level = newLevel;
+            swizzle = swizzleScalar;
+            premultiply = premultiplyScalar;
+            downsample = downsampleScalar;
+#ifdef PIXEL_KERNELS_X86
+            if (level == PIXEL_KERNELS_SSSE3) {
+                swizzle = swizzleSSSE3;
+                premultiply = premultiplySSSE3;
+                downsample = downsampleSSSE3;
+            }
+            else if (level == PIXEL_KERNELS_AVX2) {
+                swizzle = swizzleAVX2;
+                premultiply = premultiplyAVX2;
+                downsample = downsampleAVX2;
+            }
+#endif
+        }
+    };
+
+    Kernels& kernels()
+    {
+        static Kernels selected = []() {
+            Kernels k;
+            k.select(detectLevel());
+            return k;
+        }();
+        return selected;
+    }
+
+    struct SrgbTables
+    {
+        uint8_t toLinear[256];
+        uint8_t toSrgb[256];
+
+        SrgbTables()
+        {
+            for (int i = 0; i < 256; ++i) {
+                float c = i / 255.0f;
+                float linear = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+                float srgb = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+                toLinear[i] = uint8_t(linear * 255.0f + 0.5f);
+                toSrgb[i] = uint8_t(srgb * 255.0f + 0.5f);
+            }
+        }
+    };
+
+    const SrgbTables& srgbTables()
+    {
+        static const SrgbTables tables;
+        return tables;
+    }
+
+    void applyTable(uint8_t* rgba, size_t pixelsCount, const uint8_t* table)
+    {
+        for (size_t i = 0; i < pixelsCount; ++i) {
+            uint8_t* p = rgba + i * 4;
+            p[0] = table[p[0]];
+            p[1] = table[p[1]];
+            p[2] = table[p[2]];
+        }
+    }
+}
+
+PixelKernelLevel supportedPixelKernelLevel()
+{
+    static const PixelKernelLevel level = detectLevel();
+    return level;
+}
+
+PixelKernelLevel pixelKernelLevel()
+{
+    return kernels().level;
+}
+
+void setPixelKernelLevel(PixelKernelLevel level)
+{
+    kernels().select(std::min(level, supportedPixelKernelLevel()));
+}
+
+const char* pixelKernelLevelName(PixelKernelLevel level)
+{
+    switch (level) {
+    case PIXEL_KERNELS_SSSE3: return "SSSE3";
+    case PIXEL_KERNELS_AVX2:  return "AVX2";
+    default:                  return "scalar";
+    }
+}
+
+void swizzleBGRAToRGBA(const uint8_t* src, uint8_t* dst, size_t pixelsCount)
+{
+    kernels().swizzle(src, dst, pixelsCount);
+}
+
+void premultiplyAlpha(uint8_t* rgba, size_t pixelsCount)
+{
+    kernels().premultiply(rgba, pixelsCount);
+}
+
+void downsample2x2(const uint8_t* row0, const uint8_t* row1, uint8_t* dst, size_t dstPixelsCount)
+{
+    kernels().downsample(row0, row1, dst, dstPixelsCount);
+}
+
+void srgbToLinear(uint8_t* rgba, size_t pixelsCount)
+{
+    applyTable(rgba, pixelsCount, srgbTables().toLinear);
+}
+
+void linearToSrgb(uint8_t* rgba, size_t pixelsCount)
+{
+    applyTable(rgba, pixelsCount, srgbTables().toSrgb);
+}
+
+void flipVertical(uint8_t* pixels, size_t width, size_t height, size_t bytesPerPixel)
+{
+    size_t rowSize = width * bytesPerPixel;
+    vector<uint8_t> row(rowSize);
+
+    for (size_t y = 0; y < height / 2; ++y) {
+        uint8_t* top = pixels + y * rowSize;
+        uint8_t* bottom = pixels + (height - 1 - y) * rowSize;
+        memcpy(&row[0], top, rowSize);
+        memcpy(top, bottom, rowSize);
+        memcpy(bottom, &row[0], rowSize);
+    }
+}
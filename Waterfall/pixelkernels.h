@@ -0,0 +1,34 @@
+#ifndef PIXEL_KERNELS_H
+#define PIXEL_KERNELS_H
+
+#include "common.h"
+
+// Pixel conversions for texture ingest. Each kernel has scalar, SSSE3 and AVX2
+// versions; the best one the CPU supports is picked on first use.
+// All pixels are 8 bits per channel RGBA (or BGRA for the swizzle source).
+
+enum PixelKernelLevel
+{
+    PIXEL_KERNELS_SCALAR,
+    PIXEL_KERNELS_SSSE3,
+    PIXEL_KERNELS_AVX2
+};
+
+PixelKernelLevel supportedPixelKernelLevel();
+PixelKernelLevel pixelKernelLevel();
+// Forces a lower level, e.g. to compare them; clamped to what the CPU supports
+void setPixelKernelLevel(PixelKernelLevel level);
+const char* pixelKernelLevelName(PixelKernelLevel level);
+
+// dst may equal src
+void swizzleBGRAToRGBA(const uint8_t* src, uint8_t* dst, size_t pixelsCount);
+// Multiplies the color channels by alpha, rounding to nearest
+void premultiplyAlpha(uint8_t* rgba, size_t pixelsCount);
+// Rounded average of 2x2 blocks: 2 * dstPixelsCount pixels of each row give dstPixelsCount pixels
+void downsample2x2(const uint8_t* row0, const uint8_t* row1, uint8_t* dst, size_t dstPixelsCount);
+// Converts the color channels through 256-entry tables, alpha is kept
+void srgbToLinear(uint8_t* rgba, size_t pixelsCount);
+void linearToSrgb(uint8_t* rgba, size_t pixelsCount);
+void flipVertical(uint8_t* pixels, size_t width, size_t height, size_t bytesPerPixel);
+
+#endif //PIXEL_KERNELS_H
@@ -0,0 +1,237 @@
+#include "profiler.h"
+#include <iomanip>
+#include <thread>
+
+#if defined(PROFILER_RDTSC)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#undef PROFILER_RDTSC
+#endif
+#endif
+
+Profiler gProfiler;
+
+Profiler::ThreadBuffer::ThreadBuffer(uint32_t index)
+    : threadIndex(index)
+    , written(0)
+    , read(0)
+    , depth(0)
+{}
+
+Profiler::Profiler()
+    : _isRecording(false)
+    , _droppedEvents(0)
+    , _startTicks(0)
+    , _ticksPerMicrosecond(1000.0)
+{}
+
+uint64_t Profiler::ticks()
+{
+#ifdef PROFILER_RDTSC
+    return __rdtsc();
+#else
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+void Profiler::calibrate()
+{
+#ifdef PROFILER_RDTSC
+    chrono::steady_clock::time_point clockBegin = chrono::steady_clock::now();
+    uint64_t ticksBegin = ticks();
+    std::this_thread::sleep_for(chrono::milliseconds(20));
+    uint64_t ticksEnd = ticks();
+    chrono::steady_clock::time_point clockEnd = chrono::steady_clock::now();
+
+    double microseconds = chrono::duration<double, std::micro>(clockEnd - clockBegin).count();
+    _ticksPerMicrosecond = double(ticksEnd - ticksBegin) / microseconds;
+#else
+    _ticksPerMicrosecond = 1000.0;
+#endif
+}
+
+Profiler::ThreadBuffer& Profiler::threadBuffer()
+{
+    static thread_local ThreadBuffer* buffer = NULL;
+    if (buffer == NULL) {
+        std::lock_guard<std::mutex> lock(_threadsMutex);
+        _threads.push_back(std::unique_ptr<ThreadBuffer>(new ThreadBuffer(uint32_t(_threads.size()))));
+        buffer = _threads.back().get();
+    }
+    return *buffer;
+}
+
+void Profiler::start()
+{
+    if (isRecording()) {
+        return;
+    }
+
+    calibrate();
+    _startTicks = ticks();
+    _isRecording.store(true);
+}
+
+void Profiler::stop()
+{
+    _isRecording.store(false);
+}
+
+uint32_t Profiler::pushDepth()
+{
+    ThreadBuffer& buffer = threadBuffer();
+    return buffer.depth++;
+}
+
+void Profiler::popDepth()
+{
+    ThreadBuffer& buffer = threadBuffer();
+    if (buffer.depth > 0) {
+        --buffer.depth;
+    }
+}
+
+void Profiler::beginZone(const char* name)
+{
+    ThreadBuffer& buffer = threadBuffer();
+
+    // Zones are pushed even when not recording so begin/end stay paired;
+    // a zero begin marks one that is not recorded. Zones nested deeper than
+    // MAX_DEPTH are only counted, so their endZone() still pops the right one.
+    if (buffer.depth < MAX_DEPTH) {
+        buffer.openNames[buffer.depth] = name;
+        buffer.openBegins[buffer.depth] = isRecording() ? ticks() : 0;
+    }
+    ++buffer.depth;
+}
+
+void Profiler::endZone()
+{
+    ThreadBuffer& buffer = threadBuffer();
+    if (buffer.depth == 0) {
+        return;
+    }
+
+    --buffer.depth;
+    if (buffer.depth < MAX_DEPTH && buffer.openBegins[buffer.depth] != 0) {
+        record(buffer.openNames[buffer.depth], buffer.openBegins[buffer.depth], ticks(), buffer.depth);
+    }
+}
+
+void Profiler::record(const char* name, uint64_t begin, uint64_t end, uint32_t depth)
+{
+    ThreadBuffer& buffer = threadBuffer();
+
+    uint64_t index = buffer.written.load(std::memory_order_relaxed);
+    ProfileEvent& event = buffer.events[index % RING_CAPACITY];
+    event.name = name;
+    event.begin = begin;
+    event.end = end;
+    event.depth = depth;
+    event.threadIndex = buffer.threadIndex;
+    buffer.written.store(index + 1, std::memory_order_release);
+}
+
+void Profiler::collect()
+{
+    std::lock_guard<std::mutex> collectLock(_collectMutex);
+    std::lock_guard<std::mutex> threadsLock(_threadsMutex);
+
+    for (size_t i = 0; i < _threads.size(); ++i) {
+        ThreadBuffer& buffer = *_threads[i];
+        uint64_t written = buffer.written.load(std::memory_order_acquire);
+
+        // The writer has lapped us, the oldest events are gone
+        if (written - buffer.read > RING_CAPACITY) {
+            _droppedEvents += written - buffer.read - RING_CAPACITY;
+            buffer.read = written - RING_CAPACITY;
+        }
+
+        for (; buffer.read < written; ++buffer.read) {
+            ProfileEvent event = buffer.events[buffer.read % RING_CAPACITY];
+
+            // Discard the copy if the slot was overwritten while reading it
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (buffer.written.load(std::memory_order_relaxed) - buffer.read > RING_CAPACITY
+                || _collected.size() >= MAX_COLLECTED_EVENTS) {
+                ++_droppedEvents;
+                continue;
+            }
+
+            _collected.push_back(event);
+        }
+    }
+}
+
+uint64_t Profiler::droppedEvents()
+{
+    std::lock_guard<std::mutex> lock(_collectMutex);
+    return _droppedEvents;
+}
+
+static void writeJsonString(std::ofstream& out, const char* text)
+{
+    out << '"';
+    for (const char* c = text; *c; ++c) {
+        if (*c == '"' || *c == '\\') {
+            out << '\\';
+        }
+        out << *c;
+    }
+    out << '"';
+}
+
+bool Profiler::writeChromeTrace(const string& fileName)
+{
+    collect();
+
+    std::ofstream out(fileName.c_str());
+    if (!out) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> collectLock(_collectMutex);
+
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    out << std::fixed << std::setprecision(3);
+
+    size_t threadsCount;
+    {
+        std::lock_guard<std::mutex> threadsLock(_threadsMutex);
+        threadsCount = _threads.size();
+    }
+    // Thread names come first as metadata events
+    for (size_t i = 0; i < threadsCount; ++i) {
+        out << (i > 0 ? ",\n" : "")
+            << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << i
+            << ",\"args\":{\"name\":\"" << (i == 0 ? string("main") : "thread " + std::to_string(i)) << "\"}}";
+    }
+
+    for (size_t i = 0; i < _collected.size(); ++i) {
+        const ProfileEvent& event = _collected[i];
+        out << (i > 0 || threadsCount > 0 ? ",\n" : "") << "{\"name\":";
+        writeJsonString(out, event.name);
+        out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.threadIndex
+            << ",\"ts\":" << double(event.begin - _startTicks) / _ticksPerMicrosecond
+            << ",\"dur\":" << double(event.end - event.begin) / _ticksPerMicrosecond
+            << ",\"args\":{\"depth\":" << event.depth << "}}";
+    }
+
+    out << "\n]}\n";
+    return bool(out);
+}
+
+#ifdef TW_PROFILE_ZONES
+void TW_CALL profilerBeginTwZone(const char* name)
+{
+    gProfiler.beginZone(name);
+}
+
+void TW_CALL profilerEndTwZone()
+{
+    gProfiler.endZone();
+}
+#endif
@@ -0,0 +1,128 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "common.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+// Hierarchical CPU zone profiler. Every thread records finished zones into its
+// own ring buffer without locking; collect() drains the rings from any thread and
+// writeChromeTrace() saves everything in the Chrome trace event format
+// (open it in chrome://tracing or ui.perfetto.dev).
+// Timestamps come from steady_clock, or from rdtsc when built with PROFILER_RDTSC.
+
+struct ProfileEvent
+{
+    const char* name;  // must outlive the profiler, normally a string literal
+    uint64_t begin;
+    uint64_t end;
+    uint32_t depth;
+    uint32_t threadIndex;
+};
+
+class Profiler
+{
+public:
+    static const size_t RING_CAPACITY = 1 << 14;
+    static const size_t MAX_DEPTH = 64;
+    static const size_t MAX_COLLECTED_EVENTS = 1 << 22;
+
+private:
+    // Written only by its thread, drained by collect()
+    struct ThreadBuffer
+    {
+        uint32_t threadIndex;
+        ProfileEvent events[RING_CAPACITY];
+        std::atomic<uint64_t> written;
+        uint64_t read;
+
+        // Zones opened through beginZone() and not yet closed, the first MAX_DEPTH of them
+        const char* openNames[MAX_DEPTH];
+        uint64_t openBegins[MAX_DEPTH];
+        uint32_t depth;
+
+        ThreadBuffer(uint32_t index);
+    };
+
+    std::atomic<bool> _isRecording;
+    std::mutex _threadsMutex;
+    vector<std::unique_ptr<ThreadBuffer> > _threads;
+
+    std::mutex _collectMutex;
+    vector<ProfileEvent> _collected;
+    uint64_t _droppedEvents;
+
+    uint64_t _startTicks;
+    double _ticksPerMicrosecond;
+
+    ThreadBuffer& threadBuffer();
+    void calibrate();
+
+public:
+    Profiler();
+
+    static uint64_t ticks();
+
+    void start();
+    void stop();
+    bool isRecording() const
+    {
+        return _isRecording.load(std::memory_order_relaxed);
+    }
+
+    // Zones are normally opened with PROFILE_SCOPE; beginZone()/endZone()
+    // serve callers that can't use RAII (e.g. AntTweakBar callbacks)
+    void beginZone(const char* name);
+    void endZone();
+    void record(const char* name, uint64_t begin, uint64_t end, uint32_t depth);
+    uint32_t pushDepth();
+    void popDepth();
+
+    // Moves the events of every thread into the collected list; call once per frame
+    void collect();
+    uint64_t droppedEvents();
+
+    bool writeChromeTrace(const string& fileName);
+};
+
+extern Profiler gProfiler;
+
+// Records the enclosing scope as one zone
+class ProfileZone
+{
+    const char* _name;
+    uint64_t _begin;
+    uint32_t _depth;
+    bool _isActive;
+
+public:
+    explicit ProfileZone(const char* name)
+        : _name(name), _begin(0), _depth(0), _isActive(gProfiler.isRecording())
+    {
+        if (_isActive) {
+            _depth = gProfiler.pushDepth();
+            _begin = Profiler::ticks();
+        }
+    }
+
+    ~ProfileZone()
+    {
+        if (_isActive) {
+            gProfiler.record(_name, _begin, Profiler::ticks(), _depth);
+            gProfiler.popDepth();
+        }
+    }
+};
+
+#define PROFILE_CONCAT_IMPL(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL(a, b)
+#define PROFILE_SCOPE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+
+#ifdef TW_PROFILE_ZONES
+// Callbacks for TwSetProfileZoneCallbacks()
+void TW_CALL profilerBeginTwZone(const char* name);
+void TW_CALL profilerEndTwZone();
+#endif
+
+#endif //PROFILER_H
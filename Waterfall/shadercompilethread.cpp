@@ -0,0 +1,425 @@
+#include "shadercompilethread.h"
+#include "profiler.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__linux__)
+#include <GL/glx.h>
+#include <X11/Xlib.h>
+#endif
+
+ShaderCompileThread gShaderCompileThread;
+
+namespace
+{
+    // Version and profile of the current context, for a shared one to match
+    void getContextVersion(GLint& major, GLint& minor, GLint& profileMask)
+    {
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        profileMask = 0;
+        if (GLEW_VERSION_3_2) {
+            glGetIntegerv(GL_CONTEXT_PROFILE_MASK, &profileMask);
+        }
+    }
+}
+
+#if defined(_WIN32)
+
+#ifndef WGL_CONTEXT_MAJOR_VERSION_ARB
+#define WGL_CONTEXT_MAJOR_VERSION_ARB 0x2091
+#define WGL_CONTEXT_MINOR_VERSION_ARB 0x2092
+#define WGL_CONTEXT_PROFILE_MASK_ARB  0x9126
+#endif
+
+typedef HGLRC (WINAPI *PFNWGLCREATECONTEXTATTRIBSARBPROC)(HDC dc, HGLRC shareContext, const int* attribs);
+
+// Made current with the window's own device context, which has the right pixel format
+struct ShaderCompileThread::Context
+{
+    HDC dc;
+    HGLRC context;
+};
+
+static bool createSharedContext(ShaderCompileThread::Context& context)
+{
+    context.dc = wglGetCurrentDC();
+    HGLRC renderContext = wglGetCurrentContext();
+    if (context.dc == NULL || renderContext == NULL) {
+        return false;
+    }
+
+    GLint major, minor, profileMask;
+    getContextVersion(major, minor, profileMask);
+
+    context.context = NULL;
+    PFNWGLCREATECONTEXTATTRIBSARBPROC createContextAttribs =
+        (PFNWGLCREATECONTEXTATTRIBSARBPROC)wglGetProcAddress("wglCreateContextAttribsARB");
+    if (createContextAttribs != NULL) {
+        const int attribs[] = {
+            WGL_CONTEXT_MAJOR_VERSION_ARB, major,
+            WGL_CONTEXT_MINOR_VERSION_ARB, minor,
+            profileMask != 0 ? WGL_CONTEXT_PROFILE_MASK_ARB : 0, profileMask,
+            0
+        };
+        context.context = createContextAttribs(context.dc, renderContext, attribs);
+    }
+    if (context.context == NULL) {
+        // Sharing has to be set up before the new context owns any objects
+        context.context = wglCreateContext(context.dc);
+        if (context.context != NULL && !wglShareLists(renderContext, context.context)) {
+            wglDeleteContext(context.context);
+            context.context = NULL;
+        }
+    }
+
+    return context.context != NULL;
+}
+
+static bool makeCurrent(ShaderCompileThread::Context& context)
+{
+    return wglMakeCurrent(context.dc, context.context) == TRUE;
+}
+
+static void releaseCurrent(ShaderCompileThread::Context&)
+{
+    wglMakeCurrent(NULL, NULL);
+}
+
+static void destroySharedContext(ShaderCompileThread::Context& context)
+{
+    wglDeleteContext(context.context);
+}
+
+#elif defined(__linux__)
+
+// Made current with a 1x1 pbuffer on an X connection of its own, so the thread
+// never touches the Xlib state GLUT uses
+struct ShaderCompileThread::Context
+{
+    Display* display;
+    GLXPbuffer pbuffer;
+    GLXContext context;
+};
+
+static bool gIsContextFailed = false;
+
+static int onContextError(Display*, XErrorEvent*)
+{
+    gIsContextFailed = true;
+    return 0;
+}
+
+static bool createSharedContext(ShaderCompileThread::Context& context)
+{
+    Display* renderDisplay = glXGetCurrentDisplay();
+    GLXContext renderContext = glXGetCurrentContext();
+    if (renderDisplay == NULL || renderContext == NULL) {
+        return false;
+    }
+
+    int screen = 0;
+    glXQueryContext(renderDisplay, renderContext, GLX_SCREEN, &screen);
+
+    context.display = XOpenDisplay(DisplayString(renderDisplay));
+    if (context.display == NULL) {
+        return false;
+    }
+
+    const int configAttribs[] = { GLX_DRAWABLE_TYPE, GLX_PBUFFER_BIT, GLX_RENDER_TYPE, GLX_RGBA_BIT, None };
+    int configsCount = 0;
+    GLXFBConfig* configs = glXChooseFBConfig(context.display, screen, configAttribs, &configsCount);
+    if (configs == NULL || configsCount == 0) {
+        XCloseDisplay(context.display);
+        return false;
+    }
+    GLXFBConfig config = configs[0];
+    XFree(configs);
+
+    GLint major, minor, profileMask;
+    getContextVersion(major, minor, profileMask);
+
+    // A context the driver can't share reports an X error instead of returning NULL
+    gIsContextFailed = false;
+    int (*previousHandler)(Display*, XErrorEvent*) = XSetErrorHandler(onContextError);
+
+    const int pbufferAttribs[] = { GLX_PBUFFER_WIDTH, 1, GLX_PBUFFER_HEIGHT, 1, None };
+    context.pbuffer = glXCreatePbuffer(context.display, config, pbufferAttribs);
+
+    context.context = NULL;
+    PFNGLXCREATECONTEXTATTRIBSARBPROC createContextAttribs =
+        (PFNGLXCREATECONTEXTATTRIBSARBPROC)glXGetProcAddressARB((const GLubyte*)"glXCreateContextAttribsARB");
+    if (createContextAttribs != NULL) {
+        const int attribs[] = {
+            GLX_CONTEXT_MAJOR_VERSION_ARB, major,
+            GLX_CONTEXT_MINOR_VERSION_ARB, minor,
+            profileMask != 0 ? GLX_CONTEXT_PROFILE_MASK_ARB : 0, profileMask,
+            None
+        };
+        context.context = createContextAttribs(context.display, config, renderContext, True, attribs);
+        XSync(context.display, False);
+    }
+    if (context.context == NULL || gIsContextFailed) {
+        gIsContextFailed = false;
+        context.context = glXCreateNewContext(context.display, config, GLX_RGBA_TYPE, renderContext, True);
+        XSync(context.display, False);
+    }
+
+    bool isCreated = context.pbuffer != 0 && context.context != NULL && !gIsContextFailed;
+    XSetErrorHandler(previousHandler);
+
+    if (!isCreated) {
+        if (context.context != NULL) {
+            glXDestroyContext(context.display, context.context);
+        }
+        if (context.pbuffer != 0) {
+            glXDestroyPbuffer(context.display, context.pbuffer);
+        }
+        XCloseDisplay(context.display);
+    }
+
+    return isCreated;
+}
+
+static bool makeCurrent(ShaderCompileThread::Context& context)
+{
+    return glXMakeContextCurrent(context.display, context.pbuffer, context.pbuffer, context.context) == True;
+}
+
+static void releaseCurrent(ShaderCompileThread::Context& context)
+{
+    glXMakeContextCurrent(context.display, None, None, NULL);
+}
+
+static void destroySharedContext(ShaderCompileThread::Context& context)
+{
+    glXDestroyContext(context.display, context.context);
+    glXDestroyPbuffer(context.display, context.pbuffer);
+    XCloseDisplay(context.display);
+}
+
+#else
+
+struct ShaderCompileThread::Context
+{};
+
+static bool createSharedContext(ShaderCompileThread::Context&)
+{
+    return false;
+}
+
+static bool makeCurrent(ShaderCompileThread::Context&)
+{
+    return false;
+}
+
+static void releaseCurrent(ShaderCompileThread::Context&)
+{}
+
+static void destroySharedContext(ShaderCompileThread::Context&)
+{}
+
+#endif
+
+ShaderCompileThread::ShaderCompileThread()
+    : _lastTicket(0), _doneTicket(0), _isStarting(false), _isCurrent(false), _isStopping(false)
+{}
+
+ShaderCompileThread::~ShaderCompileThread()
+{
+    // Without a context the shared one can't be destroyed here, see stop()
+    if (_thread.joinable()) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _isStopping = true;
+        _requests.clear();
+        lock.unlock();
+        _requestAdded.notify_all();
+        _thread.join();
+    }
+}
+
+bool ShaderCompileThread::start()
+{
+    if (isRunning()) {
+        return true;
+    }
+
+    std::unique_ptr<Context> context(new Context());
+    if (!createSharedContext(*context)) {
+        return false;
+    }
+
+    _context = std::move(context);
+    _isStarting = true;
+    _isStopping = false;
+    _thread = std::thread(&ShaderCompileThread::threadLoop, this);
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    _requestDone.wait(lock, [this]() { return !_isStarting; });
+    lock.unlock();
+    if (!_isCurrent) {
+        _thread.join();
+        destroySharedContext(*_context);
+        _context.reset();
+        return false;
+    }
+
+    return true;
+}
+
+void ShaderCompileThread::stop()
+{
+    if (!isRunning()) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    _isStopping = true;
+    lock.unlock();
+    _requestAdded.notify_all();
+    _thread.join();
+
+    destroySharedContext(*_context);
+    _context.reset();
+}
+
+bool ShaderCompileThread::isRunning() const
+{
+    return _context != NULL;
+}
+
+ShaderCompileThread::Ticket ShaderCompileThread::push(Request& request)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    request.ticket = ++_lastTicket;
+    _requests.push_back(request);
+    lock.unlock();
+    _requestAdded.notify_one();
+
+    return request.ticket;
+}
+
+ShaderCompileThread::Ticket ShaderCompileThread::compileShader(GLuint shader, const string& source)
+{
+    Request request;
+    request.type = COMPILE_SHADER;
+    request.program = 0;
+    request.shaders.assign(1, shader);
+    request.source = source;
+    request.feedbackMode = GL_INTERLEAVED_ATTRIBS;
+
+    return push(request);
+}
+
+ShaderCompileThread::Ticket ShaderCompileThread::linkProgram(GLuint program, const vector<GLuint>& shaders,
+                                                             const vector<string>& feedbackVaryings, GLenum feedbackMode)
+{
+    Request request;
+    request.type = LINK_PROGRAM;
+    request.program = program;
+    request.shaders = shaders;
+    request.feedbackVaryings = feedbackVaryings;
+    request.feedbackMode = feedbackMode;
+
+    return push(request);
+}
+
+ShaderCompileThread::Ticket ShaderCompileThread::deleteObjects(GLuint program, const vector<GLuint>& shaders)
+{
+    Request request;
+    request.type = DELETE_OBJECTS;
+    request.program = program;
+    request.shaders = shaders;
+    request.feedbackMode = GL_INTERLEAVED_ATTRIBS;
+
+    return push(request);
+}
+
+bool ShaderCompileThread::isDone(Ticket ticket)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _doneTicket >= ticket;
+}
+
+void ShaderCompileThread::wait(Ticket ticket)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _requestDone.wait(lock, [&]() { return _doneTicket >= ticket; });
+}
+
+void ShaderCompileThread::threadLoop()
+{
+    bool isCurrent = makeCurrent(*_context);
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    _isStarting = false;
+    _isCurrent = isCurrent;
+    _requestDone.notify_all();
+    if (!isCurrent) {
+        return;
+    }
+
+    for (;;) {
+        _requestAdded.wait(lock, [this]() { return _isStopping || !_requests.empty(); });
+        if (_requests.empty()) {
+            break;
+        }
+
+        Request request = _requests.front();
+        _requests.pop_front();
+        lock.unlock();
+
+        run(request);
+        // Other contexts are only guaranteed to see finished changes
+        glFinish();
+
+        lock.lock();
+        _doneTicket = request.ticket;
+        _requestDone.notify_all();
+    }
+    lock.unlock();
+
+    releaseCurrent(*_context);
+}
+
+void ShaderCompileThread::run(const Request& request)
+{
+    GLint status;
+    switch (request.type) {
+    case COMPILE_SHADER: {
+        PROFILE_SCOPE("ShaderCompileThread::compileShader");
+
+        const char* source = request.source.c_str();
+        glShaderSource(request.shaders[0], 1, &source, NULL);
+        glCompileShader(request.shaders[0]);
+        // Drivers that compile lazily do it here
+        glGetShaderiv(request.shaders[0], GL_COMPILE_STATUS, &status);
+        break;
+    }
+    case LINK_PROGRAM: {
+        PROFILE_SCOPE("ShaderCompileThread::linkProgram");
+
+        for (size_t i = 0; i < request.shaders.size(); ++i) {
+            glAttachShader(request.program, request.shaders[i]);
+        }
+        if (!request.feedbackVaryings.empty()) {
+            vector<const char*> varyings;
+            for (size_t i = 0; i < request.feedbackVaryings.size(); ++i) {
+                varyings.push_back(request.feedbackVaryings[i].c_str());
+            }
+            glTransformFeedbackVaryings(request.program, GLsizei(varyings.size()), &varyings[0], request.feedbackMode);
+        }
+        glLinkProgram(request.program);
+        glGetProgramiv(request.program, GL_LINK_STATUS, &status);
+        break;
+    }
+    case DELETE_OBJECTS:
+        if (request.program != 0) {
+            glDeleteProgram(request.program);
+        }
+        for (size_t i = 0; i < request.shaders.size(); ++i) {
+            glDeleteShader(request.shaders[i]);
+        }
+        break;
+    }
+}
@@ -0,0 +1,86 @@
+#ifndef SHADER_COMPILE_THREAD_H
+#define SHADER_COMPILE_THREAD_H
+
+#include "common.h"
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Compiles shaders and links programs on a thread of its own, in a GL context that
+// shares objects with the render one. Without GL_KHR_parallel_shader_compile it is
+// what keeps the driver's compiler off the render thread. The caller creates the
+// objects; requests run in the order they were made.
+class ShaderCompileThread
+{
+public:
+    typedef uint64_t Ticket;
+
+    // Platform specific: the shared context and whatever it is made current with
+    struct Context;
+
+private:
+    enum RequestType
+    {
+        COMPILE_SHADER,
+        LINK_PROGRAM,
+        DELETE_OBJECTS
+    };
+
+    struct Request
+    {
+        RequestType type;
+        Ticket ticket;
+        GLuint program;
+        vector<GLuint> shaders;
+        string source;
+        vector<string> feedbackVaryings;
+        GLenum feedbackMode;
+    };
+
+    std::unique_ptr<Context> _context;
+    std::thread _thread;
+    std::mutex _mutex;
+    std::condition_variable _requestAdded;
+    std::condition_variable _requestDone;
+    std::deque<Request> _requests;
+    Ticket _lastTicket;
+    Ticket _doneTicket;
+    // Until the thread has tried to make the context current, and whether it could
+    bool _isStarting;
+    bool _isCurrent;
+    bool _isStopping;
+
+    Ticket push(Request& request);
+    void threadLoop();
+    static void run(const Request& request);
+
+public:
+    ShaderCompileThread();
+    ~ShaderCompileThread();
+
+    // Creates the shared context from the current one and starts the thread; call on
+    // the render thread. False where no shared context can be made.
+    bool start();
+    // Runs what is still queued and stops; needs the render context
+    void stop();
+    bool isRunning() const;
+
+    // Sets the source of an already created shader and compiles it
+    Ticket compileShader(GLuint shader, const string& source);
+    // Attaches the shaders, sets the transform feedback varyings and links
+    Ticket linkProgram(GLuint program, const vector<GLuint>& shaders,
+                       const vector<string>& feedbackVaryings, GLenum feedbackMode);
+    // Deletes the objects once nothing queued before uses them; program may be 0
+    Ticket deleteObjects(GLuint program, const vector<GLuint>& shaders);
+
+    // True once this request and every one before it are done. Their status and
+    // logs can then be queried from the render context without waiting.
+    bool isDone(Ticket ticket);
+    void wait(Ticket ticket);
+};
+
+extern ShaderCompileThread gShaderCompileThread;
+
+#endif //SHADER_COMPILE_THREAD_H
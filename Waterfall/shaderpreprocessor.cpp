@@ -0,0 +1,136 @@
+#include "shaderpreprocessor.h"
+#include <algorithm>
+#include <sstream>
+
+static const size_t MAX_INCLUDED_FILES = 64;
+
+static string baseName(const string& path)
+{
+    size_t slash = path.find_last_of("/\\");
+    return slash == string::npos ? path : path.substr(slash + 1);
+}
+
+static string directoryName(const string& path)
+{
+    size_t slash = path.find_last_of("/\\");
+    return slash == string::npos ? string() : path.substr(0, slash + 1);
+}
+
+static string trimLeft(const string& line)
+{
+    size_t start = line.find_first_not_of(" \t");
+    return start == string::npos ? string() : line.substr(start);
+}
+
+// Shaders are referred to both as "shaders//x.geom" and "shaders/x.geom",
+// so files are matched by name only
+bool isSameShaderFile(const string& left, const string& right)
+{
+    return baseName(left) == baseName(right);
+}
+
+string shaderDefinesKey(const ShaderDefines& defines)
+{
+    string key;
+    for (ShaderDefines::const_iterator it = defines.begin(); it != defines.end(); ++it) {
+        key += it->first + "=" + it->second + ";";
+    }
+
+    return key;
+}
+
+void ShaderPreprocessor::setFileOverride(const string& fileName, const string& source)
+{
+    _overrides[baseName(fileName)] = source;
+}
+
+string ShaderPreprocessor::readFile(const string& fileName)
+{
+    std::map<string, string>::const_iterator it = _overrides.find(baseName(fileName));
+    if (it != _overrides.end()) {
+        return it->second;
+    }
+
+    ifstream fin(fileName.c_str(), std::ios::binary);
+    if (!fin.good()) {
+        throw std::runtime_error("Can't read shader: " + fileName);
+    }
+
+    return string((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+}
+
+PreprocessedShader ShaderPreprocessor::process(const string& fileName, const ShaderDefines& defines)
+{
+    PreprocessedShader result;
+    expand(fileName, result);
+
+    // Defines have to follow #version, which must stay the first statement
+    string definesBlock;
+    for (ShaderDefines::const_iterator it = defines.begin(); it != defines.end(); ++it) {
+        definesBlock += "#define " + it->first + " " + it->second + "\n";
+    }
+
+    size_t version = result.source.find("#version");
+    if (version != string::npos) {
+        size_t lineEnd = result.source.find('\n', version);
+        size_t insertAt = lineEnd == string::npos ? result.source.size() : lineEnd + 1;
+        size_t versionLine = std::count(result.source.begin(), result.source.begin() + insertAt, '\n');
+        std::ostringstream line;
+        line << "#line " << versionLine + 1 << " 0\n";
+        result.source.insert(insertAt, definesBlock + line.str());
+    }
+    else {
+        result.source.insert(0, definesBlock + "#line 1 0\n");
+    }
+
+    return result;
+}
+
+void ShaderPreprocessor::expand(const string& fileName, PreprocessedShader& result)
+{
+    if (result.dependencies.size() >= MAX_INCLUDED_FILES) {
+        throw std::runtime_error("Too many shader includes: " + fileName);
+    }
+
+    for (size_t i = 0; i < result.dependencies.size(); ++i) {
+        if (isSameShaderFile(result.dependencies[i], fileName)) {
+            // Every file is included once, which also breaks include cycles
+            return;
+        }
+    }
+
+    size_t fileIndex = result.dependencies.size();
+    result.dependencies.push_back(fileName);
+
+    std::istringstream source(readFile(fileName));
+    string line;
+    size_t lineNumber = 0;
+    while (std::getline(source, line)) {
+        ++lineNumber;
+
+        string directive = trimLeft(line);
+        if (directive.compare(0, 8, "#include") != 0) {
+            result.source += line + "\n";
+            continue;
+        }
+
+        size_t open = directive.find('"');
+        size_t close = open == string::npos ? string::npos : directive.find('"', open + 1);
+        if (close == string::npos) {
+            throw std::runtime_error(fileName + ": malformed #include");
+        }
+
+        string includeName = directoryName(fileName) + directive.substr(open + 1, close - open - 1);
+
+        // #line keeps compiler messages pointing at the right file (by index) and line
+        std::ostringstream lineDirective;
+        lineDirective << "#line 1 " << result.dependencies.size() << "\n";
+        result.source += lineDirective.str();
+
+        expand(includeName, result);
+
+        lineDirective.str("");
+        lineDirective << "#line " << lineNumber + 1 << " " << fileIndex << "\n";
+        result.source += lineDirective.str();
+    }
+}
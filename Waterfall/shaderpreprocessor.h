@@ -0,0 +1,38 @@
+#ifndef SHADER_PREPROCESSOR_H
+#define SHADER_PREPROCESSOR_H
+
+#include "common.h"
+#include <map>
+
+// Defines injected after #version, e.g. { "TEX_ROW_COUNT", "8" }.
+// std::map keeps them sorted, so equal sets always produce the same key.
+typedef std::map<string, string> ShaderDefines;
+
+string shaderDefinesKey(const ShaderDefines& defines);
+
+struct PreprocessedShader
+{
+    string source;
+    // The shader file itself and every file it includes
+    vector<string> dependencies;
+};
+
+// Expands #include "file" (relative to the including file, each file at most once)
+// and injects defines, so a single source can be specialized at compile time.
+class ShaderPreprocessor
+{
+    std::map<string, string> _overrides;
+
+    string readFile(const string& fileName);
+    void expand(const string& fileName, PreprocessedShader& result);
+
+public:
+    // Use this source instead of reading the file from disk (hot reload)
+    void setFileOverride(const string& fileName, const string& source);
+
+    PreprocessedShader process(const string& fileName, const ShaderDefines& defines);
+};
+
+bool isSameShaderFile(const string& left, const string& right);
+
+#endif //SHADER_PREPROCESSOR_H
@@ -1,34 +1,158 @@
 #include "shaders.h"
+#include "frameconstants.h"
+#include "glstate.h"
+#include <algorithm>
+#include <cstring>
+#include <sstream>
 
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+typedef void (GLAPIENTRY *PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+
+// GL_KHR_parallel_shader_compile lets the driver compile and link on its own threads
+// and report completion without blocking. GLEW 1.10 predates it, so look it up by hand.
+bool hasParallelShaderCompile()
+{
+    static int supported = -1;
+    if (supported >= 0) {
+        return supported == 1;
+    }
+
+    supported = 0;
+    GLint extensionsCount = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &extensionsCount);
+    for (GLint i = 0; i < extensionsCount; ++i) {
+        const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+        if (extension != NULL && strcmp(extension, "GL_KHR_parallel_shader_compile") == 0) {
+            supported = 1;
+            break;
+        }
+    }
+
+    if (supported) {
+        PFNGLMAXSHADERCOMPILERTHREADSKHRPROC maxShaderCompilerThreads =
+            (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)glutGetProcAddress("glMaxShaderCompilerThreadsKHR");
+        if (maxShaderCompilerThreads != NULL) {
+            maxShaderCompilerThreads(0xFFFFFFFF);
+        }
+    }
+
+    return supported == 1;
+}
+
+static string getShaderLog(GLuint shader)
+{
+    int infoLogLength = 0;
+    glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &infoLogLength);
+
+    string buffer;
+    if (infoLogLength > 0) {
+        buffer.resize(infoLogLength);
+        glGetShaderInfoLog(shader, infoLogLength, NULL, &buffer[0]);
+    }
+
+    return buffer;
+}
+
+static string getProgramLog(GLuint program)
+{
+    int infoLogLength = 0;
+    glGetProgramiv(program, GL_INFO_LOG_LENGTH, &infoLogLength);
+
+    string buffer;
+    if (infoLogLength > 0) {
+        buffer.resize(infoLogLength);
+        glGetProgramInfoLog(program, infoLogLength, NULL, &buffer[0]);
+    }
+
+    return buffer;
+}
 
 WShader::WShader()
-    : _isCompiled(false)
+    : _shader(0), _isCompiled(false), _isPending(false), _compileTicket(0)
 {}
 
 bool WShader::createShader(GLenum type, const string& fileName)
 {
-    ifstream fin(fileName.c_str(), std::ios::binary);
-    string fileStr((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+    beginCompile(type, fileName);
+
+    string log;
+    if (!finishCompile(log) && !log.empty()) {
+        throw std::runtime_error(fileName + ": " + log);
+    }
+
+    return _isCompiled;
+}
+
+void WShader::beginCompile(GLenum type, const string& fileName, const ShaderDefines& defines)
+{
+    ShaderPreprocessor preprocessor;
+    PreprocessedShader preprocessed = preprocessor.process(fileName, defines);
+
+    beginCompileSource(type, fileName, preprocessed.source);
+    _defines = defines;
+    _dependencies = preprocessed.dependencies;
+}
 
+void WShader::beginCompileSource(GLenum type, const string& fileName, const string& source)
+{
     _shader = glCreateShader(type);
-    char const* source = fileStr.c_str();
-    glShaderSource(_shader, 1, &source, NULL);
-    glCompileShader(_shader);
+    if (gShaderCompileThread.isRunning()) {
+        _compileTicket = gShaderCompileThread.compileShader(_shader, source);
+    }
+    else {
+        hasParallelShaderCompile();
+
+        char const* sourcePtr = source.c_str();
+        glShaderSource(_shader, 1, &sourcePtr, NULL);
+        glCompileShader(_shader);
+        _compileTicket = 0;
+    }
+
+    _type = type;
+    _fileName = fileName;
+    _source = source;
+    _defines.clear();
+    _dependencies.assign(1, fileName);
+    _isCompiled = false;
+    _isPending = true;
+}
+
+bool WShader::isCompileFinished()
+{
+    if (!_isPending) {
+        return true;
+    }
+    if (_compileTicket != 0) {
+        return gShaderCompileThread.isDone(_compileTicket);
+    }
+    if (!hasParallelShaderCompile()) {
+        return true;
+    }
+
+    GLint completed = GL_FALSE;
+    glGetShaderiv(_shader, GL_COMPLETION_STATUS_KHR, &completed);
+    return completed == GL_TRUE;
+}
+
+bool WShader::finishCompile(string& log)
+{
+    if (!_isPending) {
+        return _isCompiled;
+    }
+    if (_compileTicket != 0) {
+        gShaderCompileThread.wait(_compileTicket);
+    }
 
     GLint status;
     glGetShaderiv(_shader, GL_COMPILE_STATUS, &status);
     if (!status) {
-        int infoLogLength;
-        glGetShaderiv(_shader, GL_INFO_LOG_LENGTH, &infoLogLength);
-        if (infoLogLength > 0) {
-            string buffer;
-            buffer.resize(infoLogLength);
-            glGetShaderInfoLog(_shader, infoLogLength, NULL, &buffer[0]);
-            throw std::runtime_error(fileName + ": " + buffer);
-        }
+        log = getShaderLog(_shader);
     }
 
-    _type = type;
+    _isPending = false;
     _isCompiled = status == GL_TRUE;
 
     return _isCompiled;
@@ -39,23 +163,109 @@ bool WShader::isCompiled()
     return _isCompiled;
 }
 
+bool WShader::isPending()
+{
+    return _isPending;
+}
+
 GLuint WShader::getShaderId()
 {
     return _shader;
 }
 
+GLenum WShader::getType()
+{
+    return _type;
+}
+
+const string& WShader::getFileName()
+{
+    return _fileName;
+}
+
+const string& WShader::getSource()
+{
+    return _source;
+}
+
+const ShaderDefines& WShader::getDefines()
+{
+    return _defines;
+}
+
+const vector<string>& WShader::getDependencies()
+{
+    return _dependencies;
+}
+
 void WShader::deleteShader()
 {
-    if (!_isCompiled) {
+    if (!_isCompiled && !_isPending) {
         return;
     }
-    
-    glDeleteShader(_shader);
+
+    if (gShaderCompileThread.isRunning()) {
+        // After whatever is still queued for it
+        gShaderCompileThread.deleteObjects(0, vector<GLuint>(1, _shader));
+    }
+    else {
+        glDeleteShader(_shader);
+    }
     _isCompiled = false;
+    _isPending = false;
+}
+
+static bool dependsOn(const vector<string>& dependencies, const string& fileName)
+{
+    for (size_t i = 0; i < dependencies.size(); ++i) {
+        if (isSameShaderFile(dependencies[i], fileName)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+WShader* WShaderCache::getShader(GLenum type, const string& fileName, const ShaderDefines& defines)
+{
+    std::ostringstream key;
+    key << type << ":" << fileName << ":" << shaderDefinesKey(defines);
+
+    std::map<string, WShader>::iterator it = _shaders.find(key.str());
+    if (it == _shaders.end()) {
+        it = _shaders.insert(std::make_pair(key.str(), WShader())).first;
+        it->second.beginCompile(type, fileName, defines);
+    }
+
+    return &it->second;
+}
+
+void WShaderCache::invalidate(const string& fileName)
+{
+    std::map<string, WShader>::iterator it = _shaders.begin();
+    while (it != _shaders.end()) {
+        if (dependsOn(it->second.getDependencies(), fileName)) {
+            // Programs keep their attached copy alive until they are deleted
+            it->second.deleteShader();
+            _shaders.erase(it++);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+void WShaderCache::clear()
+{
+    for (std::map<string, WShader>::iterator it = _shaders.begin(); it != _shaders.end(); ++it) {
+        it->second.deleteShader();
+    }
+    _shaders.clear();
 }
 
 WProgram::WProgram()
-    : _isLinked(false)
+    : _program(0), _isLinked(false), _feedbackMode(GL_INTERLEAVED_ATTRIBS), _pendingProgram(0), _pendingPolls(0),
+      _pendingTicket(0)
 {}
 
 void WProgram::createProgram()
@@ -65,49 +275,260 @@ void WProgram::createProgram()
 
 bool WProgram::addShader(WShader* shader)
 {
-    if (!shader->isCompiled()) {
+    if (!shader->isCompiled() && !shader->isPending()) {
         return false;
     }
 
-    glAttachShader(_program, shader->getShaderId());
+    // Attached when the program is linked, the shader may still be compiling
+    ShaderSource shaderSource;
+    shaderSource.type = shader->getType();
+    shaderSource.fileName = shader->getFileName();
+    shaderSource.source = shader->getSource();
+    shaderSource.defines = shader->getDefines();
+    shaderSource.dependencies = shader->getDependencies();
+    shaderSource.shader = shader->getShaderId();
+    _shaderSources.push_back(shaderSource);
+
     return true;
 }
 
+void WProgram::setTransformFeedbackVaryings(const char* const* varyings, size_t count, GLenum bufferMode)
+{
+    _feedbackVaryings.assign(varyings, varyings + count);
+    _feedbackMode = bufferMode;
+}
+
+void WProgram::applyTransformFeedbackVaryings(GLuint program)
+{
+    if (_feedbackVaryings.empty()) {
+        return;
+    }
+
+    vector<const char*> varyings;
+    for (size_t i = 0; i < _feedbackVaryings.size(); ++i) {
+        varyings.push_back(_feedbackVaryings[i].c_str());
+    }
+    glTransformFeedbackVaryings(program, varyings.size(), &varyings[0], _feedbackMode);
+}
+
 bool WProgram::linkProgram()
 {
+    for (size_t i = 0; i < _shaderSources.size(); ++i) {
+        glAttachShader(_program, _shaderSources[i].shader);
+    }
+    applyTransformFeedbackVaryings(_program);
     glLinkProgram(_program);
 
     GLint status;
     glGetProgramiv(_program, GL_LINK_STATUS, &status);
     if (!status) {
-        int infoLogLength;
-        glGetProgramiv(_program, GL_INFO_LOG_LENGTH, &infoLogLength);
-        if (infoLogLength > 0) {
-            string buffer;
-            buffer.resize(infoLogLength);
-            glGetProgramInfoLog(_program, infoLogLength, NULL, &buffer[0]);
-            throw std::runtime_error(buffer);
+        string log = getProgramLog(_program);
+        if (!log.empty()) {
+            throw std::runtime_error(log);
         }
     }
 
     _isLinked = status == GL_TRUE;
+    if (_isLinked) {
+        bindUniformBlock(FRAME_CONSTANTS_BLOCK, FRAME_CONSTANTS_BINDING);
+        cacheUniforms();
+    }
+
     return _isLinked;
 }
 
-void WProgram::deleteProgram()
+void WProgram::beginLink()
 {
-    if (!_isLinked) {
-        return;
+    cancelPendingLink();
+
+    vector<GLuint> shaders;
+    for (size_t i = 0; i < _shaderSources.size(); ++i) {
+        shaders.push_back(_shaderSources[i].shader);
     }
+    startLink(_program, shaders);
+}
 
-    glDeleteProgram(_program);
+// Every program is linked once, so attaching here never attaches a shader twice
+void WProgram::startLink(GLuint program, const vector<GLuint>& shaders)
+{
+    if (gShaderCompileThread.isRunning()) {
+        _pendingTicket = gShaderCompileThread.linkProgram(program, shaders, _feedbackVaryings, _feedbackMode);
+    }
+    else {
+        for (size_t i = 0; i < shaders.size(); ++i) {
+            glAttachShader(program, shaders[i]);
+        }
+        applyTransformFeedbackVaryings(program);
+        glLinkProgram(program);
+        _pendingTicket = 0;
+    }
+
+    _pendingProgram = program;
+    _pendingShaders = shaders;
+    _pendingPolls = 0;
+}
+
+bool WProgram::isLinkFinished()
+{
+    if (_pendingTicket != 0) {
+        return gShaderCompileThread.isDone(_pendingTicket);
+    }
+
+    if (hasParallelShaderCompile()) {
+        GLint completed = GL_FALSE;
+        glGetProgramiv(_pendingProgram, GL_COMPLETION_STATUS_KHR, &completed);
+        return completed == GL_TRUE;
+    }
+
+    // Only when the compile thread couldn't start either: there is no way to ask
+    // without waiting. A frame of slack lets drivers that link on their own threads
+    // get ahead, then the GL_LINK_STATUS query in pollLink() blocks until it is done.
+    return ++_pendingPolls > 1;
+}
+
+bool WProgram::pollLink()
+{
+    if (_pendingProgram == 0 || !isLinkFinished()) {
+        return false;
+    }
+
+    GLint status;
+    glGetProgramiv(_pendingProgram, GL_LINK_STATUS, &status);
+    if (!status) {
+        // Keep whatever was in use before and report why the new version failed
+        for (size_t i = 0; i < _pendingShaders.size(); ++i) {
+            std::cerr << getShaderLog(_pendingShaders[i]);
+        }
+        std::cerr << getProgramLog(_pendingProgram) << std::endl;
+
+        cancelPendingLink();
+        return false;
+    }
+
+    if (_pendingProgram != _program) {
+        if (_program != 0) {
+            glDeleteProgram(_program);
+        }
+        _program = _pendingProgram;
+
+        // The rebuilt shaders are owned by the program only: deleting them just flags
+        // them, and they live, handles included, as long as the program they are in
+        for (size_t i = 0; i < _pendingShaders.size(); ++i) {
+            _shaderSources[i].shader = _pendingShaders[i];
+            glDeleteShader(_pendingShaders[i]);
+        }
+    }
+    _pendingProgram = 0;
+    _pendingShaders.clear();
+    _pendingTicket = 0;
+
+    _isLinked = true;
+    bindUniformBlock(FRAME_CONSTANTS_BLOCK, FRAME_CONSTANTS_BINDING);
+    cacheUniforms();
+
+    return true;
+}
+
+void WProgram::cancelPendingLink()
+{
+    if (_pendingProgram != 0 && _pendingProgram != _program) {
+        if (_pendingTicket != 0) {
+            // The thread may still be linking it
+            gShaderCompileThread.deleteObjects(_pendingProgram, _pendingShaders);
+        }
+        else {
+            glDeleteProgram(_pendingProgram);
+            for (size_t i = 0; i < _pendingShaders.size(); ++i) {
+                glDeleteShader(_pendingShaders[i]);
+            }
+        }
+    }
+
+    _pendingProgram = 0;
+    _pendingShaders.clear();
+    _pendingTicket = 0;
+}
+
+bool WProgram::usesShaderFile(const string& fileName) const
+{
+    for (size_t i = 0; i < _shaderSources.size(); ++i) {
+        if (dependsOn(_shaderSources[i].dependencies, fileName)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void WProgram::beginRebuild(const string& fileName, const string& source)
+{
+    cancelPendingLink();
+
+    ShaderPreprocessor preprocessor;
+    preprocessor.setFileOverride(fileName, source);
+    for (size_t i = 0; i < _shaderSources.size(); ++i) {
+        ShaderSource& shaderSource = _shaderSources[i];
+        if (!dependsOn(shaderSource.dependencies, fileName)) {
+            continue;
+        }
+
+        try {
+            PreprocessedShader preprocessed = preprocessor.process(shaderSource.fileName, shaderSource.defines);
+            shaderSource.source = preprocessed.source;
+            shaderSource.dependencies = preprocessed.dependencies;
+        }
+        catch (std::exception const& except) {
+            std::cerr << except.what() << std::endl;
+            return;
+        }
+    }
+
+    vector<GLuint> shaders;
+    for (size_t i = 0; i < _shaderSources.size(); ++i) {
+        WShader shader;
+        shader.beginCompileSource(_shaderSources[i].type, _shaderSources[i].fileName, _shaderSources[i].source);
+        shaders.push_back(shader.getShaderId());
+    }
+    startLink(glCreateProgram(), shaders);
+}
+
+bool WProgram::isLinked()
+{
+    return _isLinked;
+}
+
+void WProgram::bindUniformBlock(const string& blockName, GLuint bindingPoint)
+{
+    GLuint blockIndex = glGetUniformBlockIndex(_program, blockName.c_str());
+    if (blockIndex != GL_INVALID_INDEX) {
+        glUniformBlockBinding(_program, blockIndex, bindingPoint);
+    }
+}
+
+void WProgram::deleteProgram()
+{
+    bool isFirstLinkPending = _pendingProgram != 0 && _pendingProgram == _program;
+    cancelPendingLink();
+
+    if (_program != 0) {
+        if (isFirstLinkPending && gShaderCompileThread.isRunning()) {
+            // Its shaders belong to the shader cache
+            gShaderCompileThread.deleteObjects(_program, vector<GLuint>());
+        }
+        else {
+            glDeleteProgram(_program);
+        }
+        _program = 0;
+    }
     _isLinked = false;
+    _uniforms.clear();
+    _uniformValues.clear();
 }
 
 void WProgram::useProgram()
 {
     if (_isLinked) {
-        glUseProgram(_program);
+        gGLState.useProgram(_program);
     }
 }
 
@@ -116,11 +537,229 @@ GLuint WProgram::getProgramId()
     return _program;
 }
 
+// Samplers and images are set as one int each
+static bool isOpaqueUniformType(GLenum type)
+{
+    return (type >= GL_SAMPLER_1D && type <= GL_SAMPLER_2D_RECT_SHADOW)
+        || (type >= GL_SAMPLER_1D_ARRAY && type <= GL_SAMPLER_CUBE_SHADOW)
+        || (type >= GL_INT_SAMPLER_1D && type <= GL_UNSIGNED_INT_SAMPLER_BUFFER)
+        || (type >= GL_SAMPLER_CUBE_MAP_ARRAY && type <= GL_UNSIGNED_INT_SAMPLER_CUBE_MAP_ARRAY)
+        || (type >= GL_IMAGE_1D && type <= GL_UNSIGNED_INT_IMAGE_2D_MULTISAMPLE_ARRAY)
+        || (type >= GL_SAMPLER_2D_MULTISAMPLE && type <= GL_UNSIGNED_INT_SAMPLER_2D_MULTISAMPLE_ARRAY);
+}
+
+// Bytes of one element of a uniform of this type, 0 for types it doesn't know
+static size_t uniformTypeSize(GLenum type)
+{
+    switch (type) {
+    case GL_FLOAT:
+    case GL_INT:
+    case GL_UNSIGNED_INT:
+    case GL_BOOL:
+        return sizeof(GLint);
+    case GL_FLOAT_VEC2:
+    case GL_INT_VEC2:
+    case GL_UNSIGNED_INT_VEC2:
+    case GL_BOOL_VEC2:
+        return 2 * sizeof(GLint);
+    case GL_FLOAT_VEC3:
+    case GL_INT_VEC3:
+    case GL_UNSIGNED_INT_VEC3:
+    case GL_BOOL_VEC3:
+        return 3 * sizeof(GLint);
+    case GL_FLOAT_VEC4:
+    case GL_INT_VEC4:
+    case GL_UNSIGNED_INT_VEC4:
+    case GL_BOOL_VEC4:
+    case GL_FLOAT_MAT2:
+        return 4 * sizeof(GLfloat);
+    case GL_FLOAT_MAT2x3:
+    case GL_FLOAT_MAT3x2:
+        return 6 * sizeof(GLfloat);
+    case GL_FLOAT_MAT2x4:
+    case GL_FLOAT_MAT4x2:
+        return 8 * sizeof(GLfloat);
+    case GL_FLOAT_MAT3:
+        return 9 * sizeof(GLfloat);
+    case GL_FLOAT_MAT3x4:
+    case GL_FLOAT_MAT4x3:
+        return 12 * sizeof(GLfloat);
+    case GL_FLOAT_MAT4:
+        return 16 * sizeof(GLfloat);
+    case GL_DOUBLE:
+        return sizeof(GLdouble);
+    case GL_DOUBLE_VEC2:
+        return 2 * sizeof(GLdouble);
+    case GL_DOUBLE_VEC3:
+        return 3 * sizeof(GLdouble);
+    case GL_DOUBLE_VEC4:
+    case GL_DOUBLE_MAT2:
+        return 4 * sizeof(GLdouble);
+    case GL_DOUBLE_MAT2x3:
+    case GL_DOUBLE_MAT3x2:
+        return 6 * sizeof(GLdouble);
+    case GL_DOUBLE_MAT2x4:
+    case GL_DOUBLE_MAT4x2:
+        return 8 * sizeof(GLdouble);
+    case GL_DOUBLE_MAT3:
+        return 9 * sizeof(GLdouble);
+    case GL_DOUBLE_MAT3x4:
+    case GL_DOUBLE_MAT4x3:
+        return 12 * sizeof(GLdouble);
+    case GL_DOUBLE_MAT4:
+        return 16 * sizeof(GLdouble);
+    default:
+        return isOpaqueUniformType(type) ? sizeof(GLint) : 0;
+    }
+}
+
+void WProgram::cacheUniforms()
+{
+    _uniforms.clear();
+    _uniformValues.clear();
+
+    GLint uniformsCount = 0;
+    GLint maxNameLength = 0;
+    glGetProgramiv(_program, GL_ACTIVE_UNIFORMS, &uniformsCount);
+    glGetProgramiv(_program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+
+    string name;
+    name.resize(std::max(maxNameLength, 1));
+
+    size_t valuesSize = 0;
+    for (GLint i = 0; i < uniformsCount; ++i) {
+        GLsizei nameLength = 0;
+        GLint arraySize = 0;
+        GLenum type;
+        glGetActiveUniform(_program, i, maxNameLength, &nameLength, &arraySize, &type, &name[0]);
+
+        // Arrays are reported as "name[0]", but are looked up by the plain name
+        string uniformName(name.c_str(), nameLength);
+        size_t bracket = uniformName.find('[');
+        if (bracket != string::npos) {
+            uniformName.resize(bracket);
+        }
+
+        GLint location = glGetUniformLocation(_program, uniformName.c_str());
+        if (location < 0) {
+            // Uniforms inside uniform blocks have no location
+            continue;
+        }
+
+        size_t typeSize = uniformTypeSize(type);
+        if (typeSize == 0) {
+            // With no room for a value, every set of it goes to GL as is
+            std::cerr << "Unknown type 0x" << std::hex << type << std::dec << " of uniform " << uniformName << std::endl;
+        }
+
+        UniformInfo info;
+        info.hash = hashUniformName(uniformName.c_str());
+        info.location = location;
+        info.type = type;
+        info.valueOffset = valuesSize;
+        info.valueSize = typeSize * arraySize;
+        info.hasValue = false;
+
+        valuesSize += info.valueSize;
+        _uniforms.push_back(info);
+    }
+
+    std::sort(_uniforms.begin(), _uniforms.end(), [](UniformInfo const& a, UniformInfo const& b) {
+        return a.hash < b.hash;
+    });
+
+    for (size_t i = 1; i < _uniforms.size(); ++i) {
+        if (_uniforms[i].hash == _uniforms[i - 1].hash) {
+            throw std::runtime_error("Uniform name hash collision in program");
+        }
+    }
+
+    _uniformValues.resize(valuesSize);
+}
+
+int WProgram::findUniform(uint32_t hash) const
+{
+    auto it = std::lower_bound(_uniforms.begin(), _uniforms.end(), hash, [](UniformInfo const& info, uint32_t hash) {
+        return info.hash < hash;
+    });
+
+    if (it == _uniforms.end() || it->hash != hash) {
+        return -1;
+    }
+
+    return int(it - _uniforms.begin());
+}
+
+bool WProgram::updateUniformValue(int slot, const void* data, size_t size)
+{
+    UniformInfo& info = _uniforms[slot];
+    if (size > info.valueSize) {
+        // Writing past the declared array size; let GL deal with it
+        return true;
+    }
+
+    GLubyte* value = &_uniformValues[info.valueOffset];
+    if (info.hasValue && memcmp(value, data, size) == 0) {
+        return false;
+    }
+
+    memcpy(value, data, size);
+    // A partial write leaves the tail of an array unknown
+    info.hasValue = size == info.valueSize;
+
+    return true;
+}
+
+void WProgram::uploadUniform(GLint location, int count, const int* values)
+{
+    glUniform1iv(location, count, values);
+}
+
+void WProgram::uploadUniform(GLint location, int count, const float* values)
+{
+    glUniform1fv(location, count, values);
+}
+
+void WProgram::uploadUniform(GLint location, int count, const vec2* vectors)
+{
+    glUniform2fv(location, count, (const GLfloat*)vectors);
+}
+
+void WProgram::uploadUniform(GLint location, int count, const vec3* vectors)
+{
+    glUniform3fv(location, count, (const GLfloat*)vectors);
+}
+
+void WProgram::uploadUniform(GLint location, int count, const vec4* vectors)
+{
+    glUniform4fv(location, count, (const GLfloat*)vectors);
+}
+
+void WProgram::uploadUniform(GLint location, int count, const mat3* matrices)
+{
+    glUniformMatrix3fv(location, count, GL_FALSE, (const GLfloat*)matrices);
+}
+
+void WProgram::uploadUniform(GLint location, int count, const mat4* matrices)
+{
+    glUniformMatrix4fv(location, count, GL_FALSE, (const GLfloat*)matrices);
+}
+
+template <typename T>
+void WProgram::setUniformByName(const string& name, int count, const T* values)
+{
+    int slot = findUniform(hashUniformName(name.c_str()));
+    if (slot < 0 || !updateUniformValue(slot, values, count * sizeof(T))) {
+        return;
+    }
+
+    uploadUniform(_uniforms[slot].location, count, values);
+}
+
 // Setting floats
 void WProgram::setUniform(const string& name, int count, float* values)
 {
-    GLint loc = glGetUniformLocation(_program, name.c_str());
-    glUniform1fv(loc, count, values);
+    setUniformByName(name, count, values);
 }
 
 void WProgram::setUniform(const string& name, float value)
@@ -131,8 +770,7 @@ void WProgram::setUniform(const string& name, float value)
 // Setting vectors
 void WProgram::setUniform(const string& name, int count, vec2* vectors)
 {
-    GLint loc = glGetUniformLocation(_program, name.c_str());
-    glUniform2fv(loc, count, (GLfloat*)vectors);
+    setUniformByName(name, count, vectors);
 }
 
 void WProgram::setUniform(const string& name, vec2 vector)
@@ -142,8 +780,7 @@ void WProgram::setUniform(const string& name, vec2 vector)
 
 void WProgram::setUniform(const string& name, int count, vec3* vectors)
 {
-    GLint loc = glGetUniformLocation(_program, name.c_str());
-    glUniform3fv(loc, count, (GLfloat*)vectors);
+    setUniformByName(name, count, vectors);
 }
 
 void WProgram::setUniform(const string& name, vec3 vector)
@@ -153,8 +790,7 @@ void WProgram::setUniform(const string& name, vec3 vector)
 
 void WProgram::setUniform(const string& name, int count, vec4* vectors)
 {
-    GLint loc = glGetUniformLocation(_program, name.c_str());
-    glUniform4fv(loc, count, (GLfloat*)vectors);
+    setUniformByName(name, count, vectors);
 }
 
 void WProgram::setUniform(const string& name, vec4 vector)
@@ -165,8 +801,7 @@ void WProgram::setUniform(const string& name, vec4 vector)
 // Setting 3x3 matrices
 void WProgram::setUniform(const string& name, int count, mat3* matrices)
 {
-    GLint loc = glGetUniformLocation(_program, name.c_str());
-    glUniformMatrix3fv(loc, count, FALSE, (GLfloat*)matrices);
+    setUniformByName(name, count, matrices);
 }
 
 void WProgram::setUniform(const string& name, mat3 matrix)
@@ -177,8 +812,7 @@ void WProgram::setUniform(const string& name, mat3 matrix)
 // Setting 4x4 matrices
 void WProgram::setUniform(const string& name, int count, mat4* matrices)
 {
-    GLint loc = glGetUniformLocation(_program, name.c_str());
-    glUniformMatrix4fv(loc, count, FALSE, (GLfloat*)matrices);
+    setUniformByName(name, count, matrices);
 }
 
 void WProgram::setUniform(const string& name, mat4 matrix)
@@ -189,8 +823,7 @@ void WProgram::setUniform(const string& name, mat4 matrix)
 // Setting integers
 void WProgram::setUniform(const string& name, int count, int* values)
 {
-    GLint loc = glGetUniformLocation(_program, name.c_str());
-    glUniform1iv(loc, count, values);
+    setUniformByName(name, count, values);
 }
 
 void WProgram::setUniform(const string& name, int value)
@@ -2,41 +2,201 @@
 #define SHADERS_H
 
 #include "common.h"
+#include "shadercompilethread.h"
+#include "shaderpreprocessor.h"
+
+// True when the driver compiles and links in the background by itself
+// (GL_KHR_parallel_shader_compile). Otherwise gShaderCompileThread can do it.
+bool hasParallelShaderCompile();
+
+// FNV-1a hash of a uniform name. It is constexpr, so names known at compile time
+// (see WUNIFORM) are hashed by the compiler and hot paths never touch strings.
+constexpr uint32_t hashUniformName(const char* name, uint32_t hash = 2166136261u)
+{
+    return *name ? hashUniformName(name + 1, (hash ^ uint32_t((unsigned char)*name)) * 16777619u) : hash;
+}
+
+template <uint32_t Hash>
+struct WUniformHash
+{
+    static const uint32_t value = Hash;
+};
+
+// Compile-time hash of a uniform name literal
+#define WUNIFORM(name) (WUniformHash<hashUniformName(name)>::value)
+
+// Typed handle to a uniform of a linked WProgram, resolved once after linking
+template <typename T>
+class WUniform
+{
+    GLint _location;
+    int _slot;
+
+    friend class WProgram;
+
+public:
+    WUniform()
+        : _location(-1), _slot(-1)
+    {}
+
+    bool isValid() const
+    {
+        return _slot >= 0;
+    }
+};
 
 class WShader
 {
     GLuint _shader;
     GLenum _type;
     bool _isCompiled;
+    bool _isPending;
+    // Of the compile request on gShaderCompileThread, 0 when compiled here
+    ShaderCompileThread::Ticket _compileTicket;
+    string _fileName;
+    string _source;
+    ShaderDefines _defines;
+    vector<string> _dependencies;
 
 public:
     WShader();
 
+    // Compiles and waits for the result, throws on compile errors
     bool createShader(GLenum type, const string& fileName);
+
+    // Issues the compile without waiting for it; poll isCompileFinished()
+    // and call finishCompile() to get the status. That never stalls when the
+    // driver compiles in the background or gShaderCompileThread is running;
+    // with neither isCompileFinished() is always true and finishCompile() waits.
+    // The file is run through ShaderPreprocessor with the given defines.
+    void beginCompile(GLenum type, const string& fileName, const ShaderDefines& defines = ShaderDefines());
+    void beginCompileSource(GLenum type, const string& fileName, const string& source);
+    bool isCompileFinished();
+    bool finishCompile(string& log);
+
     void deleteShader();
 
     bool isCompiled();
+    bool isPending();
     GLuint getShaderId();
+    GLenum getType();
+    const string& getFileName();
+    const string& getSource();
+    const ShaderDefines& getDefines();
+    const vector<string>& getDependencies();
+};
+
+// Compiled shader permutations, keyed by stage, file and define set
+class WShaderCache
+{
+    std::map<string, WShader> _shaders;
+
+public:
+    WShader* getShader(GLenum type, const string& fileName, const ShaderDefines& defines);
+
+    // Drops every permutation that includes fileName
+    void invalidate(const string& fileName);
+    void clear();
 };
 
 class WProgram
 {
+    struct UniformInfo
+    {
+        uint32_t hash;
+        GLint location;
+        GLenum type;
+        size_t valueOffset;
+        size_t valueSize;
+        bool hasValue;
+    };
+
+    struct ShaderSource
+    {
+        GLenum type;
+        string fileName;
+        string source;
+        ShaderDefines defines;
+        vector<string> dependencies;
+        // The compiled shader _program is linked from
+        GLuint shader;
+    };
+
     GLuint _program;
     bool _isLinked;
 
+    // Everything needed to rebuild the program when one of its files changes
+    vector<ShaderSource> _shaderSources;
+    vector<string> _feedbackVaryings;
+    GLenum _feedbackMode;
+
+    // Program being linked in the background; _program stays in use until it succeeds
+    GLuint _pendingProgram;
+    vector<GLuint> _pendingShaders;
+    int _pendingPolls;
+    // Of the link request on gShaderCompileThread, 0 when linked here
+    ShaderCompileThread::Ticket _pendingTicket;
+
+    // Active uniforms sorted by name hash, filled once at link time
+    vector<UniformInfo> _uniforms;
+    // Last values sent to each uniform, used to skip redundant glUniform* calls
+    vector<GLubyte> _uniformValues;
+
+    void applyTransformFeedbackVaryings(GLuint program);
+    void startLink(GLuint program, const vector<GLuint>& shaders);
+    bool isLinkFinished();
+    void cancelPendingLink();
+
+    void cacheUniforms();
+    int findUniform(uint32_t hash) const;
+    bool updateUniformValue(int slot, const void* data, size_t size);
+
+    void uploadUniform(GLint location, int count, const int* values);
+    void uploadUniform(GLint location, int count, const float* values);
+    void uploadUniform(GLint location, int count, const vec2* vectors);
+    void uploadUniform(GLint location, int count, const vec3* vectors);
+    void uploadUniform(GLint location, int count, const vec4* vectors);
+    void uploadUniform(GLint location, int count, const mat3* matrices);
+    void uploadUniform(GLint location, int count, const mat4* matrices);
+
+    template <typename T>
+    void setUniformByName(const string& name, int count, const T* values);
+
 public:
-    WProgram(); 
+    WProgram();
 
     void createProgram();
     void deleteProgram();
 
     bool addShader(WShader* wshader);
+    void setTransformFeedbackVaryings(const char* const* varyings, size_t count, GLenum bufferMode);
     bool linkProgram();
+    void bindUniformBlock(const string& blockName, GLuint bindingPoint);
+
+    // Background linking: pollLink() returns true once when a new program
+    // has been swapped in, after which uniform handles must be resolved again.
+    // It never blocks when the driver links in the background or gShaderCompileThread
+    // is running. With neither the status query is put off by a frame and then
+    // blocks until the link is done.
+    void beginLink();
+    bool pollLink();
+    bool isLinked();
+
+    // Hot reload: relinks in the background with the new source of one file
+    bool usesShaderFile(const string& fileName) const;
+    void beginRebuild(const string& fileName, const string& source);
 
     void useProgram();
 
     GLuint getProgramId();
 
+    // Resolve a typed handle, e.g. getUniform<vec3>(WUNIFORM("gravity"))
+    template <typename T>
+    WUniform<T> getUniform(uint32_t nameHash) const;
+
+    template <typename T>
+    void setUniform(WUniform<T> uniform, const T& value);
+
     // Setting integers
     void setUniform(const string& name, int count, int* values);
     void setUniform(const string& name, int value);
@@ -62,4 +222,26 @@ public:
     void setUniform(const string& name, mat4 matrix);
 };
 
-#endif //SHADERS_H
\ No newline at end of file
+template <typename T>
+WUniform<T> WProgram::getUniform(uint32_t nameHash) const
+{
+    WUniform<T> uniform;
+    uniform._slot = findUniform(nameHash);
+    if (uniform._slot >= 0) {
+        uniform._location = _uniforms[uniform._slot].location;
+    }
+
+    return uniform;
+}
+
+template <typename T>
+void WProgram::setUniform(WUniform<T> uniform, const T& value)
+{
+    if (!uniform.isValid() || !updateUniformValue(uniform._slot, &value, sizeof(T))) {
+        return;
+    }
+
+    uploadUniform(uniform._location, 1, &value);
+}
+
+#endif //SHADERS_H
@@ -0,0 +1,9 @@
+// Shared by every program through FRAME_CONSTANTS_BINDING, see frameconstants.h
+layout (std140) uniform FrameConstants {
+    mat4  mView;
+    mat4  mProj;
+    vec4  quad1;
+    vec4  quad2;
+    float time;
+    float timePassed;
+};
@@ -2,15 +2,44 @@
 
 in vec4  colorFragIn;
 in vec2  texPrevCoord;
+#ifndef SINGLE_FRAME_ATLAS
 in vec2  texNextCoord;
 in float texNextSimilarity;
+#endif
 
+#if defined(PACKED_ATLAS_FRAMES_COUNT)
+flat in vec4 texPrevBounds;
+flat in vec4 texNextBounds;
 uniform sampler2D tSampler;
+// Trimmed frames only cover part of the quad, the rest stays transparent.
+// The fetch is unconditional so derivatives stay defined.
+#define SAMPLE_FRAME(coord, bounds) (texture(tSampler, coord) * float(all(greaterThanEqual(coord, bounds.xy)) && all(lessThanEqual(coord, bounds.zw))))
+#elif defined(TEXTURE_LAYERS_COUNT)
+flat in float texLayer;
+uniform sampler2DArray tSampler;
+#define SAMPLE_ATLAS(coord) texture(tSampler, vec3(coord, texLayer))
+#else
+uniform sampler2D tSampler;
+#define SAMPLE_ATLAS(coord) texture(tSampler, coord)
+#endif
 
 out vec4 colorFragOut;
 
 void main()
 {
-    vec4 textureMix = mix(texture(tSampler, texPrevCoord), texture(tSampler, texNextCoord), texNextSimilarity);
+#if defined(PACKED_ATLAS_FRAMES_COUNT)
+    vec4 textureMix = mix(SAMPLE_FRAME(texPrevCoord, texPrevBounds), SAMPLE_FRAME(texNextCoord, texNextBounds), texNextSimilarity);
+#elif defined(SINGLE_FRAME_ATLAS)
+    // Nothing to blend between, a single fetch is enough
+    vec4 textureMix = SAMPLE_ATLAS(texPrevCoord);
+#else
+    vec4 textureMix = mix(SAMPLE_ATLAS(texPrevCoord), SAMPLE_ATLAS(texNextCoord), texNextSimilarity);
+#endif
+#ifdef ADDITIVE_BLEND
+    // Premultiplied for GL_ONE, GL_ONE; the destination alpha is never read
+    vec4 color = textureMix * colorFragIn;
+    colorFragOut = vec4(color.rgb * color.a, 1.0);
+#else
     colorFragOut = textureMix * colorFragIn;
+#endif
 }
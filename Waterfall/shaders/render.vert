@@ -6,12 +6,14 @@ layout (location = 6)  in float fullLifeTimeIn;
 layout (location = 7)  in float actualLifeTimeIn;
 layout (location = 8)  in float sizeIn;
 layout (location = 11) in float opacityIn;
+layout (location = 12) in float layerIn;
 
 out vec3  color;
 out float fullLifeTime;
 out float actualLifeTime;
 out float size;
 out float opacity;
+out float layer;
 
 void main()
 {
@@ -21,4 +23,5 @@ void main()
     actualLifeTime = actualLifeTimeIn;
     size           = sizeIn;
     opacity        = opacityIn;
+    layer          = layerIn;
 }
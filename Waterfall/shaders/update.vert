@@ -8,6 +8,7 @@ layout (location = 6)  in float fullLifeTimeIn;
 layout (location = 7)  in float actualLifeTimeIn;
 layout (location = 8)  in float sizeIn; layout (location = 9) in float minSizeIn; layout (location = 10) in float maxSizeIn;
 layout (location = 11) in float opacityIn;
+layout (location = 12) in float layerIn;
 
 out float randInit;
 out vec3  positionInit, position;
@@ -17,6 +18,7 @@ out float fullLifeTime;
 out float actualLifeTime;
 out float size, minSize, maxSize;
 out float opacity;
+out float layer;
 
 void main()
 {
@@ -28,4 +30,5 @@ void main()
     actualLifeTime = actualLifeTimeIn;
     size           = sizeIn; minSize = minSizeIn; maxSize = maxSizeIn;
     opacity        = opacityIn;
+    layer          = layerIn;
 }
@@ -0,0 +1,125 @@
+#include "shaderwatcher.h"
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+ShaderWatcher::ShaderWatcher()
+    : _inotifyFd(-1), _watchFd(-1), _isRunning(false)
+{}
+
+ShaderWatcher::~ShaderWatcher()
+{
+    stopWatching();
+}
+
+bool ShaderWatcher::startWatching(const string& directory)
+{
+#ifdef __linux__
+    if (_isRunning) {
+        return true;
+    }
+
+    _inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (_inotifyFd < 0) {
+        return false;
+    }
+
+    // Editors either rewrite the file in place or rename a temporary over it
+    _watchFd = inotify_add_watch(_inotifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (_watchFd < 0) {
+        close(_inotifyFd);
+        _inotifyFd = -1;
+        return false;
+    }
+
+    _directory = directory;
+    _isRunning = true;
+    _thread = std::thread(&ShaderWatcher::watchLoop, this);
+
+    return true;
+#else
+    (void)directory;
+    return false;
+#endif
+}
+
+void ShaderWatcher::stopWatching()
+{
+    if (!_isRunning) {
+        return;
+    }
+
+    _isRunning = false;
+    _thread.join();
+
+#ifdef __linux__
+    inotify_rm_watch(_inotifyFd, _watchFd);
+    close(_inotifyFd);
+#endif
+    _inotifyFd = -1;
+    _watchFd = -1;
+}
+
+void ShaderWatcher::watchLoop()
+{
+#ifdef __linux__
+    alignas(struct inotify_event) char buffer[4096];
+
+    while (_isRunning) {
+        pollfd fds;
+        fds.fd = _inotifyFd;
+        fds.events = POLLIN;
+
+        // Wake up regularly to notice stopWatching()
+        if (poll(&fds, 1, 100) <= 0) {
+            continue;
+        }
+
+        ssize_t length = read(_inotifyFd, buffer, sizeof(buffer));
+        for (ssize_t offset = 0; offset < length; ) {
+            const inotify_event* event = (const inotify_event*)(buffer + offset);
+            if (event->len > 0 && event->name[0] != '.') {
+                addChange(event->name);
+            }
+            offset += sizeof(inotify_event) + event->len;
+        }
+    }
+#endif
+}
+
+void ShaderWatcher::addChange(const string& fileName)
+{
+    ShaderFileChange change;
+    change.fileName = _directory + "/" + fileName;
+
+    ifstream fin(change.fileName.c_str(), std::ios::binary);
+    if (!fin.good()) {
+        return;
+    }
+    change.source.assign((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+
+    std::lock_guard<std::mutex> lock(_changesMutex);
+    for (size_t i = 0; i < _changes.size(); ++i) {
+        if (_changes[i].fileName == change.fileName) {
+            _changes[i].source.swap(change.source);
+            return;
+        }
+    }
+    _changes.push_back(change);
+}
+
+bool ShaderWatcher::takeChanges(vector<ShaderFileChange>& changes)
+{
+    std::unique_lock<std::mutex> lock(_changesMutex, std::try_to_lock);
+    if (!lock.owns_lock() || _changes.empty()) {
+        return false;
+    }
+
+    changes.swap(_changes);
+    _changes.clear();
+
+    return true;
+}
@@ -0,0 +1,44 @@
+#ifndef SHADER_WATCHER_H
+#define SHADER_WATCHER_H
+
+#include "common.h"
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+struct ShaderFileChange
+{
+    string fileName;
+    string source;
+};
+
+// Watches a shader directory on a background thread and reads every file that
+// was written, so the render thread only picks up ready sources.
+// Uses inotify and is a no-op on platforms without it.
+class ShaderWatcher
+{
+    string _directory;
+    int _inotifyFd;
+    int _watchFd;
+
+    std::thread _thread;
+    std::atomic<bool> _isRunning;
+
+    std::mutex _changesMutex;
+    vector<ShaderFileChange> _changes;
+
+    void watchLoop();
+    void addChange(const string& fileName);
+
+public:
+    ShaderWatcher();
+    ~ShaderWatcher();
+
+    bool startWatching(const string& directory);
+    void stopWatching();
+
+    // Never blocks; returns false when nothing changed since the last call
+    bool takeChanges(vector<ShaderFileChange>& changes);
+};
+
+#endif //SHADER_WATCHER_H
@@ -0,0 +1,282 @@
+#include "spriteatlas.h"
+#include "profiler.h"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+MaxRectsPacker::MaxRectsPacker(int width, int height)
+    : _width(width), _height(height)
+{
+    AtlasRect bin = { 0, 0, width, height };
+    _freeRects.push_back(bin);
+}
+
+bool MaxRectsPacker::insert(int width, int height, AtlasRect& placed)
+{
+    int bestShortSide = INT_MAX;
+    int bestLongSide = INT_MAX;
+    size_t bestIndex = _freeRects.size();
+
+    for (size_t i = 0; i < _freeRects.size(); ++i) {
+        const AtlasRect& free = _freeRects[i];
+        if (free.width < width || free.height < height) {
+            continue;
+        }
+
+        int leftoverX = free.width - width;
+        int leftoverY = free.height - height;
+        int shortSide = std::min(leftoverX, leftoverY);
+        int longSide = std::max(leftoverX, leftoverY);
+        if (shortSide < bestShortSide || (shortSide == bestShortSide && longSide < bestLongSide)) {
+            bestShortSide = shortSide;
+            bestLongSide = longSide;
+            bestIndex = i;
+        }
+    }
+
+    if (bestIndex == _freeRects.size()) {
+        return false;
+    }
+
+    placed.x = _freeRects[bestIndex].x;
+    placed.y = _freeRects[bestIndex].y;
+    placed.width = width;
+    placed.height = height;
+
+    splitFreeRects(placed);
+    pruneFreeRects();
+    return true;
+}
+
+void MaxRectsPacker::splitFreeRects(const AtlasRect& used)
+{
+    vector<AtlasRect> freeRects;
+    freeRects.reserve(_freeRects.size() + 4);
+
+    for (size_t i = 0; i < _freeRects.size(); ++i) {
+        const AtlasRect& free = _freeRects[i];
+        bool intersects = used.x < free.x + free.width && used.x + used.width > free.x
+                       && used.y < free.y + free.height && used.y + used.height > free.y;
+        if (!intersects) {
+            freeRects.push_back(free);
+            continue;
+        }
+
+        // Up to four maximal rectangles remain around the used one
+        if (used.x > free.x) {
+            AtlasRect left = { free.x, free.y, used.x - free.x, free.height };
+            freeRects.push_back(left);
+        }
+        if (used.x + used.width < free.x + free.width) {
+            AtlasRect right = { used.x + used.width, free.y, free.x + free.width - used.x - used.width, free.height };
+            freeRects.push_back(right);
+        }
+        if (used.y > free.y) {
+            AtlasRect bottom = { free.x, free.y, free.width, used.y - free.y };
+            freeRects.push_back(bottom);
+        }
+        if (used.y + used.height < free.y + free.height) {
+            AtlasRect top = { free.x, used.y + used.height, free.width, free.y + free.height - used.y - used.height };
+            freeRects.push_back(top);
+        }
+    }
+
+    _freeRects.swap(freeRects);
+}
+
+void MaxRectsPacker::pruneFreeRects()
+{
+    // Drop rectangles lying inside another one, they can never fit more
+    for (size_t i = 0; i < _freeRects.size(); ++i) {
+        for (size_t j = i + 1; j < _freeRects.size();) {
+            const AtlasRect& a = _freeRects[i];
+            const AtlasRect& b = _freeRects[j];
+            if (b.x >= a.x && b.y >= a.y && b.x + b.width <= a.x + a.width && b.y + b.height <= a.y + a.height) {
+                _freeRects.erase(_freeRects.begin() + j);
+                continue;
+            }
+            if (a.x >= b.x && a.y >= b.y && a.x + a.width <= b.x + b.width && a.y + a.height <= b.y + b.height) {
+                _freeRects.erase(_freeRects.begin() + i);
+                --i;
+                break;
+            }
+            ++j;
+        }
+    }
+}
+
+namespace
+{
+    struct FrameSource
+    {
+        DecodedImage image;
+        AtlasRect content;  // inside the image, after trimming
+        AtlasRect placed;   // in the atlas, with padding
+    };
+
+    AtlasRect opaqueBounds(const DecodedImage& image)
+    {
+        int minX = int(image.width), minY = int(image.height), maxX = -1, maxY = -1;
+        for (int y = 0; y < int(image.height); ++y) {
+            const GLubyte* row = &image.pixels[size_t(y) * image.width * 4];
+            for (int x = 0; x < int(image.width); ++x) {
+                if (row[x * 4 + 3] != 0) {
+                    minX = std::min(minX, x);
+                    maxX = std::max(maxX, x);
+                    minY = std::min(minY, y);
+                    maxY = std::max(maxY, y);
+                }
+            }
+        }
+
+        // A fully transparent frame still needs a pixel to sample
+        if (maxX < 0) {
+            AtlasRect empty = { 0, 0, 1, 1 };
+            return empty;
+        }
+        AtlasRect bounds = { minX, minY, maxX - minX + 1, maxY - minY + 1 };
+        return bounds;
+    }
+
+    bool packFrames(vector<FrameSource>& sources, const vector<size_t>& order, int padding, uint width, uint height)
+    {
+        MaxRectsPacker packer((int)width, (int)height);
+        for (size_t i = 0; i < order.size(); ++i) {
+            FrameSource& source = sources[order[i]];
+            if (!packer.insert(source.content.width + 2 * padding, source.content.height + 2 * padding, source.placed)) {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+SpriteAtlas::SpriteAtlas()
+    : _framesBuffer(0)
+{}
+
+void SpriteAtlas::build(const vector<string>& frameFileNames, int padding, bool trim, uint maxSize)
+{
+    PROFILE_SCOPE("SpriteAtlas::build");
+
+    if (frameFileNames.empty() || frameFileNames.size() > MAX_FRAMES) {
+        throw std::runtime_error("Sprite atlas needs from 1 to " + std::to_string(MAX_FRAMES) + " frames");
+    }
+
+    vector<FrameSource> sources(frameFileNames.size());
+    size_t area = 0;
+    uint minSize = 1;
+    for (size_t i = 0; i < sources.size(); ++i) {
+        FrameSource& source = sources[i];
+        TextureLoader::decode(frameFileNames[i], source.image);
+
+        AtlasRect whole = { 0, 0, int(source.image.width), int(source.image.height) };
+        source.content = trim ? opaqueBounds(source.image) : whole;
+
+        uint paddedWidth = source.content.width + 2 * padding;
+        uint paddedHeight = source.content.height + 2 * padding;
+        area += size_t(paddedWidth) * paddedHeight;
+        minSize = std::max(minSize, std::max(paddedWidth, paddedHeight));
+    }
+
+    // Big frames first leave the small ones to fill the gaps
+    vector<size_t> order(sources.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&sources](size_t a, size_t b) {
+        return std::max(sources[a].content.width, sources[a].content.height)
+             > std::max(sources[b].content.width, sources[b].content.height);
+    });
+
+    uint width = 1;
+    while (width < minSize || size_t(width) * width < area) {
+        width *= 2;
+    }
+    uint height = width;
+    // Try the half-height strip first, then grow the shorter side until everything fits
+    if (height / 2 >= minSize && size_t(width) * (height / 2) >= area) {
+        height /= 2;
+    }
+    while (!packFrames(sources, order, padding, width, height)) {
+        if (height < width) {
+            height *= 2;
+        }
+        else {
+            width *= 2;
+        }
+        if (width > maxSize || height > maxSize) {
+            throw std::runtime_error("Sprite frames don't fit into a " + std::to_string(maxSize) + " atlas");
+        }
+    }
+
+    _image.fileName = frameFileNames[0];
+    _image.width = width;
+    _image.height = height;
+    _image.pixels.assign(size_t(width) * height * 4, 0);
+    _frames.resize(sources.size());
+
+    for (size_t i = 0; i < sources.size(); ++i) {
+        const FrameSource& source = sources[i];
+        const AtlasRect& content = source.content;
+        const AtlasRect& placed = source.placed;
+
+        // The padding repeats the edge pixels of the content
+        for (int y = 0; y < placed.height; ++y) {
+            int sourceY = content.y + std::min(std::max(y - padding, 0), content.height - 1);
+            const GLubyte* sourceRow = &source.image.pixels[size_t(sourceY) * source.image.width * 4];
+            GLubyte* row = &_image.pixels[(size_t(placed.y + y) * width + placed.x) * 4];
+            for (int x = 0; x < placed.width; ++x) {
+                int sourceX = content.x + std::min(std::max(x - padding, 0), content.width - 1);
+                memcpy(row + x * 4, sourceRow + sourceX * 4, 4);
+            }
+        }
+
+        float contentX = float(placed.x + padding);
+        float contentY = float(placed.y + padding);
+        float frameX = contentX - content.x;
+        float frameY = contentY - content.y;
+
+        SpriteFrame& frame = _frames[i];
+        frame.contentRect = vec4(contentX / width, contentY / height,
+                                 (contentX + content.width) / width, (contentY + content.height) / height);
+        frame.frameRect = vec4(frameX / width, frameY / height,
+                               (frameX + source.image.width) / width, (frameY + source.image.height) / height);
+    }
+}
+
+const DecodedImage& SpriteAtlas::image() const
+{
+    return _image;
+}
+
+const vector<SpriteFrame>& SpriteAtlas::frames() const
+{
+    return _frames;
+}
+
+int SpriteAtlas::framesCount() const
+{
+    return int(_frames.size());
+}
+
+void SpriteAtlas::uploadFrames()
+{
+    if (_framesBuffer == 0) {
+        glGenBuffers(1, &_framesBuffer);
+    }
+
+    glBindBuffer(GL_UNIFORM_BUFFER, _framesBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, _frames.size() * sizeof(SpriteFrame), &_frames[0], GL_STATIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    glBindBufferBase(GL_UNIFORM_BUFFER, ATLAS_FRAMES_BINDING, _framesBuffer);
+}
+
+void SpriteAtlas::releaseFrames()
+{
+    if (_framesBuffer != 0) {
+        glDeleteBuffers(1, &_framesBuffer);
+        _framesBuffer = 0;
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef SPRITE_ATLAS_H
+#define SPRITE_ATLAS_H
+
+#include "common.h"
+#include "textureloader.h"
+
+// Binding point of the AtlasFrames uniform block in render.geom
+static const GLuint ATLAS_FRAMES_BINDING = 1;
+static const char* const ATLAS_FRAMES_BLOCK = "AtlasFrames";
+
+struct AtlasRect
+{
+    int x, y;
+    int width, height;
+};
+
+// MaxRects bin packing with the best short side fit heuristic
+// (J. Jylanki, "A Thousand Ways to Pack the Bin"): keeps every maximal free
+// rectangle and places each new one where it leaves the least leftover along its shorter side.
+class MaxRectsPacker
+{
+    int _width, _height;
+    vector<AtlasRect> _freeRects;
+
+    void splitFreeRects(const AtlasRect& used);
+    void pruneFreeRects();
+
+public:
+    MaxRectsPacker(int width, int height);
+
+    // Returns false if there is no room left
+    bool insert(int width, int height, AtlasRect& placed);
+};
+
+// Where a frame image ended up in the atlas, in texture coordinates (u0, v0, u1, v1).
+// Mirrors one entry of the std140 AtlasFrames block.
+struct SpriteFrame
+{
+    vec4 contentRect;  // the pixels that were kept after trimming
+    vec4 frameRect;    // the whole untrimmed frame, may reach past the content
+};
+
+// Builds a texture from separate frame images of any size: transparent borders
+// are trimmed, frames are packed with MaxRects and padded with their edge pixels
+// so linear filtering doesn't pick up the neighbours.
+class SpriteAtlas
+{
+    DecodedImage _image;
+    vector<SpriteFrame> _frames;
+    GLuint _framesBuffer;
+
+public:
+    // A uniform block is only guaranteed 16KB
+    static const int MAX_FRAMES = 16384 / sizeof(SpriteFrame);
+
+    SpriteAtlas();
+
+    // Packs the frames, in the given order, into the smallest power-of-two
+    // texture that fits; throws std::runtime_error on failure
+    void build(const vector<string>& frameFileNames, int padding, bool trim, uint maxSize = 4096);
+
+    const DecodedImage& image() const;
+    const vector<SpriteFrame>& frames() const;
+    int framesCount() const;
+
+    // Uploads the frame table into a uniform buffer bound at ATLAS_FRAMES_BINDING
+    void uploadFrames();
+    void releaseFrames();
+};
+
+#endif //SPRITE_ATLAS_H
@@ -1,78 +1,184 @@
 #include "texture.h"
+#include "textureloader.h"
+#include "texturecontainer.h"
+#include "atlasmipmaps.h"
+#include "glstate.h"
+#include "profiler.h"
+
+namespace
+{
+    // Level 0 plus the levels built by buildAtlasMipmaps() into the bound texture
+    void uploadLevels(const DecodedImage& image, const vector<MipLevel>& mipmaps)
+    {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image.width, image.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid*)&image.pixels[0]);
+        for (size_t i = 0; i < mipmaps.size(); ++i) {
+            glTexImage2D(GL_TEXTURE_2D, GLint(i + 1), GL_RGBA, mipmaps[i].width, mipmaps[i].height, 0, GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid*)&mipmaps[i].pixels[0]);
+        }
+        // The chain may stop early, when atlas cells get smaller than a pixel
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, GLint(mipmaps.size()));
+    }
+}
 
 TextureAtlas::TextureAtlas()
-    : _textureUnit(-1), _mipmapGenerated(false), _magFilter(NO_TEXTURE_FILTER), _minFilter(NO_TEXTURE_FILTER), _textureFileName(""), _rowCount(0), _columnCount(0)
+    : _textureUnit(-1), _loader(NULL), _mipmapGenerated(false), _magFilter(NO_TEXTURE_FILTER), _minFilter(NO_TEXTURE_FILTER), _textureFileName(""), _rowCount(0), _columnCount(0), _memorySize(0)
 {}
 
 bool TextureAtlas::loadTexture(const string& textureFileName, bool mipmapRequired, int rowCount, int columnCount)
 {
-    FREE_IMAGE_FORMAT fif = FIF_UNKNOWN;
-    FIBITMAP* dib = NULL;
-
-    fif = FreeImage_GetFileType(textureFileName.c_str(), 0);
+    PROFILE_SCOPE("TextureAtlas::loadTexture");
 
-    if (fif == FIF_UNKNOWN) {
-        fif = FreeImage_GetFIFFromFilename(textureFileName.c_str());
+    string containerFileName = TextureContainer::containerFileName(textureFileName);
+    bool isContainerUpToDate = TextureContainer::isUpToDate(containerFileName, textureFileName);
+    if (isContainerUpToDate && loadContainer(containerFileName, mipmapRequired, rowCount, columnCount)) {
+        return true;
     }
 
-    if (fif == FIF_UNKNOWN) {
-        throw std::runtime_error("Unknown image format: " + textureFileName);
-        return false;
-    }
+    DecodedImage image;
+    TextureLoader::decode(textureFileName, image);
+    vector<MipLevel> mipmaps;
+    buildAtlasMipmaps(image, rowCount, columnCount, mipmaps);
 
-    if (FreeImage_FIFSupportsReading(fif)) {
-        dib = FreeImage_Load(fif, textureFileName.c_str());
+    // First run, or the container no longer fits: cache the image so later launches skip the decoding
+    try {
+        TextureContainer::write(containerFileName, image, mipmaps, TEXTURE_CONTAINER_RGBA8, rowCount, columnCount);
+    }
+    catch (std::exception const& except) {
+        std::cerr << except.what() << endl;
     }
 
-    if (!dib) {
-        throw std::runtime_error("Can't load image: " + textureFileName);
-        return false;
+    if (!mipmapRequired) {
+        mipmaps.clear();
     }
+    createTexture(textureFileName, rowCount, columnCount);
+    _width = image.width;
+    _height = image.height;
+    gGLState.bindTexture2D(_texture);
+    uploadLevels(image, mipmaps);
+    _mipmapGenerated = mipmapRequired;
+    measureMemorySize();
+
+    return true;
+}
 
-    FIBITMAP* temp = dib;
-    dib = FreeImage_ConvertTo32Bits(dib);
-    FreeImage_Unload(temp);
+void TextureAtlas::loadImage(const DecodedImage& image, bool mipmapRequired, int rowCount, int columnCount)
+{
+    createTexture(image.fileName, rowCount, columnCount);
+    _width = image.width;
+    _height = image.height;
+
+    // Mips are filtered per atlas cell, glGenerateMipmap would blend neighbouring frames
+    vector<MipLevel> mipmaps;
+    if (mipmapRequired) {
+        buildAtlasMipmaps(image, rowCount, columnCount, mipmaps);
+    }
 
-    BYTE* data = FreeImage_GetBits(dib);
-    _width = FreeImage_GetWidth(dib);
-    _height = FreeImage_GetHeight(dib);
-    _bpp = FreeImage_GetBPP(dib);
+    gGLState.bindTexture2D(_texture);
+    uploadLevels(image, mipmaps);
+    _mipmapGenerated = mipmapRequired;
+    measureMemorySize();
+}
 
-    if (data == NULL || _width == 0 || _height == 0) {
-        throw std::runtime_error("Can't retrieve info from image: " + textureFileName);
+bool TextureAtlas::loadContainer(const string& containerFileName, bool mipmapRequired, int rowCount, int columnCount)
+{
+    TextureContainer container;
+    if (!container.open(containerFileName) || !container.isSupported()) {
         return false;
     }
+    // Mips filtered for another grid would bleed between this atlas' cells
+    if (mipmapRequired && (container.rowCount() != std::max(rowCount, 1) || container.columnCount() != std::max(columnCount, 1))) {
+        return false;
+    }
+
+    createTexture(containerFileName, rowCount, columnCount);
+    _width = container.width();
+    _height = container.height();
 
-    GLubyte* textura = new GLubyte[4 * _width*_height];
-    char* pixeles = (char*)FreeImage_GetBits(dib);
-    //FreeImage loads in BGR format, so you need to swap some bytes(Or use GL_BGR).
+    // The levels go to GL straight from the mapping
+    gGLState.bindTexture2D(_texture);
+    container.upload(mipmapRequired ? container.levelsCount() : 1);
+    _mipmapGenerated = mipmapRequired;
+    measureMemorySize();
+
+    return true;
+}
 
-    for (int j = 0; j<_width *_height; j++){
-        textura[j * 4 + 0] = pixeles[j * 4 + 2];
-        textura[j * 4 + 1] = pixeles[j * 4 + 1];
-        textura[j * 4 + 2] = pixeles[j * 4 + 0];
-        textura[j * 4 + 3] = pixeles[j * 4 + 3];
-        //cout<<j<<": "<<textura[j*4+0]<<"**"<<textura[j*4+1]<<"**"<<textura[j*4+2]<<"**"<<textura[j*4+3]<<endl;
+void TextureAtlas::loadTextureAsync(TextureLoader& loader, const string& textureFileName, bool mipmapRequired, int rowCount, int columnCount)
+{
+    // A converted texture is mapped, not decoded, so it's cheap enough to load right away
+    string containerFileName = TextureContainer::containerFileName(textureFileName);
+    if (TextureContainer::isUpToDate(containerFileName, textureFileName) && loadContainer(containerFileName, mipmapRequired, rowCount, columnCount)) {
+        return;
     }
 
-    glGenTextures(1, &_texture);
-    glBindTexture(GL_TEXTURE_2D, _texture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, _width, _height, 0, GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid*)textura);
+    createTexture(textureFileName, rowCount, columnCount);
+    _width = 1;
+    _height = 1;
+
+    // Transparent placeholder: adds nothing under additive blending until the image arrives
+    static const GLubyte placeholder[4] = { 0, 0, 0, 0 };
+    gGLState.bindTexture2D(_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
 
     if (mipmapRequired) {
         glGenerateMipmap(GL_TEXTURE_2D);
         _mipmapGenerated = true;
     }
-    
-    FreeImage_Unload(dib);
+
+    measureMemorySize();
+
+    _loader = &loader;
+    loader.requestTexture(textureFileName, _texture, mipmapRequired, rowCount, columnCount, containerFileName);
+}
+
+void TextureAtlas::measureMemorySize()
+{
+    GLuint previousTexture = gGLState.boundTexture2D();
+    gGLState.bindTexture2D(_texture);
+
+    _memorySize = 0;
+    for (GLint level = 0; ; ++level) {
+        GLint width = 0, height = 0, compressed = GL_FALSE;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_WIDTH, &width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_HEIGHT, &height);
+        if (width == 0 || height == 0) {
+            break;
+        }
+
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED, &compressed);
+        if (compressed == GL_TRUE) {
+            GLint size = 0;
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+            _memorySize += size_t(size);
+        }
+        else {
+            // Every uncompressed atlas is RGBA8
+            _memorySize += size_t(width) * height * 4;
+        }
+    }
+
+    gGLState.bindTexture2D(previousTexture);
+}
+
+size_t TextureAtlas::memorySize()
+{
+    if (_loader != NULL && !_loader->isPending(_texture)) {
+        // The background load is done, nothing left to cancel
+        _loader = NULL;
+        measureMemorySize();
+    }
+    return _memorySize;
+}
+
+void TextureAtlas::createTexture(const string& textureFileName, int rowCount, int columnCount)
+{
+    glGenTextures(1, &_texture);
     glGenSamplers(1, &_sampler);
 
+    _bpp = 32;
     _textureUnit = 0;
     _textureFileName = textureFileName;
     _rowCount = rowCount;
     _columnCount = columnCount;
-
-    return true;
 }
 
 int TextureAtlas::rowCount()
@@ -87,8 +193,8 @@ int TextureAtlas::columnCount()
 
 void TextureAtlas::bindTexture(int textureUnit)
 {
-    glActiveTexture(GL_TEXTURE0 + textureUnit);
-    glBindTexture(GL_TEXTURE_2D, _texture);
+    gGLState.activeTexture(GL_TEXTURE0 + textureUnit);
+    gGLState.bindTexture2D(_texture);
     glBindSampler(textureUnit, _sampler);
     _textureUnit = textureUnit;
 }
@@ -99,40 +205,50 @@ int TextureAtlas::textureUnit()
 }
 
 void TextureAtlas::setFiltering(int magFilter, int minFilter)
+{
+    setSamplerFiltering(_sampler, magFilter, minFilter);
+}
+
+void setSamplerFiltering(GLuint sampler, int magFilter, int minFilter)
 {
     switch (magFilter) {
     case TEXTURE_FILTER_MAG_NEAREST:
-        glSamplerParameteri(_sampler, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
         break;
     case TEXTURE_FILTER_MAG_LINEAR:
-        glSamplerParameteri(_sampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
         break;
     }
 
     switch (minFilter) {
     case TEXTURE_FILTER_MIN_NEAREST:
-        glSamplerParameteri(_sampler, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
         break;
     case TEXTURE_FILTER_MIN_LINEAR:
-        glSamplerParameteri(_sampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         break;
     case TEXTURE_FILTER_MIN_NEAREST_MIPMAP_NEAREST:
-        glSamplerParameteri(_sampler, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
         break;
     case TEXTURE_FILTER_MIN_NEAREST_MIPMAP_LINEAR:
-        glSamplerParameteri(_sampler, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_LINEAR);
+        glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_LINEAR);
         break;
     case TEXTURE_FILTER_MIN_LINEAR_MIPMAP_NEAREST:
-        glSamplerParameteri(_sampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
+        glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
         break;
     case TEXTURE_FILTER_MIN_LINEAR_MIPMAP_LINEAR:
-        glSamplerParameteri(_sampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
         break;
     }
 }
 
 void TextureAtlas::releaseTexture()
 {
+    if (_loader != NULL) {
+        _loader->cancel(_texture);
+        _loader = NULL;
+    }
     glDeleteSamplers(1, &_sampler);
     glDeleteTextures(1, &_texture);
+    gGLState.forgetTexture(_texture);
 }
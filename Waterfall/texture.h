@@ -16,28 +16,48 @@ enum TextureFiltering
     TEXTURE_FILTER_MIN_LINEAR_MIPMAP_LINEAR
 };
 
+class TextureLoader;
+struct DecodedImage;
+
+// Applies TEXTURE_FILTER_* values to a sampler object
+void setSamplerFiltering(GLuint sampler, int magFilter, int minFilter);
+
 class TextureAtlas
 {
     uint _width, _height, _bpp;
     GLuint _texture;
     GLuint _sampler;
     int _textureUnit;
+    TextureLoader* _loader;
     bool _mipmapGenerated;
     int _magFilter;
     int _minFilter;
     string _textureFileName;
     int _rowCount;
     int _columnCount;
+    size_t _memorySize;
+
+    void createTexture(const string& textureFileName, int rowCount, int columnCount);
+    // Returns false if the container can't be used, leaving the atlas untouched
+    bool loadContainer(const string& containerFileName, bool mipmapRequired, int rowCount, int columnCount);
+    // Sums the levels GL actually holds, whichever way they were uploaded
+    void measureMemorySize();
 
 public:
     TextureAtlas();
 
     bool loadTexture(const string& textureFileName, bool mipmapRequired, int rowCount, int columnCount);
+    // Uploads pixels built in memory, e.g. by SpriteAtlas
+    void loadImage(const DecodedImage& image, bool mipmapRequired, int rowCount, int columnCount);
+    // Returns at once with a transparent 1x1 placeholder; the loader swaps in the image later
+    void loadTextureAsync(TextureLoader& loader, const string& textureFileName, bool mipmapRequired, int rowCount, int columnCount);
     int rowCount();
     int columnCount();
     void bindTexture(int textureUnit);
     int textureUnit();
     void setFiltering(int magFilter, int minFilter);
+    // GPU bytes of all levels; only the placeholder's until a background load completes
+    size_t memorySize();
 
     void releaseTexture();
 };
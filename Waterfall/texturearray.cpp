@@ -0,0 +1,112 @@
+#include "texturearray.h"
+#include "texture.h"
+#include "textureloader.h"
+#include "glstate.h"
+#include "profiler.h"
+#include <algorithm>
+
+namespace
+{
+    // The filter doesn't care about channel order, so RGBA goes through FreeImage as is
+    void rescale(DecodedImage& image, uint width, uint height)
+    {
+        FIBITMAP* source = FreeImage_ConvertFromRawBits(&image.pixels[0], image.width, image.height, 4 * image.width, 32, 0, 0, 0, FALSE);
+        FIBITMAP* scaled = source != NULL ? FreeImage_Rescale(source, width, height, FILTER_BILINEAR) : NULL;
+        FreeImage_Unload(source);
+
+        if (scaled == NULL) {
+            throw std::runtime_error("Can't rescale image: " + image.fileName);
+        }
+
+        vector<GLubyte> pixels(4 * width * height);
+        FreeImage_ConvertToRawBits(&pixels[0], scaled, 4 * width, 32, 0, 0, 0, FALSE);
+        FreeImage_Unload(scaled);
+
+        image.pixels.swap(pixels);
+        image.width = width;
+        image.height = height;
+    }
+}
+
+TextureArrayAtlas::TextureArrayAtlas()
+    : _width(0), _height(0), _texture(0), _sampler(0), _textureUnit(-1)
+{}
+
+void TextureArrayAtlas::loadTextures(const vector<TextureArrayLayer>& layers, bool mipmapRequired)
+{
+    PROFILE_SCOPE("TextureArrayAtlas::loadTextures");
+
+    if (layers.empty() || layers.size() > MAX_LAYERS) {
+        throw std::runtime_error("Texture array needs from 1 to " + std::to_string(MAX_LAYERS) + " layers");
+    }
+
+    vector<DecodedImage> images(layers.size());
+    _width = 0;
+    _height = 0;
+    for (size_t i = 0; i < layers.size(); ++i) {
+        TextureLoader::decode(layers[i].fileName, images[i]);
+        _width = std::max(_width, images[i].width);
+        _height = std::max(_height, images[i].height);
+    }
+
+    glGenTextures(1, &_texture);
+    glGenSamplers(1, &_sampler);
+    _textureUnit = 0;
+    _layers = layers;
+
+    gGLState.activeTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, _texture);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, _width, _height, GLsizei(layers.size()), 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+    for (size_t i = 0; i < images.size(); ++i) {
+        if (images[i].width != _width || images[i].height != _height) {
+            rescale(images[i], _width, _height);
+        }
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, GLint(i), _width, _height, 1, GL_RGBA, GL_UNSIGNED_BYTE, &images[i].pixels[0]);
+    }
+
+    if (mipmapRequired) {
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    }
+    else {
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+    }
+}
+
+int TextureArrayAtlas::layersCount()
+{
+    return int(_layers.size());
+}
+
+const TextureArrayLayer& TextureArrayAtlas::layer(int index)
+{
+    return _layers[index];
+}
+
+void TextureArrayAtlas::bindTexture(int textureUnit)
+{
+    // Only GL_TEXTURE_2D is shadowed by gGLState, the array target is bound directly
+    gGLState.activeTexture(GL_TEXTURE0 + textureUnit);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, _texture);
+    glBindSampler(textureUnit, _sampler);
+    _textureUnit = textureUnit;
+}
+
+int TextureArrayAtlas::textureUnit()
+{
+    return _textureUnit;
+}
+
+void TextureArrayAtlas::setFiltering(int magFilter, int minFilter)
+{
+    setSamplerFiltering(_sampler, magFilter, minFilter);
+}
+
+void TextureArrayAtlas::releaseTexture()
+{
+    glDeleteSamplers(1, &_sampler);
+    glDeleteTextures(1, &_texture);
+    _texture = 0;
+    _sampler = 0;
+    _layers.clear();
+}
@@ -0,0 +1,41 @@
+#ifndef TEXTURE_ARRAY_H
+#define TEXTURE_ARRAY_H
+
+#include "common.h"
+
+// One sprite sheet of a TextureArrayAtlas
+struct TextureArrayLayer
+{
+    string fileName;
+    int rowCount;
+    int columnCount;
+};
+
+// Several sprite sheets in one GL_TEXTURE_2D_ARRAY, a sheet per layer, so
+// particles using different sheets render in a single draw without rebinding.
+// Sheets are rescaled to the largest width and height; each layer keeps its own frame grid.
+class TextureArrayAtlas
+{
+    uint _width, _height;
+    GLuint _texture;
+    GLuint _sampler;
+    int _textureUnit;
+    vector<TextureArrayLayer> _layers;
+
+public:
+    static const int MAX_LAYERS = 32;
+
+    TextureArrayAtlas();
+
+    // Throws std::runtime_error if a sheet can't be loaded
+    void loadTextures(const vector<TextureArrayLayer>& layers, bool mipmapRequired);
+    int layersCount();
+    const TextureArrayLayer& layer(int index);
+    void bindTexture(int textureUnit);
+    int textureUnit();
+    void setFiltering(int magFilter, int minFilter);
+
+    void releaseTexture();
+};
+
+#endif //TEXTURE_ARRAY_H
@@ -0,0 +1,390 @@
+#include "texturecontainer.h"
+#include "textureloader.h"
+#include "atlasmipmaps.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+    const char MAGIC[4] = { 'W', 'T', 'E', 'X' };
+
+    size_t alignOffset(size_t offset)
+    {
+        return (offset + 15) & ~size_t(15);
+    }
+
+    size_t blockBytes(TextureContainerFormat format)
+    {
+        return format == TEXTURE_CONTAINER_BC1 ? 8 : 16;
+    }
+
+    size_t levelSize(TextureContainerFormat format, uint width, uint height)
+    {
+        if (format == TEXTURE_CONTAINER_RGBA8) {
+            return size_t(width) * height * 4;
+        }
+        return size_t((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+    }
+
+    GLenum glInternalFormat(TextureContainerFormat format)
+    {
+        switch (format) {
+        case TEXTURE_CONTAINER_BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        case TEXTURE_CONTAINER_BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        default:                    return GL_RGBA8;
+        }
+    }
+
+    uint16_t packRGB565(const uint8_t* color)
+    {
+        return uint16_t(((color[0] >> 3) << 11) | ((color[1] >> 2) << 5) | (color[2] >> 3));
+    }
+
+    void unpackRGB565(uint16_t packed, int* color)
+    {
+        int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+        color[0] = (r << 3) | (r >> 2);
+        color[1] = (g << 2) | (g >> 4);
+        color[2] = (b << 3) | (b >> 2);
+    }
+
+    void writeUint16(uint8_t* out, uint16_t value)
+    {
+        out[0] = uint8_t(value);
+        out[1] = uint8_t(value >> 8);
+    }
+
+    // Color part of BC1/BC3: endpoints from the inset bounding box of the block,
+    // every texel takes the closest of the four palette colors
+    void encodeColorBlock(const uint8_t block[16][4], uint8_t* out)
+    {
+        uint8_t minColor[3] = { 255, 255, 255 };
+        uint8_t maxColor[3] = { 0, 0, 0 };
+        for (int i = 0; i < 16; ++i) {
+            for (int c = 0; c < 3; ++c) {
+                minColor[c] = std::min(minColor[c], block[i][c]);
+                maxColor[c] = std::max(maxColor[c], block[i][c]);
+            }
+        }
+        for (int c = 0; c < 3; ++c) {
+            int inset = (maxColor[c] - minColor[c]) / 16;
+            minColor[c] = uint8_t(minColor[c] + inset);
+            maxColor[c] = uint8_t(maxColor[c] - inset);
+        }
+
+        uint16_t color0 = packRGB565(maxColor);
+        uint16_t color1 = packRGB565(minColor);
+        // color0 > color1 selects the four color mode
+        if (color0 < color1) {
+            std::swap(color0, color1);
+        }
+        writeUint16(out, color0);
+        writeUint16(out + 2, color1);
+
+        uint32_t indices = 0;
+        if (color0 != color1) {
+            int palette[4][3];
+            unpackRGB565(color0, palette[0]);
+            unpackRGB565(color1, palette[1]);
+            for (int c = 0; c < 3; ++c) {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+
+            for (int i = 0; i < 16; ++i) {
+                int bestIndex = 0;
+                int bestDistance = 1 << 30;
+                for (int p = 0; p < 4; ++p) {
+                    int distance = 0;
+                    for (int c = 0; c < 3; ++c) {
+                        int d = block[i][c] - palette[p][c];
+                        distance += d * d;
+                    }
+                    if (distance < bestDistance) {
+                        bestDistance = distance;
+                        bestIndex = p;
+                    }
+                }
+                indices |= uint32_t(bestIndex) << (2 * i);
+            }
+        }
+        for (int i = 0; i < 4; ++i) {
+            out[4 + i] = uint8_t(indices >> (8 * i));
+        }
+    }
+
+    // Alpha part of BC3 in the eight value mode between the block's extremes
+    void encodeAlphaBlock(const uint8_t block[16][4], uint8_t* out)
+    {
+        uint8_t minAlpha = 255, maxAlpha = 0;
+        for (int i = 0; i < 16; ++i) {
+            minAlpha = std::min(minAlpha, block[i][3]);
+            maxAlpha = std::max(maxAlpha, block[i][3]);
+        }
+        out[0] = maxAlpha;
+        out[1] = minAlpha;
+
+        uint64_t indices = 0;
+        if (maxAlpha != minAlpha) {
+            int range = maxAlpha - minAlpha;
+            for (int i = 0; i < 16; ++i) {
+                // Step from min (0) to max (7); the palette stores max first, then min,
+                // then the interpolated values from max down
+                int step = ((block[i][3] - minAlpha) * 7 + range / 2) / range;
+                int index = step == 7 ? 0 : (step == 0 ? 1 : 8 - step);
+                indices |= uint64_t(index) << (3 * i);
+            }
+        }
+        for (int i = 0; i < 6; ++i) {
+            out[2 + i] = uint8_t(indices >> (8 * i));
+        }
+    }
+
+    void compressLevel(const vector<uint8_t>& pixels, uint width, uint height, TextureContainerFormat format, uint8_t* out)
+    {
+        size_t bytes = blockBytes(format);
+        for (uint by = 0; by < height; by += 4) {
+            for (uint bx = 0; bx < width; bx += 4) {
+                // Blocks over the edge repeat the last row and column
+                uint8_t block[16][4];
+                for (uint y = 0; y < 4; ++y) {
+                    for (uint x = 0; x < 4; ++x) {
+                        size_t source = (size_t(std::min(by + y, height - 1)) * width + std::min(bx + x, width - 1)) * 4;
+                        memcpy(block[y * 4 + x], &pixels[source], 4);
+                    }
+                }
+
+                if (format == TEXTURE_CONTAINER_BC3) {
+                    encodeAlphaBlock(block, out);
+                    encodeColorBlock(block, out + 8);
+                }
+                else {
+                    encodeColorBlock(block, out);
+                }
+                out += bytes;
+            }
+        }
+    }
+}
+
+TextureContainer::TextureContainer()
+    : _header(NULL), _levels(NULL)
+{}
+
+string TextureContainer::containerFileName(const string& imageFileName)
+{
+    return imageFileName + ".wtex";
+}
+
+bool TextureContainer::isUpToDate(const string& containerFileName, const string& imageFileName)
+{
+    int64_t containerTime = fileModificationTime(containerFileName);
+    return containerTime >= 0 && containerTime >= fileModificationTime(imageFileName);
+}
+
+bool TextureContainer::parseFormat(const string& name, TextureContainerFormat& format)
+{
+    if (name == "rgba8") {
+        format = TEXTURE_CONTAINER_RGBA8;
+    }
+    else if (name == "bc1") {
+        format = TEXTURE_CONTAINER_BC1;
+    }
+    else if (name == "bc3") {
+        format = TEXTURE_CONTAINER_BC3;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+void TextureContainer::write(const string& fileName, const DecodedImage& image, TextureContainerFormat format, int rowCount, int columnCount)
+{
+    vector<MipLevel> mipmaps;
+    buildAtlasMipmaps(image, rowCount, columnCount, mipmaps);
+    write(fileName, image, mipmaps, format, rowCount, columnCount);
+}
+
+void TextureContainer::write(const string& fileName, const DecodedImage& image, const vector<MipLevel>& mipmaps,
+                             TextureContainerFormat format, int rowCount, int columnCount)
+{
+    PROFILE_SCOPE("TextureContainer::write");
+
+    if (image.width == 0 || image.height == 0 || image.pixels.size() != size_t(image.width) * image.height * 4) {
+        throw std::runtime_error("Can't write empty texture container: " + fileName);
+    }
+
+    size_t levelsCount = std::min(size_t(MAX_LEVELS), mipmaps.size() + 1);
+    vector<TextureContainerLevel> levels(levelsCount);
+    size_t offset = alignOffset(sizeof(TextureContainerHeader) + MAX_LEVELS * sizeof(TextureContainerLevel));
+    for (size_t i = 0; i < levelsCount; ++i) {
+        TextureContainerLevel& level = levels[i];
+        level.width = i == 0 ? image.width : mipmaps[i - 1].width;
+        level.height = i == 0 ? image.height : mipmaps[i - 1].height;
+        level.offset = offset;
+        level.size = levelSize(format, level.width, level.height);
+        offset = alignOffset(offset + size_t(level.size));
+    }
+
+    TextureContainerHeader header;
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.format = format;
+    header.internalFormat = glInternalFormat(format);
+    header.width = image.width;
+    header.height = image.height;
+    header.levelsCount = uint32_t(levelsCount);
+    header.rowCount = uint32_t(std::max(rowCount, 1));
+    header.columnCount = uint32_t(std::max(columnCount, 1));
+    header.reserved = 0;
+
+    vector<uint8_t> file(offset, 0);
+    memcpy(&file[0], &header, sizeof(header));
+    memcpy(&file[sizeof(header)], &levels[0], levels.size() * sizeof(TextureContainerLevel));
+
+    for (size_t i = 0; i < levelsCount; ++i) {
+        const TextureContainerLevel& level = levels[i];
+        const vector<GLubyte>& pixels = i == 0 ? image.pixels : mipmaps[i - 1].pixels;
+
+        if (format == TEXTURE_CONTAINER_RGBA8) {
+            memcpy(&file[size_t(level.offset)], &pixels[0], size_t(level.size));
+        }
+        else {
+            compressLevel(pixels, level.width, level.height, format, &file[size_t(level.offset)]);
+        }
+    }
+
+    // Written under a temporary name so a reader never maps half a file
+    string temporaryFileName = fileName + ".tmp";
+    {
+        std::ofstream out(temporaryFileName.c_str(), std::ios::binary | std::ios::trunc);
+        out.write((const char*)&file[0], file.size());
+        if (!out) {
+            throw std::runtime_error("Can't write texture container: " + fileName);
+        }
+    }
+    std::remove(fileName.c_str());
+    if (std::rename(temporaryFileName.c_str(), fileName.c_str()) != 0) {
+        std::remove(temporaryFileName.c_str());
+        throw std::runtime_error("Can't write texture container: " + fileName);
+    }
+}
+
+bool TextureContainer::open(const string& fileName)
+{
+    close();
+
+    if (!_file.open(fileName)) {
+        return false;
+    }
+
+    const uint8_t* data = _file.data();
+    size_t size = _file.size();
+    if (size < sizeof(TextureContainerHeader)) {
+        close();
+        return false;
+    }
+
+    const TextureContainerHeader* header = (const TextureContainerHeader*)data;
+    if (memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 || header->version != VERSION
+        || header->format > TEXTURE_CONTAINER_BC3 || header->levelsCount == 0 || header->levelsCount > MAX_LEVELS
+        || sizeof(TextureContainerHeader) + header->levelsCount * sizeof(TextureContainerLevel) > size) {
+        close();
+        return false;
+    }
+
+    const TextureContainerLevel* levels = (const TextureContainerLevel*)(data + sizeof(TextureContainerHeader));
+    for (uint i = 0; i < header->levelsCount; ++i) {
+        if (levels[i].offset > size || levels[i].size > size - levels[i].offset
+            || levels[i].size != levelSize(TextureContainerFormat(header->format), levels[i].width, levels[i].height)) {
+            close();
+            return false;
+        }
+    }
+
+    _header = header;
+    _levels = levels;
+    return true;
+}
+
+void TextureContainer::close()
+{
+    _file.close();
+    _header = NULL;
+    _levels = NULL;
+}
+
+TextureContainerFormat TextureContainer::format() const
+{
+    return TextureContainerFormat(_header->format);
+}
+
+GLenum TextureContainer::internalFormat() const
+{
+    return _header->internalFormat;
+}
+
+bool TextureContainer::isCompressed() const
+{
+    return format() != TEXTURE_CONTAINER_RGBA8;
+}
+
+bool TextureContainer::isSupported() const
+{
+    return !isCompressed() || GLEW_EXT_texture_compression_s3tc;
+}
+
+uint TextureContainer::width() const
+{
+    return _header->width;
+}
+
+uint TextureContainer::height() const
+{
+    return _header->height;
+}
+
+int TextureContainer::rowCount() const
+{
+    return int(_header->rowCount);
+}
+
+int TextureContainer::columnCount() const
+{
+    return int(_header->columnCount);
+}
+
+uint TextureContainer::levelsCount() const
+{
+    return _header->levelsCount;
+}
+
+const TextureContainerLevel& TextureContainer::level(uint index) const
+{
+    return _levels[index];
+}
+
+const uint8_t* TextureContainer::levelData(uint index) const
+{
+    return _file.data() + _levels[index].offset;
+}
+
+void TextureContainer::upload(uint levelsCount) const
+{
+    PROFILE_SCOPE("TextureContainer::upload");
+
+    levelsCount = std::min(levelsCount, this->levelsCount());
+    for (uint i = 0; i < levelsCount; ++i) {
+        const TextureContainerLevel& level = _levels[i];
+        if (isCompressed()) {
+            glCompressedTexImage2D(GL_TEXTURE_2D, i, internalFormat(), level.width, level.height, 0, GLsizei(level.size), levelData(i));
+        }
+        else {
+            glTexImage2D(GL_TEXTURE_2D, i, internalFormat(), level.width, level.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, levelData(i));
+        }
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelsCount - 1);
+}
@@ -0,0 +1,93 @@
+#ifndef TEXTURE_CONTAINER_H
+#define TEXTURE_CONTAINER_H
+
+#include "common.h"
+#include "mappedfile.h"
+
+struct DecodedImage;
+struct MipLevel;
+
+// Binary texture file (.wtex) holding a ready-to-upload mip chain, so textures
+// load without decoding: the file is mapped and the levels are passed to GL as is.
+//
+// Layout: TextureContainerHeader, levelsCount TextureContainerLevel entries,
+// then the level data, each level starting at a 16-byte aligned offset.
+// Rows go bottom-up like glTexImage2D expects.
+
+enum TextureContainerFormat
+{
+    TEXTURE_CONTAINER_RGBA8,
+    TEXTURE_CONTAINER_BC1,  // opaque, 8 bytes per 4x4 block
+    TEXTURE_CONTAINER_BC3   // with alpha, 16 bytes per 4x4 block
+};
+
+struct TextureContainerHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t format;
+    uint32_t internalFormat;
+    uint32_t width;
+    uint32_t height;
+    uint32_t levelsCount;
+    // Atlas grid the mip levels were filtered for, see buildAtlasMipmaps()
+    uint32_t rowCount;
+    uint32_t columnCount;
+    uint32_t reserved;
+};
+
+struct TextureContainerLevel
+{
+    uint32_t width;
+    uint32_t height;
+    uint64_t offset;
+    uint64_t size;
+};
+
+class TextureContainer
+{
+    MappedFile _file;
+    const TextureContainerHeader* _header;
+    const TextureContainerLevel* _levels;
+
+public:
+    static const uint32_t VERSION = 2;
+    static const uint32_t MAX_LEVELS = 16;
+
+    // Where the container converted from an image is cached
+    static string containerFileName(const string& imageFileName);
+    // True when the container exists and is not older than the image
+    static bool isUpToDate(const string& containerFileName, const string& imageFileName);
+    // Builds the mip chain for the atlas grid, compresses it if asked and writes
+    // the file; throws std::runtime_error on failure
+    static void write(const string& fileName, const DecodedImage& image, TextureContainerFormat format, int rowCount = 1, int columnCount = 1);
+    // Same with levels 1..n already built by buildAtlasMipmaps() for that grid
+    static void write(const string& fileName, const DecodedImage& image, const vector<MipLevel>& mipmaps,
+                      TextureContainerFormat format, int rowCount, int columnCount);
+    static bool parseFormat(const string& name, TextureContainerFormat& format);
+
+    TextureContainer();
+
+    // Returns false if the file is missing, has another version or is damaged
+    bool open(const string& fileName);
+    void close();
+
+    TextureContainerFormat format() const;
+    GLenum internalFormat() const;
+    bool isCompressed() const;
+    // Compressed containers need EXT_texture_compression_s3tc
+    bool isSupported() const;
+
+    int rowCount() const;
+    int columnCount() const;
+    uint width() const;
+    uint height() const;
+    uint levelsCount() const;
+    const TextureContainerLevel& level(uint index) const;
+    const uint8_t* levelData(uint index) const;
+
+    // Uploads the first levelsCount levels into the bound GL_TEXTURE_2D
+    void upload(uint levelsCount) const;
+};
+
+#endif //TEXTURE_CONTAINER_H
@@ -0,0 +1,335 @@
+#include "textureloader.h"
+#include "glstate.h"
+#include "pixelkernels.h"
+#include "profiler.h"
+#include "texturecontainer.h"
+#include <algorithm>
+#include <cstring>
+
+DecodedImage::DecodedImage()
+    : width(0), height(0)
+{}
+
+TextureLoader::TextureLoader()
+    : _isStopping(false)
+{}
+
+TextureLoader::~TextureLoader()
+{
+    // Without a context the pixel buffers can't be freed here, see shutdown()
+    std::unique_lock<std::mutex> lock(_mutex);
+    _isStopping = true;
+    _requests.clear();
+    lock.unlock();
+    _requestAdded.notify_all();
+
+    for (size_t i = 0; i < _workers.size(); ++i) {
+        _workers[i].join();
+    }
+}
+
+void TextureLoader::decode(const string& fileName, DecodedImage& image)
+{
+    PROFILE_SCOPE("TextureLoader::decode");
+
+    FREE_IMAGE_FORMAT fif = FreeImage_GetFileType(fileName.c_str(), 0);
+
+    if (fif == FIF_UNKNOWN) {
+        fif = FreeImage_GetFIFFromFilename(fileName.c_str());
+    }
+
+    if (fif == FIF_UNKNOWN) {
+        throw std::runtime_error("Unknown image format: " + fileName);
+    }
+
+    FIBITMAP* dib = NULL;
+    if (FreeImage_FIFSupportsReading(fif)) {
+        dib = FreeImage_Load(fif, fileName.c_str());
+    }
+
+    if (!dib) {
+        throw std::runtime_error("Can't load image: " + fileName);
+    }
+
+    FIBITMAP* temp = dib;
+    dib = FreeImage_ConvertTo32Bits(dib);
+    FreeImage_Unload(temp);
+
+    if (!dib) {
+        throw std::runtime_error("Can't convert image: " + fileName);
+    }
+
+    const BYTE* data = FreeImage_GetBits(dib);
+    image.fileName = fileName;
+    image.width = FreeImage_GetWidth(dib);
+    image.height = FreeImage_GetHeight(dib);
+
+    if (data == NULL || image.width == 0 || image.height == 0) {
+        FreeImage_Unload(dib);
+        throw std::runtime_error("Can't retrieve info from image: " + fileName);
+    }
+
+    // FreeImage stores 32-bit pixels as BGRA and may pad the rows
+    image.pixels.resize(4 * image.width * image.height);
+    uint pitch = FreeImage_GetPitch(dib);
+    for (uint y = 0; y < image.height; ++y) {
+        const BYTE* src = data + y * pitch;
+        GLubyte* dst = &image.pixels[4 * image.width * y];
+#if FREEIMAGE_COLORORDER == FREEIMAGE_COLORORDER_BGR
+        swizzleBGRAToRGBA(src, dst, image.width);
+#else
+        memcpy(dst, src, 4 * image.width);
+#endif
+    }
+
+    FreeImage_Unload(dib);
+}
+
+void TextureLoader::startWorkers()
+{
+    unsigned int threadsCount = std::thread::hardware_concurrency();
+    threadsCount = std::min(4u, std::max(1u, threadsCount > 1 ? threadsCount - 1 : 1u));
+
+    for (unsigned int i = 0; i < threadsCount; ++i) {
+        _workers.push_back(std::thread(&TextureLoader::workerLoop, this));
+    }
+}
+
+void TextureLoader::workerLoop()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    while (true) {
+        while (_requests.empty() && !_isStopping) {
+            _requestAdded.wait(lock);
+        }
+        if (_isStopping) {
+            return;
+        }
+
+        Decoded decoded;
+        decoded.request = _requests.front();
+        _requests.pop_front();
+        _inFlight.push_back(decoded.request.texture);
+        lock.unlock();
+
+        try {
+            decode(decoded.request.fileName, decoded.image);
+        }
+        catch (std::exception const& except) {
+            decoded.error = except.what();
+        }
+
+        const Request& request = decoded.request;
+        if (decoded.error.empty() && (request.mipmapRequired || !request.containerFileName.empty())) {
+            buildAtlasMipmaps(decoded.image, request.rowCount, request.columnCount, decoded.mipmaps);
+        }
+
+        if (decoded.error.empty() && !request.containerFileName.empty()) {
+            try {
+                TextureContainer::write(request.containerFileName, decoded.image, decoded.mipmaps,
+                                        TEXTURE_CONTAINER_RGBA8, request.rowCount, request.columnCount);
+            }
+            catch (std::exception const& except) {
+                // Not fatal, the image is just decoded again next time
+                std::cerr << except.what() << endl;
+            }
+        }
+        if (!request.mipmapRequired) {
+            decoded.mipmaps.clear();
+        }
+
+        lock.lock();
+        _inFlight.erase(std::find(_inFlight.begin(), _inFlight.end(), decoded.request.texture));
+
+        std::map<GLuint, int>::iterator cancelled = _cancelledInFlight.find(decoded.request.texture);
+        if (cancelled != _cancelledInFlight.end()) {
+            if (--cancelled->second == 0) {
+                _cancelledInFlight.erase(cancelled);
+            }
+            continue;
+        }
+
+        _decoded.push_back(Decoded());
+        std::swap(_decoded.back(), decoded);
+    }
+}
+
+void TextureLoader::requestTexture(const string& fileName, GLuint texture, bool mipmapRequired, int rowCount, int columnCount,
+                                   const string& containerFileName)
+{
+    if (_workers.empty()) {
+        startWorkers();
+    }
+
+    Request request;
+    request.fileName = fileName;
+    request.containerFileName = containerFileName;
+    request.texture = texture;
+    request.mipmapRequired = mipmapRequired;
+    request.rowCount = rowCount;
+    request.columnCount = columnCount;
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _requests.push_back(request);
+    }
+    _requestAdded.notify_one();
+}
+
+void TextureLoader::cancel(GLuint texture)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    for (size_t i = _requests.size(); i-- > 0;) {
+        if (_requests[i].texture == texture) {
+            _requests.erase(_requests.begin() + i);
+        }
+    }
+
+    for (size_t i = _decoded.size(); i-- > 0;) {
+        if (_decoded[i].request.texture == texture) {
+            _decoded.erase(_decoded.begin() + i);
+        }
+    }
+
+    int inFlight = int(std::count(_inFlight.begin(), _inFlight.end(), texture));
+    if (inFlight > 0) {
+        _cancelledInFlight[texture] += inFlight;
+    }
+}
+
+void TextureLoader::upload(Decoded& decoded)
+{
+    PROFILE_SCOPE("TextureLoader::upload");
+
+    const DecodedImage& image = decoded.image;
+    const vector<MipLevel>& mipmaps = decoded.mipmaps;
+
+    // Every level goes into one buffer, one after another
+    vector<size_t> offsets(1, 0);
+    size_t size = image.pixels.size();
+    for (size_t i = 0; i < mipmaps.size(); ++i) {
+        offsets.push_back(size);
+        size += mipmaps[i].pixels.size();
+    }
+
+    GLuint pixelBuffer;
+    if (_freePixelBuffers.empty()) {
+        glGenBuffers(1, &pixelBuffer);
+    }
+    else {
+        pixelBuffer = _freePixelBuffers.back();
+        _freePixelBuffers.pop_back();
+    }
+
+    // Orphan the previous storage so the copy never waits for an earlier upload
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffer);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, GLsizeiptr(size), NULL, GL_STREAM_DRAW);
+    void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, GLsizeiptr(size), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+
+    if (mapped != NULL) {
+        memcpy(mapped, &image.pixels[0], image.pixels.size());
+        for (size_t i = 0; i < mipmaps.size(); ++i) {
+            memcpy((GLubyte*)mapped + offsets[i + 1], &mipmaps[i].pixels[0], mipmaps[i].pixels.size());
+        }
+        if (glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) != GL_TRUE) {
+            mapped = NULL;
+        }
+    }
+    if (mapped == NULL) {
+        // Mapping failed or the data got corrupted, upload from client memory instead
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    GLuint previousTexture = gGLState.boundTexture2D();
+    gGLState.bindTexture2D(decoded.request.texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image.width, image.height, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                 mapped != NULL ? (const GLvoid*)0 : (const GLvoid*)&image.pixels[0]);
+    // Mips were filtered per atlas cell on the worker, see buildAtlasMipmaps()
+    for (size_t i = 0; i < mipmaps.size(); ++i) {
+        glTexImage2D(GL_TEXTURE_2D, GLint(i + 1), GL_RGBA, mipmaps[i].width, mipmaps[i].height, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                     mapped != NULL ? (const GLvoid*)offsets[i + 1] : (const GLvoid*)&mipmaps[i].pixels[0]);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, GLint(mipmaps.size()));
+    gGLState.bindTexture2D(previousTexture);
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    _freePixelBuffers.push_back(pixelBuffer);
+}
+
+int TextureLoader::pollUploads(size_t budgetBytes)
+{
+    int completed = 0;
+    size_t uploadedBytes = 0;
+
+    while (completed == 0 || uploadedBytes < budgetBytes) {
+        Decoded decoded;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_decoded.empty()) {
+                break;
+            }
+            std::swap(decoded, _decoded.front());
+            _decoded.pop_front();
+        }
+
+        if (!decoded.error.empty()) {
+            std::cerr << decoded.error << std::endl;
+            continue;
+        }
+
+        upload(decoded);
+        uploadedBytes += decoded.image.pixels.size();
+        for (size_t i = 0; i < decoded.mipmaps.size(); ++i) {
+            uploadedBytes += decoded.mipmaps[i].pixels.size();
+        }
+        ++completed;
+    }
+
+    return completed;
+}
+
+bool TextureLoader::isIdle()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _requests.empty() && _decoded.empty() && _inFlight.empty();
+}
+
+bool TextureLoader::isPending(GLuint texture)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    for (size_t i = 0; i < _requests.size(); ++i) {
+        if (_requests[i].texture == texture) {
+            return true;
+        }
+    }
+    for (size_t i = 0; i < _decoded.size(); ++i) {
+        if (_decoded[i].request.texture == texture) {
+            return true;
+        }
+    }
+    return std::find(_inFlight.begin(), _inFlight.end(), texture) != _inFlight.end();
+}
+
+void TextureLoader::shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _isStopping = true;
+        _requests.clear();
+        _decoded.clear();
+    }
+    _requestAdded.notify_all();
+
+    for (size_t i = 0; i < _workers.size(); ++i) {
+        _workers[i].join();
+    }
+    _workers.clear();
+
+    if (!_freePixelBuffers.empty()) {
+        glDeleteBuffers(GLsizei(_freePixelBuffers.size()), &_freePixelBuffers[0]);
+        _freePixelBuffers.clear();
+    }
+}
@@ -0,0 +1,90 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include "common.h"
+#include "atlasmipmaps.h"
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+
+// RGBA8 pixels of a decoded image, rows bottom-up as glTexImage2D expects
+struct DecodedImage
+{
+    string fileName;
+    uint width, height;
+    vector<GLubyte> pixels;
+
+    DecodedImage();
+};
+
+// Loads textures without stalling the render thread: files are decoded and
+// converted to RGBA on worker threads, then pollUploads() streams them into
+// their GL textures through pixel buffer objects, a few per frame.
+class TextureLoader
+{
+    struct Request
+    {
+        string fileName;
+        string containerFileName;
+        GLuint texture;
+        bool mipmapRequired;
+        int rowCount, columnCount;
+    };
+
+    struct Decoded
+    {
+        Request request;
+        DecodedImage image;
+        vector<MipLevel> mipmaps;
+        string error;
+    };
+
+    vector<std::thread> _workers;
+    std::mutex _mutex;
+    std::condition_variable _requestAdded;
+    std::deque<Request> _requests;
+    std::deque<Decoded> _decoded;
+    // Textures being decoded right now, and how many of those were cancelled
+    vector<GLuint> _inFlight;
+    std::map<GLuint, int> _cancelledInFlight;
+    bool _isStopping;
+
+    // Unpack buffers reused between uploads
+    vector<GLuint> _freePixelBuffers;
+
+    void startWorkers();
+    void workerLoop();
+    void upload(Decoded& decoded);
+
+public:
+    static const size_t DEFAULT_UPLOAD_BUDGET = 8 * 1024 * 1024;
+
+    TextureLoader();
+    ~TextureLoader();
+
+    // Decodes an image file into RGBA8, throws std::runtime_error on failure
+    static void decode(const string& fileName, DecodedImage& image);
+
+    // Queues the file for decoding; the texture keeps its current contents
+    // (e.g. a placeholder) until pollUploads() replaces them. Mips are built on the
+    // worker per cell of the rowCount x columnCount atlas. With a container file name
+    // the decoded image is also saved there for the next launch.
+    void requestTexture(const string& fileName, GLuint texture, bool mipmapRequired, int rowCount, int columnCount,
+                        const string& containerFileName = "");
+    // Drops pending work for a texture that is about to be deleted
+    void cancel(GLuint texture);
+
+    // Uploads decoded images, at least one and at most budgetBytes per call;
+    // returns the number of textures completed. Must run on the GL thread.
+    int pollUploads(size_t budgetBytes = DEFAULT_UPLOAD_BUDGET);
+    bool isIdle();
+    // True until the texture's image is uploaded, or dropped after an error
+    bool isPending(GLuint texture);
+
+    // Stops the workers and frees the pixel buffers; needs the GL context
+    void shutdown();
+};
+
+#endif //TEXTURE_LOADER_H
@@ -0,0 +1,127 @@
+#include "texturemanager.h"
+#include "profiler.h"
+#include <sstream>
+
+TextureManager::TextureManager()
+    : _loader(NULL), _budget(DEFAULT_BUDGET), _memoryUsage(0), _useCounter(0)
+{}
+
+void TextureManager::setLoader(TextureLoader* loader)
+{
+    _loader = loader;
+}
+
+void TextureManager::setBudget(size_t budgetBytes)
+{
+    _budget = budgetBytes;
+    evictUnused();
+}
+
+size_t TextureManager::budget() const
+{
+    return _budget;
+}
+
+size_t TextureManager::memoryUsage() const
+{
+    return _memoryUsage;
+}
+
+size_t TextureManager::texturesCount() const
+{
+    return _entries.size();
+}
+
+TextureAtlas* TextureManager::acquire(const string& fileName, bool mipmapRequired, int rowCount, int columnCount)
+{
+    // Mips and the grid change what gets uploaded, so they are part of the key
+    std::ostringstream key;
+    key << fileName << '|' << (mipmapRequired ? 1 : 0) << '|' << rowCount << 'x' << columnCount;
+
+    std::map<string, Entry>::iterator found = _entries.find(key.str());
+    if (found != _entries.end()) {
+        found->second.refCount++;
+        found->second.lastUse = ++_useCounter;
+        return &found->second.atlas;
+    }
+
+    PROFILE_SCOPE("TextureManager::acquire");
+
+    Entry& entry = _entries[key.str()];
+    entry.refCount = 1;
+    entry.memorySize = 0;
+    entry.lastUse = ++_useCounter;
+
+    try {
+        if (_loader != NULL) {
+            entry.atlas.loadTextureAsync(*_loader, fileName, mipmapRequired, rowCount, columnCount);
+        }
+        else {
+            entry.atlas.loadTexture(fileName, mipmapRequired, rowCount, columnCount);
+        }
+    }
+    catch (...) {
+        _entries.erase(key.str());
+        throw;
+    }
+
+    updateMemorySize(entry);
+    evictUnused();
+    return &entry.atlas;
+}
+
+void TextureManager::release(TextureAtlas* atlas)
+{
+    for (std::map<string, Entry>::iterator it = _entries.begin(); it != _entries.end(); ++it) {
+        if (&it->second.atlas == atlas) {
+            assert(it->second.refCount > 0);
+            it->second.refCount--;
+            it->second.lastUse = ++_useCounter;
+            evictUnused();
+            return;
+        }
+    }
+}
+
+void TextureManager::update()
+{
+    for (std::map<string, Entry>::iterator it = _entries.begin(); it != _entries.end(); ++it) {
+        updateMemorySize(it->second);
+    }
+    evictUnused();
+}
+
+void TextureManager::updateMemorySize(Entry& entry)
+{
+    size_t memorySize = entry.atlas.memorySize();
+    _memoryUsage = _memoryUsage - entry.memorySize + memorySize;
+    entry.memorySize = memorySize;
+}
+
+void TextureManager::evictUnused()
+{
+    while (_memoryUsage > _budget) {
+        std::map<string, Entry>::iterator oldest = _entries.end();
+        for (std::map<string, Entry>::iterator it = _entries.begin(); it != _entries.end(); ++it) {
+            if (it->second.refCount == 0 && (oldest == _entries.end() || it->second.lastUse < oldest->second.lastUse)) {
+                oldest = it;
+            }
+        }
+        if (oldest == _entries.end()) {
+            return;
+        }
+
+        _memoryUsage -= oldest->second.memorySize;
+        oldest->second.atlas.releaseTexture();
+        _entries.erase(oldest);
+    }
+}
+
+void TextureManager::clear()
+{
+    for (std::map<string, Entry>::iterator it = _entries.begin(); it != _entries.end(); ++it) {
+        it->second.atlas.releaseTexture();
+    }
+    _entries.clear();
+    _memoryUsage = 0;
+}
@@ -0,0 +1,57 @@
+#ifndef TEXTURE_MANAGER_H
+#define TEXTURE_MANAGER_H
+
+#include "common.h"
+#include "texture.h"
+#include <map>
+
+class TextureLoader;
+
+// Shares texture atlases between their users: the same file loaded with the same
+// options is decoded and uploaded once. Atlases are reference counted; released
+// ones stay cached, so swapping effects back is free, until the GPU memory they
+// take goes over the budget. Then the least recently used are deleted first.
+// Atlases still in use are never evicted, so usage may stay above a small budget.
+class TextureManager
+{
+    struct Entry
+    {
+        TextureAtlas atlas;
+        int refCount;
+        size_t memorySize;
+        uint64_t lastUse;
+    };
+
+    std::map<string, Entry> _entries;
+    TextureLoader* _loader;
+    size_t _budget;
+    size_t _memoryUsage;
+    uint64_t _useCounter;
+
+    void updateMemorySize(Entry& entry);
+    void evictUnused();
+
+public:
+    static const size_t DEFAULT_BUDGET = 256 << 20;
+
+    TextureManager();
+
+    // With a loader new textures load in the background, see TextureAtlas::loadTextureAsync()
+    void setLoader(TextureLoader* loader);
+    void setBudget(size_t budgetBytes);
+    size_t budget() const;
+    // Bytes of every cached texture, released or not
+    size_t memoryUsage() const;
+    size_t texturesCount() const;
+
+    TextureAtlas* acquire(const string& fileName, bool mipmapRequired, int rowCount, int columnCount);
+    void release(TextureAtlas* atlas);
+
+    // Picks up the sizes of finished background loads and evicts over the budget;
+    // once a frame, after TextureLoader::pollUploads()
+    void update();
+    // Deletes every texture, in use or not; needs the GL context
+    void clear();
+};
+
+#endif //TEXTURE_MANAGER_H
@@ -1,22 +1,112 @@
 #include "waterfallprogram.h"
+#include "glstate.h"
+#include "profiler.h"
+#include "shadercompilethread.h"
+#include "shaders.h"
 
 #define PARTICLES_COUNT 10000
 
-WaterfallProgram::WaterfallProgram()
+WaterfallProgram::WaterfallProgram(SpriteSource spriteSource)
     : _lastFrameTP(chrono::system_clock::now())
+    , _spriteSource(spriteSource)
 {
     initSettings();
     initAntTweakBar();
+    _frameConstants.createBuffer();
+    _textureManager.setLoader(&_textureLoader);
+
+    // Drivers that don't compile in the background would stall the frame on every shader
+    if (!hasParallelShaderCompile() && !gShaderCompileThread.start()) {
+        std::cerr << "Shaders are compiled on the render thread" << std::endl;
+    }
     initParticleSystem();
+
+    if (!_shaderWatcher.startWatching("shaders")) {
+        std::cerr << "Shader hot reload is not available" << std::endl;
+    }
+}
+
+WaterfallProgram::~WaterfallProgram()
+{
+    gShaderCompileThread.stop();
+    _shaderCache.clear();
+    _particleSystem.releaseTextures();
+    _textureManager.clear();
+    _textureLoader.shutdown();
+    _frameConstants.deleteBuffer();
+}
+
+bool WaterfallProgram::parseSpriteSource(const string& name, SpriteSource& source)
+{
+    if (name == "layers") {
+        source = SPRITES_LAYERS;
+    }
+    else if (name == "sheet") {
+        source = SPRITES_SHEET;
+    }
+    else if (name == "packed") {
+        source = SPRITES_PACKED;
+    }
+    else {
+        return false;
+    }
+    return true;
 }
 
 void WaterfallProgram::initParticleSystem()
 {
+    // The waterfall itself is the first emitter, edited from the tweak bar
+    _particleSystem.emitters.resize(1);
+    _particleSystem.emitters[0].particlesCount = PARTICLES_COUNT;
     setupParticleSystem();
-    //_particleSystem.loadTextureAtlas("textures//bang_ta.png", 8, 8);
-    _particleSystem.loadTextureAtlas("textures//water1.jpg", 1, 1);
-    //_particleSystem.loadTextureAtlas("textures//water_sprite.png", 4, 4);
-    _particleSystem.initialize(PARTICLES_COUNT);
+
+    if (_spriteSource == SPRITES_LAYERS) {
+        TextureArrayLayer layers[] = { { "textures//water1.jpg", 1, 1 }, { "textures//water_sprite.png", 4, 4 }, { "textures//water_drop.png", 1, 1 } };
+        _particleSystem.loadTextureArray(vector<TextureArrayLayer>(layers, layers + 3));
+        addSplashEmitters();
+    }
+    else if (_spriteSource == SPRITES_PACKED) {
+        const char* frames[] = { "textures//water_drop.png", "textures//metaball.png", "textures//plus.png" };
+        _particleSystem.loadPackedAtlas(vector<string>(frames, frames + 3));
+    }
+    else {
+        //_particleSystem.loadTextureAtlas("textures//bang_ta.png", 8, 8, _textureManager);
+        _particleSystem.loadTextureAtlas("textures//water1.jpg", 1, 1, _textureManager);
+        //_particleSystem.loadTextureAtlas("textures//water_sprite.png", 4, 4, _textureManager);
+    }
+    _particleSystem.initialize(&_shaderCache);
+}
+
+void WaterfallProgram::addSplashEmitters()
+{
+    // Spray where the water lands, animated from the water sprite sheet
+    ParticleEmitter splash;
+    splash.position         = vec3(0.0f, -45.0f, 0.0f);
+    splash.vicinity         = vec3(12.0f, 2.0f, 0.0f);
+    splash.averageVelocity  = vec3(0.0f, 12.0f, 0.0f);
+    splash.velocityVicinity = vec3(8.0f, 4.0f, 0.0f);
+    splash.minLifeTime = 1;
+    splash.maxLifeTime = 2;
+    splash.minSize = 0.3;
+    splash.maxSize = 0.8;
+    splash.color = vec3(0.6f, 0.9f, 1.0f);
+    splash.opacity = 0.3f;
+    splash.particlesCount = PARTICLES_COUNT / 4;
+    splash.layer = 1;
+    _particleSystem.emitters.push_back(splash);
+
+    // Fewer drops, thrown higher and wider
+    ParticleEmitter drops = splash;
+    drops.averageVelocity  = vec3(0.0f, 20.0f, 0.0f);
+    drops.velocityVicinity = vec3(20.0f, 6.0f, 0.0f);
+    drops.minLifeTime = 2;
+    drops.maxLifeTime = 3;
+    drops.minSize = 0.1;
+    drops.maxSize = 0.3;
+    drops.color = vec3(0.8f, 1.0f, 1.0f);
+    drops.particlesCount = PARTICLES_COUNT / 10;
+    drops.layer = 2;
+    _particleSystem.emitters.push_back(drops);
 }
 
 void WaterfallProgram::initSettings()
@@ -37,11 +127,16 @@ void WaterfallProgram::initSettings()
 
     _particleColor = vec3(0.0f, 1.0f, 1.0f);
     _particleOpacity = 0.4f;
+
+    _textureBudgetMB = float(TextureManager::DEFAULT_BUDGET >> 20);
+    _textureMemoryMB = 0;
 }
 
 void WaterfallProgram::initAntTweakBar()
 {
-    TwInit(TW_OPENGL, NULL);
+    TwInit(TW_OPENGL_CORE, NULL);
+    // TwInit leaves its own vertex array and buffer bound, only TwDraw goes through the shadow
+    gGLState.resync();
 
     TwBar* bar = TwNewBar("Parameters");
     TwDefine(" Parameters size='500 1000' color='70 100 120' valueswidth=220 iconpos=topleft");
@@ -70,28 +165,52 @@ void WaterfallProgram::initAntTweakBar()
 
     TwAddVarRW(bar, "Partice Color", TW_TYPE_COLOR3F, &_particleColor, NULL);
     TwAddVarRW(bar, "Partice Opacity", TW_TYPE_FLOAT, &_particleOpacity, "min=0 max=1 step=0.01");
+
+    TwAddVarRW(bar, "Texture Budget (MB)", TW_TYPE_FLOAT, &_textureBudgetMB, "min=0 step=16");
+    TwAddVarRO(bar, "Texture Memory (MB)", TW_TYPE_FLOAT, &_textureMemoryMB, NULL);
 }
 
 void WaterfallProgram::setupParticleSystem()
 {
-    _particleSystem.emitterPosition = _emitterPosition;
-    _particleSystem.emitterVicinity = _emitterVicinity;
-    _particleSystem.averageVelocity = _averageVelocity;
-    _particleSystem.velocityVicinity = _velocityVicinity;
+    ParticleEmitter& waterfall = _particleSystem.emitters[0];
+    waterfall.position = _emitterPosition;
+    waterfall.vicinity = _emitterVicinity;
+    waterfall.averageVelocity = _averageVelocity;
+    waterfall.velocityVicinity = _velocityVicinity;
+    waterfall.minLifeTime = _minLifeTime;
+    waterfall.maxLifeTime = _maxLifeTime;
+    waterfall.minSize = _minSize;
+    waterfall.maxSize = _maxSize;
+    waterfall.color = _particleColor;
+    waterfall.opacity = _particleOpacity;
     _particleSystem.gravity = _gravity;
-    _particleSystem.minLifeTime = _minLifeTime;
-    _particleSystem.maxLifeTime = _maxLifeTime;
-    _particleSystem.minSize = _minSize;
-    _particleSystem.maxSize = _maxSize;
-    _particleSystem.colorInit = _particleColor;
-    _particleSystem.opacityInit = _particleOpacity;
+}
+
+void WaterfallProgram::reloadChangedShaders()
+{
+    vector<ShaderFileChange> changes;
+    if (!_shaderWatcher.takeChanges(changes)) {
+        return;
+    }
+
+    for (size_t i = 0; i < changes.size(); ++i) {
+        cout << "Reloading " << changes[i].fileName << endl;
+        _shaderCache.invalidate(changes[i].fileName);
+        _particleSystem.reloadShader(changes[i].fileName, changes[i].source);
+    }
 }
 
 void WaterfallProgram::drawFrame()
 {
+    PROFILE_SCOPE("WaterfallProgram::drawFrame");
+
+    reloadChangedShaders();
+    _textureLoader.pollUploads();
+    _textureManager.setBudget(size_t(_textureBudgetMB * (1 << 20)));
+    _textureManager.update();
+    _textureMemoryMB = float(_textureManager.memoryUsage()) / (1 << 20);
     setupParticleSystem();
-    float timePassed = updateTimer();
-    _particleSystem.updateParticles(timePassed);
+    _frameConstants.advanceTime(updateTimer());
 
     float const width = (float)glutGet(GLUT_WINDOW_WIDTH);
     float const height = (float)glutGet(GLUT_WINDOW_HEIGHT);
@@ -101,7 +220,10 @@ void WaterfallProgram::drawFrame()
     vec3 viewCenter = vec3(0, 0, 0);
     vec3 upVector = vec3(0, 1, 0);
 
-    _particleSystem.setMatrices(mProj, cameraPosition, viewCenter, upVector, _rotation);
+    _frameConstants.setCamera(mProj, cameraPosition, viewCenter, upVector);
+    _frameConstants.update();
+
+    _particleSystem.updateParticles();
     _particleSystem.renderParticles();
 }
 
@@ -3,10 +3,23 @@
 
 #include "common.h"
 #include "particlesystem.h"
+#include "frameconstants.h"
+#include "shaderwatcher.h"
+#include "textureloader.h"
+#include "texturemanager.h"
+
+// Where the particles take their sprites from, picked with --sprites on the command line
+enum SpriteSource
+{
+    SPRITES_LAYERS,  // the waterfall, its splash and drops, a texture array layer each, in one draw
+    SPRITES_SHEET,   // the waterfall alone, from a single sheet
+    SPRITES_PACKED   // the waterfall alone, its frames packed into one atlas by SpriteAtlas
+};
 
 class WaterfallProgram
 {
     chrono::system_clock::time_point _lastFrameTP;
+    SpriteSource _spriteSource;
 
     float _cameraZPosition;
     float _cameraFOV;
@@ -25,15 +38,29 @@ class WaterfallProgram
     vec3 _particleColor;
     float _particleOpacity;
 
+    float _textureBudgetMB;
+    float _textureMemoryMB;
+
+    FrameConstantsBuffer _frameConstants;
+    ShaderWatcher _shaderWatcher;
+    WShaderCache _shaderCache;
+    TextureLoader _textureLoader;
+    TextureManager _textureManager;
     ParticleSystem _particleSystem;
 
     void initSettings();
     void initAntTweakBar();
     void initParticleSystem();
+    void addSplashEmitters();
     void setupParticleSystem();
+    void reloadChangedShaders();
 
 public:
-    WaterfallProgram();
+    explicit WaterfallProgram(SpriteSource spriteSource);
+    ~WaterfallProgram();
+
+    // Reads the --sprites argument: "layers", "sheet" or "packed"
+    static bool parseSpriteSource(const string& name, SpriteSource& source);
 
     void drawFrame();
     float updateTimer();
@@ -0,0 +1,473 @@
+#define GL_COUNTERS_IMPLEMENTATION
+#include "common.h"
+#include "glcounters.h"
+#include <cstring>
+#include <thread>
+
+GLCallCounters gGLCounters;
+
+GLFrameCounters::GLFrameCounters()
+    : drawCalls(0), stateChanges(0), programBinds(0), textureBinds(0)
+    , bufferUploads(0), uploadBytes(0), getQueries(0), queryReadbacks(0)
+{}
+
+GLFrameCounters& GLFrameCounters::operator+=(const GLFrameCounters& other)
+{
+    drawCalls += other.drawCalls;
+    stateChanges += other.stateChanges;
+    programBinds += other.programBinds;
+    textureBinds += other.textureBinds;
+    bufferUploads += other.bufferUploads;
+    uploadBytes += other.uploadBytes;
+    getQueries += other.getQueries;
+    queryReadbacks += other.queryReadbacks;
+    return *this;
+}
+
+#ifdef GL_COUNTERS
+
+namespace
+{
+    struct CountedProc
+    {
+        const char* name;
+        void* wrapper;
+    };
+
+    vector<CountedProc> countedProcs;
+
+    GLuint pixelUnpackBuffer = 0;
+
+    // The thread install() ran on; only its calls belong to a frame
+    std::thread::id renderThread;
+
+    GLFrameCounters& counters()
+    {
+        // Calls from other threads, e.g. a shader compile thread, are dropped here
+        static thread_local GLFrameCounters otherThread;
+        return std::this_thread::get_id() == renderThread ? gGLCounters.current() : otherThread;
+    }
+
+    uint64_t pixelsSize(GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type)
+    {
+        int components = 4;
+        switch (format) {
+        case GL_RED: case GL_GREEN: case GL_BLUE: case GL_ALPHA:
+        case GL_LUMINANCE: case GL_DEPTH_COMPONENT: case GL_RED_INTEGER:
+            components = 1;
+            break;
+        case GL_RG: case GL_LUMINANCE_ALPHA: case GL_RG_INTEGER: case GL_DEPTH_STENCIL:
+            components = 2;
+            break;
+        case GL_RGB: case GL_BGR: case GL_RGB_INTEGER:
+            components = 3;
+            break;
+        }
+
+        int componentSize = 1;
+        switch (type) {
+        case GL_UNSIGNED_SHORT: case GL_SHORT: case GL_HALF_FLOAT:
+            componentSize = 2;
+            break;
+        case GL_UNSIGNED_INT: case GL_INT: case GL_FLOAT:
+            componentSize = 4;
+            break;
+        case GL_UNSIGNED_INT_8_8_8_8: case GL_UNSIGNED_INT_8_8_8_8_REV:
+        case GL_UNSIGNED_INT_2_10_10_10_REV: case GL_UNSIGNED_INT_24_8:
+            // Packed types describe the whole pixel
+            components = 1;
+            componentSize = 4;
+            break;
+        }
+
+        return uint64_t(width) * height * depth * components * componentSize;
+    }
+
+    void countUpload(uint64_t bytes)
+    {
+        ++counters().bufferUploads;
+        counters().uploadBytes += bytes;
+    }
+
+    void countTextureUpload(const GLvoid* pixels, uint64_t bytes)
+    {
+        // NULL pixels only allocate storage unless they are an offset into a bound PBO
+        if (pixels != NULL || pixelUnpackBuffer != 0) {
+            countUpload(bytes);
+        }
+    }
+}
+
+// Wrappers for the GLEW function pointers; install() swaps them in and keeps the originals.
+// Parameter constness follows the GL spec, which newer GLEW headers match.
+#define GL_COUNTED_GLEW(Ret, Name, Params, Args, Count) \
+    static decltype(__glew##Name) real##Name = NULL; \
+    static Ret GLAPIENTRY counted##Name Params { Count; return real##Name Args; }
+
+// Wrappers for GL 1.1 functions called directly from the GL library
+#define GL_COUNTED_GL11(Ret, Name, Params, Args, Count) \
+    Ret GLAPIENTRY glCounted##Name Params { Count; return gl##Name Args; }
+
+#define COUNT_DRAW      ++counters().drawCalls
+#define COUNT_STATE     ++counters().stateChanges
+#define COUNT_PROGRAM   ++counters().programBinds
+#define COUNT_TEXTURE   ++counters().textureBinds
+#define COUNT_GET       ++counters().getQueries
+#define COUNT_READBACK  ++counters().queryReadbacks
+
+GL_COUNTED_GLEW(void, DrawArraysInstanced, (GLenum mode, GLint first, GLsizei count, GLsizei primcount),
+                (mode, first, count, primcount), COUNT_DRAW)
+GL_COUNTED_GLEW(void, DrawElementsInstanced, (GLenum mode, GLsizei count, GLenum type, const GLvoid* indices, GLsizei primcount),
+                (mode, count, type, indices, primcount), COUNT_DRAW)
+GL_COUNTED_GLEW(void, DrawRangeElements, (GLenum mode, GLuint start, GLuint end, GLsizei count, GLenum type, const GLvoid* indices),
+                (mode, start, end, count, type, indices), COUNT_DRAW)
+GL_COUNTED_GLEW(void, DrawElementsBaseVertex, (GLenum mode, GLsizei count, GLenum type, const GLvoid* indices, GLint basevertex),
+                (mode, count, type, indices, basevertex), COUNT_DRAW)
+GL_COUNTED_GLEW(void, MultiDrawArrays, (GLenum mode, const GLint* first, const GLsizei* count, GLsizei drawcount),
+                (mode, first, count, drawcount), COUNT_DRAW)
+GL_COUNTED_GLEW(void, MultiDrawElements, (GLenum mode, const GLsizei* count, GLenum type, const GLvoid* const* indices, GLsizei drawcount),
+                (mode, count, type, (const GLvoid**)indices, drawcount), COUNT_DRAW)
+
+GL_COUNTED_GLEW(void, UseProgram, (GLuint program), (program), COUNT_PROGRAM)
+
+GL_COUNTED_GLEW(void, ActiveTexture, (GLenum texture), (texture), COUNT_STATE)
+GL_COUNTED_GLEW(void, BindSampler, (GLuint unit, GLuint sampler), (unit, sampler), COUNT_STATE)
+GL_COUNTED_GLEW(void, SamplerParameteri, (GLuint sampler, GLenum pname, GLint param), (sampler, pname, param), COUNT_STATE)
+GL_COUNTED_GLEW(void, BindVertexArray, (GLuint array), (array), COUNT_STATE)
+GL_COUNTED_GLEW(void, BindBuffer, (GLenum target, GLuint buffer), (target, buffer),
+                COUNT_STATE; if (target == GL_PIXEL_UNPACK_BUFFER) pixelUnpackBuffer = buffer)
+GL_COUNTED_GLEW(void, BindBufferBase, (GLenum target, GLuint index, GLuint buffer), (target, index, buffer), COUNT_STATE)
+GL_COUNTED_GLEW(void, BindBufferRange, (GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size),
+                (target, index, buffer, offset, size), COUNT_STATE)
+GL_COUNTED_GLEW(void, BindTransformFeedback, (GLenum target, GLuint id), (target, id), COUNT_STATE)
+GL_COUNTED_GLEW(void, BindFramebuffer, (GLenum target, GLuint framebuffer), (target, framebuffer), COUNT_STATE)
+GL_COUNTED_GLEW(void, BlendFuncSeparate, (GLenum srcRGB, GLenum dstRGB, GLenum srcAlpha, GLenum dstAlpha),
+                (srcRGB, dstRGB, srcAlpha, dstAlpha), COUNT_STATE)
+GL_COUNTED_GLEW(void, BlendEquation, (GLenum mode), (mode), COUNT_STATE)
+GL_COUNTED_GLEW(void, EnableVertexAttribArray, (GLuint index), (index), COUNT_STATE)
+GL_COUNTED_GLEW(void, DisableVertexAttribArray, (GLuint index), (index), COUNT_STATE)
+GL_COUNTED_GLEW(void, VertexAttribPointer, (GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const GLvoid* pointer),
+                (index, size, type, normalized, stride, pointer), COUNT_STATE)
+GL_COUNTED_GLEW(void, VertexAttribDivisor, (GLuint index, GLuint divisor), (index, divisor), COUNT_STATE)
+GL_COUNTED_GLEW(void, Uniform1i, (GLint location, GLint v0), (location, v0), COUNT_STATE)
+GL_COUNTED_GLEW(void, Uniform1f, (GLint location, GLfloat v0), (location, v0), COUNT_STATE)
+GL_COUNTED_GLEW(void, Uniform2f, (GLint location, GLfloat v0, GLfloat v1), (location, v0, v1), COUNT_STATE)
+GL_COUNTED_GLEW(void, Uniform3f, (GLint location, GLfloat v0, GLfloat v1, GLfloat v2), (location, v0, v1, v2), COUNT_STATE)
+GL_COUNTED_GLEW(void, Uniform4f, (GLint location, GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3),
+                (location, v0, v1, v2, v3), COUNT_STATE)
+GL_COUNTED_GLEW(void, Uniform1iv, (GLint location, GLsizei count, const GLint* value), (location, count, value), COUNT_STATE)
+GL_COUNTED_GLEW(void, Uniform1fv, (GLint location, GLsizei count, const GLfloat* value), (location, count, value), COUNT_STATE)
+GL_COUNTED_GLEW(void, Uniform2fv, (GLint location, GLsizei count, const GLfloat* value), (location, count, value), COUNT_STATE)
+GL_COUNTED_GLEW(void, Uniform3fv, (GLint location, GLsizei count, const GLfloat* value), (location, count, value), COUNT_STATE)
+GL_COUNTED_GLEW(void, Uniform4fv, (GLint location, GLsizei count, const GLfloat* value), (location, count, value), COUNT_STATE)
+GL_COUNTED_GLEW(void, UniformMatrix3fv, (GLint location, GLsizei count, GLboolean transpose, const GLfloat* value),
+                (location, count, transpose, value), COUNT_STATE)
+GL_COUNTED_GLEW(void, UniformMatrix4fv, (GLint location, GLsizei count, GLboolean transpose, const GLfloat* value),
+                (location, count, transpose, value), COUNT_STATE)
+
+GL_COUNTED_GLEW(void, BufferData, (GLenum target, GLsizeiptr size, const GLvoid* data, GLenum usage),
+                (target, size, data, usage), if (data != NULL) countUpload(size))
+GL_COUNTED_GLEW(void, BufferSubData, (GLenum target, GLintptr offset, GLsizeiptr size, const GLvoid* data),
+                (target, offset, size, data), countUpload(size))
+GL_COUNTED_GLEW(GLvoid*, MapBufferRange, (GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access),
+                (target, offset, length, access), if (access & GL_MAP_WRITE_BIT) countUpload(length))
+GL_COUNTED_GLEW(void, TexImage3D, (GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLsizei depth,
+                                   GLint border, GLenum format, GLenum type, const GLvoid* pixels),
+                (target, level, internalformat, width, height, depth, border, format, type, pixels),
+                countTextureUpload(pixels, pixelsSize(width, height, depth, format, type)))
+GL_COUNTED_GLEW(void, TexSubImage3D, (GLenum target, GLint level, GLint xoffset, GLint yoffset, GLint zoffset,
+                                      GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type, const GLvoid* pixels),
+                (target, level, xoffset, yoffset, zoffset, width, height, depth, format, type, pixels),
+                countTextureUpload(pixels, pixelsSize(width, height, depth, format, type)))
+GL_COUNTED_GLEW(void, CompressedTexImage2D, (GLenum target, GLint level, GLenum internalformat, GLsizei width, GLsizei height,
+                                             GLint border, GLsizei imageSize, const GLvoid* data),
+                (target, level, internalformat, width, height, border, imageSize, data),
+                countTextureUpload(data, imageSize))
+
+GL_COUNTED_GLEW(void, GetIntegeri_v, (GLenum target, GLuint index, GLint* data), (target, index, data), COUNT_GET)
+GL_COUNTED_GLEW(const GLubyte*, GetStringi, (GLenum name, GLuint index), (name, index), COUNT_GET)
+GL_COUNTED_GLEW(void, GetProgramiv, (GLuint program, GLenum pname, GLint* params), (program, pname, params), COUNT_GET)
+GL_COUNTED_GLEW(void, GetShaderiv, (GLuint shader, GLenum pname, GLint* params), (shader, pname, params), COUNT_GET)
+GL_COUNTED_GLEW(GLint, GetUniformLocation, (GLuint program, const GLchar* name), (program, name), COUNT_GET)
+GL_COUNTED_GLEW(GLint, GetAttribLocation, (GLuint program, const GLchar* name), (program, name), COUNT_GET)
+GL_COUNTED_GLEW(GLuint, GetUniformBlockIndex, (GLuint program, const GLchar* uniformBlockName), (program, uniformBlockName), COUNT_GET)
+
+GL_COUNTED_GLEW(void, GetQueryObjectiv, (GLuint id, GLenum pname, GLint* params), (id, pname, params), COUNT_READBACK)
+GL_COUNTED_GLEW(void, GetQueryObjectuiv, (GLuint id, GLenum pname, GLuint* params), (id, pname, params), COUNT_READBACK)
+GL_COUNTED_GLEW(void, GetQueryObjectui64v, (GLuint id, GLenum pname, GLuint64* params), (id, pname, params), COUNT_READBACK)
+GL_COUNTED_GLEW(void, GetBufferSubData, (GLenum target, GLintptr offset, GLsizeiptr size, GLvoid* data),
+                (target, offset, size, data), COUNT_READBACK)
+
+GL_COUNTED_GL11(void, DrawArrays, (GLenum mode, GLint first, GLsizei count), (mode, first, count), COUNT_DRAW)
+GL_COUNTED_GL11(void, DrawElements, (GLenum mode, GLsizei count, GLenum type, const GLvoid* indices),
+                (mode, count, type, indices), COUNT_DRAW)
+GL_COUNTED_GL11(void, Enable, (GLenum cap), (cap), COUNT_STATE)
+GL_COUNTED_GL11(void, Disable, (GLenum cap), (cap), COUNT_STATE)
+GL_COUNTED_GL11(void, BlendFunc, (GLenum sfactor, GLenum dfactor), (sfactor, dfactor), COUNT_STATE)
+GL_COUNTED_GL11(void, DepthMask, (GLboolean flag), (flag), COUNT_STATE)
+GL_COUNTED_GL11(void, DepthFunc, (GLenum func), (func), COUNT_STATE)
+GL_COUNTED_GL11(void, CullFace, (GLenum mode), (mode), COUNT_STATE)
+GL_COUNTED_GL11(void, PolygonMode, (GLenum face, GLenum mode), (face, mode), COUNT_STATE)
+GL_COUNTED_GL11(void, LineWidth, (GLfloat width), (width), COUNT_STATE)
+GL_COUNTED_GL11(void, PointSize, (GLfloat size), (size), COUNT_STATE)
+GL_COUNTED_GL11(void, Viewport, (GLint x, GLint y, GLsizei width, GLsizei height), (x, y, width, height), COUNT_STATE)
+GL_COUNTED_GL11(void, Scissor, (GLint x, GLint y, GLsizei width, GLsizei height), (x, y, width, height), COUNT_STATE)
+GL_COUNTED_GL11(void, ClearColor, (GLclampf red, GLclampf green, GLclampf blue, GLclampf alpha),
+                (red, green, blue, alpha), COUNT_STATE)
+GL_COUNTED_GL11(void, ClearDepth, (GLclampd depth), (depth), COUNT_STATE)
+GL_COUNTED_GL11(void, ColorMask, (GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha),
+                (red, green, blue, alpha), COUNT_STATE)
+GL_COUNTED_GL11(void, BindTexture, (GLenum target, GLuint texture), (target, texture), COUNT_TEXTURE)
+GL_COUNTED_GL11(void, TexParameteri, (GLenum target, GLenum pname, GLint param), (target, pname, param), COUNT_STATE)
+GL_COUNTED_GL11(void, TexParameterf, (GLenum target, GLenum pname, GLfloat param), (target, pname, param), COUNT_STATE)
+GL_COUNTED_GL11(void, TexImage2D, (GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height,
+                                   GLint border, GLenum format, GLenum type, const GLvoid* pixels),
+                (target, level, internalformat, width, height, border, format, type, pixels),
+                countTextureUpload(pixels, pixelsSize(width, height, 1, format, type)))
+GL_COUNTED_GL11(void, TexSubImage2D, (GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height,
+                                      GLenum format, GLenum type, const GLvoid* pixels),
+                (target, level, xoffset, yoffset, width, height, format, type, pixels),
+                countTextureUpload(pixels, pixelsSize(width, height, 1, format, type)))
+GL_COUNTED_GL11(void, GetIntegerv, (GLenum pname, GLint* params), (pname, params), COUNT_GET)
+GL_COUNTED_GL11(void, GetFloatv, (GLenum pname, GLfloat* params), (pname, params), COUNT_GET)
+GL_COUNTED_GL11(void, GetBooleanv, (GLenum pname, GLboolean* params), (pname, params), COUNT_GET)
+GL_COUNTED_GL11(GLboolean, IsEnabled, (GLenum cap), (cap), COUNT_GET)
+GL_COUNTED_GL11(const GLubyte*, GetString, (GLenum name), (name), COUNT_GET)
+GL_COUNTED_GL11(GLenum, GetError, (), (), COUNT_GET)
+GL_COUNTED_GL11(void, ReadPixels, (GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, GLvoid* pixels),
+                (x, y, width, height, format, type, pixels), COUNT_READBACK)
+GL_COUNTED_GL11(void, GetTexImage, (GLenum target, GLint level, GLenum format, GLenum type, GLvoid* pixels),
+                (target, level, format, type, pixels), COUNT_READBACK)
+
+#define INSTALL_GLEW(Name) \
+    if (__glew##Name != NULL && __glew##Name != (decltype(__glew##Name))counted##Name) { \
+        real##Name = __glew##Name; \
+        __glew##Name = (decltype(__glew##Name))counted##Name; \
+        CountedProc proc = { "gl" #Name, (void*)counted##Name }; \
+        countedProcs.push_back(proc); \
+    }
+
+#define INSTALL_GL11(Name) \
+    { \
+        CountedProc proc = { "gl" #Name, (void*)glCounted##Name }; \
+        countedProcs.push_back(proc); \
+    }
+
+#endif // GL_COUNTERS
+
+GLCallCounters::GLCallCounters()
+    : _isInstalled(false)
+    , _subsystem(0)
+    , _frame(0)
+    , _log(NULL)
+{
+    _subsystemNames.push_back("other");
+}
+
+GLCallCounters::~GLCallCounters()
+{
+    closeLog();
+}
+
+void GLCallCounters::install()
+{
+#ifdef GL_COUNTERS
+    if (_isInstalled) {
+        return;
+    }
+
+    INSTALL_GLEW(DrawArraysInstanced)
+    INSTALL_GLEW(DrawElementsInstanced)
+    INSTALL_GLEW(DrawRangeElements)
+    INSTALL_GLEW(DrawElementsBaseVertex)
+    INSTALL_GLEW(MultiDrawArrays)
+    INSTALL_GLEW(MultiDrawElements)
+    INSTALL_GLEW(UseProgram)
+    INSTALL_GLEW(ActiveTexture)
+    INSTALL_GLEW(BindSampler)
+    INSTALL_GLEW(SamplerParameteri)
+    INSTALL_GLEW(BindVertexArray)
+    INSTALL_GLEW(BindBuffer)
+    INSTALL_GLEW(BindBufferBase)
+    INSTALL_GLEW(BindBufferRange)
+    INSTALL_GLEW(BindTransformFeedback)
+    INSTALL_GLEW(BindFramebuffer)
+    INSTALL_GLEW(BlendFuncSeparate)
+    INSTALL_GLEW(BlendEquation)
+    INSTALL_GLEW(EnableVertexAttribArray)
+    INSTALL_GLEW(DisableVertexAttribArray)
+    INSTALL_GLEW(VertexAttribPointer)
+    INSTALL_GLEW(VertexAttribDivisor)
+    INSTALL_GLEW(Uniform1i)
+    INSTALL_GLEW(Uniform1f)
+    INSTALL_GLEW(Uniform2f)
+    INSTALL_GLEW(Uniform3f)
+    INSTALL_GLEW(Uniform4f)
+    INSTALL_GLEW(Uniform1iv)
+    INSTALL_GLEW(Uniform1fv)
+    INSTALL_GLEW(Uniform2fv)
+    INSTALL_GLEW(Uniform3fv)
+    INSTALL_GLEW(Uniform4fv)
+    INSTALL_GLEW(UniformMatrix3fv)
+    INSTALL_GLEW(UniformMatrix4fv)
+    INSTALL_GLEW(BufferData)
+    INSTALL_GLEW(BufferSubData)
+    INSTALL_GLEW(MapBufferRange)
+    INSTALL_GLEW(TexImage3D)
+    INSTALL_GLEW(TexSubImage3D)
+    INSTALL_GLEW(CompressedTexImage2D)
+    INSTALL_GLEW(GetIntegeri_v)
+    INSTALL_GLEW(GetStringi)
+    INSTALL_GLEW(GetProgramiv)
+    INSTALL_GLEW(GetShaderiv)
+    INSTALL_GLEW(GetUniformLocation)
+    INSTALL_GLEW(GetAttribLocation)
+    INSTALL_GLEW(GetUniformBlockIndex)
+    INSTALL_GLEW(GetQueryObjectiv)
+    INSTALL_GLEW(GetQueryObjectuiv)
+    INSTALL_GLEW(GetQueryObjectui64v)
+    INSTALL_GLEW(GetBufferSubData)
+
+    INSTALL_GL11(DrawArrays)
+    INSTALL_GL11(DrawElements)
+    INSTALL_GL11(Enable)
+    INSTALL_GL11(Disable)
+    INSTALL_GL11(BlendFunc)
+    INSTALL_GL11(DepthMask)
+    INSTALL_GL11(DepthFunc)
+    INSTALL_GL11(CullFace)
+    INSTALL_GL11(PolygonMode)
+    INSTALL_GL11(LineWidth)
+    INSTALL_GL11(PointSize)
+    INSTALL_GL11(Viewport)
+    INSTALL_GL11(Scissor)
+    INSTALL_GL11(ClearColor)
+    INSTALL_GL11(ClearDepth)
+    INSTALL_GL11(ColorMask)
+    INSTALL_GL11(BindTexture)
+    INSTALL_GL11(TexParameteri)
+    INSTALL_GL11(TexParameterf)
+    INSTALL_GL11(TexImage2D)
+    INSTALL_GL11(TexSubImage2D)
+    INSTALL_GL11(GetIntegerv)
+    INSTALL_GL11(GetFloatv)
+    INSTALL_GL11(GetBooleanv)
+    INSTALL_GL11(IsEnabled)
+    INSTALL_GL11(GetString)
+    INSTALL_GL11(GetError)
+    INSTALL_GL11(ReadPixels)
+    INSTALL_GL11(GetTexImage)
+
+    renderThread = std::this_thread::get_id();
+    _isInstalled = true;
+#endif
+}
+
+bool GLCallCounters::isInstalled() const
+{
+    return _isInstalled;
+}
+
+int GLCallCounters::subsystem(const string& name)
+{
+    for (size_t i = 0; i < _subsystemNames.size(); ++i) {
+        if (_subsystemNames[i] == name) {
+            return int(i);
+        }
+    }
+
+    if (_subsystemNames.size() >= size_t(MAX_SUBSYSTEMS)) {
+        return 0;
+    }
+
+    _subsystemNames.push_back(name);
+    return int(_subsystemNames.size() - 1);
+}
+
+const string& GLCallCounters::subsystemName(int subsystem) const
+{
+    return _subsystemNames[subsystem];
+}
+
+int GLCallCounters::subsystemCount() const
+{
+    return int(_subsystemNames.size());
+}
+
+int GLCallCounters::currentSubsystem() const
+{
+    return _subsystem;
+}
+
+void GLCallCounters::setSubsystem(int subsystem)
+{
+    _subsystem = subsystem;
+}
+
+const GLFrameCounters& GLCallCounters::lastFrame(int subsystem) const
+{
+    return _lastFrame[subsystem];
+}
+
+GLFrameCounters GLCallCounters::lastFrameTotal() const
+{
+    GLFrameCounters total;
+    for (int i = 0; i < subsystemCount(); ++i) {
+        total += _lastFrame[i];
+    }
+    return total;
+}
+
+bool GLCallCounters::openLog(const string& fileName)
+{
+    closeLog();
+
+    _log = fopen(fileName.c_str(), "w");
+    if (_log == NULL) {
+        return false;
+    }
+
+    fprintf(_log, "frame,subsystem,drawCalls,stateChanges,programBinds,textureBinds,"
+                  "bufferUploads,uploadBytes,getQueries,queryReadbacks\n");
+    return true;
+}
+
+void GLCallCounters::closeLog()
+{
+    if (_log != NULL) {
+        fclose(_log);
+        _log = NULL;
+    }
+}
+
+void GLCallCounters::endFrame()
+{
+    for (int i = 0; i < subsystemCount(); ++i) {
+        const GLFrameCounters& c = _counters[i];
+        if (_log != NULL) {
+            fprintf(_log, "%llu,%s,%u,%u,%u,%u,%u,%llu,%u,%u\n",
+                    (unsigned long long)_frame, _subsystemNames[i].c_str(),
+                    c.drawCalls, c.stateChanges, c.programBinds, c.textureBinds,
+                    c.bufferUploads, (unsigned long long)c.uploadBytes, c.getQueries, c.queryReadbacks);
+        }
+        _lastFrame[i] = c;
+        _counters[i] = GLFrameCounters();
+    }
+    ++_frame;
+}
+
+#ifdef TW_GL_PROC_HOOK
+void* TW_CALL glCountersProcHook(const char* name, void* proc)
+{
+#ifdef GL_COUNTERS
+    for (size_t i = 0; i < countedProcs.size(); ++i) {
+        if (strcmp(countedProcs[i].name, name) == 0) {
+            return countedProcs[i].wrapper;
+        }
+    }
+#else
+    (void)name;
+#endif
+    return proc;
+}
+#endif
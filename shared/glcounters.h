@@ -0,0 +1,170 @@
+#ifndef GL_COUNTERS_H
+#define GL_COUNTERS_H
+
+#include <GL/glew.h>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Per-frame GL call counters broken down by subsystem. When built with
+// GL_COUNTERS, install() swaps the GLEW entry points for counting wrappers and
+// the GL 1.1 functions are redirected by the macros at the end of this file.
+// Without it nothing is intercepted and the counters stay at zero.
+
+struct GLFrameCounters
+{
+    uint32_t drawCalls;
+    uint32_t stateChanges;
+    uint32_t programBinds;
+    uint32_t textureBinds;
+    uint32_t bufferUploads;
+    uint64_t uploadBytes;
+    uint32_t getQueries;
+    uint32_t queryReadbacks;
+
+    GLFrameCounters();
+    GLFrameCounters& operator+=(const GLFrameCounters& other);
+};
+
+class GLCallCounters
+{
+public:
+    static const int MAX_SUBSYSTEMS = 8;
+
+private:
+    bool _isInstalled;
+    std::vector<std::string> _subsystemNames;
+    int _subsystem;
+    GLFrameCounters _counters[MAX_SUBSYSTEMS];
+    GLFrameCounters _lastFrame[MAX_SUBSYSTEMS];
+    uint64_t _frame;
+    FILE* _log;
+
+public:
+    GLCallCounters();
+    ~GLCallCounters();
+
+    // Installs the wrappers; call once on the render thread, after glewInit() and before TwInit()
+    void install();
+    bool isInstalled() const;
+
+    // Finds or registers a subsystem by name. Calls outside any
+    // GLCounterScope go to subsystem 0, "other".
+    int subsystem(const std::string& name);
+    const std::string& subsystemName(int subsystem) const;
+    int subsystemCount() const;
+    int currentSubsystem() const;
+    void setSubsystem(int subsystem);
+
+    // Counters of the frame in progress, used by the wrappers
+    GLFrameCounters& current()
+    {
+        return _counters[_subsystem];
+    }
+
+    // Counters of the last finished frame
+    const GLFrameCounters& lastFrame(int subsystem) const;
+    GLFrameCounters lastFrameTotal() const;
+
+    // Writes one CSV row per subsystem on every endFrame()
+    bool openLog(const std::string& fileName);
+    void closeLog();
+
+    void endFrame();
+};
+
+extern GLCallCounters gGLCounters;
+
+// Attributes the GL calls made in a scope to a subsystem
+class GLCounterScope
+{
+    int _previous;
+
+public:
+    explicit GLCounterScope(int subsystem)
+        : _previous(gGLCounters.currentSubsystem())
+    {
+        gGLCounters.setSubsystem(subsystem);
+    }
+
+    ~GLCounterScope()
+    {
+        gGLCounters.setSubsystem(_previous);
+    }
+};
+
+#ifdef TW_GL_PROC_HOOK
+// Hook for TwSetGLProcHook() so the calls AntTweakBar makes are counted too
+void* TW_CALL glCountersProcHook(const char* name, void* proc);
+#endif
+
+#if defined(GL_COUNTERS) && !defined(GL_COUNTERS_IMPLEMENTATION)
+// GL 1.1 functions are exported by the GL library rather than loaded by GLEW,
+// so calls to them are renamed to the counting wrappers instead
+#define glDrawArrays    glCountedDrawArrays
+#define glDrawElements  glCountedDrawElements
+#define glEnable        glCountedEnable
+#define glDisable       glCountedDisable
+#define glBlendFunc     glCountedBlendFunc
+#define glDepthMask     glCountedDepthMask
+#define glDepthFunc     glCountedDepthFunc
+#define glCullFace      glCountedCullFace
+#define glPolygonMode   glCountedPolygonMode
+#define glLineWidth     glCountedLineWidth
+#define glPointSize     glCountedPointSize
+#define glViewport      glCountedViewport
+#define glScissor       glCountedScissor
+#define glClearColor    glCountedClearColor
+#define glClearDepth    glCountedClearDepth
+#define glColorMask     glCountedColorMask
+#define glBindTexture   glCountedBindTexture
+#define glTexParameteri glCountedTexParameteri
+#define glTexParameterf glCountedTexParameterf
+#define glTexImage2D    glCountedTexImage2D
+#define glTexSubImage2D glCountedTexSubImage2D
+#define glGetIntegerv   glCountedGetIntegerv
+#define glGetFloatv     glCountedGetFloatv
+#define glGetBooleanv   glCountedGetBooleanv
+#define glIsEnabled     glCountedIsEnabled
+#define glGetString     glCountedGetString
+#define glGetError      glCountedGetError
+#define glReadPixels    glCountedReadPixels
+#define glGetTexImage   glCountedGetTexImage
+#endif
+
+#ifdef GL_COUNTERS
+void GLAPIENTRY glCountedDrawArrays(GLenum mode, GLint first, GLsizei count);
+void GLAPIENTRY glCountedDrawElements(GLenum mode, GLsizei count, GLenum type, const GLvoid* indices);
+void GLAPIENTRY glCountedEnable(GLenum cap);
+void GLAPIENTRY glCountedDisable(GLenum cap);
+void GLAPIENTRY glCountedBlendFunc(GLenum sfactor, GLenum dfactor);
+void GLAPIENTRY glCountedDepthMask(GLboolean flag);
+void GLAPIENTRY glCountedDepthFunc(GLenum func);
+void GLAPIENTRY glCountedCullFace(GLenum mode);
+void GLAPIENTRY glCountedPolygonMode(GLenum face, GLenum mode);
+void GLAPIENTRY glCountedLineWidth(GLfloat width);
+void GLAPIENTRY glCountedPointSize(GLfloat size);
+void GLAPIENTRY glCountedViewport(GLint x, GLint y, GLsizei width, GLsizei height);
+void GLAPIENTRY glCountedScissor(GLint x, GLint y, GLsizei width, GLsizei height);
+void GLAPIENTRY glCountedClearColor(GLclampf red, GLclampf green, GLclampf blue, GLclampf alpha);
+void GLAPIENTRY glCountedClearDepth(GLclampd depth);
+void GLAPIENTRY glCountedColorMask(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha);
+void GLAPIENTRY glCountedBindTexture(GLenum target, GLuint texture);
+void GLAPIENTRY glCountedTexParameteri(GLenum target, GLenum pname, GLint param);
+void GLAPIENTRY glCountedTexParameterf(GLenum target, GLenum pname, GLfloat param);
+void GLAPIENTRY glCountedTexImage2D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height,
+                                    GLint border, GLenum format, GLenum type, const GLvoid* pixels);
+void GLAPIENTRY glCountedTexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height,
+                                       GLenum format, GLenum type, const GLvoid* pixels);
+void GLAPIENTRY glCountedGetIntegerv(GLenum pname, GLint* params);
+void GLAPIENTRY glCountedGetFloatv(GLenum pname, GLfloat* params);
+void GLAPIENTRY glCountedGetBooleanv(GLenum pname, GLboolean* params);
+GLboolean GLAPIENTRY glCountedIsEnabled(GLenum cap);
+const GLubyte* GLAPIENTRY glCountedGetString(GLenum name);
+GLenum GLAPIENTRY glCountedGetError();
+void GLAPIENTRY glCountedReadPixels(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, GLvoid* pixels);
+void GLAPIENTRY glCountedGetTexImage(GLenum target, GLint level, GLenum format, GLenum type, GLvoid* pixels);
+#endif
+
+#endif //GL_COUNTERS_H
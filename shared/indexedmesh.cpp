@@ -0,0 +1,246 @@
+#include "indexedmesh.h"
+#include "objparser.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    const uint32_t EMPTY_SLOT = 0xFFFFFFFFu;
+
+    // Forsyth's tuning: 32 entries, the last triangle's vertices slightly below the newest
+    const int CACHE_SIZE = 32;
+    const float CACHE_DECAY_POWER = 1.5f;
+    const float LAST_TRIANGLE_SCORE = 0.75f;
+    const float VALENCE_BOOST_SCALE = 2.0f;
+    const float VALENCE_BOOST_POWER = 0.5f;
+    const int MAX_TABLED_VALENCE = 32;
+
+    inline uint32_t hashCorner(int position, int texCoord, int normal)
+    {
+        return uint32_t(position) * 73856093u ^ uint32_t(texCoord) * 19349663u ^ uint32_t(normal) * 83492791u;
+    }
+
+    struct VertexScores
+    {
+        float cache[CACHE_SIZE];
+        float valence[MAX_TABLED_VALENCE + 1];
+
+        VertexScores()
+        {
+            for (int i = 0; i < CACHE_SIZE; ++i) {
+                cache[i] = i < 3 ? LAST_TRIANGLE_SCORE
+                                 : std::pow(1.0f - float(i - 3) / (CACHE_SIZE - 3), CACHE_DECAY_POWER);
+            }
+            valence[0] = 0;
+            for (int i = 1; i <= MAX_TABLED_VALENCE; ++i) {
+                valence[i] = VALENCE_BOOST_SCALE * std::pow(float(i), -VALENCE_BOOST_POWER);
+            }
+        }
+
+        // Vertices with few triangles left score higher, so lone triangles don't get stranded
+        float score(int cachePosition, uint32_t remainingTriangles) const
+        {
+            if (remainingTriangles == 0) {
+                return -1;
+            }
+            float result = cachePosition >= 0 ? cache[cachePosition] : 0;
+            return result + (remainingTriangles <= uint32_t(MAX_TABLED_VALENCE)
+                             ? valence[remainingTriangles]
+                             : VALENCE_BOOST_SCALE * std::pow(float(remainingTriangles), -VALENCE_BOOST_POWER));
+        }
+    };
+}
+
+void buildIndexedMesh(const ObjData& obj, vector<vec3>& positions, vector<vec2>& texCoords,
+                      vector<vec3>& normals, vector<uint32_t>& indices)
+{
+    size_t cornersCount = obj.positionIndices.size();
+    positions.clear();
+    texCoords.clear();
+    normals.clear();
+    indices.resize(cornersCount);
+
+    // Open addressing over the welded vertices, at most half full
+    size_t capacity = 16;
+    while (capacity < 2 * cornersCount) {
+        capacity *= 2;
+    }
+    vector<uint32_t> table(capacity, EMPTY_SLOT);
+    // Source corner of every welded vertex, to compare the triplets
+    vector<uint32_t> firstCorners;
+
+    for (size_t i = 0; i < cornersCount; ++i) {
+        int position = obj.positionIndices[i];
+        int texCoord = obj.texCoordIndices[i];
+        int normal = obj.normalIndices[i];
+
+        size_t slot = hashCorner(position, texCoord, normal) & (capacity - 1);
+        while (table[slot] != EMPTY_SLOT) {
+            uint32_t corner = firstCorners[table[slot]];
+            if (obj.positionIndices[corner] == position && obj.texCoordIndices[corner] == texCoord
+                && obj.normalIndices[corner] == normal) {
+                break;
+            }
+            slot = (slot + 1) & (capacity - 1);
+        }
+
+        if (table[slot] == EMPTY_SLOT) {
+            table[slot] = uint32_t(firstCorners.size());
+            firstCorners.push_back(uint32_t(i));
+            positions.push_back(obj.positions[position]);
+            texCoords.push_back(texCoord >= 0 ? obj.texCoords[texCoord] : vec2(0));
+            normals.push_back(normal >= 0 ? obj.normals[normal] : vec3(0));
+        }
+        indices[i] = table[slot];
+    }
+}
+
+void optimizeVertexCache(vector<uint32_t>& indices, size_t verticesCount)
+{
+    static const VertexScores scores;
+
+    size_t trianglesCount = indices.size() / 3;
+    if (trianglesCount == 0) {
+        return;
+    }
+
+    // Triangles of every vertex, packed one vertex after another
+    vector<uint32_t> remaining(verticesCount, 0);
+    for (size_t i = 0; i < indices.size(); ++i) {
+        remaining[indices[i]]++;
+    }
+    vector<uint32_t> offsets(verticesCount + 1, 0);
+    for (size_t v = 0; v < verticesCount; ++v) {
+        offsets[v + 1] = offsets[v] + remaining[v];
+    }
+    vector<uint32_t> adjacency(indices.size());
+    {
+        vector<uint32_t> filled(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < indices.size(); ++i) {
+            adjacency[filled[indices[i]]++] = uint32_t(i / 3);
+        }
+    }
+
+    vector<int> cachePositions(verticesCount, -1);
+    vector<float> vertexScores(verticesCount);
+    for (size_t v = 0; v < verticesCount; ++v) {
+        vertexScores[v] = scores.score(-1, remaining[v]);
+    }
+
+    vector<float> triangleScores(trianglesCount);
+    vector<bool> isEmitted(trianglesCount, false);
+    for (size_t t = 0; t < trianglesCount; ++t) {
+        triangleScores[t] = vertexScores[indices[3 * t]] + vertexScores[indices[3 * t + 1]] + vertexScores[indices[3 * t + 2]];
+    }
+
+    vector<uint32_t> result;
+    result.reserve(indices.size());
+    vector<uint32_t> cache, nextCache;
+    cache.reserve(CACHE_SIZE + 3);
+    nextCache.reserve(CACHE_SIZE + 3);
+
+    size_t best = size_t(std::max_element(triangleScores.begin(), triangleScores.end()) - triangleScores.begin());
+    size_t cursor = 0;
+
+    for (size_t emitted = 0; emitted < trianglesCount; ++emitted) {
+        if (best == trianglesCount) {
+            // Nothing in the cache touches a remaining triangle: start a new strip anywhere
+            while (isEmitted[cursor]) {
+                ++cursor;
+            }
+            best = cursor;
+        }
+
+        const uint32_t* triangle = &indices[3 * best];
+        isEmitted[best] = true;
+        result.insert(result.end(), triangle, triangle + 3);
+
+        // The triangle's vertices go to the front, the rest shift back and may fall out
+        nextCache.assign(triangle, triangle + 3);
+        for (size_t i = 0; i < cache.size(); ++i) {
+            if (cache[i] != triangle[0] && cache[i] != triangle[1] && cache[i] != triangle[2]) {
+                nextCache.push_back(cache[i]);
+            }
+        }
+
+        for (int k = 0; k < 3; ++k) {
+            uint32_t v = triangle[k];
+            uint32_t* begin = &adjacency[offsets[v]];
+            uint32_t* end = begin + remaining[v];
+            *std::find(begin, end, uint32_t(best)) = end[-1];
+            remaining[v]--;
+        }
+
+        for (size_t i = 0; i < nextCache.size(); ++i) {
+            uint32_t v = nextCache[i];
+            cachePositions[v] = i < size_t(CACHE_SIZE) ? int(i) : -1;
+
+            float score = scores.score(cachePositions[v], remaining[v]);
+            float delta = score - vertexScores[v];
+            vertexScores[v] = score;
+            for (uint32_t j = offsets[v]; j < offsets[v] + remaining[v]; ++j) {
+                triangleScores[adjacency[j]] += delta;
+            }
+        }
+        if (nextCache.size() > size_t(CACHE_SIZE)) {
+            nextCache.resize(CACHE_SIZE);
+        }
+        cache.swap(nextCache);
+
+        // Only triangles around the cache changed, the best one is among them
+        best = trianglesCount;
+        float bestScore = -1;
+        for (size_t i = 0; i < cache.size(); ++i) {
+            uint32_t v = cache[i];
+            for (uint32_t j = offsets[v]; j < offsets[v] + remaining[v]; ++j) {
+                uint32_t t = adjacency[j];
+                if (triangleScores[t] > bestScore) {
+                    bestScore = triangleScores[t];
+                    best = t;
+                }
+            }
+        }
+    }
+
+    indices.swap(result);
+}
+
+void optimizeVertexFetch(vector<uint32_t>& indices, size_t verticesCount, vector<uint32_t>& remap)
+{
+    remap.assign(verticesCount, EMPTY_SLOT);
+    uint32_t next = 0;
+    for (size_t i = 0; i < indices.size(); ++i) {
+        uint32_t& index = indices[i];
+        if (remap[index] == EMPTY_SLOT) {
+            remap[index] = next++;
+        }
+        index = remap[index];
+    }
+
+    // Unreferenced vertices keep their relative order at the end
+    for (size_t v = 0; v < verticesCount; ++v) {
+        if (remap[v] == EMPTY_SLOT) {
+            remap[v] = next++;
+        }
+    }
+}
+
+float averageCacheMissRatio(const vector<uint32_t>& indices, size_t verticesCount, int cacheSize)
+{
+    if (indices.size() < 3) {
+        return 0;
+    }
+
+    // A vertex is in the FIFO while fewer than cacheSize misses came after its own
+    vector<uint32_t> missTimes(verticesCount, 0);
+    uint32_t time = uint32_t(cacheSize) + 1;
+    size_t misses = 0;
+    for (size_t i = 0; i < indices.size(); ++i) {
+        uint32_t v = indices[i];
+        if (time - missTimes[v] > uint32_t(cacheSize)) {
+            missTimes[v] = time++;
+            misses++;
+        }
+    }
+    return float(misses) / float(indices.size() / 3);
+}
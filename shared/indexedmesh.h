@@ -0,0 +1,34 @@
+#ifndef INDEXED_MESH_H
+#define INDEXED_MESH_H
+
+#include "common.h"
+
+struct ObjData;
+
+// Welds face corners that share the same position, texture coordinate and normal
+// into one vertex; three indices per triangle. Attributes a face leaves out are zero.
+void buildIndexedMesh(const ObjData& obj, vector<vec3>& positions, vector<vec2>& texCoords,
+                      vector<vec3>& normals, vector<uint32_t>& indices);
+
+// Reorders triangles so consecutive ones reuse the vertices the GPU has just
+// transformed (Forsyth, "Linear-Speed Vertex Cache Optimisation")
+void optimizeVertexCache(vector<uint32_t>& indices, size_t verticesCount);
+
+// Renumbers vertices in the order the indices first use them, so vertex fetches
+// walk the buffers forward. remap[old] is the new index; use remapVertices() on every attribute.
+void optimizeVertexFetch(vector<uint32_t>& indices, size_t verticesCount, vector<uint32_t>& remap);
+
+template<typename T>
+void remapVertices(vector<T>& vertices, const vector<uint32_t>& remap)
+{
+    vector<T> remapped(vertices.size());
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        remapped[remap[i]] = vertices[i];
+    }
+    vertices.swap(remapped);
+}
+
+// Vertices transformed per triangle with a FIFO post-transform cache: 3 with no reuse, 0.5 at best
+float averageCacheMissRatio(const vector<uint32_t>& indices, size_t verticesCount, int cacheSize = 32);
+
+#endif //INDEXED_MESH_H
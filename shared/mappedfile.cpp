@@ -0,0 +1,143 @@
+#include "mappedfile.h"
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+    : _data(NULL)
+    , _size(0)
+#ifdef _WIN32
+    , _file(INVALID_HANDLE_VALUE)
+    , _mapping(NULL)
+#else
+    , _file(-1)
+#endif
+{}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const string& fileName)
+{
+    close();
+
+#ifdef _WIN32
+    _file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (_file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(_file, &size) || size.QuadPart == 0) {
+        close();
+        return false;
+    }
+    _size = size_t(size.QuadPart);
+
+    _mapping = CreateFileMappingA(_file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (_mapping == NULL) {
+        close();
+        return false;
+    }
+
+    _data = (const uint8_t*)MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+    if (_data == NULL) {
+        close();
+        return false;
+    }
+#else
+    _file = ::open(fileName.c_str(), O_RDONLY);
+    if (_file < 0) {
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(_file, &info) != 0 || info.st_size == 0) {
+        close();
+        return false;
+    }
+    _size = size_t(info.st_size);
+
+    void* data = mmap(NULL, _size, PROT_READ, MAP_PRIVATE, _file, 0);
+    if (data == MAP_FAILED) {
+        close();
+        return false;
+    }
+    _data = (const uint8_t*)data;
+    // The whole file is read front to back, let the kernel read ahead
+    madvise(data, _size, MADV_SEQUENTIAL);
+#endif
+
+    return true;
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+    if (_data != NULL) {
+        UnmapViewOfFile(_data);
+    }
+    if (_mapping != NULL) {
+        CloseHandle(_mapping);
+    }
+    if (_file != INVALID_HANDLE_VALUE) {
+        CloseHandle(_file);
+    }
+    _mapping = NULL;
+    _file = INVALID_HANDLE_VALUE;
+#else
+    if (_data != NULL) {
+        munmap((void*)_data, _size);
+    }
+    if (_file >= 0) {
+        ::close(_file);
+    }
+    _file = -1;
+#endif
+
+    _data = NULL;
+    _size = 0;
+}
+
+bool MappedFile::isOpen() const
+{
+    return _data != NULL;
+}
+
+const uint8_t* MappedFile::data() const
+{
+    return _data;
+}
+
+size_t MappedFile::size() const
+{
+    return _size;
+}
+
+int64_t fileModificationTime(const string& fileName)
+{
+    struct stat info;
+    if (stat(fileName.c_str(), &info) != 0) {
+        return -1;
+    }
+    return int64_t(info.st_mtime);
+}
+
+int64_t fileSize(const string& fileName)
+{
+    struct stat info;
+    if (stat(fileName.c_str(), &info) != 0) {
+        return -1;
+    }
+    return int64_t(info.st_size);
+}
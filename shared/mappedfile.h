@@ -0,0 +1,39 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include "common.h"
+
+// Read-only memory mapping of a whole file
+class MappedFile
+{
+    const uint8_t* _data;
+    size_t _size;
+#ifdef _WIN32
+    void* _file;
+    void* _mapping;
+#else
+    int _file;
+#endif
+
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+public:
+    MappedFile();
+    ~MappedFile();
+
+    // Returns false if the file is missing, empty or can't be mapped
+    bool open(const string& fileName);
+    void close();
+
+    bool isOpen() const;
+    const uint8_t* data() const;
+    size_t size() const;
+};
+
+// Seconds since the epoch, or -1 if the file doesn't exist
+int64_t fileModificationTime(const string& fileName);
+// Bytes, or -1 if the file doesn't exist
+int64_t fileSize(const string& fileName);
+
+#endif //MAPPED_FILE_H
@@ -0,0 +1,264 @@
+#include "meshbounds.h"
+#include <algorithm>
+#include <thread>
+
+// SSE2 is part of every x86-64 CPU, so unlike the pixel kernels there is nothing to detect
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MESH_BOUNDS_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    // Spawning threads costs more than reducing fewer vertices than this
+    const size_t MIN_VERTICES_PER_THREAD = 1 << 16;
+
+    // Every step at least halves the distance the farthest vertex is out by
+    const int MAX_GROWTH_STEPS = 32;
+
+    // Float sums go into a double this often, so large meshes keep the centroid's precision
+    const size_t SUM_BLOCK_VERTICES = 1024;
+
+    struct BoxSum
+    {
+        vec3 minimum;
+        vec3 maximum;
+        dvec3 sum;
+    };
+
+    struct Farthest
+    {
+        float distance2;
+        size_t index;
+    };
+
+    // Runs reduce(begin, end, result) over slices of count vertices, the last one on this thread
+    template<typename Result, typename Reduce>
+    vector<Result> reduceSlices(size_t count, int threadsCount, const Reduce& reduce)
+    {
+        if (threadsCount <= 0) {
+            threadsCount = int(std::max(1u, std::thread::hardware_concurrency()));
+        }
+        size_t slicesCount = std::min(size_t(threadsCount), std::max<size_t>(1, count / MIN_VERTICES_PER_THREAD));
+        vector<Result> results(slicesCount);
+        vector<std::thread> threads;
+        for (size_t i = 0; i + 1 < slicesCount; ++i) {
+            threads.push_back(std::thread([&, i]() {
+                reduce(count * i / slicesCount, count * (i + 1) / slicesCount, results[i]);
+            }));
+        }
+        reduce(count * (slicesCount - 1) / slicesCount, count, results.back());
+        for (size_t i = 0; i < threads.size(); ++i) {
+            threads[i].join();
+        }
+        return results;
+    }
+
+#ifdef MESH_BOUNDS_SSE2
+    // Four packed vec3 from three loads, transposed into x, y and z lanes
+    inline void loadPositions(const float* p, __m128& x, __m128& y, __m128& z)
+    {
+        __m128 a = _mm_loadu_ps(p);                                 // x0 y0 z0 x1
+        __m128 b = _mm_loadu_ps(p + 4);                             // y1 z1 x2 y2
+        __m128 c = _mm_loadu_ps(p + 8);                             // z2 x3 y3 z3
+        __m128 bc = _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 1, 3, 2));  // x2 y2 x3 y3
+        x = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 0, 3, 0)), bc, _MM_SHUFFLE(2, 0, 1, 0));
+        y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), bc, _MM_SHUFFLE(3, 1, 2, 0));
+        z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), c, _MM_SHUFFLE(3, 0, 2, 0));
+    }
+
+    inline float horizontalMin(__m128 v)
+    {
+        v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+        v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+        return _mm_cvtss_f32(v);
+    }
+
+    inline float horizontalMax(__m128 v)
+    {
+        v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+        v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+        return _mm_cvtss_f32(v);
+    }
+
+    inline double horizontalSum(__m128 v)
+    {
+        float lanes[4];
+        _mm_storeu_ps(lanes, v);
+        return double(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+    }
+#endif
+
+    void reduceBox(const vector<vec3>& positions, size_t begin, size_t end, BoxSum& result)
+    {
+        result.minimum = positions[begin];
+        result.maximum = positions[begin];
+        result.sum = dvec3(0);
+        size_t i = begin;
+#ifdef MESH_BOUNDS_SSE2
+        if (end - begin >= 4) {
+            __m128 minX = _mm_set1_ps(result.minimum.x), minY = _mm_set1_ps(result.minimum.y), minZ = _mm_set1_ps(result.minimum.z);
+            __m128 maxX = minX, maxY = minY, maxZ = minZ;
+            while (i + 4 <= end) {
+                __m128 sumX = _mm_setzero_ps(), sumY = _mm_setzero_ps(), sumZ = _mm_setzero_ps();
+                size_t blockEnd = std::min(end, i + SUM_BLOCK_VERTICES);
+                for (; i + 4 <= blockEnd; i += 4) {
+                    __m128 x, y, z;
+                    loadPositions(&positions[i].x, x, y, z);
+                    minX = _mm_min_ps(minX, x);
+                    minY = _mm_min_ps(minY, y);
+                    minZ = _mm_min_ps(minZ, z);
+                    maxX = _mm_max_ps(maxX, x);
+                    maxY = _mm_max_ps(maxY, y);
+                    maxZ = _mm_max_ps(maxZ, z);
+                    sumX = _mm_add_ps(sumX, x);
+                    sumY = _mm_add_ps(sumY, y);
+                    sumZ = _mm_add_ps(sumZ, z);
+                }
+                result.sum += dvec3(horizontalSum(sumX), horizontalSum(sumY), horizontalSum(sumZ));
+            }
+            result.minimum = vec3(horizontalMin(minX), horizontalMin(minY), horizontalMin(minZ));
+            result.maximum = vec3(horizontalMax(maxX), horizontalMax(maxY), horizontalMax(maxZ));
+        }
+#endif
+        for (; i < end; ++i) {
+            result.minimum = glm::min(result.minimum, positions[i]);
+            result.maximum = glm::max(result.maximum, positions[i]);
+            result.sum += dvec3(positions[i]);
+        }
+    }
+
+    void reduceFarthest(const vector<vec3>& positions, size_t begin, size_t end, const vec3& point, Farthest& result)
+    {
+        result.distance2 = -1;
+        result.index = begin;
+        size_t i = begin;
+#ifdef MESH_BOUNDS_SSE2
+        if (end - begin >= 4) {
+            __m128 pointX = _mm_set1_ps(point.x), pointY = _mm_set1_ps(point.y), pointZ = _mm_set1_ps(point.z);
+            __m128 best = _mm_set1_ps(-1);
+            __m128i bestIndices = _mm_setzero_si128();
+            __m128i indices = _mm_setr_epi32(int(i), int(i + 1), int(i + 2), int(i + 3));
+            const __m128i four = _mm_set1_epi32(4);
+            for (; i + 4 <= end; i += 4) {
+                __m128 x, y, z;
+                loadPositions(&positions[i].x, x, y, z);
+                x = _mm_sub_ps(x, pointX);
+                y = _mm_sub_ps(y, pointY);
+                z = _mm_sub_ps(z, pointZ);
+                __m128 distance2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+                __m128i isFarther = _mm_castps_si128(_mm_cmpgt_ps(distance2, best));
+                best = _mm_max_ps(best, distance2);
+                bestIndices = _mm_or_si128(_mm_and_si128(isFarther, indices), _mm_andnot_si128(isFarther, bestIndices));
+                indices = _mm_add_epi32(indices, four);
+            }
+
+            float lanes[4];
+            int laneIndices[4];
+            _mm_storeu_ps(lanes, best);
+            _mm_storeu_si128((__m128i*)laneIndices, bestIndices);
+            for (int lane = 0; lane < 4; ++lane) {
+                if (lanes[lane] > result.distance2) {
+                    result.distance2 = lanes[lane];
+                    result.index = size_t(laneIndices[lane]);
+                }
+            }
+        }
+#endif
+        for (; i < end; ++i) {
+            vec3 offset = positions[i] - point;
+            float distance2 = glm::dot(offset, offset);
+            if (distance2 > result.distance2) {
+                result.distance2 = distance2;
+                result.index = i;
+            }
+        }
+    }
+
+    Farthest findFarthest(const vector<vec3>& positions, const vec3& point, int threadsCount)
+    {
+        vector<Farthest> slices = reduceSlices<Farthest>(positions.size(), threadsCount,
+            [&](size_t begin, size_t end, Farthest& result) {
+                reduceFarthest(positions, begin, end, point, result);
+            });
+        Farthest farthest = slices[0];
+        for (size_t i = 1; i < slices.size(); ++i) {
+            if (slices[i].distance2 > farthest.distance2) {
+                farthest = slices[i];
+            }
+        }
+        return farthest;
+    }
+
+    // Grows the sphere towards the farthest vertex until it holds every vertex
+    void growSphere(const vector<vec3>& positions, int threadsCount, vec3& center, float& radius)
+    {
+        for (int step = 0; ; ++step) {
+            Farthest farthest = findFarthest(positions, center, threadsCount);
+            float distance = std::sqrt(farthest.distance2);
+            if (distance <= radius) {
+                return;
+            }
+            if (step == MAX_GROWTH_STEPS) {
+                radius = distance;
+                return;
+            }
+            float grownRadius = (radius + distance) * 0.5f;
+            center += (positions[farthest.index] - center) * ((grownRadius - radius) / distance);
+            radius = grownRadius;
+        }
+    }
+}
+
+MeshBounds::MeshBounds()
+    : minimum(0), maximum(0), centroid(0), centroidRadius(0), sphereCenter(0), sphereRadius(0)
+{}
+
+MeshBounds computeMeshBounds(const vector<vec3>& positions, int threadsCount)
+{
+    MeshBounds bounds;
+    if (positions.empty()) {
+        return bounds;
+    }
+
+    vector<BoxSum> slices = reduceSlices<BoxSum>(positions.size(), threadsCount,
+        [&](size_t begin, size_t end, BoxSum& result) {
+            reduceBox(positions, begin, end, result);
+        });
+    bounds.minimum = slices[0].minimum;
+    bounds.maximum = slices[0].maximum;
+    dvec3 sum = slices[0].sum;
+    for (size_t i = 1; i < slices.size(); ++i) {
+        bounds.minimum = glm::min(bounds.minimum, slices[i].minimum);
+        bounds.maximum = glm::max(bounds.maximum, slices[i].maximum);
+        sum += slices[i].sum;
+    }
+    bounds.centroid = vec3(sum / double(positions.size()));
+
+    Farthest fromCentroid = findFarthest(positions, bounds.centroid, threadsCount);
+    bounds.centroidRadius = std::sqrt(fromCentroid.distance2);
+
+    // Ritter: the vertex farthest from the farthest one gives the starting diameter
+    vec3 first = positions[fromCentroid.index];
+    vec3 second = positions[findFarthest(positions, first, threadsCount).index];
+    bounds.sphereCenter = (first + second) * 0.5f;
+    bounds.sphereRadius = glm::length(second - first) * 0.5f;
+    growSphere(positions, threadsCount, bounds.sphereCenter, bounds.sphereRadius);
+
+    // Ritter's sphere is usually the tighter one, but not for every shape
+    vec3 boxCenter = (bounds.minimum + bounds.maximum) * 0.5f;
+    float boxRadius = std::sqrt(findFarthest(positions, boxCenter, threadsCount).distance2);
+    if (boxRadius < bounds.sphereRadius) {
+        bounds.sphereCenter = boxCenter;
+        bounds.sphereRadius = boxRadius;
+    }
+    return bounds;
+}
+
+void transformSphere(const mat4& transform, const vec3& center, float radius, vec3& transformedCenter, float& transformedRadius)
+{
+    transformedCenter = vec3(transform * vec4(center, 1));
+    float scale2 = std::max(glm::dot(vec3(transform[0]), vec3(transform[0])),
+                   std::max(glm::dot(vec3(transform[1]), vec3(transform[1])), glm::dot(vec3(transform[2]), vec3(transform[2]))));
+    transformedRadius = radius * std::sqrt(scale2);
+}
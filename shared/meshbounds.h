@@ -0,0 +1,30 @@
+#ifndef MESHBOUNDS_H
+#define MESHBOUNDS_H
+
+#include "common.h"
+
+// Bounds of a mesh in model space, computed once when it is loaded
+struct MeshBounds
+{
+    vec3 minimum;
+    vec3 maximum;
+
+    // Average of the vertices and the distance to the farthest one
+    vec3 centroid;
+    float centroidRadius;
+
+    // Ritter's sphere refined by growing towards the farthest vertex, a few
+    // percent over the minimal one instead of up to the box's diagonal
+    vec3 sphereCenter;
+    float sphereRadius;
+
+    MeshBounds();
+};
+
+// SSE2 reductions over threadsCount threads, 0 for one per core. Small meshes stay on one thread.
+MeshBounds computeMeshBounds(const vector<vec3>& positions, int threadsCount = 0);
+
+// Sphere under an affine transform; the radius grows by the largest axis scale
+void transformSphere(const mat4& transform, const vec3& center, float radius, vec3& transformedCenter, float& transformedRadius);
+
+#endif //MESHBOUNDS_H
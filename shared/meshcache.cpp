@@ -0,0 +1,292 @@
+#include "meshcache.h"
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+    const char MAGIC[4] = { 'W', 'M', 'S', 'H' };
+
+    size_t alignOffset(size_t offset)
+    {
+        return (offset + 15) & ~size_t(15);
+    }
+
+    // FNV-1a over 8-byte words: only has to notice edits, and runs at memory speed
+    uint64_t hashBytes(const uint8_t* data, size_t size)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8) {
+            uint64_t word;
+            memcpy(&word, data + i, sizeof(word));
+            hash = (hash ^ word) * 1099511628211ull;
+        }
+        for (; i < size; ++i) {
+            hash = (hash ^ data[i]) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    bool hashFile(const string& fileName, uint64_t& hash)
+    {
+        MappedFile file;
+        if (!file.open(fileName)) {
+            return false;
+        }
+        hash = hashBytes(file.data(), file.size());
+        return true;
+    }
+
+    template<typename T>
+    MeshCacheArray placeArray(const vector<T>& values, size_t& offset)
+    {
+        MeshCacheArray array = { 0, 0 };
+        if (!values.empty()) {
+            array.offset = offset;
+            array.size = values.size() * sizeof(T);
+            offset = alignOffset(offset + size_t(array.size));
+        }
+        return array;
+    }
+
+    template<typename T>
+    void copyArray(const vector<T>& values, const MeshCacheArray& array, vector<uint8_t>& file)
+    {
+        if (array.size > 0) {
+            memcpy(&file[size_t(array.offset)], &values[0], size_t(array.size));
+        }
+    }
+
+    void storeVec3(const vec3& value, float stored[3])
+    {
+        stored[0] = value.x;
+        stored[1] = value.y;
+        stored[2] = value.z;
+    }
+
+    void storeBounds(const MeshBounds& bounds, MeshCacheBounds& stored)
+    {
+        storeVec3(bounds.minimum, stored.minimum);
+        storeVec3(bounds.maximum, stored.maximum);
+        storeVec3(bounds.centroid, stored.centroid);
+        stored.centroidRadius = bounds.centroidRadius;
+        storeVec3(bounds.sphereCenter, stored.sphereCenter);
+        stored.sphereRadius = bounds.sphereRadius;
+    }
+
+    bool isArrayValid(const MeshCacheArray& array, size_t expectedSize, size_t fileSize)
+    {
+        return array.size == expectedSize && array.offset % 16 == 0
+            && array.offset <= fileSize && array.size <= fileSize - array.offset;
+    }
+}
+
+string MeshCache::cacheFileName(const string& sourceFileName)
+{
+    return sourceFileName + ".wmesh";
+}
+
+void MeshCache::write(const string& fileName, const string& sourceFileName, const vector<vec3>& positions,
+                      const vector<vec2>& texCoords, const vector<vec3>& normals, const vector<uint32_t>& indices,
+                      const vector<MeshLod>& lods, const MeshBounds& bounds)
+{
+    size_t verticesCount = positions.size();
+    if (verticesCount == 0 || (!texCoords.empty() && texCoords.size() != verticesCount)
+        || (!normals.empty() && normals.size() != verticesCount)) {
+        throw std::runtime_error("Can't write mesh cache without matching vertex arrays: " + fileName);
+    }
+
+    MeshCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    if (!hashFile(sourceFileName, header.sourceHash)) {
+        throw std::runtime_error("Can't read mesh cache source: " + sourceFileName);
+    }
+    header.sourceSize = uint64_t(fileSize(sourceFileName));
+    header.sourceTime = fileModificationTime(sourceFileName);
+    header.vertexFormat = MESH_CACHE_POSITION | (texCoords.empty() ? 0 : MESH_CACHE_TEX_COORD) | (normals.empty() ? 0 : MESH_CACHE_NORMAL);
+    header.indexSize = sizeof(uint32_t);
+    header.verticesCount = uint32_t(verticesCount);
+    header.indicesCount = uint32_t(indices.size());
+    storeBounds(bounds, header.bounds);
+
+    size_t offset = alignOffset(sizeof(MeshCacheHeader));
+    header.positions = placeArray(positions, offset);
+    header.texCoords = placeArray(texCoords, offset);
+    header.normals = placeArray(normals, offset);
+    header.indices = placeArray(indices, offset);
+
+    header.lodsCount = uint32_t(lods.size());
+    vector<MeshCacheLod> lodTable(lods.size());
+    header.lods = placeArray(lodTable, offset);
+    vector<MeshCacheArray> lodArrays(lods.size());
+    for (size_t i = 0; i < lods.size(); ++i) {
+        lodArrays[i] = placeArray(lods[i].indices, offset);
+        lodTable[i].offset = lodArrays[i].offset;
+        lodTable[i].indicesCount = uint32_t(lods[i].indices.size());
+        lodTable[i].error = lods[i].error;
+    }
+
+    vector<uint8_t> file(offset, 0);
+    memcpy(&file[0], &header, sizeof(header));
+    copyArray(positions, header.positions, file);
+    copyArray(texCoords, header.texCoords, file);
+    copyArray(normals, header.normals, file);
+    copyArray(indices, header.indices, file);
+    copyArray(lodTable, header.lods, file);
+    for (size_t i = 0; i < lods.size(); ++i) {
+        copyArray(lods[i].indices, lodArrays[i], file);
+    }
+
+    // Written under a temporary name so a reader never maps half a file
+    string temporaryFileName = fileName + ".tmp";
+    {
+        std::ofstream out(temporaryFileName.c_str(), std::ios::binary | std::ios::trunc);
+        out.write((const char*)&file[0], file.size());
+        if (!out) {
+            throw std::runtime_error("Can't write mesh cache: " + fileName);
+        }
+    }
+    std::remove(fileName.c_str());
+    if (std::rename(temporaryFileName.c_str(), fileName.c_str()) != 0) {
+        std::remove(temporaryFileName.c_str());
+        throw std::runtime_error("Can't write mesh cache: " + fileName);
+    }
+}
+
+MeshCache::MeshCache()
+    : _header(NULL)
+{}
+
+bool MeshCache::open(const string& fileName, const string& sourceFileName)
+{
+    close();
+
+    if (!_file.open(fileName)) {
+        return false;
+    }
+
+    size_t size = _file.size();
+    const MeshCacheHeader* header = (const MeshCacheHeader*)_file.data();
+    if (size < sizeof(MeshCacheHeader) || memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 || header->version != VERSION
+        || header->indexSize != sizeof(uint32_t) || (header->vertexFormat & MESH_CACHE_POSITION) == 0) {
+        close();
+        return false;
+    }
+
+    size_t verticesCount = header->verticesCount;
+    bool hasTexCoords = (header->vertexFormat & MESH_CACHE_TEX_COORD) != 0;
+    bool hasNormals = (header->vertexFormat & MESH_CACHE_NORMAL) != 0;
+    if (!isArrayValid(header->positions, verticesCount * sizeof(vec3), size)
+        || !isArrayValid(header->texCoords, hasTexCoords ? verticesCount * sizeof(vec2) : 0, size)
+        || !isArrayValid(header->normals, hasNormals ? verticesCount * sizeof(vec3) : 0, size)
+        || !isArrayValid(header->indices, size_t(header->indicesCount) * sizeof(uint32_t), size)
+        || !isArrayValid(header->lods, size_t(header->lodsCount) * sizeof(MeshCacheLod), size)) {
+        close();
+        return false;
+    }
+    const MeshCacheLod* lods = (const MeshCacheLod*)(_file.data() + header->lods.offset);
+    for (size_t i = 0; i < header->lodsCount; ++i) {
+        MeshCacheArray array = { lods[i].offset, uint64_t(lods[i].indicesCount) * sizeof(uint32_t) };
+        if (!isArrayValid(array, size_t(array.size), size)) {
+            close();
+            return false;
+        }
+    }
+
+    // Size and time are enough normally; a touched file is hashed to see if it really changed
+    bool isSourceSame = int64_t(header->sourceSize) == fileSize(sourceFileName);
+    if (isSourceSame && header->sourceTime != fileModificationTime(sourceFileName)) {
+        uint64_t hash;
+        isSourceSame = hashFile(sourceFileName, hash) && hash == header->sourceHash;
+    }
+    if (!isSourceSame) {
+        close();
+        return false;
+    }
+
+    _header = header;
+    return true;
+}
+
+void MeshCache::close()
+{
+    _file.close();
+    _header = NULL;
+}
+
+const uint8_t* MeshCache::arrayData(const MeshCacheArray& array) const
+{
+    return array.size > 0 ? _file.data() + array.offset : NULL;
+}
+
+uint32_t MeshCache::vertexFormat() const
+{
+    return _header->vertexFormat;
+}
+
+size_t MeshCache::verticesCount() const
+{
+    return _header->verticesCount;
+}
+
+size_t MeshCache::indicesCount() const
+{
+    return _header->indicesCount;
+}
+
+const vec3* MeshCache::positions() const
+{
+    return (const vec3*)arrayData(_header->positions);
+}
+
+const vec2* MeshCache::texCoords() const
+{
+    return (const vec2*)arrayData(_header->texCoords);
+}
+
+const vec3* MeshCache::normals() const
+{
+    return (const vec3*)arrayData(_header->normals);
+}
+
+const uint32_t* MeshCache::indices() const
+{
+    return (const uint32_t*)arrayData(_header->indices);
+}
+
+size_t MeshCache::lodsCount() const
+{
+    return _header->lodsCount;
+}
+
+size_t MeshCache::lodIndicesCount(size_t lod) const
+{
+    return ((const MeshCacheLod*)arrayData(_header->lods))[lod].indicesCount;
+}
+
+const uint32_t* MeshCache::lodIndices(size_t lod) const
+{
+    const MeshCacheLod& entry = ((const MeshCacheLod*)arrayData(_header->lods))[lod];
+    return entry.indicesCount > 0 ? (const uint32_t*)(_file.data() + entry.offset) : NULL;
+}
+
+float MeshCache::lodError(size_t lod) const
+{
+    return ((const MeshCacheLod*)arrayData(_header->lods))[lod].error;
+}
+
+MeshBounds MeshCache::bounds() const
+{
+    const MeshCacheBounds& stored = _header->bounds;
+    MeshBounds bounds;
+    bounds.minimum = glm::make_vec3(stored.minimum);
+    bounds.maximum = glm::make_vec3(stored.maximum);
+    bounds.centroid = glm::make_vec3(stored.centroid);
+    bounds.centroidRadius = stored.centroidRadius;
+    bounds.sphereCenter = glm::make_vec3(stored.sphereCenter);
+    bounds.sphereRadius = stored.sphereRadius;
+    return bounds;
+}
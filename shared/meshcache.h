@@ -0,0 +1,112 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include "common.h"
+#include "mappedfile.h"
+#include "meshbounds.h"
+#include "simplifier.h"
+
+// Binary mesh file (.wmesh) with the welded and reordered mesh Model::load builds
+// from an OBJ, so later launches map it instead of parsing.
+//
+// Layout: MeshCacheHeader, then each array present in vertexFormat, the indices, the
+// MeshCacheLod table and the indices of every level of detail, each starting at a
+// 16-byte aligned offset. The header also keeps the mesh bounds, so a cached load
+// doesn't go over the vertices at all. The source's size, time and hash tell whether
+// the OBJ changed since; a file that was only touched keeps its cache.
+
+enum MeshCacheAttribute
+{
+    MESH_CACHE_POSITION  = 1 << 0,  // vec3
+    MESH_CACHE_TEX_COORD = 1 << 1,  // vec2
+    MESH_CACHE_NORMAL    = 1 << 2   // vec3
+};
+
+struct MeshCacheArray
+{
+    uint64_t offset;
+    uint64_t size;
+};
+
+// MeshBounds in plain floats
+struct MeshCacheBounds
+{
+    float minimum[3];
+    float maximum[3];
+    float centroid[3];
+    float centroidRadius;
+    float sphereCenter[3];
+    float sphereRadius;
+};
+
+struct MeshCacheHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    uint64_t sourceHash;
+    uint32_t vertexFormat;  // MESH_CACHE_* bits
+    uint32_t indexSize;     // bytes per index
+    uint32_t verticesCount;
+    uint32_t indicesCount;
+    MeshCacheArray positions;
+    MeshCacheArray texCoords;
+    MeshCacheArray normals;
+    MeshCacheArray indices;
+    uint32_t lodsCount;
+    uint32_t reserved;
+    MeshCacheArray lods;    // MeshCacheLod per level
+    MeshCacheBounds bounds;
+};
+
+struct MeshCacheLod
+{
+    uint64_t offset;
+    uint32_t indicesCount;
+    float error;
+};
+
+class MeshCache
+{
+    MappedFile _file;
+    const MeshCacheHeader* _header;
+
+    const uint8_t* arrayData(const MeshCacheArray& array) const;
+
+public:
+    // Bump whenever the mesh processing changes, older caches are then rebuilt
+    static const uint32_t VERSION = 3;
+
+    // Where the mesh built from an OBJ file is cached
+    static string cacheFileName(const string& sourceFileName);
+    // Empty attribute arrays are left out of the file; throws std::runtime_error on failure
+    static void write(const string& fileName, const string& sourceFileName, const vector<vec3>& positions,
+                      const vector<vec2>& texCoords, const vector<vec3>& normals, const vector<uint32_t>& indices,
+                      const vector<MeshLod>& lods, const MeshBounds& bounds);
+
+    MeshCache();
+
+    // Returns false if the file is missing, has another version, is damaged
+    // or was built from another version of the source
+    bool open(const string& fileName, const string& sourceFileName);
+    void close();
+
+    uint32_t vertexFormat() const;
+    size_t verticesCount() const;
+    size_t indicesCount() const;
+    // Point into the mapping, NULL for attributes the file doesn't have
+    const vec3* positions() const;
+    const vec2* texCoords() const;
+    const vec3* normals() const;
+    const uint32_t* indices() const;
+
+    size_t lodsCount() const;
+    size_t lodIndicesCount(size_t lod) const;
+    const uint32_t* lodIndices(size_t lod) const;
+    float lodError(size_t lod) const;
+
+    MeshBounds bounds() const;
+};
+
+#endif //MESH_CACHE_H
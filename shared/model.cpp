@@ -0,0 +1,142 @@
+#include "model.h"
+#include "indexedmesh.h"
+#include "meshcache.h"
+#include "objparser.h"
+#include "profilezones.h"
+
+namespace
+{
+    template<typename T>
+    const T* arrayData(const vector<T>& values)
+    {
+        return values.empty() ? NULL : &values[0];
+    }
+}
+
+Model::Model()
+{}
+
+Model::Model(string const& path)
+    : path_(path)
+{
+    load(path);
+}
+
+void Model::load(string const& path)
+{
+    SHARED_PROFILE_SCOPE("Model::load");
+
+    if (loadCached(path)) {
+        return;
+    }
+
+    ObjData obj;
+    if (!loadObj(path, obj)) {
+        std::cout << "fail to open file" << std::endl;
+        return;
+    }
+    build(path, obj);
+}
+
+void Model::clear()
+{
+    vertices_.clear();
+    textures_.clear();
+    normals_.clear();
+    indices_.clear();
+    lods_.clear();
+    bounds_ = MeshBounds();
+    cache_.reset();
+}
+
+bool Model::loadCached(string const& path)
+{
+    path_ = path;
+    clear();
+
+    std::shared_ptr<MeshCache> cache = std::make_shared<MeshCache>();
+    if (!cache->open(MeshCache::cacheFileName(path), path)) {
+        return false;
+    }
+    cache_ = cache;
+    bounds_ = cache->bounds();
+    return true;
+}
+
+void Model::build(string const& path, const ObjData& obj)
+{
+    path_ = path;
+    clear();
+
+    // Corners sharing a vertex are welded, so the GPU transforms each one once
+    // and, after the cache reorder, mostly reuses it for the neighbouring triangles
+    buildIndexedMesh(obj, vertices_, textures_, normals_, indices_);
+    optimizeVertexCache(indices_, vertices_.size());
+
+    vector<uint32_t> remap;
+    optimizeVertexFetch(indices_, vertices_.size(), remap);
+    remapVertices(vertices_, remap);
+    remapVertices(textures_, remap);
+    remapVertices(normals_, remap);
+
+    buildLodChain(vertices_, textures_, normals_, indices_, lods_);
+    bounds_ = computeMeshBounds(vertices_);
+
+    try {
+        MeshCache::write(MeshCache::cacheFileName(path), path, vertices_, textures_, normals_, indices_, lods_, bounds_);
+    }
+    catch (std::exception const& except) {
+        // Only the next launch gets slower
+        std::cerr << except.what() << std::endl;
+    }
+}
+
+size_t Model::vertices_count() const
+{
+    return cache_ ? cache_->verticesCount() : vertices_.size();
+}
+
+size_t Model::indices_count() const
+{
+    return cache_ ? cache_->indicesCount() : indices_.size();
+}
+
+const vec3* Model::positions() const
+{
+    return cache_ ? cache_->positions() : arrayData(vertices_);
+}
+
+const vec2* Model::tex_coords() const
+{
+    return cache_ ? cache_->texCoords() : arrayData(textures_);
+}
+
+const vec3* Model::normals() const
+{
+    return cache_ ? cache_->normals() : arrayData(normals_);
+}
+
+const uint32_t* Model::indices() const
+{
+    return cache_ ? cache_->indices() : arrayData(indices_);
+}
+
+size_t Model::lods_count() const
+{
+    return cache_ ? cache_->lodsCount() : lods_.size();
+}
+
+size_t Model::lod_indices_count(size_t lod) const
+{
+    return cache_ ? cache_->lodIndicesCount(lod) : lods_[lod].indices.size();
+}
+
+const uint32_t* Model::lod_indices(size_t lod) const
+{
+    return cache_ ? cache_->lodIndices(lod) : arrayData(lods_[lod].indices);
+}
+
+float Model::lod_error(size_t lod) const
+{
+    return cache_ ? cache_->lodError(lod) : lods_[lod].error;
+}
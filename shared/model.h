@@ -0,0 +1,65 @@
+#ifndef MODEL_H
+#define MODEL_H
+
+#include "common.h"
+#include "meshbounds.h"
+#include "simplifier.h"
+#include <memory>
+#include <sstream>
+
+using std::stringstream;
+
+struct ObjData;
+class MeshCache;
+
+typedef vector<vec2> vvec2;
+typedef vector<vec3> vvec3;
+typedef vector<vec4> vvec4;
+typedef vector<mat3> vmat3;
+
+struct Model
+{
+    string path_;
+
+    vvec3 vertices_;
+    vvec2 textures_;
+    vvec3 normals_;
+    vvec3 faces_;
+    // Three per triangle into the vertex arrays above
+    vector<uint32_t> indices_;
+    // Coarser versions of indices_ over the same vertices, finest first
+    vector<MeshLod> lods_;
+    // Computed on load, so frames only transform them
+    MeshBounds bounds_;
+    // Set by loadCached instead of the arrays above, which stay empty: the
+    // accessors below point into the mapped file until clear()
+    std::shared_ptr<MeshCache> cache_;
+
+//public:
+    Model();
+    Model(string const& path);
+
+    size_t vertices_count() const;
+    size_t indices_count() const;
+
+    // The mesh wherever it is, to be uploaded or read as is
+    const vec3* positions() const;
+    const vec2* tex_coords() const;
+    const vec3* normals() const;
+    const uint32_t* indices() const;
+    size_t lods_count() const;
+    size_t lod_indices_count(size_t lod) const;
+    const uint32_t* lod_indices(size_t lod) const;
+    float lod_error(size_t lod) const;
+
+    void load(string const& path);
+
+    // The two halves of load, for callers that parse the OBJ themselves.
+    // loadCached maps the mesh built on an earlier run, as long as the OBJ
+    // hasn't changed since; build welds, optimizes and simplifies obj, then caches it.
+    bool loadCached(string const& path);
+    void build(string const& path, const ObjData& obj);
+    void clear();
+};
+
+#endif // MODEL_H
@@ -0,0 +1,479 @@
+#include "objparser.h"
+#include "mappedfile.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <exception>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+namespace
+{
+    // Digits past this don't fit the 64-bit mantissa and can't change a float anyway
+    const int MAX_MANTISSA_DIGITS = 19;
+
+    const double POWERS_OF_TEN[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+        1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    // Up to 1e22 the powers are exact doubles
+    const int MAX_EXACT_POWER = 22;
+
+    inline bool isDigit(char c)
+    {
+        return unsigned(c - '0') < 10;
+    }
+
+    inline bool isBlank(char c)
+    {
+        return c == ' ' || c == '\t';
+    }
+
+    inline const char* skipBlanks(const char* p, const char* end)
+    {
+        while (p < end && isBlank(*p)) {
+            ++p;
+        }
+        return p;
+    }
+
+    inline const char* skipLine(const char* p, const char* end)
+    {
+        const char* newline = (const char*)memchr(p, '\n', size_t(end - p));
+        return newline != NULL ? newline + 1 : end;
+    }
+
+    bool parseInt(const char*& p, const char* end, int& value)
+    {
+        const char* s = p;
+        bool isNegative = false;
+        if (s < end && (*s == '-' || *s == '+')) {
+            isNegative = *s == '-';
+            ++s;
+        }
+        if (s == end || !isDigit(*s)) {
+            return false;
+        }
+
+        int result = 0;
+        while (s < end && isDigit(*s)) {
+            result = result * 10 + (*s - '0');
+            ++s;
+        }
+        value = isNegative ? -result : result;
+        p = s;
+        return true;
+    }
+
+    void throwParseError(const char* begin, const char* at, const char* what)
+    {
+        size_t line = 1 + std::count(begin, at, '\n');
+        std::ostringstream message;
+        message << "OBJ line " << line << ": " << what;
+        throw std::runtime_error(message.str());
+    }
+
+    // Fails both the required and the optional check in mergeIndices()
+    const int INVALID_INDEX = -2;
+    // A chunk doesn't know how many elements came before it, so relative
+    // indices stay biased below RELATIVE_LIMIT until the chunks are merged
+    const int RELATIVE_BIAS = -(1 << 30);
+    const int RELATIVE_LIMIT = -(1 << 29);
+
+    // Smaller chunks cost more in threads than they save
+    const size_t MIN_CHUNK_SIZE = 1 << 20;
+
+    // 1-based, or negative counting back from the last element read so far
+    inline int resolveIndex(int index, size_t count)
+    {
+        if (index > 0) {
+            return index - 1;
+        }
+        return index < 0 ? RELATIVE_BIAS + int(count) + index : INVALID_INDEX;
+    }
+
+    // Statement kinds, told apart by the first two characters of a line
+    struct ObjCounts
+    {
+        size_t positions, texCoords, normals, faces;
+    };
+
+    // A fast pass over the lines, so the arrays are allocated once
+    ObjCounts countStatements(const char* p, const char* end)
+    {
+        ObjCounts counts = { 0, 0, 0, 0 };
+        while (p < end) {
+            p = skipBlanks(p, end);
+            if (end - p >= 2) {
+                if (p[0] == 'v') {
+                    if (isBlank(p[1])) {
+                        counts.positions++;
+                    }
+                    else if (p[1] == 't') {
+                        counts.texCoords++;
+                    }
+                    else if (p[1] == 'n') {
+                        counts.normals++;
+                    }
+                }
+                else if (p[0] == 'f' && isBlank(p[1])) {
+                    counts.faces++;
+                }
+            }
+            p = skipLine(p, end);
+        }
+        return counts;
+    }
+
+    template<int N, typename V>
+    void parseVector(const char* begin, const char*& p, const char* end, vector<V>& values)
+    {
+        V value;
+        for (int i = 0; i < N; ++i) {
+            p = skipBlanks(p, end);
+            if (!parseObjFloat(p, end, value[i])) {
+                throwParseError(begin, p, "expected a number");
+            }
+        }
+        values.push_back(value);
+    }
+
+    void parseFace(const char* begin, const char*& p, const char* end, ObjData& data)
+    {
+        int corners[3][3];  // first, previous and current corner: position, texCoord, normal
+        int cornersCount = 0;
+
+        while (true) {
+            p = skipBlanks(p, end);
+            int position;
+            if (!parseInt(p, end, position)) {
+                break;
+            }
+
+            int* corner = corners[std::min(cornersCount, 2)];
+            corner[0] = resolveIndex(position, data.positions.size());
+            corner[1] = -1;
+            corner[2] = -1;
+
+            // v, v/t, v//n or v/t/n
+            if (p < end && *p == '/') {
+                ++p;
+                int texCoord;
+                if (parseInt(p, end, texCoord)) {
+                    corner[1] = resolveIndex(texCoord, data.texCoords.size());
+                }
+                if (p < end && *p == '/') {
+                    ++p;
+                    int normal;
+                    if (!parseInt(p, end, normal)) {
+                        throwParseError(begin, p, "expected a normal index");
+                    }
+                    corner[2] = resolveIndex(normal, data.normals.size());
+                }
+            }
+
+            if (++cornersCount < 3) {
+                continue;
+            }
+            for (int i = 0; i < 3; ++i) {
+                data.positionIndices.push_back(corners[i][0]);
+                data.texCoordIndices.push_back(corners[i][1]);
+                data.normalIndices.push_back(corners[i][2]);
+            }
+            // The next corner makes a fan with the first one and this one
+            memcpy(corners[1], corners[2], sizeof(corners[2]));
+        }
+
+        if (cornersCount < 3) {
+            throwParseError(begin, p, "a face needs at least three corners");
+        }
+    }
+
+    // Parses [begin, end) into chunk; fileBegin is only for line numbers in errors
+    void parseChunk(const char* fileBegin, const char* begin, const char* end, ObjData& chunk)
+    {
+        chunk.clear();
+
+        ObjCounts counts = countStatements(begin, end);
+        chunk.positions.reserve(counts.positions);
+        chunk.texCoords.reserve(counts.texCoords);
+        chunk.normals.reserve(counts.normals);
+        // Exact for triangle meshes, polygons grow the arrays
+        chunk.positionIndices.reserve(3 * counts.faces);
+        chunk.texCoordIndices.reserve(3 * counts.faces);
+        chunk.normalIndices.reserve(3 * counts.faces);
+
+        const char* p = begin;
+        while (p < end) {
+            p = skipBlanks(p, end);
+            if (end - p >= 2) {
+                if (p[0] == 'v' && isBlank(p[1])) {
+                    p += 1;
+                    parseVector<3>(fileBegin, p, end, chunk.positions);
+                }
+                else if (p[0] == 'v' && p[1] == 't') {
+                    p += 2;
+                    parseVector<2>(fileBegin, p, end, chunk.texCoords);
+                }
+                else if (p[0] == 'v' && p[1] == 'n') {
+                    p += 2;
+                    parseVector<3>(fileBegin, p, end, chunk.normals);
+                }
+                else if (p[0] == 'f' && isBlank(p[1])) {
+                    p += 1;
+                    parseFace(fileBegin, p, end, chunk);
+                }
+            }
+            // Comments, groups, materials and the rest of the line, e.g. a w or vertex colors
+            p = skipLine(p, end);
+        }
+    }
+
+    // Copies a chunk's indices to their place in the merged arrays, resolving the
+    // relative ones against base, the count of elements in earlier chunks
+    void mergeIndices(const vector<int>& indices, int base, size_t count, bool isRequired, const char* what, int* destination)
+    {
+        for (size_t i = 0; i < indices.size(); ++i) {
+            int index = indices[i];
+            if (index < RELATIVE_LIMIT) {
+                index = index - RELATIVE_BIAS + base;
+                index = index >= 0 ? index : INVALID_INDEX;
+            }
+            if (index >= int(count) || index < (isRequired ? 0 : -1)) {
+                throw std::runtime_error(string("OBJ face refers to a missing ") + what);
+            }
+            destination[i] = index;
+        }
+    }
+
+    template<typename T>
+    void appendAt(const vector<T>& source, vector<T>& destination, size_t offset)
+    {
+        std::copy(source.begin(), source.end(), destination.begin() + offset);
+    }
+
+    template<typename T>
+    size_t appendAll(const vector<T>& source, vector<T>& destination)
+    {
+        size_t offset = destination.size();
+        destination.resize(offset + source.size());
+        appendAt(source, destination, offset);
+        return offset;
+    }
+
+    // Runs task(0) .. task(count - 1) on their own threads; rethrows the first failure
+    template<typename Task>
+    void runParallel(size_t count, Task task)
+    {
+        vector<std::exception_ptr> errors(count);
+        vector<std::thread> threads;
+        for (size_t i = 0; i < count; ++i) {
+            threads.push_back(std::thread([&task, &errors, i]() {
+                try {
+                    task(i);
+                }
+                catch (...) {
+                    errors[i] = std::current_exception();
+                }
+            }));
+        }
+        for (size_t i = 0; i < threads.size(); ++i) {
+            threads[i].join();
+        }
+        for (size_t i = 0; i < errors.size(); ++i) {
+            if (errors[i]) {
+                std::rethrow_exception(errors[i]);
+            }
+        }
+    }
+}
+
+void ObjData::clear()
+{
+    positions.clear();
+    texCoords.clear();
+    normals.clear();
+    positionIndices.clear();
+    texCoordIndices.clear();
+    normalIndices.clear();
+}
+
+size_t ObjData::trianglesCount() const
+{
+    return positionIndices.size() / 3;
+}
+
+bool parseObjFloat(const char*& p, const char* end, float& value)
+{
+    const char* s = p;
+    bool isNegative = false;
+    if (s < end && (*s == '-' || *s == '+')) {
+        isNegative = *s == '-';
+        ++s;
+    }
+
+    uint64_t mantissa = 0;
+    int digitsCount = 0;
+    int exponent = 0;
+    bool hasDigits = false;
+
+    for (; s < end && isDigit(*s); ++s) {
+        hasDigits = true;
+        if (digitsCount < MAX_MANTISSA_DIGITS) {
+            mantissa = mantissa * 10 + (*s - '0');
+            digitsCount += mantissa != 0;
+        }
+        else {
+            ++exponent;
+        }
+    }
+    if (s < end && *s == '.') {
+        for (++s; s < end && isDigit(*s); ++s) {
+            hasDigits = true;
+            if (digitsCount < MAX_MANTISSA_DIGITS) {
+                mantissa = mantissa * 10 + (*s - '0');
+                digitsCount += mantissa != 0;
+                --exponent;
+            }
+        }
+    }
+    if (!hasDigits) {
+        return false;
+    }
+
+    if (s < end && (*s == 'e' || *s == 'E')) {
+        const char* e = s + 1;
+        int power;
+        if (parseInt(e, end, power)) {
+            exponent += power;
+            s = e;
+        }
+    }
+
+    // One correctly rounded operation while both operands are exact
+    double result = double(mantissa);
+    if (exponent < 0 && exponent >= -MAX_EXACT_POWER) {
+        result /= POWERS_OF_TEN[-exponent];
+    }
+    else if (exponent > 0 && exponent <= MAX_EXACT_POWER) {
+        result *= POWERS_OF_TEN[exponent];
+    }
+    else if (exponent != 0) {
+        result *= std::pow(10.0, exponent);
+    }
+
+    value = float(isNegative ? -result : result);
+    p = s;
+    return true;
+}
+
+void parseObj(const char* begin, const char* end, ObjData& data, int threadsCount)
+{
+    if (threadsCount <= 0) {
+        threadsCount = int(std::max(1u, std::thread::hardware_concurrency()));
+    }
+    size_t chunksCount = std::min(size_t(threadsCount), std::max<size_t>(1, size_t(end - begin) / MIN_CHUNK_SIZE));
+
+    if (chunksCount == 1) {
+        parseChunk(begin, begin, end, data);
+        mergeIndices(data.positionIndices, 0, data.positions.size(), true, "position", data.positionIndices.data());
+        mergeIndices(data.texCoordIndices, 0, data.texCoords.size(), false, "texture coordinate", data.texCoordIndices.data());
+        mergeIndices(data.normalIndices, 0, data.normals.size(), false, "normal", data.normalIndices.data());
+        return;
+    }
+
+    // Equal sizes, each boundary moved forward to the next line
+    vector<const char*> bounds(chunksCount + 1, end);
+    bounds[0] = begin;
+    for (size_t i = 1; i < chunksCount; ++i) {
+        const char* p = std::max(begin + size_t(end - begin) * i / chunksCount, bounds[i - 1]);
+        bounds[i] = p > begin && p[-1] == '\n' ? p : skipLine(p, end);
+    }
+
+    vector<ObjData> chunks(chunksCount);
+    runParallel(chunksCount, [&](size_t i) {
+        parseChunk(begin, bounds[i], bounds[i + 1], chunks[i]);
+    });
+
+    // Prefix sums give every chunk its place in the merged arrays
+    vector<size_t> positionBases(chunksCount + 1, 0), texCoordBases(chunksCount + 1, 0);
+    vector<size_t> normalBases(chunksCount + 1, 0), cornerBases(chunksCount + 1, 0);
+    for (size_t i = 0; i < chunksCount; ++i) {
+        positionBases[i + 1] = positionBases[i] + chunks[i].positions.size();
+        texCoordBases[i + 1] = texCoordBases[i] + chunks[i].texCoords.size();
+        normalBases[i + 1] = normalBases[i] + chunks[i].normals.size();
+        cornerBases[i + 1] = cornerBases[i] + chunks[i].positionIndices.size();
+    }
+
+    data.clear();
+    data.positions.resize(positionBases[chunksCount]);
+    data.texCoords.resize(texCoordBases[chunksCount]);
+    data.normals.resize(normalBases[chunksCount]);
+    data.positionIndices.resize(cornerBases[chunksCount]);
+    data.texCoordIndices.resize(cornerBases[chunksCount]);
+    data.normalIndices.resize(cornerBases[chunksCount]);
+
+    runParallel(chunksCount, [&](size_t i) {
+        const ObjData& chunk = chunks[i];
+        appendAt(chunk.positions, data.positions, positionBases[i]);
+        appendAt(chunk.texCoords, data.texCoords, texCoordBases[i]);
+        appendAt(chunk.normals, data.normals, normalBases[i]);
+
+        size_t corner = cornerBases[i];
+        mergeIndices(chunk.positionIndices, int(positionBases[i]), data.positions.size(), true, "position", &data.positionIndices[corner]);
+        mergeIndices(chunk.texCoordIndices, int(texCoordBases[i]), data.texCoords.size(), false, "texture coordinate", &data.texCoordIndices[corner]);
+        mergeIndices(chunk.normalIndices, int(normalBases[i]), data.normals.size(), false, "normal", &data.normalIndices[corner]);
+
+        // Free the chunk as soon as it is merged, the peak is already twice the mesh
+        chunks[i] = ObjData();
+    });
+}
+
+void appendObj(const char* fileBegin, const char* begin, const char* end, ObjData& data)
+{
+    ObjData chunk;
+    parseChunk(fileBegin, begin, end, chunk);
+
+    // Anything up to INT_MAX may still come, only relative indices are resolved and checked
+    const size_t UNKNOWN_COUNT = size_t(std::numeric_limits<int>::max());
+    int positionBase = int(appendAll(chunk.positions, data.positions));
+    int texCoordBase = int(appendAll(chunk.texCoords, data.texCoords));
+    int normalBase = int(appendAll(chunk.normals, data.normals));
+    size_t corner = appendAll(chunk.positionIndices, data.positionIndices);
+    data.texCoordIndices.resize(data.positionIndices.size());
+    data.normalIndices.resize(data.positionIndices.size());
+    mergeIndices(chunk.positionIndices, positionBase, UNKNOWN_COUNT, true, "position", data.positionIndices.data() + corner);
+    mergeIndices(chunk.texCoordIndices, texCoordBase, UNKNOWN_COUNT, false, "texture coordinate", data.texCoordIndices.data() + corner);
+    mergeIndices(chunk.normalIndices, normalBase, UNKNOWN_COUNT, false, "normal", data.normalIndices.data() + corner);
+}
+
+void checkObjIndices(ObjData& data)
+{
+    // Already resolved, so merging in place only checks the ranges
+    mergeIndices(data.positionIndices, 0, data.positions.size(), true, "position", data.positionIndices.data());
+    mergeIndices(data.texCoordIndices, 0, data.texCoords.size(), false, "texture coordinate", data.texCoordIndices.data());
+    mergeIndices(data.normalIndices, 0, data.normals.size(), false, "normal", data.normalIndices.data());
+}
+
+const char* findObjChunkEnd(const char* begin, const char* end, size_t size)
+{
+    if (size_t(end - begin) <= size) {
+        return end;
+    }
+    const char* p = begin + size;
+    return p[-1] == '\n' ? p : skipLine(p, end);
+}
+
+bool loadObj(const string& fileName, ObjData& data, int threadsCount)
+{
+    MappedFile file;
+    if (!file.open(fileName)) {
+        return false;
+    }
+
+    const char* text = (const char*)file.data();
+    parseObj(text, text + file.size(), data, threadsCount);
+    return true;
+}
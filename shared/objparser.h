@@ -0,0 +1,45 @@
+#ifndef OBJ_PARSER_H
+#define OBJ_PARSER_H
+
+#include "common.h"
+
+// Wavefront OBJ geometry: v, vt, vn and f statements, everything else is skipped.
+// Polygons are split into triangle fans and relative (negative) indices resolved,
+// so every three corners make a triangle.
+struct ObjData
+{
+    vector<vec3> positions;
+    vector<vec2> texCoords;
+    vector<vec3> normals;
+
+    // 0-based, one entry per corner; -1 where a face leaves the attribute out
+    vector<int> positionIndices;
+    vector<int> texCoordIndices;
+    vector<int> normalIndices;
+
+    void clear();
+    size_t trianglesCount() const;
+};
+
+// Parses the text in place, without copying lines or going through streams.
+// Large files are split into line-aligned chunks parsed on threadsCount threads
+// (0 for one per core) and merged afterwards. Throws std::runtime_error with the
+// line number on malformed input.
+void parseObj(const char* begin, const char* end, ObjData& data, int threadsCount = 0);
+// Maps the file and parses it; returns false if it can't be opened
+bool loadObj(const string& fileName, ObjData& data, int threadsCount = 0);
+
+// For parsing a file a piece at a time: appends [begin, end), whole lines of the file
+// starting at fileBegin, to data holding the lines before them. Faces may still refer
+// to elements further on, so indices past the ends of data's arrays are kept.
+void appendObj(const char* fileBegin, const char* begin, const char* end, ObjData& data);
+// Throws std::runtime_error if a face refers past the arrays, for data put together with appendObj
+void checkObjIndices(ObjData& data);
+// Start of the first line at least size bytes past begin, or end
+const char* findObjChunkEnd(const char* begin, const char* end, size_t size);
+
+// Decimal float as written by OBJ exporters (sign, digits, fraction, exponent);
+// advances p past it, returns false and leaves p alone if there is no number
+bool parseObjFloat(const char*& p, const char* end, float& value);
+
+#endif //OBJ_PARSER_H
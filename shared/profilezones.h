@@ -0,0 +1,14 @@
+#ifndef PROFILE_ZONES_H
+#define PROFILE_ZONES_H
+
+// Profiler zones in the shared sources. A project with a profiler defines
+// SHARED_PROFILE_ZONES and provides profiler.h; elsewhere the zones compile to nothing.
+
+#ifdef SHARED_PROFILE_ZONES
+#include "profiler.h"
+#define SHARED_PROFILE_SCOPE(name) PROFILE_SCOPE(name)
+#else
+#define SHARED_PROFILE_SCOPE(name)
+#endif
+
+#endif //PROFILE_ZONES_H
@@ -0,0 +1,522 @@
+#include "simplifier.h"
+#include "indexedmesh.h"
+#include <algorithm>
+#include <cfloat>
+
+namespace
+{
+    const uint32_t NONE = 0xFFFFFFFFu;
+    const uint64_t EMPTY_EDGE = ~uint64_t(0);
+
+    // What a position may do, from the edges around it: an edge is a border if no
+    // triangle runs it backwards, and a seam if one does but with other attributes
+    enum PositionKind
+    {
+        KIND_MANIFOLD,  // moves anywhere
+        KIND_BORDER,    // on one border, slides along it
+        KIND_SEAM,      // on one seam, slides along it
+        KIND_LOCKED     // corners, crossings and non-manifold spots never move
+    };
+
+    // Planes standing on open edges outweigh the surface, so outlines stay put
+    const float BORDER_WEIGHT = 10.0f;
+    // Squared attribute change against squared distance in a unit-sized model
+    const float NORMAL_WEIGHT = 1e-3f;
+    const float TEX_COORD_WEIGHT = 1e-3f;
+
+    const size_t MAX_LODS = 8;
+    const size_t MIN_LOD_TRIANGLES = 64;
+    // A level keeping more of the previous one isn't worth its memory
+    const float MAX_LOD_RATIO = 0.8f;
+
+    // Sum of squared distances to weighted planes, as a symmetric 4x4 matrix.
+    // Doubles: on fine meshes the error is a tiny difference of large terms.
+    struct Quadric
+    {
+        double a00, a11, a22, a01, a02, a12;
+        double b0, b1, b2;
+        double c;
+        double weight;
+    };
+
+    void addPlane(Quadric& q, const vec3& normal, float distance, float weight)
+    {
+        q.a00 += weight * normal.x * normal.x;
+        q.a11 += weight * normal.y * normal.y;
+        q.a22 += weight * normal.z * normal.z;
+        q.a01 += weight * normal.x * normal.y;
+        q.a02 += weight * normal.x * normal.z;
+        q.a12 += weight * normal.y * normal.z;
+        q.b0 += weight * normal.x * distance;
+        q.b1 += weight * normal.y * distance;
+        q.b2 += weight * normal.z * distance;
+        q.c += weight * distance * distance;
+        q.weight += weight;
+    }
+
+    void addQuadric(Quadric& q, const Quadric& other)
+    {
+        q.a00 += other.a00;
+        q.a11 += other.a11;
+        q.a22 += other.a22;
+        q.a01 += other.a01;
+        q.a02 += other.a02;
+        q.a12 += other.a12;
+        q.b0 += other.b0;
+        q.b1 += other.b1;
+        q.b2 += other.b2;
+        q.c += other.c;
+        q.weight += other.weight;
+    }
+
+    // Mean squared distance of p to the planes of both quadrics
+    float quadricError(const Quadric& q, const Quadric& other, const vec3& p)
+    {
+        Quadric sum = q;
+        addQuadric(sum, other);
+        double x = sum.a00 * p.x + sum.a01 * p.y + sum.a02 * p.z;
+        double y = sum.a01 * p.x + sum.a11 * p.y + sum.a12 * p.z;
+        double z = sum.a02 * p.x + sum.a12 * p.y + sum.a22 * p.z;
+        double error = p.x * x + p.y * y + p.z * z + 2 * (sum.b0 * p.x + sum.b1 * p.y + sum.b2 * p.z) + sum.c;
+        return sum.weight > 0 ? float(std::abs(error) / sum.weight) : 0;
+    }
+
+    // Moves every vertex at position from onto a vertex at position to
+    struct Collapse
+    {
+        uint32_t from;
+        uint32_t to;
+        float error;
+    };
+
+    // Directed edges of the triangles, open addressing at most half full
+    class EdgeSet
+    {
+        vector<uint64_t> _slots;
+        size_t _mask;
+
+        size_t slot(uint64_t key) const
+        {
+            return size_t((key * 0x9E3779B97F4A7C15ull) >> 32) & _mask;
+        }
+
+    public:
+        // Edges between ids[] of the corners (vertices or positions). An edge coming
+        // twice the same way is non-manifold, its ends are flagged in isTangled if given.
+        void collect(const vector<uint32_t>& indices, const vector<uint32_t>& ids, vector<bool>* isTangled = NULL)
+        {
+            size_t capacity = 16;
+            while (capacity < 2 * indices.size()) {
+                capacity *= 2;
+            }
+            _slots.assign(capacity, EMPTY_EDGE);
+            _mask = capacity - 1;
+
+            for (size_t i = 0; i < indices.size(); i += 3) {
+                for (size_t k = 0; k < 3; ++k) {
+                    uint32_t a = ids[indices[i + k]];
+                    uint32_t b = ids[indices[i + (k + 1) % 3]];
+                    uint64_t key = uint64_t(a) << 32 | b;
+                    size_t s = slot(key);
+                    while (_slots[s] != EMPTY_EDGE && _slots[s] != key) {
+                        s = (s + 1) & _mask;
+                    }
+                    if (_slots[s] == key && isTangled != NULL) {
+                        (*isTangled)[a] = (*isTangled)[b] = true;
+                    }
+                    _slots[s] = key;
+                }
+            }
+        }
+
+        bool contains(uint32_t a, uint32_t b) const
+        {
+            uint64_t key = uint64_t(a) << 32 | b;
+            for (size_t s = slot(key); _slots[s] != EMPTY_EDGE; s = (s + 1) & _mask) {
+                if (_slots[s] == key) {
+                    return true;
+                }
+            }
+            return false;
+        }
+    };
+
+    bool isLess(const vec3& a, const vec3& b)
+    {
+        return a.x != b.x ? a.x < b.x : a.y != b.y ? a.y < b.y : a.z < b.z;
+    }
+
+    bool isLess(const vec2& a, const vec2& b)
+    {
+        return a.x != b.x ? a.x < b.x : a.y < b.y;
+    }
+
+    // groups[v] is the smallest vertex equal to v under the strict order isLess
+    template<typename Less>
+    void groupVertices(size_t verticesCount, Less isLess, vector<uint32_t>& groups)
+    {
+        vector<uint32_t> order(verticesCount);
+        for (size_t v = 0; v < verticesCount; ++v) {
+            order[v] = uint32_t(v);
+        }
+        std::stable_sort(order.begin(), order.end(), isLess);
+
+        groups.resize(verticesCount);
+        for (size_t i = 0; i < verticesCount; ++i) {
+            bool isNewGroup = i == 0 || isLess(order[i - 1], order[i]);
+            groups[order[i]] = isNewGroup ? order[i] : groups[order[i - 1]];
+        }
+    }
+}
+
+float simplifyMesh(const vector<vec3>& positions, const vector<vec2>& texCoords, const vector<vec3>& normals,
+                   const vector<uint32_t>& indices, size_t targetIndicesCount, float targetError,
+                   vector<uint32_t>& result)
+{
+    size_t verticesCount = positions.size();
+    bool hasTexCoords = !texCoords.empty();
+    bool hasNormals = !normals.empty();
+    result.assign(indices.begin(), indices.end() - indices.size() % 3);
+    if (result.empty()) {
+        return 0;
+    }
+
+    // A unit-sized copy, so the weights don't depend on the model's scale
+    vec3 minimum = positions[result[0]];
+    vec3 maximum = minimum;
+    for (size_t i = 1; i < result.size(); ++i) {
+        minimum = glm::min(minimum, positions[result[i]]);
+        maximum = glm::max(maximum, positions[result[i]]);
+    }
+    vec3 extent = maximum - minimum;
+    float scale = std::max(extent.x, std::max(extent.y, extent.z));
+    if (scale == 0) {
+        scale = 1;
+    }
+    vector<vec3> points(verticesCount);
+    for (size_t v = 0; v < verticesCount; ++v) {
+        points[v] = (positions[v] - minimum) / scale;
+    }
+
+    // Vertices with equal values are one, duplicated OBJ entries mustn't look like seams.
+    // Positions are named by their first vertex.
+    vector<uint32_t> canonical, positionIds;
+    groupVertices(verticesCount, [&](uint32_t a, uint32_t b) {
+        if (positions[a] != positions[b]) {
+            return isLess(positions[a], positions[b]);
+        }
+        if (hasTexCoords && texCoords[a] != texCoords[b]) {
+            return isLess(texCoords[a], texCoords[b]);
+        }
+        return hasNormals && isLess(normals[a], normals[b]);
+    }, canonical);
+    groupVertices(verticesCount, [&](uint32_t a, uint32_t b) {
+        return isLess(positions[a], positions[b]);
+    }, positionIds);
+
+    for (size_t i = 0; i < result.size(); ++i) {
+        result[i] = canonical[result[i]];
+    }
+
+    vector<bool> isTangled(verticesCount, false);
+    EdgeSet vertexEdges, positionEdges;
+    vertexEdges.collect(result, canonical);
+    positionEdges.collect(result, positionIds, &isTangled);
+
+    vector<uint8_t> borderEdges(verticesCount, 0), seamEdges(verticesCount, 0);
+    for (size_t i = 0; i < result.size(); i += 3) {
+        for (size_t k = 0; k < 3; ++k) {
+            uint32_t a = result[i + k];
+            uint32_t b = result[i + (k + 1) % 3];
+            uint32_t pa = positionIds[a], pb = positionIds[b];
+            if (pa == pb) {
+                isTangled[pa] = true;
+            }
+            else if (!positionEdges.contains(pb, pa)) {
+                borderEdges[pa] = uint8_t(std::min(borderEdges[pa] + 1, 255));
+                borderEdges[pb] = uint8_t(std::min(borderEdges[pb] + 1, 255));
+            }
+            else if (!vertexEdges.contains(b, a)) {
+                seamEdges[pa] = uint8_t(std::min(seamEdges[pa] + 1, 255));
+                seamEdges[pb] = uint8_t(std::min(seamEdges[pb] + 1, 255));
+            }
+        }
+    }
+
+    // Passing through, a border has an edge in and one out, a seam both on either side
+    vector<uint8_t> kinds(verticesCount, KIND_LOCKED);
+    for (size_t v = 0; v < verticesCount; ++v) {
+        if (isTangled[v]) {
+            continue;
+        }
+        if (borderEdges[v] == 0 && seamEdges[v] == 0) {
+            kinds[v] = KIND_MANIFOLD;
+        }
+        else if (borderEdges[v] == 2 && seamEdges[v] == 0) {
+            kinds[v] = KIND_BORDER;
+        }
+        else if (borderEdges[v] == 0 && seamEdges[v] == 4) {
+            kinds[v] = KIND_SEAM;
+        }
+    }
+
+    // Quadrics belong to positions
+    Quadric zero = {};
+    vector<Quadric> quadrics(verticesCount, zero);
+    for (size_t i = 0; i < result.size(); i += 3) {
+        const uint32_t* triangle = &result[i];
+        const vec3& p0 = points[triangle[0]];
+        vec3 normal = glm::cross(points[triangle[1]] - p0, points[triangle[2]] - p0);
+        float area = glm::length(normal);
+        if (area == 0) {
+            continue;
+        }
+        normal /= area;
+        for (size_t k = 0; k < 3; ++k) {
+            addPlane(quadrics[positionIds[triangle[k]]], normal, -glm::dot(normal, p0), area);
+        }
+
+        for (size_t k = 0; k < 3; ++k) {
+            uint32_t a = triangle[k];
+            uint32_t b = triangle[(k + 1) % 3];
+            if (vertexEdges.contains(b, a)) {
+                continue;
+            }
+            vec3 edge = points[b] - points[a];
+            float length = glm::length(edge);
+            if (length > 0) {
+                vec3 edgeNormal = glm::normalize(glm::cross(edge, normal));
+                float distance = -glm::dot(edgeNormal, points[a]);
+                addPlane(quadrics[positionIds[a]], edgeNormal, distance, length * BORDER_WEIGHT);
+                addPlane(quadrics[positionIds[b]], edgeNormal, distance, length * BORDER_WEIGHT);
+            }
+        }
+    }
+
+    auto attributeError = [&](uint32_t from, uint32_t to) {
+        float error = 0;
+        if (hasTexCoords) {
+            vec2 delta = texCoords[from] - texCoords[to];
+            error += TEX_COORD_WEIGHT * glm::dot(delta, delta);
+        }
+        if (hasNormals) {
+            vec3 delta = normals[from] - normals[to];
+            error += NORMAL_WEIGHT * glm::dot(delta, delta);
+        }
+        return error;
+    };
+
+    // Triangles around every position
+    vector<uint32_t> offsets, adjacency;
+    auto collectAdjacency = [&]() {
+        offsets.assign(verticesCount + 1, 0);
+        for (size_t i = 0; i < result.size(); ++i) {
+            offsets[positionIds[result[i]] + 1]++;
+        }
+        for (size_t v = 0; v < verticesCount; ++v) {
+            offsets[v + 1] += offsets[v];
+        }
+        adjacency.resize(result.size());
+        vector<uint32_t> filled(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < result.size(); ++i) {
+            adjacency[filled[positionIds[result[i]]]++] = uint32_t(i / 3);
+        }
+    };
+
+    // Every vertex at position from goes to the vertex at position to it shares a
+    // triangle with; a vertex without one, or with two, would tear its attributes
+    vector<uint32_t> wedgesFrom, wedgesTo;
+    auto mapWedges = [&](uint32_t from, uint32_t to) {
+        wedgesFrom.clear();
+        wedgesTo.clear();
+        for (uint32_t j = offsets[from]; j < offsets[from + 1]; ++j) {
+            const uint32_t* triangle = &result[3 * adjacency[j]];
+            uint32_t wedgeFrom = NONE, wedgeTo = NONE;
+            for (size_t k = 0; k < 3; ++k) {
+                uint32_t position = positionIds[triangle[k]];
+                if (position == from) {
+                    wedgeFrom = triangle[k];
+                }
+                else if (position == to) {
+                    wedgeTo = triangle[k];
+                }
+            }
+            size_t w = std::find(wedgesFrom.begin(), wedgesFrom.end(), wedgeFrom) - wedgesFrom.begin();
+            if (w == wedgesFrom.size()) {
+                wedgesFrom.push_back(wedgeFrom);
+                wedgesTo.push_back(wedgeTo);
+            }
+            else if (wedgeTo != NONE) {
+                if (wedgesTo[w] != NONE && wedgesTo[w] != wedgeTo) {
+                    return false;
+                }
+                wedgesTo[w] = wedgeTo;
+            }
+        }
+        return std::find(wedgesTo.begin(), wedgesTo.end(), NONE) == wedgesTo.end();
+    };
+
+    auto collapseError = [&](uint32_t from, uint32_t to, bool isBorder, bool isSeam) {
+        uint8_t kind = kinds[from];
+        if (kind == KIND_LOCKED || (kind == KIND_BORDER && !isBorder) || (kind == KIND_SEAM && !isSeam)
+            || !mapWedges(from, to)) {
+            return FLT_MAX;
+        }
+        float error = quadricError(quadrics[from], quadrics[to], points[to]);
+        for (size_t w = 0; w < wedgesFrom.size(); ++w) {
+            error += attributeError(wedgesFrom[w], wedgesTo[w]);
+        }
+        return error;
+    };
+
+    float maxError = targetError / scale;
+    maxError *= maxError;
+    float resultError = 0;
+
+    vector<Collapse> collapses;
+    vector<uint32_t> remap(verticesCount);
+    vector<bool> isLocked(verticesCount);
+
+    while (result.size() > targetIndicesCount) {
+        if (!collapses.empty()) {
+            vertexEdges.collect(result, canonical);
+            positionEdges.collect(result, positionIds);
+        }
+        collectAdjacency();
+
+        collapses.clear();
+        for (size_t i = 0; i < result.size(); i += 3) {
+            for (size_t k = 0; k < 3; ++k) {
+                uint32_t a = result[i + k];
+                uint32_t b = result[i + (k + 1) % 3];
+                uint32_t pa = positionIds[a], pb = positionIds[b];
+                bool isBorder = !positionEdges.contains(pb, pa);
+                // Inner edges are seen from both sides, take them once
+                if (!isBorder && pa > pb) {
+                    continue;
+                }
+                bool isSeam = !isBorder && !vertexEdges.contains(b, a);
+                Collapse collapse = { pa, pb, collapseError(pa, pb, isBorder, isSeam) };
+                float reverseError = collapseError(pb, pa, isBorder, isSeam);
+                if (reverseError < collapse.error) {
+                    collapse.from = pb;
+                    collapse.to = pa;
+                    collapse.error = reverseError;
+                }
+                if (collapse.error != FLT_MAX) {
+                    collapses.push_back(collapse);
+                }
+            }
+        }
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) {
+            return a.error < b.error;
+        });
+
+        // A pass goes for the triangles still to remove, a collapse usually takes two.
+        // Quadrics only change between passes, so collapses costing well above the
+        // pass's share wait for the next one; skipped collapses widen the share.
+        size_t trianglesGoal = (result.size() - targetIndicesCount + 2) / 3;
+        size_t collapsesGoal = std::max<size_t>(1, trianglesGoal / 2);
+        size_t skippedCollapses = 0;
+
+        for (size_t v = 0; v < verticesCount; ++v) {
+            remap[v] = uint32_t(v);
+        }
+        isLocked.assign(verticesCount, false);
+        size_t removedTriangles = 0;
+
+        for (size_t c = 0; c < collapses.size() && removedTriangles < trianglesGoal; ++c) {
+            const Collapse& collapse = collapses[c];
+            size_t shareEnd = collapsesGoal + skippedCollapses;
+            if (collapse.error > maxError
+                || (shareEnd < collapses.size() && collapse.error > collapses[shareEnd].error * 1.5f)) {
+                break;
+            }
+            // Neighbours of a collapse this pass have stale quadrics and triangles
+            if (isLocked[collapse.from] || isLocked[collapse.to]) {
+                skippedCollapses++;
+                continue;
+            }
+
+            // Triangles that stay must not turn over
+            bool isFlipping = false;
+            size_t collapsingTriangles = 0;
+            for (uint32_t j = offsets[collapse.from]; j < offsets[collapse.from + 1] && !isFlipping; ++j) {
+                const uint32_t* triangle = &result[3 * adjacency[j]];
+                vec3 corners[3];
+                bool isCollapsing = false;
+                for (size_t k = 0; k < 3; ++k) {
+                    uint32_t position = positionIds[triangle[k]];
+                    isCollapsing = isCollapsing || position == collapse.to;
+                    corners[k] = points[position == collapse.from ? collapse.to : triangle[k]];
+                }
+                if (isCollapsing) {
+                    collapsingTriangles++;
+                }
+                else {
+                    const vec3& p0 = points[triangle[0]];
+                    vec3 before = glm::cross(points[triangle[1]] - p0, points[triangle[2]] - p0);
+                    vec3 after = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+                    isFlipping = glm::dot(before, after) <= 0;
+                }
+            }
+            if (isFlipping) {
+                skippedCollapses++;
+                continue;
+            }
+
+            mapWedges(collapse.from, collapse.to);
+            for (size_t w = 0; w < wedgesFrom.size(); ++w) {
+                remap[wedgesFrom[w]] = wedgesTo[w];
+            }
+            addQuadric(quadrics[collapse.to], quadrics[collapse.from]);
+            isLocked[collapse.from] = isLocked[collapse.to] = true;
+            removedTriangles += collapsingTriangles;
+            resultError = std::max(resultError, collapse.error);
+        }
+
+        if (removedTriangles == 0) {
+            break;
+        }
+
+        // Triangles collapsed to an edge or a point leave
+        size_t written = 0;
+        for (size_t i = 0; i < result.size(); i += 3) {
+            uint32_t a = remap[result[i]], b = remap[result[i + 1]], c = remap[result[i + 2]];
+            if (positionIds[a] != positionIds[b] && positionIds[b] != positionIds[c] && positionIds[a] != positionIds[c]) {
+                result[written++] = a;
+                result[written++] = b;
+                result[written++] = c;
+            }
+        }
+        result.resize(written);
+    }
+
+    return std::sqrt(resultError) * scale;
+}
+
+void buildLodChain(const vector<vec3>& positions, const vector<vec2>& texCoords, const vector<vec3>& normals,
+                   const vector<uint32_t>& indices, vector<MeshLod>& lods)
+{
+    lods.clear();
+    float error = 0;
+    while (lods.size() < MAX_LODS) {
+        const vector<uint32_t>& source = lods.empty() ? indices : lods.back().indices;
+        size_t trianglesCount = source.size() / 3;
+        if (trianglesCount < 2 * MIN_LOD_TRIANGLES) {
+            break;
+        }
+
+        MeshLod lod;
+        float levelError = simplifyMesh(positions, texCoords, normals, source, trianglesCount / 2 * 3, FLT_MAX, lod.indices);
+        if (lod.indices.size() > source.size() * MAX_LOD_RATIO) {
+            break;
+        }
+        optimizeVertexCache(lod.indices, positions.size());
+
+        // Every level strays from the previous one, not from the full mesh
+        error += levelError;
+        lod.error = error;
+        lods.push_back(lod);
+    }
+}
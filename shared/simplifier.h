@@ -0,0 +1,30 @@
+#ifndef SIMPLIFIER_H
+#define SIMPLIFIER_H
+
+#include "common.h"
+
+// One level of detail: triangles over the full mesh's vertices, so every level
+// shares the vertex buffer and only needs its own indices
+struct MeshLod
+{
+    vector<uint32_t> indices;
+    // How far the level may stray from the full mesh, in model units
+    float error;
+};
+
+// Quadric error edge collapse (Garland and Heckbert) onto existing vertices.
+// Collapses until at most targetIndicesCount indices are left or the next one
+// would cost more than targetError; returns the error reached, in model units.
+// Attribute changes add to the cost, and vertices where texture coordinates or
+// normals split (seams) and open borders only slide along the seam or border.
+// texCoords and normals may be empty.
+float simplifyMesh(const vector<vec3>& positions, const vector<vec2>& texCoords, const vector<vec3>& normals,
+                   const vector<uint32_t>& indices, size_t targetIndicesCount, float targetError,
+                   vector<uint32_t>& result);
+
+// Levels of about half the triangles of the previous one, each simplified from the
+// previous and ordered for the vertex cache, until simplifying stops paying off
+void buildLodChain(const vector<vec3>& positions, const vector<vec2>& texCoords, const vector<vec3>& normals,
+                   const vector<uint32_t>& indices, vector<MeshLod>& lods);
+
+#endif //SIMPLIFIER_H